@@ -104,13 +104,20 @@ struct cmyth_chain;
 struct cmyth_chanlist;
 struct cmyth_channel;
 struct cmyth_conn;
+struct cmyth_conn_pool;
 struct cmyth_commbreak;
 struct cmyth_commbreaklist;
+struct cmyth_event_sub;
+struct cmyth_eventinfo;
 struct cmyth_file;
 struct cmyth_freespace;
+struct cmyth_posmap;
 struct cmyth_proginfo;
 struct cmyth_proglist;
+struct cmyth_reclist;
 struct cmyth_recorder;
+struct cmyth_request;
+struct cmyth_shmlive;
 struct cmyth_timestamp;
 
 /*
@@ -151,6 +158,18 @@ typedef struct cmyth_commbreak *cmyth_commbreak_t;
  */
 typedef struct cmyth_commbreaklist *cmyth_commbreaklist_t;
 
+/**
+ * \typedef cmyth_event_sub_t
+ * A subscription to the events of a backend.
+ */
+typedef struct cmyth_event_sub *cmyth_event_sub_t;
+
+/**
+ * \typedef cmyth_eventinfo_t
+ * An event from a backend, with the data which came with it.
+ */
+typedef struct cmyth_eventinfo *cmyth_eventinfo_t;
+
 /**
  * \typedef cmyth_file_t
  * A connection to a file on a MythTV backend.
@@ -164,6 +183,13 @@ typedef struct cmyth_file *cmyth_file_t;
  */
 typedef struct cmyth_freespace *cmyth_freespace_t;
 
+/**
+ * \typedef cmyth_posmap_t
+ * The seek table of a recording, mapping key frames to byte offsets and
+ * times.
+ */
+typedef struct cmyth_posmap *cmyth_posmap_t;
+
 /**
  * \typedef cmyth_proginfo_t
  * The program information structure which describes the recording.
@@ -176,18 +202,56 @@ typedef struct cmyth_proginfo *cmyth_proginfo_t;
  */
 typedef struct cmyth_proglist *cmyth_proglist_t;
 
+/**
+ * \typedef cmyth_reclist_t
+ * The list of recordings on a backend, kept up to date from the events
+ * the backend sends.
+ */
+typedef struct cmyth_reclist *cmyth_reclist_t;
+
 /**
  * \typedef cmyth_recorder_t
  * A connection to a recorder on a MythTV backend.
  */
 typedef struct cmyth_recorder *cmyth_recorder_t;
 
+/**
+ * \typedef cmyth_shmlive_t
+ * A live TV stream shared with other processes through a shared memory
+ * ring.
+ */
+typedef struct cmyth_shmlive *cmyth_shmlive_t;
+
 /**
  * \typedef cmyth_timestamp_t
  * A data structure describing a timestamp with second granularity.
  */
 typedef struct cmyth_timestamp *cmyth_timestamp_t;
 
+/**
+ * \typedef cmyth_conn_pool_t
+ * A set of control connections to one backend, leased out to one thread
+ * at a time.
+ */
+typedef struct cmyth_conn_pool *cmyth_conn_pool_t;
+
+/**
+ * \typedef cmyth_request_t
+ * A control command which has been queued on a connection and completes
+ * asynchronously.
+ */
+typedef struct cmyth_request *cmyth_request_t;
+
+/**
+ * Callback made when a request completes.  It is called from the worker
+ * thread of the connection, which holds the connection while it runs, so
+ * it must not make synchronous calls on the same connection.  It may
+ * submit further requests.
+ * \param req request handle
+ * \param data data passed when the request was submitted
+ */
+typedef void (*cmyth_request_callback_t)(cmyth_request_t req, void *data);
+
 /*
  * -----------------------------------------------------------------
  * Enums
@@ -243,6 +307,7 @@ typedef enum {
 	CMYTH_EVENT_CLEAR_SETTINGS_CACHE,
 	CMYTH_EVENT_ERROR,
 	CMYTH_EVENT_COMMFLAG_START,
+	CMYTH_EVENT_COMMFLAG_UPDATE,
 } cmyth_event_t;
 
 /**
@@ -451,6 +516,19 @@ extern cmyth_recorder_t cmyth_conn_get_free_recorder(cmyth_conn_t conn);
 extern int cmyth_conn_get_freespace(cmyth_conn_t control,
 				    long long *total, long long *used);
 
+/**
+ * Queue a request for the amount of free disk space on a backend.  Use
+ * cmyth_request_get_freespace() for the result.
+ * \param control control handle
+ * \param callback function to call on completion, or NULL
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL request handle, to be released with ref_release()
+ */
+extern cmyth_request_t cmyth_conn_get_freespace_async(cmyth_conn_t control,
+					cmyth_request_callback_t callback,
+					void *data);
+
 /**
  * Determine if a control connection is not responding.
  * \param control control handle
@@ -484,6 +562,23 @@ extern int cmyth_conn_get_protocol_version(cmyth_conn_t conn);
 extern char * cmyth_conn_get_setting(cmyth_conn_t conn,
                const char* hostname, const char* setting);
 
+/**
+ * Queue a request for a MythTV setting for a hostname.  The result is a
+ * ref counted string (see cmyth_request_get_result()).
+ * \param conn connection handle
+ * \param hostname hostname to retreive the setting from
+ * \param setting the setting name to get
+ * \param callback function to call on completion, or NULL
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL request handle, to be released with ref_release()
+ */
+extern cmyth_request_t cmyth_conn_get_setting_async(cmyth_conn_t conn,
+					const char* hostname,
+					const char* setting,
+					cmyth_request_callback_t callback,
+					void *data);
+
 /**
  * Inform the MythTV backend that a shutdown is allowed even though this
  * connction is active.
@@ -502,6 +597,149 @@ extern int cmyth_conn_allow_shutdown(cmyth_conn_t conn);
  */
 extern int cmyth_conn_block_shutdown(cmyth_conn_t conn);
 
+/**
+ * Set the timeouts used when waiting on a connection.  After timeout
+ * milliseconds without progress the connection is flagged as hung (see
+ * cmyth_conn_hung()), and after deadline milliseconds a blocking call
+ * gives up with -ETIMEDOUT.
+ * \param conn connection handle
+ * \param timeout hang timeout in milliseconds, 10000 by default
+ * \param deadline deadline in milliseconds, or 0 (the default) to wait
+ *                 forever
+ * \retval 0 success
+ * \retval <0 error
+ */
+extern int cmyth_conn_set_timeout(cmyth_conn_t conn, int timeout,
+				  int deadline);
+
+/**
+ * Set how many queued requests may be sent on a connection before the
+ * response to the first of them has been received.  The default of 1
+ * sends each request once the previous one has completed.
+ * \param conn connection handle
+ * \param depth maximum number of requests in flight
+ * \retval 0 success
+ * \retval <0 error
+ */
+extern int cmyth_conn_set_pipeline(cmyth_conn_t conn, int depth);
+
+/**
+ * Retrieve statistics on the control and event connections established
+ * so far.  Any of the pointers may be NULL.
+ * \param[out] connects connections established
+ * \param[out] cache_hits connections whose cached protocol version was
+ *                        accepted straight away
+ * \param[out] retries connections which had to reconnect to agree on a
+ *                     protocol version
+ * \param[out] msecs total time spent establishing connections, in
+ *                   milliseconds
+ */
+extern void cmyth_conn_get_connect_stats(unsigned long *connects,
+					 unsigned long *cache_hits,
+					 unsigned long *retries,
+					 unsigned long long *msecs);
+
+/**
+ * Keep the protocol versions agreed with backends in a memory mapped
+ * file, so that later connections from any process using the same file
+ * offer the right version first instead of reconnecting.  Without a file
+ * the versions are only remembered by this process.
+ * \param path file to use, created if needed, or NULL to stop using a file
+ * \retval 0 success
+ * \retval <0 error
+ */
+extern int cmyth_version_cache_open(const char *path);
+
+/*
+ * -----------------------------------------------------------------
+ * Connection Pool Operations
+ * -----------------------------------------------------------------
+ */
+
+/**
+ * Create a pool of control connections to a backend.  Connections are
+ * opened as they are needed.
+ * \param server server hostname or ip address
+ * \param port port number to connect on
+ * \param buflen buffer size for the connections to use
+ * \param tcp_rcvbuf if non-zero, the TCP receive buffer size for the sockets
+ * \param max maximum number of connections to open
+ * \retval NULL error
+ * \retval non-NULL pool handle, to be released with ref_release()
+ */
+extern cmyth_conn_pool_t cmyth_conn_pool_create(char *server,
+						unsigned short port,
+						unsigned buflen,
+						int tcp_rcvbuf, int max);
+
+/**
+ * Lease a control connection from a pool, waiting if they are all in use.
+ * \param pool pool handle
+ * \retval NULL error
+ * \retval non-NULL control handle, to be given back with
+ *                  cmyth_conn_pool_put()
+ */
+extern cmyth_conn_t cmyth_conn_pool_get(cmyth_conn_pool_t pool);
+
+/**
+ * Give a leased control connection back to its pool.
+ * \param pool pool handle
+ * \param conn control handle from cmyth_conn_pool_get()
+ */
+extern void cmyth_conn_pool_put(cmyth_conn_pool_t pool, cmyth_conn_t conn);
+
+/*
+ * -----------------------------------------------------------------
+ * Request Operations
+ * -----------------------------------------------------------------
+ */
+
+/**
+ * Wait for a request to complete.  This must not be called from a
+ * completion callback.
+ * \param req request handle
+ * \retval <0 error
+ * \retval >=0 request status
+ */
+extern int cmyth_request_wait(cmyth_request_t req);
+
+/**
+ * Check whether a request has completed, without waiting.
+ * \param req request handle
+ * \retval <0 error
+ * \retval 0 still in progress
+ * \retval 1 completed
+ */
+extern int cmyth_request_done(cmyth_request_t req);
+
+/**
+ * Get the status of a completed request.
+ * \param req request handle
+ * \retval -EINPROGRESS not completed yet
+ * \retval <0 error
+ * \retval >=0 request status
+ */
+extern int cmyth_request_get_status(cmyth_request_t req);
+
+/**
+ * Get the result of a completed request, such as a program list.
+ * \param req request handle
+ * \retval NULL no result, or the request failed or is in progress
+ * \retval non-NULL ref counted result, to be released with ref_release()
+ */
+extern void *cmyth_request_get_result(cmyth_request_t req);
+
+/**
+ * Get the result of a completed cmyth_conn_get_freespace_async() request.
+ * \param req request handle
+ * \param[out] total total disk space
+ * \param[out] used used disk space
+ * \retval 0 success
+ * \retval <0 error
+ */
+extern int cmyth_request_get_freespace(cmyth_request_t req,
+				       long long *total, long long *used);
+
 /*
  * -----------------------------------------------------------------
  * Event Operations
@@ -509,7 +747,9 @@ extern int cmyth_conn_block_shutdown(cmyth_conn_t conn);
  */
 
 /**
- * Retrieve an event from a backend.
+ * Retrieve an event from a backend.  The data of DONE_RECORDING,
+ * QUIT_LIVETV, SIGNAL and ASK_RECORDING events is not returned; use
+ * cmyth_event_next() for it.
  * \param conn connection handle
  * \param[out] data data, if the event returns any
  * \param len size of data buffer
@@ -517,6 +757,86 @@ extern int cmyth_conn_block_shutdown(cmyth_conn_t conn);
  */
 extern cmyth_event_t cmyth_event_get(cmyth_conn_t conn, char * data, int len);
 
+/**
+ * Retrieve an event from a backend, along with the program info carried
+ * by a RECORDING_LIST_CHANGE UPDATE event.
+ * \param conn connection handle
+ * \param[out] data data, if the event returns any
+ * \param len size of data buffer
+ * \param[out] prog held program info of the event, or NULL if it has none
+ * \return event type
+ */
+extern cmyth_event_t cmyth_event_get_proginfo(cmyth_conn_t conn, char *data,
+					      int len, cmyth_proginfo_t *prog);
+
+/**
+ * Retrieve an event from a backend, with everything the backend sent
+ * along with it.
+ * \param conn connection handle
+ * \return event handle, to be released with ref_release()
+ * \retval NULL out of memory
+ */
+extern cmyth_eventinfo_t cmyth_event_next(cmyth_conn_t conn);
+
+/**
+ * Retrieve the events which have already arrived from a backend, without
+ * waiting for more.
+ * \param conn connection handle
+ * \param[out] events event handles, each to be released with ref_release()
+ * \param max size of the events array
+ * \retval <0 error
+ * \retval >=0 number of events retrieved
+ */
+extern int cmyth_event_drain(cmyth_conn_t conn, cmyth_eventinfo_t *events,
+			     int max);
+
+/**
+ * Retrieve the type of an event.
+ * \param ev event handle
+ * \return event type
+ */
+extern cmyth_event_t cmyth_eventinfo_type(cmyth_eventinfo_t ev);
+
+/**
+ * Retrieve the data of an event, which is the rest of the backend message
+ * after the name of the event.
+ * \param ev event handle
+ * \return held string, or NULL if the event has no data
+ */
+extern char *cmyth_eventinfo_data(cmyth_eventinfo_t ev);
+
+/**
+ * Retrieve the program info sent with a RECORDING_LIST_CHANGE UPDATE or
+ * ASK_RECORDING event.
+ * \param ev event handle
+ * \return held proginfo handle, or NULL if the event has none
+ */
+extern cmyth_proginfo_t cmyth_eventinfo_proginfo(cmyth_eventinfo_t ev);
+
+/**
+ * Retrieve the number of named values sent with an event, such as the
+ * signal monitor values of a SIGNAL event.
+ * \param ev event handle
+ * \return number of values
+ */
+extern int cmyth_eventinfo_value_count(cmyth_eventinfo_t ev);
+
+/**
+ * Retrieve the name of a value sent with an event.
+ * \param ev event handle
+ * \param index value index
+ * \return held string, or NULL
+ */
+extern char *cmyth_eventinfo_value_name(cmyth_eventinfo_t ev, int index);
+
+/**
+ * Retrieve a value sent with an event.
+ * \param ev event handle
+ * \param index value index
+ * \return held string, or NULL
+ */
+extern char *cmyth_eventinfo_value(cmyth_eventinfo_t ev, int index);
+
 /**
  * Selects on the event socket, waiting for an event to show up.
  * Allows nonblocking access to events.
@@ -528,6 +848,75 @@ extern cmyth_event_t cmyth_event_get(cmyth_conn_t conn, char * data, int len);
  */
 extern int cmyth_event_select(cmyth_conn_t conn, struct timeval *timeout);
 
+/**
+ * The bit of an event type in a subscription mask.
+ */
+#define CMYTH_EVENT_MASK(type)	(1UL << (type))
+
+/**
+ * A subscription mask with every event type.
+ */
+#define CMYTH_EVENT_MASK_ALL	(~0UL)
+
+/**
+ * Called on the dispatcher thread with each event of a subscription.
+ * \param sub subscription handle
+ * \param ev event handle, only valid during the call unless held
+ * \param data data given to cmyth_event_subscribe()
+ */
+typedef void (*cmyth_event_callback_t)(cmyth_event_sub_t sub,
+				       cmyth_eventinfo_t ev, void *data);
+
+/**
+ * Subscribe to the events of a backend.  All the subscribers of a backend
+ * share one event connection and one dispatcher thread.  CLOSE and ERROR
+ * events are always delivered, since they mean events may have been
+ * missed.
+ * \param server backend host name
+ * \param port backend port
+ * \param mask event types wanted, a combination of CMYTH_EVENT_MASK()
+ * \param callback called with each event, or NULL to queue the events
+ *                 for cmyth_event_sub_next()
+ * \param data passed to the callback
+ * \return subscription handle, to be passed to cmyth_event_unsubscribe()
+ *         and then released with ref_release()
+ * \retval NULL error
+ */
+extern cmyth_event_sub_t cmyth_event_subscribe(char *server,
+					       unsigned short port,
+					       unsigned long mask,
+					       cmyth_event_callback_t callback,
+					       void *data);
+
+/**
+ * Stop delivering events to a subscriber, waiting for a callback running
+ * on another thread to return.
+ * \param sub subscription handle
+ */
+extern void cmyth_event_unsubscribe(cmyth_event_sub_t sub);
+
+/**
+ * Take the next queued event of a subscriber which has no callback.
+ * Only one thread may read from a subscriber.
+ * \param sub subscription handle
+ * \param timeout milliseconds to wait, or -1 to wait forever
+ * \return event handle, to be released with ref_release(), which is a
+ *         CMYTH_EVENT_ERROR event if the queue overflowed
+ * \retval NULL timeout, or the subscriber was unsubscribed
+ */
+extern cmyth_eventinfo_t cmyth_event_sub_next(cmyth_event_sub_t sub,
+					      int timeout);
+
+/**
+ * Tell whether the event connection of a subscriber is up.  Each
+ * connection to the backend gets a new number, so a change of number
+ * means events may have been missed in between.
+ * \param sub subscription handle
+ * \return number of the current connection
+ * \retval 0 the connection is down, or sub was unsubscribed
+ */
+extern unsigned long cmyth_event_sub_connected(cmyth_event_sub_t sub);
+
 /*
  * -----------------------------------------------------------------
  * Recorder Operations
@@ -655,6 +1044,19 @@ extern int cmyth_recorder_get_recorder_id(cmyth_recorder_t rec);
  */
 extern cmyth_chanlist_t cmyth_recorder_get_chanlist(cmyth_recorder_t rec);
 
+/**
+ * Retrieve the seek table of the recording in progress on a recorder in
+ * one reply.  Key frame times are included on backends which support it.
+ * \param rec recorder handle
+ * \param start first key frame number
+ * \param end last key frame number, or -1 for the latest
+ * \return position map handle
+ * \retval NULL error
+ */
+extern cmyth_posmap_t cmyth_recorder_get_posmap(cmyth_recorder_t rec,
+						long long start,
+						long long end);
+
 /*
  * -----------------------------------------------------------------
  * Channel List Operations
@@ -677,6 +1079,19 @@ extern int cmyth_chanlist_get_count(cmyth_chanlist_t list);
  */
 extern cmyth_channel_t cmyth_chanlist_get_item(cmyth_chanlist_t list,
 					       unsigned int index);
+
+/**
+ * Set how long the channel list of a video source is cached, so that new
+ * recorders do not walk the program guide of the backend again.
+ * \param seconds cache lifetime, or 0 to turn the cache off
+ */
+extern void cmyth_chanlist_cache_ttl(int seconds);
+
+/**
+ * Empty the channel list cache.
+ */
+extern void cmyth_chanlist_cache_flush(void);
+
 /*
  * -----------------------------------------------------------------
  * Channel Operations
@@ -759,6 +1174,21 @@ extern int cmyth_livetv_select(cmyth_recorder_t rec, struct timeval *timeout);
  */
 extern int cmyth_livetv_request_block(cmyth_recorder_t rec, unsigned long len);
 
+/**
+ * Report the state of the block size controller of the connection that
+ * live TV data is currently read from.  See cmyth_file_get_tune_stats().
+ * \param rec recorder handle
+ * \param[out] block current block size in bytes
+ * \param[out] rcvbuf socket receive buffer size in bytes
+ * \param[out] rate throughput of the latest requests in bytes per second
+ * \param[out] latency smoothed time from request to reply in milliseconds
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_livetv_get_tune_stats(cmyth_recorder_t rec,
+				       unsigned long *block, int *rcvbuf,
+				       unsigned long long *rate, int *latency);
+
 /**
  * Seek to a specified offset in the live TV stream.
  * \param rec recorder handle
@@ -831,6 +1261,92 @@ extern int cmyth_chain_remove_prog(cmyth_chain_t chain, cmyth_proginfo_t prog);
 extern int cmyth_chain_set_callback(cmyth_chain_t chain,
 				    void (*callback)(cmyth_proginfo_t prog));
 
+/*
+ * -----------------------------------------------------------------
+ * Shared Live TV Operations
+ * -----------------------------------------------------------------
+ */
+
+/**
+ * Publish the live TV stream of a recorder into a POSIX shared memory
+ * ring, so that other processes on the same host can watch the channel
+ * without a recorder or backend connection of their own.  A thread reads
+ * the stream through the live TV chain and writes it into the ring.
+ * Publishing stops, and the ring is unlinked, when the handle is
+ * released.  Readers which already attached keep their mapping.
+ * \param rec recorder handle, with live TV started
+ * \param name shared memory object name, such as "/cmyth-live-1"
+ * \param size ring size in bytes, rounded up to a whole page
+ * \retval NULL error, or the name is published by a live process
+ * \retval non-NULL publisher handle
+ */
+extern cmyth_shmlive_t cmyth_shmlive_publish(cmyth_recorder_t rec,
+					     const char *name,
+					     unsigned long size);
+
+/**
+ * Attach read-only to a stream published by cmyth_shmlive_publish().
+ * Each reader keeps its own position and starts at the live edge.  A
+ * reader never holds up the publisher; one which falls more than a ring
+ * behind is moved to the live edge.
+ * \param name shared memory object name
+ * \retval NULL error
+ * \retval non-NULL reader handle
+ */
+extern cmyth_shmlive_t cmyth_shmlive_attach(const char *name);
+
+/**
+ * Wait for data on a shared live TV stream.
+ * \param sl reader handle
+ * \param timeout milliseconds to wait, 0 to poll, <0 to wait forever
+ * \retval -EPIPE the publisher has stopped and all data has been read
+ * \retval <0 error
+ * \retval 0 timeout
+ * \retval >0 number of bytes available
+ */
+extern long cmyth_shmlive_wait(cmyth_shmlive_t sl, int timeout);
+
+/**
+ * Get direct access to the next data of a shared live TV stream, without
+ * copying it.  The data stays in place until the publisher wraps around
+ * the ring, so it must be released with cmyth_shmlive_consume(), which
+ * reports whether it was overwritten while in use.
+ * \param sl reader handle
+ * \param[out] data start of the data in the ring
+ * \retval -EOVERFLOW the reader fell behind and was moved to the live edge
+ * \retval <0 error
+ * \retval 0 no data available
+ * \retval >0 number of contiguous bytes at data
+ */
+extern long cmyth_shmlive_peek(cmyth_shmlive_t sl, const char **data);
+
+/**
+ * Release data obtained with cmyth_shmlive_peek().
+ * \param sl reader handle
+ * \param len number of bytes used, at most the size returned by the peek
+ * \retval -EOVERFLOW the data was overwritten while in use, and the
+ *                    reader was moved to the live edge
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_shmlive_consume(cmyth_shmlive_t sl, unsigned long len);
+
+/**
+ * Copy data out of a shared live TV stream.
+ * \param sl reader handle
+ * \param buf buffer for the data
+ * \param len size of buf
+ * \param timeout milliseconds to wait for data, 0 to poll, <0 to wait
+ *        forever
+ * \retval -EOVERFLOW the reader fell behind and was moved to the live edge
+ * \retval -EPIPE the publisher has stopped and all data has been read
+ * \retval <0 error
+ * \retval 0 timeout
+ * \retval >0 number of bytes copied
+ */
+extern long cmyth_shmlive_read(cmyth_shmlive_t sl, char *buf,
+			       unsigned long len, int timeout);
+
 /*
  * -----------------------------------------------------------------
  * Timestamp Operations
@@ -908,6 +1424,21 @@ extern char* cmyth_datetime_string(cmyth_timestamp_t ts);
 extern int cmyth_timestamp_compare(cmyth_timestamp_t ts1,
 				   cmyth_timestamp_t ts2);
 
+/**
+ * Split the "chanid starttime" at the start of the data of a
+ * RECORDING_LIST_CHANGE ADD or DELETE, or UPDATE_FILE_SIZE, event.
+ * \param data event data
+ * \param chanid set to the channel id
+ * \param recstart buffer for the start time, as sent by the backend
+ * \param len size of recstart
+ * \param start set to the start time in seconds since the Epoch
+ * \param rest if not NULL, set to point after the start time in data
+ * \retval 0 success
+ * \retval <0 error
+ */
+extern int cmyth_timeslot_parse(char *data, long *chanid, char *recstart,
+				int len, time_t *start, char **rest);
+
 /*
  * -----------------------------------------------------------------
  * Program Info Operations
@@ -923,6 +1454,18 @@ extern int cmyth_timestamp_compare(cmyth_timestamp_t ts1,
 extern cmyth_proginfo_t cmyth_proginfo_get_detail(cmyth_conn_t control,
 						  cmyth_proginfo_t prog);
 
+/**
+ * Retrieve a single recording by its channel and start time, such as
+ * those given by a RECORDING_LIST_CHANGE ADD or DELETE event.
+ * \param control backend control handle
+ * \param chanid channel id
+ * \param recstart recording start time, as sent by the backend
+ * \return proginfo handle, or NULL if there is no such recording
+ */
+extern cmyth_proginfo_t cmyth_proginfo_get_from_timeslot(cmyth_conn_t control,
+							 long chanid,
+							 char *recstart);
+
 /**
  * Delete a program.
  * \param control backend control handle
@@ -954,6 +1497,22 @@ extern int cmyth_proginfo_stop_recording(cmyth_conn_t control,
 extern int cmyth_proginfo_check_recording(cmyth_conn_t control,
 					  cmyth_proginfo_t prog);
 
+/**
+ * Queue a check of a program recording status.  The status of the
+ * request is the value cmyth_proginfo_check_recording() would return.
+ * \param control control handle
+ * \param prog proginfo handle
+ * \param callback function to call on completion, or NULL
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL request handle, to be released with ref_release()
+ */
+extern cmyth_request_t cmyth_proginfo_check_recording_async(
+					cmyth_conn_t control,
+					cmyth_proginfo_t prog,
+					cmyth_request_callback_t callback,
+					void *data);
+
 /**
  * Delete a program such that it may be recorded again.
  * \param control backend control handle
@@ -1216,6 +1775,46 @@ extern cmyth_proglist_t cmyth_proglist_get_all_pending(cmyth_conn_t control);
  */
 extern cmyth_proglist_t cmyth_proglist_get_all_scheduled(cmyth_conn_t control);
 
+/**
+ * Queue a request for a program list of all recorded programs.  The
+ * result is a program list handle (see cmyth_request_get_result()).
+ * \param control control handle
+ * \param callback function to call on completion, or NULL
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL request handle, to be released with ref_release()
+ */
+extern cmyth_request_t cmyth_proglist_get_all_recorded_async(
+					cmyth_conn_t control,
+					cmyth_request_callback_t callback,
+					void *data);
+
+/**
+ * Queue a request for a program list of all pending recordings.
+ * \param control control handle
+ * \param callback function to call on completion, or NULL
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL request handle, to be released with ref_release()
+ */
+extern cmyth_request_t cmyth_proglist_get_all_pending_async(
+					cmyth_conn_t control,
+					cmyth_request_callback_t callback,
+					void *data);
+
+/**
+ * Queue a request for a program list of all scheduled recordings.
+ * \param control control handle
+ * \param callback function to call on completion, or NULL
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL request handle, to be released with ref_release()
+ */
+extern cmyth_request_t cmyth_proglist_get_all_scheduled_async(
+					cmyth_conn_t control,
+					cmyth_request_callback_t callback,
+					void *data);
+
 /**
  * Retrieve a program list of all conflicting recordings from the MythTV
  * backend.
@@ -1269,6 +1868,72 @@ extern int cmyth_proglist_get_count(cmyth_proglist_t pl);
 extern int cmyth_proglist_sort(cmyth_proglist_t pl, int count,
 			       cmyth_proglist_sort_t sort);
 
+/*
+ * -----------------------------------------------------------------
+ * Recording List Operations
+ * -----------------------------------------------------------------
+ */
+
+/**
+ * Callback made when a recording list changes.
+ * \param rl recording list handle
+ * \param change CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD, _UPDATE or _DELETE
+ *               when a single recording changed, or
+ *               CMYTH_EVENT_RECORDING_LIST_CHANGE when the whole list was
+ *               fetched again
+ * \param prog the recording which changed, or NULL for the whole list
+ * \param version version of the list after the change
+ * \param data data passed when the list was created
+ */
+typedef void (*cmyth_reclist_callback_t)(cmyth_reclist_t rl,
+					 cmyth_event_t change,
+					 cmyth_proginfo_t prog,
+					 unsigned long version,
+					 void *data);
+
+/**
+ * Fetch the list of recordings from a backend.  The list subscribes to
+ * the events of the backend and keeps itself up to date: recordings which
+ * are added, updated, deleted or grow are changed in place, and the whole
+ * list is only fetched again when a change cannot be applied or events
+ * may have been missed.
+ * \param control control handle, used for as long as the list exists
+ * \param callback function to call when the list changes, or NULL.  It is
+ *                 called on the event dispatcher thread, or on the thread
+ *                 calling cmyth_reclist_refresh().
+ * \param data passed to the callback
+ * \retval NULL error
+ * \retval non-NULL recording list handle, to be released with ref_release()
+ */
+extern cmyth_reclist_t cmyth_reclist_create(cmyth_conn_t control,
+					    cmyth_reclist_callback_t callback,
+					    void *data);
+
+/**
+ * Fetch the whole list of recordings again.
+ * \param rl recording list handle
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_reclist_refresh(cmyth_reclist_t rl);
+
+/**
+ * Retrieve the program list of a recording list.  This is the live list,
+ * which changes as updates are applied.
+ * \param rl recording list handle
+ * \retval NULL error
+ * \retval non-NULL program list handle, to be released with ref_release()
+ */
+extern cmyth_proglist_t cmyth_reclist_get_list(cmyth_reclist_t rl);
+
+/**
+ * Retrieve the version of a recording list, which goes up by one with
+ * every change.
+ * \param rl recording list handle
+ * \return version
+ */
+extern unsigned long cmyth_reclist_get_version(cmyth_reclist_t rl);
+
 /*
  * -----------------------------------------------------------------
  * File Transfer Operations
@@ -1334,6 +1999,182 @@ extern long long cmyth_file_seek(cmyth_file_t file,
  */
 extern int cmyth_file_select(cmyth_file_t file, struct timeval *timeout);
 
+/**
+ * Turn read-ahead on or off for a file.  With read-ahead on, a background
+ * thread keeps up to depth block requests of up to block bytes outstanding
+ * on the backend, and buffers the data until it is consumed with
+ * cmyth_file_read().  While read-ahead is on, cmyth_file_request_block(),
+ * cmyth_file_get_block() and cmyth_file_select() fail with -EBUSY.
+ * \param file file handle
+ * \param depth number of requests to keep in flight, or 0 to turn
+ *              read-ahead off
+ * \param block largest request in bytes, the block size controller of
+ *              the connection may use smaller ones
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_file_set_readahead(cmyth_file_t file, int depth,
+				    unsigned long block);
+
+/**
+ * Read up to len bytes from the current position in a file, and advance
+ * the position.  This uses the read-ahead buffers if read-ahead is on,
+ * and requests the data from the backend otherwise.  Reaching the end
+ * of the file returns 0, and a later read will try again in case the
+ * file has grown.
+ * \param file file handle
+ * \param buf data buffer
+ * \param len size of buf
+ * \retval <0 error
+ * \retval 0 end of file
+ * \retval >0 number of bytes read into buf
+ */
+extern int cmyth_file_read(cmyth_file_t file, char *buf, unsigned long len);
+
+/**
+ * Copy part or all of a file to a file descriptor.  Several block
+ * requests are kept in flight and the block size grows with the measured
+ * throughput.  On Linux the data is spliced from the socket to fd
+ * without being copied through user space, where fd allows it.  The file
+ * position ends up after the last byte copied.  This cannot be used
+ * while read-ahead or the block cache is on.
+ * \param file file handle
+ * \param fd file descriptor to write to
+ * \param offset where to start, or -1 for the current position
+ * \param len bytes to copy, or -1 to copy to the end of the file
+ * \retval <0 error
+ * \retval >=0 number of bytes copied, less than len at the end of the file
+ */
+extern long long cmyth_file_copy_to_fd(cmyth_file_t file, int fd,
+				       long long offset, long long len);
+
+/**
+ * Report the state of the block size controller of a file.  Block
+ * requests on a file are cut to a size which is tuned to the measured
+ * throughput and latency of the connection, and the socket receive
+ * buffer grows along with it.  Any of the pointers may be NULL.
+ * \param file file handle
+ * \param[out] block current block size in bytes
+ * \param[out] rcvbuf socket receive buffer size in bytes
+ * \param[out] rate throughput of the latest requests in bytes per second
+ * \param[out] latency smoothed time from request to reply in milliseconds
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_file_get_tune_stats(cmyth_file_t file, unsigned long *block,
+				     int *rcvbuf, unsigned long long *rate,
+				     int *latency);
+
+/**
+ * Turn the block cache on or off for a file.  With the cache on, data
+ * is read from cached blocks where possible, and seeking does not talk
+ * to the backend.  Requests do not cross cache block boundaries, so they
+ * may return less data than was asked for.  The cache cannot be used
+ * together with read-ahead.
+ * \param file file handle
+ * \param enable 1 to use the cache, 0 to stop using it
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_file_set_cache(cmyth_file_t file, int enable);
+
+/**
+ * Set up the block cache shared by all files which have it turned on.
+ * The cache keeps mem_size bytes of recently used blocks in memory, and
+ * moves older blocks into disk_size bytes of disk_file, which is memory
+ * mapped and removed from the file system straight away.  Only complete
+ * blocks are cached, so the growing end of a recording in progress is
+ * always read from the backend.  Reconfiguring empties the cache.
+ * \param mem_size bytes of memory to use
+ * \param disk_size bytes of disk to use, or 0 for no disk tier
+ * \param disk_file file to use for the disk tier
+ * \retval <0 error
+ * \retval 0 success
+ */
+extern int cmyth_cache_configure(unsigned long mem_size,
+				 unsigned long long disk_size,
+				 const char *disk_file);
+
+/**
+ * Retrieve block cache statistics.  Any of the pointers may be NULL.
+ * \param[out] hits blocks found in memory
+ * \param[out] disk_hits blocks found in the disk tier
+ * \param[out] misses blocks read from the backend
+ * \param[out] evictions blocks dropped to make room
+ */
+extern void cmyth_cache_get_stats(unsigned long *hits,
+				  unsigned long *disk_hits,
+				  unsigned long *misses,
+				  unsigned long *evictions);
+
+/**
+ * Seek to the last key frame at or before a frame of a recording.
+ * \param file file handle
+ * \param pm position map of the recording
+ * \param frame frame number
+ * \retval <0 error
+ * \retval >=0 new absolute position in the file
+ */
+extern long long cmyth_file_seek_frame(cmyth_file_t file, cmyth_posmap_t pm,
+				       long long frame);
+
+/**
+ * Seek to the last key frame at or before a time in a recording.  The
+ * position map has to include key frame times.
+ * \param file file handle
+ * \param pm position map of the recording
+ * \param msec milliseconds from the start of the recording
+ * \retval <0 error
+ * \retval >=0 new absolute position in the file
+ */
+extern long long cmyth_file_seek_time(cmyth_file_t file, cmyth_posmap_t pm,
+				      long long msec);
+
+/*
+ * -----------------------------------------------------------------
+ * Position Map Operations
+ * -----------------------------------------------------------------
+ */
+
+/**
+ * Retrieve the number of key frames with a known offset in a position map.
+ * \param pm position map handle
+ * \retval <0 error
+ * \retval >=0 number of key frames
+ */
+extern long cmyth_posmap_get_count(cmyth_posmap_t pm);
+
+/**
+ * Look up the byte offset of the last key frame at or before a frame.
+ * Frames before the first key frame map to the first key frame.
+ * \param pm position map handle
+ * \param frame frame number
+ * \param[out] keyframe number of the key frame found, may be NULL
+ * \retval <0 error
+ * \retval >=0 byte offset in the recording
+ */
+extern long long cmyth_posmap_frame_offset(cmyth_posmap_t pm,
+					   long long frame,
+					   long long *keyframe);
+
+/**
+ * Look up the last key frame at or before a time.
+ * \param pm position map handle
+ * \param msec milliseconds from the start of the recording
+ * \retval <0 error, -ENOENT if the map has no key frame times
+ * \retval >=0 key frame number
+ */
+extern long long cmyth_posmap_time_frame(cmyth_posmap_t pm, long long msec);
+
+/**
+ * Look up the time of the last key frame at or before a frame.
+ * \param pm position map handle
+ * \param frame frame number
+ * \retval <0 error, -ENOENT if the map has no key frame times
+ * \retval >=0 milliseconds from the start of the recording
+ */
+extern long long cmyth_posmap_frame_time(cmyth_posmap_t pm, long long frame);
+
 
 /*
  * -------
@@ -1429,6 +2270,58 @@ extern int cmyth_commbreak_get_count(cmyth_commbreaklist_t cbl);
 extern cmyth_commbreak_t cmyth_commbreak_get_item(cmyth_commbreaklist_t cbl,
 						  unsigned int index);
 
+/**
+ * Find the commercial break covering a byte offset.  Overlapping breaks
+ * are merged, and the lookup is a binary search, so it is cheap enough
+ * to do on every read.
+ * \param cbl commercial break list handle
+ * \param offset byte offset in the recording
+ * \retval NULL the offset is not in a break
+ * \retval non-NULL ref counted commercial break handle
+ * \note Only breaks retrieved via MySQL have offsets.  A list without
+ *       offsets is matched by mark, with offset taken as a frame number.
+ */
+extern cmyth_commbreak_t cmyth_commbreak_find(cmyth_commbreaklist_t cbl,
+					      long long offset);
+
+/**
+ * Find the commercial break covering a frame.
+ * \param cbl commercial break list handle
+ * \param mark frame number
+ * \retval NULL the frame is not in a break
+ * \retval non-NULL ref counted commercial break handle
+ */
+extern cmyth_commbreak_t cmyth_commbreak_find_mark(cmyth_commbreaklist_t cbl,
+						   long long mark);
+
+/**
+ * Find the commercial break covering a byte offset, or else the next
+ * one after it.  Data up to the start offset of the break returned can
+ * be read without looking again.
+ * \param cbl commercial break list handle
+ * \param offset byte offset in the recording
+ * \retval NULL there is no break after the offset
+ * \retval non-NULL ref counted commercial break handle
+ * \note Only breaks retrieved via MySQL have offsets.  A list without
+ *       offsets is searched by mark, as with cmyth_commbreak_find().
+ */
+extern cmyth_commbreak_t cmyth_commbreak_next(cmyth_commbreaklist_t cbl,
+					      long long offset);
+
+/**
+ * Turn the cache of commercial break and cut lists on or off.  Lists are
+ * cached per backend and recording, and dropped when the backend reports
+ * that the marks of a recording may have changed, which takes an event
+ * connection to each backend cached from.  The cache is off by default.
+ * \param enable 1 to use the cache, 0 to empty it and stop using it
+ */
+extern void cmyth_commbreak_cache_enable(int enable);
+
+/**
+ * Empty the cache of commercial break and cut lists.
+ */
+extern void cmyth_commbreak_cache_flush(void);
+
 /*
  * -----------------------------------------------------------------
  * Optional MySQL Database Operations
@@ -1462,6 +2355,33 @@ extern long long cmyth_get_bookmark_mark(cmyth_database_t, cmyth_proginfo_t, lon
 extern int cmyth_get_bookmark_offset(cmyth_database_t db, long chanid, long long mark, char *starttime, int mode);
 extern cmyth_commbreaklist_t cmyth_mysql_get_commbreaklist(cmyth_database_t db, cmyth_conn_t conn, cmyth_proginfo_t prog);
 
+/**
+ * Build the channel lists of new recorders from a database, with one
+ * query per video source instead of walking the program guide.
+ * \param db database handle, or NULL to walk the guide again
+ */
+extern void cmyth_chanlist_set_database(cmyth_database_t db);
+
+/**
+ * Retrieve the visible channels of a video source from a database.
+ * \param db database handle
+ * \param sourceid video source id
+ * \return channel list handle
+ * \retval NULL error
+ */
+extern cmyth_chanlist_t cmyth_mysql_get_chanlist(cmyth_database_t db,
+						 long sourceid);
+
+/**
+ * Load the seek table of a recording from a database in one query.
+ * \param db database handle
+ * \param prog program info handle
+ * \return position map handle
+ * \retval NULL error
+ */
+extern cmyth_posmap_t cmyth_mysql_get_posmap(cmyth_database_t db,
+					     cmyth_proginfo_t prog);
+
 /*
  * mysql info
  */
@@ -1547,6 +2467,11 @@ struct cmyth_commbreak {
 struct cmyth_commbreaklist {
         cmyth_commbreak_t *commbreak_list;
         long commbreak_count;
+        cmyth_commbreak_t *commbreak_marks;	/**< merged, by mark */
+        long commbreak_marks_count;
+        cmyth_commbreak_t *commbreak_offsets;	/**< merged, by offset */
+        long commbreak_offsets_count;
+        volatile int commbreak_indexed;
 };
 
 /**
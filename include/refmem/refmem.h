@@ -67,6 +67,28 @@ extern int ref_get_refcount();
  */
 extern void ref_get_usage(unsigned int *refs, unsigned int *bytes);
 
+/**
+ * Turn the size class pool behind ref_alloc() on or off.  The pool
+ * keeps small blocks in per-thread caches and lock-free free lists
+ * instead of returning them to malloc(), which suits long running
+ * programs that keep allocating the same kinds of objects.  It is off
+ * by default.
+ * \param enable non-zero to use the pool for new allocations
+ */
+extern void ref_pool_enable(int enable);
+
+/**
+ * Retrieve the size class pool statistics.  Any argument may be NULL.
+ * \param slab_bytes bytes obtained from the system for pool slabs
+ * \param in_use number of pool blocks currently allocated
+ * \param hits number of allocations served by the pool
+ * \param misses number of allocations that fell back to malloc()
+ */
+extern void ref_get_pool_usage(unsigned int *slab_bytes,
+			       unsigned int *in_use,
+			       unsigned int *hits,
+			       unsigned int *misses);
+
 /**
  * Release a reference to allocated memory.
  * \param p allocated memory
@@ -80,6 +102,17 @@ extern void ref_release(void *p);
  */
 extern void *ref_hold(void *p);
 
+/**
+ * Add a reference to allocated memory, unless its last reference has
+ * already been released and it is being destroyed.  This is for tables
+ * and callbacks which keep pointers to blocks without holding them, and
+ * which are cleared from the blocks' destroy functions.
+ * \param p allocated memory
+ * \retval NULL p is being destroyed
+ * \retval non-NULL new reference
+ */
+extern void *ref_hold_live(void *p);
+
 /**
  * Duplicate a string using reference counted memory.
  * \param str string to duplicate
@@ -87,6 +120,16 @@ extern void *ref_hold(void *p);
  */
 extern char *ref_strdup(char *str);
 
+/**
+ * Get a shared reference counted copy of a string.  Every caller
+ * interning an equal string gets the same pointer for as long as any of
+ * them holds it, so interned strings can be compared by pointer.  The
+ * result must never be modified.
+ * \param str string to intern
+ * \return reference to the interned string
+ */
+extern char *ref_strintern(const char *str);
+
 /**
  * Create a reference counted buffer whose contents contain the result of
  * calling sprintf() on the argument list.
@@ -128,6 +171,23 @@ extern void *ref_realloc(void *p, size_t len);
 
 typedef void (*ref_destroy_t)(void *p);
 
+/**
+ * Compute the space a sub-block needs inside its parent block.
+ * \param len sub-block size
+ * \return number of bytes to reserve in the parent block
+ */
+extern size_t ref_sub_size(size_t len);
+
+/**
+ * Carve a reference counted sub-block out of a larger allocation.  Holds
+ * and releases of the sub-block are applied to the parent block.
+ * \param parent reference counted memory containing the sub-block
+ * \param offset offset of the sub-block within parent
+ * \param len sub-block size
+ * \return pointer to the sub-block, holding a reference on parent
+ */
+extern void *ref_sub_alloc(void *parent, size_t offset, size_t len);
+
 /**
  * Add a destroy callback for reference counted memory.
  * \param block allocated memory
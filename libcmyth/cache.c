@@ -0,0 +1,489 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * cache.c -   Block cache for file transfers.  Blocks of CMYTH_CACHE_BLOCK
+ *             bytes are cached by file path, host and block number, so
+ *             that all readers of a recording in the process share them.
+ *
+ *             There are two tiers.  Recently used blocks are kept in
+ *             memory, and blocks that fall off the end of the memory LRU
+ *             list move into slots of a memory mapped file, which has
+ *             its own LRU list.  A hit in the file tier moves the block
+ *             back into memory.
+ *
+ *             Only complete blocks are ever cached.  A recording that is
+ *             still in progress grows at the end, so a short block at
+ *             the end of a file is not final and is always fetched again.
+ *
+ *             The path and host strings are interned, so keys are
+ *             compared by pointer.  Each block holds a reference on both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <cmyth_local.h>
+
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#define CACHE_HAS_MMAP
+#endif
+
+#define CACHE_TIER_MEM	0
+#define CACHE_TIER_DISK	1
+
+struct cache_block {
+	struct cache_block *cb_hnext;	/* hash chain */
+	struct cache_block *cb_prev;	/* LRU list of the tier */
+	struct cache_block *cb_next;
+	char *cb_path;
+	char *cb_host;
+	uint64_t cb_index;
+	int cb_tier;
+	long cb_slot;			/* slot in the mapped file */
+	char *cb_data;
+};
+
+struct cache_tier {
+	struct cache_block *ct_head;	/* most recently used */
+	struct cache_block *ct_tail;
+	unsigned long ct_count;
+	unsigned long ct_max;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct cache_block **cache_hash;
+static unsigned long cache_nbuckets;
+static struct cache_tier cache_tier[2];
+
+static char *cache_map;
+static size_t cache_map_size;
+static long *cache_free_slots;
+static long cache_nfree;
+
+static unsigned long cache_hits;
+static unsigned long cache_disk_hits;
+static unsigned long cache_misses;
+static unsigned long cache_evictions;
+
+static inline unsigned long
+cache_bucket(const char *path, const char *host, uint64_t index)
+{
+	uint64_t h;
+
+	h = (uintptr_t)path * 31 + (uintptr_t)host;
+	h ^= index * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 29;
+
+	return (unsigned long)(h & (cache_nbuckets - 1));
+}
+
+static void
+cache_lru_remove(struct cache_block *cb)
+{
+	struct cache_tier *t = &cache_tier[cb->cb_tier];
+
+	if (cb->cb_prev)
+		cb->cb_prev->cb_next = cb->cb_next;
+	else
+		t->ct_head = cb->cb_next;
+	if (cb->cb_next)
+		cb->cb_next->cb_prev = cb->cb_prev;
+	else
+		t->ct_tail = cb->cb_prev;
+	t->ct_count--;
+}
+
+static void
+cache_lru_insert(struct cache_block *cb, int tier)
+{
+	struct cache_tier *t = &cache_tier[tier];
+
+	cb->cb_tier = tier;
+	cb->cb_prev = NULL;
+	cb->cb_next = t->ct_head;
+	if (t->ct_head)
+		t->ct_head->cb_prev = cb;
+	else
+		t->ct_tail = cb;
+	t->ct_head = cb;
+	t->ct_count++;
+}
+
+static void
+cache_drop(struct cache_block *cb)
+{
+	struct cache_block **pp;
+
+	pp = &cache_hash[cache_bucket(cb->cb_path, cb->cb_host, cb->cb_index)];
+	while (*pp != cb) {
+		pp = &(*pp)->cb_hnext;
+	}
+	*pp = cb->cb_hnext;
+
+	cache_lru_remove(cb);
+	if (cb->cb_tier == CACHE_TIER_MEM) {
+		free(cb->cb_data);
+	} else {
+		cache_free_slots[cache_nfree++] = cb->cb_slot;
+	}
+	ref_release(cb->cb_path);
+	ref_release(cb->cb_host);
+	free(cb);
+}
+
+/*
+ * Push blocks off the end of the memory tier into the file tier, making
+ * room there by dropping its least recently used blocks.  Without a file
+ * tier, the blocks are dropped.
+ */
+static void
+cache_trim(void)
+{
+	struct cache_tier *mem = &cache_tier[CACHE_TIER_MEM];
+	struct cache_tier *disk = &cache_tier[CACHE_TIER_DISK];
+	struct cache_block *cb;
+
+	while (mem->ct_count > mem->ct_max) {
+		cb = mem->ct_tail;
+		if (disk->ct_max == 0) {
+			cache_drop(cb);
+			cache_evictions++;
+			continue;
+		}
+		if (cache_nfree == 0) {
+			cache_drop(disk->ct_tail);
+			cache_evictions++;
+		}
+		cache_lru_remove(cb);
+		cb->cb_slot = cache_free_slots[--cache_nfree];
+		memcpy(cache_map + (size_t)cb->cb_slot * CMYTH_CACHE_BLOCK,
+		       cb->cb_data, CMYTH_CACHE_BLOCK);
+		free(cb->cb_data);
+		cb->cb_data = cache_map +
+			(size_t)cb->cb_slot * CMYTH_CACHE_BLOCK;
+		cache_lru_insert(cb, CACHE_TIER_DISK);
+	}
+}
+
+static void
+cache_teardown(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < cache_nbuckets; i++) {
+		while (cache_hash[i]) {
+			cache_drop(cache_hash[i]);
+		}
+	}
+	free(cache_hash);
+	cache_hash = NULL;
+	cache_nbuckets = 0;
+	free(cache_free_slots);
+	cache_free_slots = NULL;
+	cache_nfree = 0;
+#if defined(CACHE_HAS_MMAP)
+	if (cache_map) {
+		munmap(cache_map, cache_map_size);
+	}
+#endif
+	cache_map = NULL;
+	cache_map_size = 0;
+	memset(cache_tier, 0, sizeof(cache_tier));
+}
+
+/*
+ * cmyth_cache_configure(unsigned long mem_size, unsigned long long disk_size,
+ *                       const char *disk_file)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Set up the file transfer block cache with 'mem_size' bytes of memory
+ * and 'disk_size' bytes in 'disk_file', which is created (or truncated),
+ * memory mapped and then unlinked, so it goes away with the process.
+ * Sizes are rounded down to whole blocks.  Anything already cached is
+ * thrown away.  If both sizes are 0 the cache is turned off.
+ *
+ * Files only use the cache once it is turned on for them with
+ * cmyth_file_set_cache().
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -errno
+ */
+int
+cmyth_cache_configure(unsigned long mem_size, unsigned long long disk_size,
+		      const char *disk_file)
+{
+	unsigned long nblocks, i;
+	long nslots = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	cache_teardown();
+
+	nslots = disk_size / CMYTH_CACHE_BLOCK;
+	if (nslots > 0) {
+#if defined(CACHE_HAS_MMAP)
+		int fd;
+
+		if (!disk_file) {
+			ret = -EINVAL;
+			goto out;
+		}
+		if ((fd = open(disk_file, O_RDWR | O_CREAT | O_TRUNC,
+			       0600)) < 0) {
+			ret = -errno;
+			cmyth_dbg(CMYTH_DBG_ERROR, "%s: open(%s) failed (%d)\n",
+				  __FUNCTION__, disk_file, errno);
+			goto out;
+		}
+		unlink(disk_file);
+		cache_map_size = (size_t)nslots * CMYTH_CACHE_BLOCK;
+		if (ftruncate(fd, cache_map_size) < 0) {
+			ret = -errno;
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: ftruncate() failed (%d)\n",
+				  __FUNCTION__, errno);
+			close(fd);
+			goto out;
+		}
+		cache_map = mmap(NULL, cache_map_size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, fd, 0);
+		close(fd);
+		if (cache_map == MAP_FAILED) {
+			ret = -errno;
+			cmyth_dbg(CMYTH_DBG_ERROR, "%s: mmap() failed (%d)\n",
+				  __FUNCTION__, errno);
+			cache_map = NULL;
+			goto out;
+		}
+		cache_free_slots = malloc(nslots * sizeof(*cache_free_slots));
+		if (!cache_free_slots) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (i = 0; i < (unsigned long)nslots; i++) {
+			cache_free_slots[i] = nslots - 1 - i;
+		}
+		cache_nfree = nslots;
+#else
+		ret = -ENOSYS;
+		goto out;
+#endif
+	}
+
+	nblocks = (mem_size / CMYTH_CACHE_BLOCK) + nslots;
+	if (nblocks == 0) {
+		goto out;
+	}
+	for (cache_nbuckets = 64; cache_nbuckets < nblocks;
+	     cache_nbuckets <<= 1)
+		;
+	cache_hash = calloc(cache_nbuckets, sizeof(*cache_hash));
+	if (!cache_hash) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	cache_tier[CACHE_TIER_MEM].ct_max = mem_size / CMYTH_CACHE_BLOCK;
+	cache_tier[CACHE_TIER_DISK].ct_max = nslots;
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: %lu memory blocks, %ld file blocks\n",
+		  __FUNCTION__, cache_tier[CACHE_TIER_MEM].ct_max, nslots);
+
+    out:
+	if (ret < 0) {
+		cache_teardown();
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	return ret;
+}
+
+/*
+ * cmyth_cache_get_stats(unsigned long *hits, unsigned long *disk_hits,
+ *                       unsigned long *misses, unsigned long *evictions)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the block cache counters: blocks found in memory, blocks
+ * found in the file tier, blocks that had to be fetched from the backend,
+ * and blocks thrown out of the cache to make room.  Any of the pointers
+ * may be NULL.
+ *
+ * Return Value: NONE
+ */
+void
+cmyth_cache_get_stats(unsigned long *hits, unsigned long *disk_hits,
+		      unsigned long *misses, unsigned long *evictions)
+{
+	pthread_mutex_lock(&cache_mutex);
+	if (hits)
+		*hits = cache_hits;
+	if (disk_hits)
+		*disk_hits = cache_disk_hits;
+	if (misses)
+		*misses = cache_misses;
+	if (evictions)
+		*evictions = cache_evictions;
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+/*
+ * cmyth_cache_get(char *path, char *host, uint64_t index, char *buf)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_cache_get)
+ *
+ * Description
+ *
+ * Look up block 'index' of the file 'path' on 'host', both of which
+ * must be interned strings, and copy it into 'buf', which must hold
+ * CMYTH_CACHE_BLOCK bytes.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -ENOENT if the block is not cached
+ */
+int
+cmyth_cache_get(char *path, char *host, uint64_t index, char *buf)
+{
+	struct cache_block *cb;
+	char *data;
+	int ret = -ENOENT;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	if (!cache_hash) {
+		goto out;
+	}
+	for (cb = cache_hash[cache_bucket(path, host, index)]; cb;
+	     cb = cb->cb_hnext) {
+		if ((cb->cb_index == index) && (cb->cb_path == path) &&
+		    (cb->cb_host == host)) {
+			break;
+		}
+	}
+	if (!cb) {
+		cache_misses++;
+		goto out;
+	}
+
+	memcpy(buf, cb->cb_data, CMYTH_CACHE_BLOCK);
+	ret = 0;
+
+	cache_lru_remove(cb);
+	if ((cb->cb_tier == CACHE_TIER_DISK) &&
+	    (cache_tier[CACHE_TIER_MEM].ct_max > 0) &&
+	    ((data = malloc(CMYTH_CACHE_BLOCK)) != NULL)) {
+		cache_disk_hits++;
+		memcpy(data, buf, CMYTH_CACHE_BLOCK);
+		cache_free_slots[cache_nfree++] = cb->cb_slot;
+		cb->cb_data = data;
+		cache_lru_insert(cb, CACHE_TIER_MEM);
+		cache_trim();
+	} else {
+		if (cb->cb_tier == CACHE_TIER_DISK)
+			cache_disk_hits++;
+		else
+			cache_hits++;
+		cache_lru_insert(cb, cb->cb_tier);
+	}
+
+    out:
+	pthread_mutex_unlock(&cache_mutex);
+
+	return ret;
+}
+
+/*
+ * cmyth_cache_put(char *path, char *host, uint64_t index, char *buf)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_cache_put)
+ *
+ * Description
+ *
+ * Add a copy of block 'index' of the file 'path' on 'host', both of
+ * which must be interned strings, to the cache.  'buf' must hold a
+ * complete block of CMYTH_CACHE_BLOCK bytes.  The cache is best effort,
+ * so nothing is reported if the block cannot be added.
+ *
+ * Return Value: NONE
+ */
+void
+cmyth_cache_put(char *path, char *host, uint64_t index, char *buf)
+{
+	struct cache_block *cb;
+	unsigned long b;
+	int tier = CACHE_TIER_MEM;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	if (!cache_hash) {
+		goto out;
+	}
+	b = cache_bucket(path, host, index);
+	for (cb = cache_hash[b]; cb; cb = cb->cb_hnext) {
+		if ((cb->cb_index == index) && (cb->cb_path == path) &&
+		    (cb->cb_host == host)) {
+			goto out;
+		}
+	}
+
+	if ((cb = malloc(sizeof(*cb))) == NULL) {
+		goto out;
+	}
+	if (cache_tier[CACHE_TIER_MEM].ct_max == 0) {
+		tier = CACHE_TIER_DISK;
+		if (cache_nfree == 0) {
+			cache_drop(cache_tier[CACHE_TIER_DISK].ct_tail);
+			cache_evictions++;
+		}
+		cb->cb_slot = cache_free_slots[--cache_nfree];
+		cb->cb_data = cache_map +
+			(size_t)cb->cb_slot * CMYTH_CACHE_BLOCK;
+	} else if ((cb->cb_data = malloc(CMYTH_CACHE_BLOCK)) == NULL) {
+		free(cb);
+		goto out;
+	}
+	memcpy(cb->cb_data, buf, CMYTH_CACHE_BLOCK);
+	cb->cb_path = ref_hold(path);
+	cb->cb_host = ref_hold(host);
+	cb->cb_index = index;
+	cb->cb_hnext = cache_hash[b];
+	cache_hash[b] = cb;
+	cache_lru_insert(cb, tier);
+	cache_trim();
+
+    out:
+	pthread_mutex_unlock(&cache_mutex);
+}
@@ -21,28 +21,107 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
 #include <cmyth_local.h>
 
-struct event_loop_args {
-	cmyth_recorder_t rec;
+#define CHAIN_LIST_MIN	8
+
+/*
+ * How long a switch waits for a background open of the same file before
+ * opening it itself.
+ */
+#define CHAIN_PREOPEN_WAIT	10
+
+struct cmyth_chain_preopen {
 	cmyth_chain_t chain;
+	cmyth_chain_entry_t entry;
 };
 
-static void *cmyth_chain_event_loop(void *data);
+static void cmyth_chain_event(cmyth_event_sub_t sub, cmyth_eventinfo_t ev,
+			      void *data);
+
+/*
+ * Look up entry 'index' without taking chain_mutex.  chain_count is read
+ * before chain_list, which is replaced before chain_count is raised, so
+ * the array read holds at least chain_count entries.
+ */
+static cmyth_chain_entry_t
+cmyth_chain_entry(cmyth_chain_t chain, int index)
+{
+	struct cmyth_chain_list *list;
+	unsigned int count;
+
+	count = chain->chain_count;
+	__sync_synchronize();
+	list = chain->chain_list;
+
+	if ((index < 0) || ((unsigned int)index >= count) || (list == NULL)) {
+		return NULL;
+	}
+
+	return list->entries[index];
+}
+
+/*
+ * Publish 'entry' at the end of the chain.  Called with chain_mutex held.
+ */
+static int
+cmyth_chain_append(cmyth_chain_t chain, cmyth_chain_entry_t entry)
+{
+	struct cmyth_chain_list *list = chain->chain_list, *grown;
+	unsigned int count = chain->chain_count;
+	unsigned int size;
+
+	if ((list == NULL) || (count == list->size)) {
+		size = list ? (list->size * 2) : CHAIN_LIST_MIN;
+		grown = ref_alloc(sizeof(*grown) + (size * sizeof(entry)));
+		if (grown == NULL) {
+			return -ENOMEM;
+		}
+		grown->prev = list;
+		grown->size = size;
+		grown->entries = (cmyth_chain_entry_t*)(grown + 1);
+		if (count > 0) {
+			memcpy(grown->entries, list->entries,
+			       count * sizeof(entry));
+		}
+		__sync_synchronize();
+		chain->chain_list = grown;
+		list = grown;
+	}
+
+	list->entries[count] = entry;
+	__sync_synchronize();
+	chain->chain_count = count + 1;
+
+	return 0;
+}
+
+/*
+ * Make entry 'index' the current one.  Called with chain_mutex held.
+ */
+static void
+cmyth_chain_set_index(cmyth_chain_t chain, int index)
+{
+	__sync_synchronize();
+	chain->chain_current = index;
+}
 
 static void
 cmyth_chain_destroy(cmyth_chain_t chain)
 {
+	struct cmyth_chain_list *list, *prev;
 	unsigned int i;
 
 	if (chain == NULL) {
 		return;
 	}
 
-	if (chain->chain_thread) {
-		pthread_cancel(chain->chain_thread);
-		pthread_join(chain->chain_thread, NULL);
-		chain->chain_thread = 0;
+	if (chain->chain_event) {
+		cmyth_event_unsubscribe(chain->chain_event);
+		ref_release(chain->chain_event);
+		chain->chain_event = NULL;
 	}
 
 	pthread_mutex_lock(&chain->chain_mutex);
@@ -55,7 +134,7 @@ cmyth_chain_destroy(cmyth_chain_t chain)
 	for (i=0; i<chain->chain_count; i++) {
 		cmyth_chain_entry_t entry;
 
-		if ((entry=chain->chain_list[i]) != NULL) {
+		if ((entry=chain->chain_list->entries[i]) != NULL) {
 			ref_release(entry->prog);
 			ref_release(entry->file);
 			entry->prog = NULL;
@@ -63,30 +142,18 @@ cmyth_chain_destroy(cmyth_chain_t chain)
 		}
 
 		ref_release(entry);
-
-		chain->chain_list[i] = NULL;
-	}
-
-	if (chain->chain_list) {
-		ref_release(chain->chain_list);
-		chain->chain_list = NULL;
-	}
-
-	if (chain->chain_thread_args) {
-		struct event_loop_args *data =
-			(struct event_loop_args*)chain->chain_thread_args;
-		ref_release(data);
-		chain->chain_thread_args = NULL;
 	}
+	chain->chain_count = 0;
 
-	if (chain->chain_thread_rec) {
-		ref_release(chain->chain_thread_rec);
-		chain->chain_thread_rec = NULL;
+	for (list=chain->chain_list; list; list=prev) {
+		prev = list->prev;
+		ref_release(list);
 	}
+	chain->chain_list = NULL;
 
-	if (chain->chain_event) {
-		ref_release(chain->chain_event);
-		chain->chain_event = NULL;
+	if (chain->chain_event_rec) {
+		ref_release(chain->chain_event_rec);
+		chain->chain_event_rec = NULL;
 	}
 
 	if (chain->chain_conn) {
@@ -102,9 +169,7 @@ cmyth_chain_t
 cmyth_chain_create(cmyth_recorder_t rec, char *chain_id)
 {
 	cmyth_chain_t chain;
-	struct event_loop_args *args;
-
-	args = ref_alloc(sizeof(*args));
+	unsigned long mask;
 
 	chain = ref_alloc(sizeof(*chain));
 
@@ -114,21 +179,25 @@ cmyth_chain_create(cmyth_recorder_t rec, char *chain_id)
 	chain->chain_list = NULL;
 	chain->chain_callback = NULL;
 	chain->chain_event = NULL;
-	chain->chain_thread = 0;
+	chain->chain_event_rec = NULL;
 	chain->chain_conn = ref_hold(rec->rec_conn);
+	chain->chain_rec_id = rec->rec_id;
 
 	pthread_mutex_init(&chain->chain_mutex, NULL);
 	pthread_cond_init(&chain->chain_cond, NULL);
 
 	ref_set_destroy(chain, (ref_destroy_t)cmyth_chain_destroy);
 
-	args->rec = ref_hold(rec);
-	args->chain = ref_hold(chain);
-
-	chain->chain_thread_args = (void*)args;
-
-	pthread_create(&chain->chain_thread, NULL,
-		       cmyth_chain_event_loop, (void*)args);
+	/*
+	 * The subscription does not hold the chain, or it would never be
+	 * destroyed.  Destroying it unsubscribes instead, and the callback
+	 * only holds the chain while it is live.
+	 */
+	mask = CMYTH_EVENT_MASK(CMYTH_EVENT_LIVETV_CHAIN_UPDATE);
+	chain->chain_event = cmyth_event_subscribe(rec->rec_server,
+						   rec->rec_port, mask,
+						   cmyth_chain_event,
+						   (void*)chain);
 
 	return chain;
 }
@@ -158,12 +227,13 @@ cmyth_chain_set_current(cmyth_chain_t chain, cmyth_proginfo_t prog)
 	pthread_mutex_lock(&chain->chain_mutex);
 
 	for (i=0; i<chain->chain_count; i++) {
-		if (cmyth_proginfo_compare(prog,
-					   chain->chain_list[i]->prog) == 0) {
-			chain->chain_current = i;
+		cmyth_chain_entry_t entry = chain->chain_list->entries[i];
+
+		if (cmyth_proginfo_compare(prog, entry->prog) == 0) {
+			cmyth_chain_set_index(chain, i);
 			callback = chain->chain_callback;
 			if (callback) {
-				cb_prog = ref_hold(chain->chain_list[i]->prog);
+				cb_prog = ref_hold(entry->prog);
 			}
 			break;
 		}
@@ -179,51 +249,93 @@ cmyth_chain_set_current(cmyth_chain_t chain, cmyth_proginfo_t prog)
 	return rc;
 }
 
+/*
+ * Open the file of 'prog' on a connection of its own to the backend which
+ * records it.  Returns -1 if the backend cannot be reached, and 0
+ * otherwise, with the file, if it could be opened, in 'filep'.
+ */
+static int
+cmyth_chain_open(cmyth_proginfo_t prog, cmyth_file_t *filep)
+{
+	cmyth_conn_t conn;
+	char *path, *title;
+
+	*filep = NULL;
+
+	conn = cmyth_conn_connect_ctrl(prog->proginfo_hostname,
+				       prog->proginfo_port,
+				       16*1024, 4096);
+	if (conn == NULL) {
+		return -1;
+	}
+
+	path = cmyth_proginfo_pathname(prog);
+	title = cmyth_proginfo_title(prog);
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s(): connect to file %s [%s]\n",
+		  __FUNCTION__, path, title);
+	ref_release(path);
+	ref_release(title);
+
+	*filep = cmyth_conn_connect_file(prog, conn, 128*1024, 128*1024);
+
+	ref_release(conn);
+
+	return 0;
+}
+
+/*
+ * Wait for the background open of 'entry' to finish.  Called with
+ * chain_mutex held.
+ */
+static void
+cmyth_chain_open_wait(cmyth_chain_t chain, cmyth_chain_entry_t entry)
+{
+	struct timespec to;
+
+	clock_gettime(CLOCK_REALTIME, &to);
+	to.tv_sec += CHAIN_PREOPEN_WAIT;
+
+	while (entry->opening && (entry->file == NULL)) {
+		if (pthread_cond_timedwait(&chain->chain_cond,
+					   &chain->chain_mutex,
+					   &to) == ETIMEDOUT) {
+			break;
+		}
+	}
+}
+
 int
 cmyth_chain_switch_to_locked(cmyth_chain_t chain, int index)
 {
 	int rc = -1;
 
 	if ((index >= 0) && (index < (int)chain->chain_count)) {
-		cmyth_conn_t conn;
+		cmyth_chain_entry_t entry = chain->chain_list->entries[index];
 		cmyth_file_t file;
-		cmyth_proginfo_t prog;
-		char *path, *title;
 
-		if (chain->chain_list[index]->file != NULL) {
-			chain->chain_current = index;
-			return 0;
+		if ((entry->file == NULL) && entry->opening) {
+			cmyth_chain_open_wait(chain, entry);
 		}
 
-		prog = chain->chain_list[index]->prog;
+		if (entry->file != NULL) {
+			cmyth_chain_set_index(chain, index);
+			return 0;
+		}
 
-		if (prog == NULL) {
+		if (entry->prog == NULL) {
 			return -1;
 		}
 
-		conn = cmyth_conn_connect_ctrl(prog->proginfo_hostname,
-					       prog->proginfo_port,
-					       16*1024, 4096);
-		if (conn == NULL) {
+		if (cmyth_chain_open(entry->prog, &file) < 0) {
 			return -1;
 		}
 
-		path = cmyth_proginfo_pathname(prog);
-		title = cmyth_proginfo_title(prog);
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s(): connect to file %s [%s]\n",
-			  __FUNCTION__, path, title);
-		ref_release(path);
-		ref_release(title);
-
-		file = cmyth_conn_connect_file(prog, conn, 128*1024, 128*1024);
-
 		if (file) {
-			chain->chain_current = index;
-			chain->chain_list[index]->file = file;
+			__sync_synchronize();
+			entry->file = file;
+			cmyth_chain_set_index(chain, index);
 		}
 
-		ref_release(conn);
-
 		rc = 0;
 	}
 
@@ -287,86 +399,62 @@ cmyth_chain_switch_last(cmyth_chain_t chain)
 int
 cmyth_chain_get_count(cmyth_chain_t chain)
 {
-	int count;
-
 	if (chain == NULL) {
 		return -1;
 	}
 
-	pthread_mutex_lock(&chain->chain_mutex);
-
-	count = chain->chain_count;
-
-	pthread_mutex_unlock(&chain->chain_mutex);
-
-	return count;
+	return chain->chain_count;
 }
 
 cmyth_file_t
 cmyth_chain_get_file(cmyth_chain_t chain, cmyth_proginfo_t prog)
 {
-	cmyth_file_t file = NULL;
-	unsigned int i;
+	cmyth_chain_entry_t entry;
+	int i;
 
 	if ((chain == NULL) || (prog == NULL)) {
 		return NULL;
 	}
 
-	pthread_mutex_lock(&chain->chain_mutex);
-
-	for (i=0; i<chain->chain_count; i++) {
-		if (cmyth_proginfo_compare(prog,
-					   chain->chain_list[i]->prog) == 0) {
-			file = ref_hold(chain->chain_list[i]->file);
-			break;
+	for (i=0; (entry=cmyth_chain_entry(chain, i)) != NULL; i++) {
+		if (cmyth_proginfo_compare(prog, entry->prog) == 0) {
+			return ref_hold(entry->file);
 		}
 	}
 
-	pthread_mutex_unlock(&chain->chain_mutex);
-
-	return file;
+	return NULL;
 }
 
 cmyth_proginfo_t
 cmyth_chain_get_prog(cmyth_chain_t chain, unsigned int which)
 {
-	cmyth_proginfo_t prog = NULL;
+	cmyth_chain_entry_t entry;
 
-	if (chain == NULL) {
+	if ((chain == NULL) || (which > INT_MAX)) {
 		return NULL;
 	}
 
-	pthread_mutex_lock(&chain->chain_mutex);
-
-	if (which < chain->chain_count) {
-		prog = chain->chain_list[which]->prog;
-		ref_hold(prog);
+	if ((entry=cmyth_chain_entry(chain, (int)which)) == NULL) {
+		return NULL;
 	}
 
-	pthread_mutex_unlock(&chain->chain_mutex);
-
-	return prog;
+	return ref_hold(entry->prog);
 }
 
 cmyth_proginfo_t
 cmyth_chain_get_current(cmyth_chain_t chain)
 {
-	cmyth_proginfo_t prog = NULL;
+	cmyth_chain_entry_t entry;
 
 	if (chain == NULL) {
 		return NULL;
 	}
 
-	pthread_mutex_lock(&chain->chain_mutex);
-
-	if (chain->chain_list) {
-		prog = chain->chain_list[chain->chain_current]->prog;
-		ref_hold(prog);
+	if ((entry=cmyth_chain_entry(chain, chain->chain_current)) == NULL) {
+		return NULL;
 	}
 
-	pthread_mutex_unlock(&chain->chain_mutex);
-
-	return prog;
+	return ref_hold(entry->prog);
 }
 
 int
@@ -395,22 +483,29 @@ cmyth_chain_set_callback(cmyth_chain_t chain,
 cmyth_file_t
 cmyth_chain_current_file(cmyth_chain_t chain)
 {
+	cmyth_chain_entry_t entry;
 	cmyth_file_t file = NULL;
 
 	if (chain == NULL) {
 		return NULL;
 	}
 
+	/*
+	 * This is called for every block, so the usual case of a file which
+	 * is already open takes no lock.
+	 */
+	if ((entry=cmyth_chain_entry(chain, chain->chain_current)) == NULL) {
+		return NULL;
+	}
+	if ((file=entry->file) != NULL) {
+		return ref_hold(file);
+	}
+
 	pthread_mutex_lock(&chain->chain_mutex);
 
-	if (chain->chain_list) {
-		file = chain->chain_list[chain->chain_current]->file;
-		if (file == NULL) {
-			cmyth_chain_switch_to_locked(chain,
-						     chain->chain_current);
-			file = chain->chain_list[chain->chain_current]->file;
-		}
-		ref_hold(file);
+	cmyth_chain_switch_to_locked(chain, chain->chain_current);
+	if ((entry=cmyth_chain_entry(chain, chain->chain_current)) != NULL) {
+		file = ref_hold(entry->file);
 	}
 
 	pthread_mutex_unlock(&chain->chain_mutex);
@@ -418,13 +513,97 @@ cmyth_chain_current_file(cmyth_chain_t chain)
 	return file;
 }
 
+/*
+ * Open the file of a new chain entry and read its first block, so that
+ * switching to it when the program before it ends costs no round trips.
+ * The first block is kept in the block buffer of the file, which means
+ * the file is read through the block cache (see cmyth_file_set_cache()),
+ * and that follows the growing end of the recording by itself.  If a
+ * switch got to the entry first, the file opened here is dropped.
+ */
+static void *
+cmyth_chain_preopen_thread(void *arg)
+{
+	struct cmyth_chain_preopen *po = (struct cmyth_chain_preopen*)arg;
+	cmyth_chain_t chain = po->chain;
+	cmyth_chain_entry_t entry = po->entry;
+	cmyth_file_t file = NULL;
+
+	free(po);
+
+	if ((cmyth_chain_open(entry->prog, &file) == 0) && file) {
+		if ((cmyth_file_set_cache(file, 1) == 0) &&
+		    (cmyth_file_request_block(file, CMYTH_CACHE_BLOCK) > 0)) {
+			cmyth_file_seek(file, 0, SEEK_SET);
+		}
+	}
+
+	pthread_mutex_lock(&chain->chain_mutex);
+
+	if (file && (entry->file == NULL)) {
+		__sync_synchronize();
+		entry->file = file;
+		file = NULL;
+	}
+	entry->opening = 0;
+	pthread_cond_broadcast(&chain->chain_cond);
+
+	pthread_mutex_unlock(&chain->chain_mutex);
+
+	ref_release(file);
+	ref_release(entry);
+	ref_release(chain);
+
+	return NULL;
+}
+
+/*
+ * Start opening the file of 'entry' in the background.  The entry was
+ * marked as opening when it was added, and is unmarked again here if no
+ * thread can be started.
+ */
+static void
+cmyth_chain_preopen(cmyth_chain_t chain, cmyth_chain_entry_t entry)
+{
+	struct cmyth_chain_preopen *po;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int err = ENOMEM;
+
+	if ((po = malloc(sizeof(*po))) != NULL) {
+		po->chain = ref_hold(chain);
+		po->entry = ref_hold(entry);
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		err = pthread_create(&thread, &attr,
+				     cmyth_chain_preopen_thread, po);
+		pthread_attr_destroy(&attr);
+
+		if (err != 0) {
+			ref_release(po->entry);
+			ref_release(po->chain);
+			free(po);
+		}
+	}
+
+	if (err != 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: pthread_create() failed (%d)\n",
+			  __FUNCTION__, err);
+		pthread_mutex_lock(&chain->chain_mutex);
+		entry->opening = 0;
+		pthread_cond_broadcast(&chain->chain_cond);
+		pthread_mutex_unlock(&chain->chain_mutex);
+	}
+}
+
 static void
 cmyth_chain_update(cmyth_chain_t chain, cmyth_recorder_t rec, char *msg)
 {
 	char *p;
 	cmyth_proginfo_t prog = NULL;
-	cmyth_chain_entry_t entry;
-	int size, tip;
+	cmyth_chain_entry_t entry, preopen = NULL;
+	int tip;
 	long long offset;
 	int start = 0;
 	char *path;
@@ -467,33 +646,44 @@ cmyth_chain_update(cmyth_chain_t chain, cmyth_recorder_t rec, char *msg)
 	tip = chain->chain_count - 1;
 
 	if (tip >= 0) {
-		path = cmyth_proginfo_pathname(chain->chain_list[tip]->prog);
-		ref_release(path);
+		entry = chain->chain_list->entries[tip];
 
-		if (cmyth_proginfo_compare(prog,
-					   chain->chain_list[tip]->prog) == 0) {
+		if (cmyth_proginfo_compare(prog, entry->prog) == 0) {
 			ref_release(prog);
 			goto out;
 		}
 
-		offset = chain->chain_list[tip]->offset +
-			cmyth_proginfo_length(chain->chain_list[tip]->prog);
+		offset = entry->offset + cmyth_proginfo_length(entry->prog);
 	} else {
 		offset = 0;
 		start = 1;
 	}
 
-	size = sizeof(*chain->chain_list) * (++chain->chain_count);
-
-	chain->chain_list = ref_realloc(chain->chain_list, size);
-
 	entry = ref_alloc(sizeof(*entry));
 
 	entry->prog = prog;
 	entry->file = NULL;
 	entry->offset = offset;
+	entry->opening = !start;
 
-	chain->chain_list[tip+1] = entry;
+	if (cmyth_chain_append(chain, entry) < 0) {
+		ref_release(prog);
+		ref_release(entry);
+		start = 0;
+		goto out;
+	}
+
+	/*
+	 * The first entry is switched to right away, and is current even if
+	 * its file cannot be opened yet, so that reading retries the open.
+	 * Any later one is where live TV goes when the current program
+	 * ends, so get its file ready now.
+	 */
+	if (start) {
+		cmyth_chain_set_index(chain, 0);
+	} else {
+		preopen = ref_hold(entry);
+	}
 
 	pthread_cond_broadcast(&chain->chain_cond);
 
@@ -501,63 +691,68 @@ out:
 	pthread_mutex_unlock(&chain->chain_mutex);
 
 	if (start) {
-		chain->chain_current = 0;
-		cmyth_chain_switch(chain, 0);
+		cmyth_chain_switch_to(chain, 0);
+	}
+	if (preopen) {
+		cmyth_chain_preopen(chain, preopen);
+		ref_release(preopen);
 	}
 }
 
-static void*
-cmyth_chain_event_loop(void *data)
+/*
+ * Called by the event dispatcher with each LIVETV_CHAIN_UPDATE event of
+ * the backend, which may be for the chain of another recorder.  The
+ * recorder used to look up the new program is a separate handle, since
+ * the recorder of the chain holds the chain.
+ *
+ * The subscription does not hold the chain, so its last reference may
+ * be dropped while this runs.  Its destroy function then waits in
+ * cmyth_event_unsubscribe() until this returns, which keeps the memory
+ * valid, but the chain must not be held again, or the background open
+ * would outlive it.  A hold is only taken while the chain is still live.
+ */
+static void
+cmyth_chain_event(cmyth_event_sub_t sub, cmyth_eventinfo_t ev, void *data)
 {
-	int oldstate;
-	struct event_loop_args *args = (struct event_loop_args*)data;
-	cmyth_chain_t chain = args->chain;
-	cmyth_recorder_t rec = args->rec;
-	cmyth_recorder_t new_rec;
-
-	cmyth_dbg(CMYTH_DBG_DEBUG, "%s(): thread started!\n", __FUNCTION__);
-
-	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
-
-	chain->chain_event = cmyth_conn_connect_event(rec->rec_server,
-						      rec->rec_port,
-						      16*1024, 4096);
+	cmyth_chain_t chain;
+	char buf[256];
+	char *id;
 
-	if (chain->chain_event == NULL) {
-		return NULL;
+	if (cmyth_eventinfo_type(ev) != CMYTH_EVENT_LIVETV_CHAIN_UPDATE) {
+		return;
 	}
 
-	new_rec = cmyth_conn_get_recorder(rec->rec_conn, rec->rec_id);
-
-	chain->chain_thread_rec = new_rec;
-
-	ref_release(chain);
-	ref_release(rec);
-
-	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldstate);
-
-	while (1) {
-		cmyth_event_t next;
-		char buf[256];
+	if ((chain = ref_hold_live(data)) == NULL) {
+		return;
+	}
 
-		next = cmyth_event_get(chain->chain_event, buf, sizeof(buf));
+	if ((id=cmyth_eventinfo_data(ev)) == NULL) {
+		ref_release(chain);
+		return;
+	}
+	if (!chain->chain_id ||
+	    (strncmp(id, chain->chain_id, strlen(id)) != 0)) {
+		ref_release(id);
+		ref_release(chain);
+		return;
+	}
 
-		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s(): chain update %s\n", __FUNCTION__, id);
 
-		switch (next) {
-		case CMYTH_EVENT_LIVETV_CHAIN_UPDATE:
-			cmyth_dbg(CMYTH_DBG_DEBUG,
-				  "%s(): chain update %s\n", __FUNCTION__, buf);
-			cmyth_chain_update(chain, new_rec, buf);
-			break;
-		default:
-			break;
-		}
+	strncpy(buf, id, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	ref_release(id);
 
-		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldstate);
+	if (chain->chain_event_rec == NULL) {
+		chain->chain_event_rec =
+			cmyth_conn_get_recorder(chain->chain_conn,
+						chain->chain_rec_id);
+	}
+	if (chain->chain_event_rec) {
+		cmyth_chain_update(chain, chain->chain_event_rec, buf);
 	}
 
-	return NULL;
+	ref_release(chain);
 }
 
 void
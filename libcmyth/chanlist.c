@@ -119,3 +119,269 @@ cmyth_chanlist_add(cmyth_chanlist_t list, cmyth_channel_t channel)
 
 	return 0;
 }
+
+/*
+ * Channel lists are cached, so that each recorder object does not walk
+ * the program guide again.  A list is kept for each backend and video
+ * source, or for each recorder when its source is not known, which is
+ * marked by a negative source.  Cached lists are never changed, so they
+ * are shared by every recorder using the source.
+ */
+#define CHANLIST_CACHE_SIZE	16
+#define CHANLIST_CACHE_HOST	64
+#define CHANLIST_CACHE_TTL	300	/* seconds */
+
+struct chanlist_entry {
+	char ce_host[CHANLIST_CACHE_HOST];
+	int ce_port;
+	long ce_source;
+	time_t ce_time;
+	cmyth_chanlist_t ce_list;
+};
+
+static pthread_mutex_t chanlist_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct chanlist_entry chanlist_cache[CHANLIST_CACHE_SIZE];
+static int chanlist_ttl = CHANLIST_CACHE_TTL;
+#if defined(HAS_MYSQL)
+static cmyth_database_t chanlist_db;
+#endif
+
+static struct chanlist_entry *
+chanlist_find(const char *host, int port, long source)
+{
+	int i;
+
+	for (i = 0; i < CHANLIST_CACHE_SIZE; i++) {
+		struct chanlist_entry *ce = &chanlist_cache[i];
+
+		if (ce->ce_list && (ce->ce_port == port) &&
+		    (ce->ce_source == source) &&
+		    (strcmp(ce->ce_host, host) == 0)) {
+			return ce;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * cmyth_chanlist_cache_get(const char *host, int port, long source)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_chanlist_cache_get)
+ *
+ * Description
+ *
+ * Look up the cached channel list of the video source 'source' of the
+ * backend at 'host' and 'port'.  Lists older than the cache lifetime are
+ * dropped.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_chanlist_t
+ *
+ * Failure: NULL, if no list is cached
+ */
+cmyth_chanlist_t
+cmyth_chanlist_cache_get(const char *host, int port, long source)
+{
+	struct chanlist_entry *ce;
+	cmyth_chanlist_t list = NULL;
+	cmyth_chanlist_t stale = NULL;
+
+	if (!host) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&chanlist_mutex);
+
+	if ((ce=chanlist_find(host, port, source)) != NULL) {
+		if (time(NULL) - ce->ce_time < chanlist_ttl) {
+			list = ref_hold(ce->ce_list);
+		} else {
+			stale = ce->ce_list;
+			ce->ce_list = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&chanlist_mutex);
+
+	ref_release(stale);
+
+	return list;
+}
+
+/*
+ * cmyth_chanlist_cache_put(const char *host, int port, long source,
+ *                          cmyth_chanlist_t list)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_chanlist_cache_put)
+ *
+ * Description
+ *
+ * Cache the channel list 'list' of the video source 'source' of the
+ * backend at 'host' and 'port', replacing the oldest list if the cache
+ * is full.  The list must not be changed afterwards.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_chanlist_cache_put(const char *host, int port, long source,
+			 cmyth_chanlist_t list)
+{
+	struct chanlist_entry *ce;
+	cmyth_chanlist_t old;
+	int i;
+
+	if (!host || !list || (strlen(host) >= CHANLIST_CACHE_HOST)) {
+		return;
+	}
+
+	pthread_mutex_lock(&chanlist_mutex);
+
+	if (chanlist_ttl <= 0) {
+		pthread_mutex_unlock(&chanlist_mutex);
+		return;
+	}
+
+	if ((ce=chanlist_find(host, port, source)) == NULL) {
+		ce = &chanlist_cache[0];
+		for (i = 0; i < CHANLIST_CACHE_SIZE; i++) {
+			if (chanlist_cache[i].ce_list == NULL) {
+				ce = &chanlist_cache[i];
+				break;
+			}
+			if (chanlist_cache[i].ce_time < ce->ce_time) {
+				ce = &chanlist_cache[i];
+			}
+		}
+	}
+
+	old = ce->ce_list;
+	strcpy(ce->ce_host, host);
+	ce->ce_port = port;
+	ce->ce_source = source;
+	ce->ce_time = time(NULL);
+	ce->ce_list = ref_hold(list);
+
+	pthread_mutex_unlock(&chanlist_mutex);
+
+	ref_release(old);
+}
+
+/*
+ * cmyth_chanlist_cache_ttl(int seconds)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Set how many seconds a channel list is kept in the cache.  Zero turns
+ * the cache off and empties it.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_chanlist_cache_ttl(int seconds)
+{
+	pthread_mutex_lock(&chanlist_mutex);
+	chanlist_ttl = seconds;
+	pthread_mutex_unlock(&chanlist_mutex);
+
+	if (seconds <= 0) {
+		cmyth_chanlist_cache_flush();
+	}
+}
+
+/*
+ * cmyth_chanlist_cache_flush(void)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Empty the channel list cache, so that the next recorder created walks
+ * the program guide again, for instance after channels were changed.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_chanlist_cache_flush(void)
+{
+	cmyth_chanlist_t old[CHANLIST_CACHE_SIZE];
+	int i;
+
+	pthread_mutex_lock(&chanlist_mutex);
+	for (i = 0; i < CHANLIST_CACHE_SIZE; i++) {
+		old[i] = chanlist_cache[i].ce_list;
+		chanlist_cache[i].ce_list = NULL;
+	}
+	pthread_mutex_unlock(&chanlist_mutex);
+
+	for (i = 0; i < CHANLIST_CACHE_SIZE; i++) {
+		ref_release(old[i]);
+	}
+}
+
+#if defined(HAS_MYSQL)
+/*
+ * cmyth_chanlist_set_database(cmyth_database_t db)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Use the database 'db' to build the channel lists of new recorders,
+ * with one query instead of a round trip to the backend per channel.
+ * The lists are then shared by all the recorders on the same video
+ * source.  If 'db' is NULL the program guide is walked again.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_chanlist_set_database(cmyth_database_t db)
+{
+	cmyth_database_t old;
+
+	pthread_mutex_lock(&chanlist_mutex);
+	old = chanlist_db;
+	chanlist_db = ref_hold(db);
+	pthread_mutex_unlock(&chanlist_mutex);
+
+	ref_release(old);
+}
+
+/*
+ * cmyth_chanlist_get_database(void)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_chanlist_get_database)
+ *
+ * Description
+ *
+ * Retrieve the database set with cmyth_chanlist_set_database().
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_database_t
+ *
+ * Failure: NULL, if there is none
+ */
+cmyth_database_t
+cmyth_chanlist_get_database(void)
+{
+	cmyth_database_t db;
+
+	pthread_mutex_lock(&chanlist_mutex);
+	db = ref_hold(chanlist_db);
+	pthread_mutex_unlock(&chanlist_mutex);
+
+	return db;
+}
+#endif /* HAS_MYSQL */
@@ -96,6 +96,30 @@ typedef int cmyth_socket_t;
 #define CMYTH_COMMBREAK_END 5
 #define CMYTH_CUTLIST_START 1
 #define CMYTH_CUTLIST_END 0
+#define CMYTH_MARK_GOP_BYFRAME 9
+#define CMYTH_MARK_DURATION_MS 33
+#define CMYTH_CACHE_BLOCK (128 * 1024)
+#define CMYTH_IO_HANG_TIMEOUT 10000
+#define CMYTH_IO_CONNECT_TIMEOUT 5000
+#define CMYTH_IO_CONNECT_STAGGER 250
+
+/**
+ * Block size controller of a data connection, see tune.c
+ */
+struct cmyth_tune {
+	pthread_mutex_t	tune_mutex;
+	unsigned long	tune_block;	/**< bytes per request */
+	unsigned long	tune_ceiling;	/**< block that did not pay off */
+	int		tune_probe;	/**< windows until it is tried again */
+	int		tune_grew;	/**< block was doubled last window */
+	int		tune_limited;	/**< window had short requests */
+	int		tune_latency;	/**< smoothed ms from request to reply */
+	int		tune_count;	/**< requests in this window */
+	long long	tune_bytes;	/**< bytes in this window */
+	long long	tune_start;	/**< cmyth_io_now() at window start */
+	long long	tune_last;	/**< cmyth_io_now() at last reply */
+	long long	tune_rate;	/**< bytes/s of the last window */
+};
 
 /**
  * MythTV backend connection
@@ -112,6 +136,35 @@ struct cmyth_conn {
 	pthread_mutex_t conn_mutex;
 	int		conn_port;
 	char		*conn_server;
+	int		conn_timeout;	/**< ms until conn_hang is set */
+	int		conn_deadline;	/**< ms until a wait fails, 0 never */
+	int		conn_pipeline;	/**< max requests in flight */
+	struct cmyth_request_queue *conn_requests; /**< async requests */
+	struct cmyth_tune conn_tune;	/**< block size controller */
+};
+
+/**
+ * Receive the 'count' byte response to a request, setting req_status and
+ * req_result.  Returns the number of bytes left unconsumed, or -errno.
+ */
+typedef int (*cmyth_request_rcv_t)(cmyth_conn_t conn, cmyth_request_t req,
+				   int count);
+
+/**
+ * Asynchronous control command
+ */
+struct cmyth_request {
+	cmyth_request_t	req_next;	/**< next in queue or pipeline */
+	struct cmyth_request_queue *req_queue;
+	cmyth_conn_t	req_conn;	/**< held connection */
+	char		*req_msg;	/**< command to send */
+	cmyth_request_rcv_t req_rcv;	/**< response parser */
+	void		*req_arg;	/**< held argument for req_rcv */
+	void		*req_result;	/**< held result */
+	int		req_status;	/**< result >= 0, or -errno */
+	int		req_done;	/**< completed? */
+	cmyth_request_callback_t req_callback;
+	void		*req_data;	/**< callback data */
 };
 
 /* Sergio: Added to support new livetv protocol */
@@ -139,23 +192,40 @@ struct cmyth_database {
 
 typedef struct cmyth_chain_entry {
 	cmyth_proginfo_t prog;
-	cmyth_file_t file;
+	cmyth_file_t volatile file;	/* set once, when opened */
 	long long offset;
+	int opening;			/* being opened in the background */
 } *cmyth_chain_entry_t ;
 
+/*
+ * The entries of a chain.  Published slots are never changed.  When the
+ * array is full a bigger copy replaces it, and the old one is kept on
+ * the prev list until the chain is destroyed, since readers may still be
+ * looking at it.
+ */
+struct cmyth_chain_list {
+	struct cmyth_chain_list *prev;
+	unsigned int size;
+	cmyth_chain_entry_t *entries;
+};
+
+/*
+ * chain_mutex serializes the changes to a chain.  Readers take no lock:
+ * chain_list and chain_count only grow, and an entry is filled in before
+ * chain_count is raised past it.
+ */
 struct cmyth_chain {
 	char *chain_id;
-	unsigned int chain_count;
-	int chain_current;
-	cmyth_chain_entry_t *chain_list;
+	volatile unsigned int chain_count;
+	volatile int chain_current;
+	struct cmyth_chain_list * volatile chain_list;
 	void (*chain_callback)(cmyth_proginfo_t prog);
 	pthread_mutex_t chain_mutex;
 	pthread_cond_t chain_cond;
-	pthread_t chain_thread;
-	cmyth_conn_t chain_event;
+	cmyth_event_sub_t chain_event;
 	cmyth_conn_t chain_conn;
-	void *chain_thread_args;
-	cmyth_recorder_t chain_thread_rec;
+	unsigned chain_rec_id;
+	cmyth_recorder_t chain_event_rec;	/* used by chain_event only */
 };
 
 struct cmyth_channel {
@@ -195,6 +265,10 @@ struct cmyth_file {
 	uint64_t file_length;	/**< file length */
 	uint64_t file_pos;	/**< current file position */
 	cmyth_conn_t file_control;	/**< master backend connection */
+	struct cmyth_file_readahead *file_ra;	/**< read-ahead state */
+	char *file_path;	/**< interned pathname, the cache key */
+	char *file_host;	/**< interned host, the cache key */
+	struct cmyth_file_cache *file_cache;	/**< block cache state */
 };
 
 struct cmyth_ringbuf {
@@ -216,12 +290,74 @@ struct cmyth_keyframe {
 
 typedef struct cmyth_keyframe *cmyth_keyframe_t;
 
+/*
+ * A position map index is a list of (key, value) pairs with ascending
+ * keys, stored in blocks of CMYTH_POSMAP_BLOCK entries.  The first pair
+ * of each block is kept whole so that the blocks can be found by binary
+ * search on either the key or the value.  The remaining pairs of a block
+ * are kept as variable length deltas from the previous pair in
+ * 'pi_data'.
+ */
+#define CMYTH_POSMAP_BLOCK 64
+
+struct cmyth_posmap_index {
+	unsigned long	pi_count;	/**< number of pairs */
+	unsigned long	pi_blocks;	/**< number of blocks */
+	unsigned long	pi_max;		/**< allocated blocks */
+	int64_t		*pi_key;	/**< first key of each block */
+	int64_t		*pi_val;	/**< first value of each block */
+	uint32_t	*pi_off;	/**< start of each block in pi_data */
+	unsigned char	*pi_data;	/**< encoded deltas */
+	uint32_t	pi_len;		/**< bytes used in pi_data */
+	uint32_t	pi_size;	/**< bytes allocated for pi_data */
+	int64_t		pi_last_key;	/**< last key added */
+	int64_t		pi_last_val;	/**< last value added */
+};
+
 struct cmyth_posmap {
-	unsigned int posmap_count;
-	struct cmyth_keyframe **posmap_list;
+	struct cmyth_posmap_index posmap_pos;	/**< keyframe to offset */
+	struct cmyth_posmap_index posmap_dur;	/**< keyframe to msec */
 };
 
-typedef struct cmyth_posmap *cmyth_posmap_t;
+/*
+ * A shared live TV ring is a POSIX shared memory object holding a
+ * 'struct cmyth_shmlive_hdr' in its first page, followed by 'sh_size'
+ * bytes of stream data.  The publisher is the only writer.  'sh_head'
+ * counts every byte ever written, so the data at stream position 'pos'
+ * lives at 'pos % sh_size'.  'sh_seq' is odd while 'sh_head' is being
+ * changed, so that readers on 32 bit hosts never see a torn value, and
+ * is also what readers sleep on.  Readers keep their positions to
+ * themselves, which lets them map the object read-only.
+ */
+#define CMYTH_SHMLIVE_MAGIC	0x636d796cU
+#define CMYTH_SHMLIVE_VERSION	1
+#define CMYTH_SHMLIVE_HDR	4096
+
+struct cmyth_shmlive_hdr {
+	uint32_t		sh_magic;	/**< CMYTH_SHMLIVE_MAGIC */
+	uint32_t		sh_version;	/**< CMYTH_SHMLIVE_VERSION */
+	uint64_t		sh_size;	/**< bytes of ring data */
+	uint64_t		sh_chunk;	/**< largest single write */
+	volatile uint64_t	sh_head;	/**< bytes written so far */
+	volatile uint32_t	sh_seq;		/**< odd while head changes */
+	volatile uint32_t	sh_state;	/**< non-zero once ended */
+	int32_t			sh_pid;		/**< publishing process */
+};
+
+struct cmyth_shmlive {
+	char			*sl_name;	/**< shared memory name */
+	int			sl_writer;	/**< publisher handle */
+	struct cmyth_shmlive_hdr *sl_hdr;	/**< mapped header */
+	char			*sl_data;	/**< mapped ring data */
+	size_t			sl_maplen;	/**< length of the mapping */
+	uint64_t		sl_size;	/**< copy of sh_size */
+	uint64_t		sl_chunk;	/**< copy of sh_chunk */
+	uint64_t		sl_pos;		/**< reader position */
+	cmyth_recorder_t	sl_rec;		/**< publisher source */
+	pthread_t		sl_thread;	/**< publisher thread */
+	volatile int		sl_stop;	/**< stop the publisher */
+	int			sl_running;	/**< sl_thread was started */
+};
 
 struct cmyth_freespace {
 	uint64_t freespace_total;
@@ -308,6 +444,71 @@ struct cmyth_proglist {
 	pthread_mutex_t proglist_mutex;
 };
 
+struct cmyth_eventinfo {
+	cmyth_event_t ev_type;
+	char *ev_data;			/* rest of the message */
+	cmyth_proginfo_t ev_proginfo;
+	int ev_nvalues;
+	char **ev_names;		/* named values, e.g. signal monitor */
+	char **ev_values;
+};
+
+#define CMYTH_EVENT_QUEUE_SIZE 64
+
+struct cmyth_event_sub {
+	struct event_bus *sub_bus;
+	struct cmyth_event_sub *sub_next;
+	volatile int sub_active;
+	unsigned long sub_mask;
+	cmyth_event_callback_t sub_callback;
+	void *sub_data;
+	/* ring written by the dispatcher, read by the subscriber */
+	cmyth_eventinfo_t sub_queue[CMYTH_EVENT_QUEUE_SIZE];
+	volatile unsigned int sub_head;
+	volatile unsigned int sub_tail;
+	volatile int sub_lost;		/* events dropped since the ring filled */
+	volatile int sub_waiting;	/* reader is asleep on sub_cond */
+	pthread_mutex_t sub_mutex;
+	pthread_cond_t sub_cond;
+};
+
+struct cmyth_reclist {
+	pthread_mutex_t rl_mutex;	/* protects rl_version and rl_stale */
+	pthread_mutex_t rl_fetch_mutex;	/* serializes changes to the list */
+	cmyth_conn_t rl_control;
+	cmyth_event_sub_t rl_event;
+	cmyth_proglist_t rl_list;
+	unsigned long rl_version;
+	unsigned long rl_conn;		/* event connection the list follows */
+	int rl_stale;			/* events may have been missed */
+	cmyth_reclist_callback_t rl_callback;
+	void *rl_data;
+};
+
+/**
+ * A token within a received protocol message
+ */
+struct cmyth_token {
+	int tok_off;			/**< offset of the token in msg_buf */
+	int tok_len;			/**< length of the token */
+};
+
+/**
+ * A complete protocol message, received in one buffer and split into
+ * tokens in place.
+ */
+struct cmyth_msg {
+	char		*msg_buf;	/**< message payload */
+	int		msg_len;	/**< payload length */
+	struct cmyth_token *msg_tokens;	/**< token slices of msg_buf */
+	int		msg_count;	/**< number of tokens */
+	int		msg_max;	/**< allocated size of msg_tokens */
+	int		msg_next;	/**< next token to be consumed */
+	unsigned long	msg_version;	/**< protocol version */
+};
+
+typedef struct cmyth_msg *cmyth_msg_t;
+
 /*
  * Private funtions in socket.c
  */
@@ -394,6 +595,9 @@ extern int cmyth_rcv_proginfo(cmyth_conn_t conn, int *err,
 			      cmyth_proginfo_t buf,
 			      int count);
 
+#define cmyth_msg_proginfo __cmyth_msg_proginfo
+extern int cmyth_msg_proginfo(cmyth_msg_t msg, cmyth_proginfo_t buf);
+
 #define cmyth_rcv_chaninfo __cmyth_rcv_chaninfo
 extern int cmyth_rcv_chaninfo(cmyth_conn_t conn, int *err,
 			      cmyth_proginfo_t buf,
@@ -423,15 +627,185 @@ extern int cmyth_rcv_recorder(cmyth_conn_t conn, int *err,
 extern int cmyth_rcv_ringbuf(cmyth_conn_t conn, int *err, cmyth_ringbuf_t buf,
 			     int count);
 
+/*
+ * Private funtions in message.c
+ */
+#define cmyth_rcv_msg __cmyth_rcv_msg
+extern cmyth_msg_t cmyth_rcv_msg(cmyth_conn_t conn, int *err, int count);
+
+#define cmyth_msg_remaining __cmyth_msg_remaining
+extern int cmyth_msg_remaining(cmyth_msg_t msg);
+
+#define cmyth_msg_string __cmyth_msg_string
+extern char *cmyth_msg_string(cmyth_msg_t msg);
+
+#define cmyth_msg_long __cmyth_msg_long
+extern int cmyth_msg_long(cmyth_msg_t msg, long *buf);
+
+#define cmyth_msg_ulong __cmyth_msg_ulong
+extern int cmyth_msg_ulong(cmyth_msg_t msg, unsigned long *buf);
+
+#define cmyth_msg_ushort __cmyth_msg_ushort
+extern int cmyth_msg_ushort(cmyth_msg_t msg, unsigned short *buf);
+
+#define cmyth_msg_int64 __cmyth_msg_int64
+extern int cmyth_msg_int64(cmyth_msg_t msg, int64_t *buf, int forced);
+
+#define cmyth_msg_timestamp __cmyth_msg_timestamp
+extern int cmyth_msg_timestamp(cmyth_msg_t msg, cmyth_timestamp_t ts);
+
+#define cmyth_msg_datetime __cmyth_msg_datetime
+extern int cmyth_msg_datetime(cmyth_msg_t msg, cmyth_timestamp_t ts);
+
+/*
+ * From io.c
+ */
+#define CMYTH_IO_POLL_MAX 8
+
+#define CMYTH_IO_READ		1	/* socket is readable */
+#define CMYTH_IO_WRITE		2	/* socket is writable */
+
+struct cmyth_io_fd {
+	cmyth_socket_t fd;
+	int events;		/* CMYTH_IO_READ and/or CMYTH_IO_WRITE */
+	int ready;		/* set by cmyth_io_poll() */
+};
+
+#define cmyth_io_now __cmyth_io_now
+extern long long cmyth_io_now(void);
+
+#define cmyth_io_poll __cmyth_io_poll
+extern int cmyth_io_poll(struct cmyth_io_fd *fds, int nfds, int timeout);
+
+#define cmyth_io_wait __cmyth_io_wait
+extern int cmyth_io_wait(cmyth_socket_t fd, int events, int timeout);
+
+#define cmyth_conn_wait __cmyth_conn_wait
+extern int cmyth_conn_wait(cmyth_conn_t conn, int events);
+
+#define cmyth_io_timeval __cmyth_io_timeval
+extern int cmyth_io_timeval(struct timeval *tv);
+
+struct cmyth_addr {
+	struct sockaddr_storage addr;
+	socklen_t len;
+};
+
+#define cmyth_io_connect __cmyth_io_connect
+extern int cmyth_io_connect(struct cmyth_addr *addrs, int naddrs,
+			    int tcp_rcvbuf, int timeout, cmyth_socket_t *fdp);
+
+/*
+ * From resolve.c
+ */
+#define cmyth_resolve __cmyth_resolve
+extern int cmyth_resolve(const char *host, unsigned short port,
+			 struct cmyth_addr *addrs, int max);
+
+/*
+ * From tune.c
+ */
+#define cmyth_tune_init __cmyth_tune_init
+extern void cmyth_tune_init(cmyth_conn_t conn);
+
+#define cmyth_tune_block __cmyth_tune_block
+extern unsigned long cmyth_tune_block(cmyth_conn_t conn, unsigned long len,
+				      int streamed);
+
+#define cmyth_tune_sample __cmyth_tune_sample
+extern void cmyth_tune_sample(cmyth_conn_t conn, unsigned long asked,
+			      long got, long long sent);
+
+#define cmyth_tune_get_stats __cmyth_tune_get_stats
+extern void cmyth_tune_get_stats(cmyth_conn_t conn, unsigned long *block,
+				 int *rcvbuf, unsigned long long *rate,
+				 int *latency);
+
+/*
+ * From request.c
+ */
+#define cmyth_request_submit __cmyth_request_submit
+extern cmyth_request_t cmyth_request_submit(cmyth_conn_t conn, char *msg,
+					    cmyth_request_rcv_t rcv, void *arg,
+					    cmyth_request_callback_t callback,
+					    void *data);
+
+#define cmyth_request_queue_stop __cmyth_request_queue_stop
+extern void cmyth_request_queue_stop(cmyth_conn_t conn);
+
+/*
+ * From protocache.c
+ */
+#define cmyth_version_get __cmyth_version_get
+extern unsigned long cmyth_version_get(const char *host, unsigned short port);
+
+#define cmyth_version_put __cmyth_version_put
+extern void cmyth_version_put(const char *host, unsigned short port,
+			      unsigned long version);
+
+/*
+ * From cache.c
+ */
+#define cmyth_cache_get __cmyth_cache_get
+extern int cmyth_cache_get(char *path, char *host, uint64_t index, char *buf);
+
+#define cmyth_cache_put __cmyth_cache_put
+extern void cmyth_cache_put(char *path, char *host, uint64_t index, char *buf);
+
 /*
  * From proginfo.c
  */
+#define cmyth_proginfo_alloc __cmyth_proginfo_alloc
+extern cmyth_proginfo_t cmyth_proginfo_alloc(void);
+
+#define cmyth_proginfo_dup __cmyth_proginfo_dup
+extern cmyth_proginfo_t cmyth_proginfo_dup(cmyth_proginfo_t p);
+
 #define cmyth_proginfo_string __cmyth_proginfo_string
 extern char *cmyth_proginfo_string(cmyth_proginfo_t prog);
 
 #define cmyth_chaninfo_string __cmyth_chaninfo_string
 extern char *cmyth_chaninfo_string(cmyth_proginfo_t prog);
 
+/*
+ * From commbreak.c
+ */
+#define cmyth_commbreaklist_add __cmyth_commbreaklist_add
+extern int cmyth_commbreaklist_add(cmyth_commbreaklist_t cbl,
+				   cmyth_commbreak_t cb);
+
+/*
+ * From event.c
+ */
+#define cmyth_eventinfo_create __cmyth_eventinfo_create
+extern cmyth_eventinfo_t cmyth_eventinfo_create(cmyth_event_t type);
+
+/*
+ * From posmap.c
+ */
+#define cmyth_posmap_create __cmyth_posmap_create
+extern cmyth_posmap_t cmyth_posmap_create(void);
+
+#define cmyth_posmap_add __cmyth_posmap_add
+extern int cmyth_posmap_add(cmyth_posmap_t pm, int duration,
+			    int64_t frame, int64_t value);
+
+/*
+ * From shmlive.c
+ */
+#define cmyth_shmlive_create __cmyth_shmlive_create
+extern cmyth_shmlive_t cmyth_shmlive_create(const char *name,
+					    unsigned long size);
+
+#define cmyth_shmlive_reserve __cmyth_shmlive_reserve
+extern long cmyth_shmlive_reserve(cmyth_shmlive_t sl, char **data);
+
+#define cmyth_shmlive_commit __cmyth_shmlive_commit
+extern int cmyth_shmlive_commit(cmyth_shmlive_t sl, unsigned long len);
+
+#define cmyth_shmlive_end __cmyth_shmlive_end
+extern void cmyth_shmlive_end(cmyth_shmlive_t sl);
+
 /*
  * From file.c
  */
@@ -444,6 +818,12 @@ extern cmyth_file_t cmyth_file_create(cmyth_conn_t control);
 #define cmyth_timestamp_diff __cmyth_timestamp_diff
 extern int cmyth_timestamp_diff(cmyth_timestamp_t, cmyth_timestamp_t);
 
+#define cmyth_timestamp_set_string __cmyth_timestamp_set_string
+extern int cmyth_timestamp_set_string(cmyth_timestamp_t ts, char *str);
+
+#define cmyth_timestamp_set_unixtime __cmyth_timestamp_set_unixtime
+extern void cmyth_timestamp_set_unixtime(cmyth_timestamp_t ts, time_t l);
+
 #if defined(HAS_MYSQL)
 /*
  * From mythtv_mysql.c
@@ -451,6 +831,9 @@ extern int cmyth_timestamp_diff(cmyth_timestamp_t, cmyth_timestamp_t);
 
 extern MYSQL * cmyth_db_get_connection(cmyth_database_t db);
 
+#define cmyth_mysql_get_card_source __cmyth_mysql_get_card_source
+extern long cmyth_mysql_get_card_source(cmyth_database_t db, int cardid);
+
 
 /*
  * From mysql_query.c
@@ -487,6 +870,19 @@ extern int cmyth_recorder_add_chanlist(cmyth_recorder_t rec);
 extern cmyth_chanlist_t cmyth_chanlist_create(void);
 extern int cmyth_chanlist_add(cmyth_chanlist_t list, cmyth_channel_t channel);
 
+#define cmyth_chanlist_cache_get __cmyth_chanlist_cache_get
+extern cmyth_chanlist_t cmyth_chanlist_cache_get(const char *host, int port,
+						 long source);
+
+#define cmyth_chanlist_cache_put __cmyth_chanlist_cache_put
+extern void cmyth_chanlist_cache_put(const char *host, int port, long source,
+				     cmyth_chanlist_t list);
+
+#if defined(HAS_MYSQL)
+#define cmyth_chanlist_get_database __cmyth_chanlist_get_database
+extern cmyth_database_t cmyth_chanlist_get_database(void);
+#endif /* HAS_MYSQL */
+
 /*
  * From channel.c
  */
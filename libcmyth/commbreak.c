@@ -41,6 +41,14 @@ cmyth_commbreaklist_destroy(cmyth_commbreaklist_t cbl)
 	if (cbl->commbreak_list) {
 		free(cbl->commbreak_list);
 	}
+	for (i = 0; i < cbl->commbreak_marks_count; ++i) {
+		ref_release(cbl->commbreak_marks[i]);
+	}
+	free(cbl->commbreak_marks);
+	for (i = 0; i < cbl->commbreak_offsets_count; ++i) {
+		ref_release(cbl->commbreak_offsets[i]);
+	}
+	free(cbl->commbreak_offsets);
 }
 
 cmyth_commbreaklist_t
@@ -57,9 +65,49 @@ cmyth_commbreaklist_create(void)
 
 	ret->commbreak_list = NULL;
 	ret->commbreak_count = 0;
+	ret->commbreak_marks = NULL;
+	ret->commbreak_marks_count = 0;
+	ret->commbreak_offsets = NULL;
+	ret->commbreak_offsets_count = 0;
+	ret->commbreak_indexed = 0;
 	return ret;
 }
 
+/*
+ * cmyth_commbreaklist_add(cmyth_commbreaklist_t cbl, cmyth_commbreak_t cb)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_commbreaklist_add)
+ *
+ * Description
+ *
+ * Append the commercial break 'cb' to the list 'cbl', which takes over
+ * the reference held by the caller.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -ENOMEM, and 'cb' is released
+ */
+int
+cmyth_commbreaklist_add(cmyth_commbreaklist_t cbl, cmyth_commbreak_t cb)
+{
+	cmyth_commbreak_t *list;
+
+	list = realloc(cbl->commbreak_list,
+		       (cbl->commbreak_count + 1) * sizeof(*list));
+	if (list == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: realloc() failed\n",
+			  __FUNCTION__);
+		ref_release(cb);
+		return -ENOMEM;
+	}
+	list[cbl->commbreak_count++] = cb;
+	cbl->commbreak_list = list;
+
+	return 0;
+}
+
 void
 cmyth_commbreak_destroy(cmyth_commbreak_t b)
 {
@@ -92,6 +140,460 @@ cmyth_commbreak_create(void)
 	return ret;
 }
 
+/*
+ * Commercial break and cut lists are cached per backend and recording,
+ * so that a player asking again for the list of the recording it plays
+ * does not go back to the backend.  The lists are dropped when the
+ * backend reports that the marks of a recording may have changed, so a
+ * backend is only cached from while its event connection is up, and a
+ * list is only cached if that connection was up since before it was
+ * fetched.  Following the events costs a connection and a thread per
+ * backend, so the cache is only used once it has been turned on with
+ * cmyth_commbreak_cache_enable().  Cached lists are never changed, so
+ * they are shared by every caller.
+ */
+#define COMMBREAK_CACHE_SIZE	32
+#define COMMBREAK_CACHE_HOST	64
+
+#define COMMBREAK_KIND_COMMBREAK	0
+#define COMMBREAK_KIND_CUTLIST		1
+#define COMMBREAK_KIND_DATABASE		2
+
+struct commbreak_entry {
+	char ce_host[COMMBREAK_CACHE_HOST];
+	int ce_port;
+	int ce_kind;
+	long ce_chanid;
+	time_t ce_start;
+	unsigned long ce_used;
+	cmyth_commbreaklist_t ce_list;
+};
+
+struct commbreak_watch {
+	char cw_host[COMMBREAK_CACHE_HOST];
+	int cw_port;
+	cmyth_event_sub_t cw_sub;
+	unsigned long cw_conn;		/* event connection last seen up */
+	struct commbreak_watch *cw_next;
+};
+
+static pthread_mutex_t commbreak_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct commbreak_entry commbreak_cache[COMMBREAK_CACHE_SIZE];
+static struct commbreak_watch *commbreak_watches;
+static unsigned long commbreak_clock;
+static unsigned long commbreak_gen;
+static int commbreak_cache_on = 0;
+
+/*
+ * commbreak_cache_drop(const char *host, int port, long chanid)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Drop the cached lists of the recordings on channel 'chanid' of the
+ * backend at 'host' and 'port', or of all its recordings if 'chanid' is
+ * negative.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+commbreak_cache_drop(const char *host, int port, long chanid)
+{
+	cmyth_commbreaklist_t old[COMMBREAK_CACHE_SIZE];
+	int i, n = 0;
+
+	pthread_mutex_lock(&commbreak_mutex);
+	for (i = 0; i < COMMBREAK_CACHE_SIZE; i++) {
+		struct commbreak_entry *ce = &commbreak_cache[i];
+
+		if (ce->ce_list && (ce->ce_port == port) &&
+		    ((chanid < 0) || (ce->ce_chanid == chanid)) &&
+		    (strcmp(ce->ce_host, host) == 0)) {
+			old[n++] = ce->ce_list;
+			ce->ce_list = NULL;
+		}
+	}
+	commbreak_gen++;
+	pthread_mutex_unlock(&commbreak_mutex);
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: dropped %d lists for %s:%d chanid %ld\n",
+		  __FUNCTION__, n, host, port, chanid);
+
+	for (i = 0; i < n; i++) {
+		ref_release(old[i]);
+	}
+}
+
+/*
+ * commbreak_cache_event(cmyth_event_sub_t sub, cmyth_eventinfo_t ev,
+ *                       void *data)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Event callback of the backend described by the commbreak_watch
+ * 'data'.  Commercial flagging and edits of a recording drop the lists
+ * of its channel.  A new recording list, or a lost event connection,
+ * drops every list of the backend.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+commbreak_cache_event(cmyth_event_sub_t sub, cmyth_eventinfo_t ev,
+		      void *data)
+{
+	struct commbreak_watch *cw = data;
+	long chanid = -1;
+
+	switch (ev->ev_type) {
+	case CMYTH_EVENT_COMMFLAG_START:
+	case CMYTH_EVENT_COMMFLAG_UPDATE:
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE:
+		/* the data starts with the channel id of the recording */
+		if (ev->ev_data) {
+			chanid = atol(ev->ev_data);
+		}
+		break;
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE:
+		if (ev->ev_proginfo) {
+			chanid = ev->ev_proginfo->proginfo_chanId;
+		}
+		break;
+	default:
+		break;
+	}
+
+	commbreak_cache_drop(cw->cw_host, cw->cw_port, chanid);
+}
+
+/*
+ * commbreak_cache_watch(const char *host, int port)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Make sure the events of the backend at 'host' and 'port' are
+ * followed.  The caller holds commbreak_mutex.
+ *
+ * Return Value:
+ *
+ * Success: The watch of the backend
+ *
+ * Failure: NULL
+ */
+static struct commbreak_watch *
+commbreak_cache_watch(const char *host, int port)
+{
+	struct commbreak_watch *cw;
+	unsigned long mask;
+
+	for (cw = commbreak_watches; cw; cw = cw->cw_next) {
+		if ((cw->cw_port == port) && (strcmp(cw->cw_host, host) == 0)) {
+			return cw;
+		}
+	}
+
+	if ((cw = calloc(1, sizeof(*cw))) == NULL) {
+		return NULL;
+	}
+	strcpy(cw->cw_host, host);
+	cw->cw_port = port;
+
+	mask = CMYTH_EVENT_MASK(CMYTH_EVENT_COMMFLAG_START) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_COMMFLAG_UPDATE) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE);
+	cw->cw_sub = cmyth_event_subscribe(cw->cw_host, port, mask,
+					   commbreak_cache_event, (void*)cw);
+	if (cw->cw_sub == NULL) {
+		free(cw);
+		return NULL;
+	}
+	cw->cw_next = commbreak_watches;
+	commbreak_watches = cw;
+
+	return cw;
+}
+
+/*
+ * commbreak_cache_live(struct commbreak_watch *cw)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Check that the event connection of the watch 'cw' is up, and that it
+ * is the one seen up before.  Events may have been missed before a new
+ * connection came up, so seeing one counts as a drop of the lists of
+ * the backend, which puts off caching any list fetched before it.  The
+ * caller holds commbreak_mutex.
+ *
+ * Return Value:
+ *
+ * Success: 1, lists of the backend can be cached
+ *
+ * Failure: 0
+ */
+static int
+commbreak_cache_live(struct commbreak_watch *cw)
+{
+	unsigned long conn;
+
+	if ((conn = cmyth_event_sub_connected(cw->cw_sub)) == 0) {
+		return 0;
+	}
+	if (conn != cw->cw_conn) {
+		cw->cw_conn = conn;
+		commbreak_gen++;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * commbreak_cache_find(const char *host, int port, int kind,
+ *                      long chanid, time_t start)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Find the cache entry of the list 'kind' of the recording 'chanid' and
+ * 'start' on the backend at 'host' and 'port'.  The caller holds
+ * commbreak_mutex.
+ *
+ * Return Value:
+ *
+ * Success: The entry
+ *
+ * Failure: NULL
+ */
+static struct commbreak_entry *
+commbreak_cache_find(const char *host, int port, int kind, long chanid,
+		     time_t start)
+{
+	int i;
+
+	for (i = 0; i < COMMBREAK_CACHE_SIZE; i++) {
+		struct commbreak_entry *ce = &commbreak_cache[i];
+
+		if (ce->ce_list && (ce->ce_chanid == chanid) &&
+		    (ce->ce_start == start) && (ce->ce_kind == kind) &&
+		    (ce->ce_port == port) && (strcmp(ce->ce_host, host) == 0)) {
+			return ce;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * commbreak_cache_get(cmyth_conn_t conn, cmyth_proginfo_t prog, int kind,
+ *                     unsigned long *gen)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Look up the cached list 'kind' of the recording 'prog' on the backend
+ * of the connection 'conn'.  The number of drops so far is placed in
+ * 'gen', to be handed to commbreak_cache_put() with the list fetched
+ * instead.  With the cache on, the events of the backend are followed
+ * from here on, so that the list fetched can be cached.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_commbreaklist_t
+ *
+ * Failure: NULL, if no list is cached
+ */
+static cmyth_commbreaklist_t
+commbreak_cache_get(cmyth_conn_t conn, cmyth_proginfo_t prog, int kind,
+		    unsigned long *gen)
+{
+	struct commbreak_entry *ce;
+	struct commbreak_watch *cw;
+	cmyth_commbreaklist_t ret = NULL;
+	time_t start;
+
+	if (!conn->conn_server || !prog->proginfo_rec_start_ts ||
+	    (strlen(conn->conn_server) >= COMMBREAK_CACHE_HOST)) {
+		return NULL;
+	}
+	start = cmyth_timestamp_to_unixtime(prog->proginfo_rec_start_ts);
+
+	pthread_mutex_lock(&commbreak_mutex);
+	if (commbreak_cache_on &&
+	    ((cw = commbreak_cache_watch(conn->conn_server,
+					 conn->conn_port)) != NULL)) {
+		commbreak_cache_live(cw);
+	}
+	*gen = commbreak_gen;
+	if ((ce=commbreak_cache_find(conn->conn_server, conn->conn_port, kind,
+				     prog->proginfo_chanId, start)) != NULL) {
+		ce->ce_used = ++commbreak_clock;
+		ret = ref_hold(ce->ce_list);
+	}
+	pthread_mutex_unlock(&commbreak_mutex);
+
+	return ret;
+}
+
+/*
+ * commbreak_cache_put(cmyth_conn_t conn, cmyth_proginfo_t prog, int kind,
+ *                     unsigned long gen, cmyth_commbreaklist_t cbl)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Cache the list 'cbl' of kind 'kind' of the recording 'prog' on the
+ * backend of the connection 'conn', replacing the least recently used
+ * list if the cache is full.  Nothing is cached if the cache is off,
+ * if the event connection of the backend is not up, or if lists were
+ * dropped since 'gen' was returned by commbreak_cache_get(), as 'cbl'
+ * may then be out of date.
+ * The list must not be changed afterwards.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+commbreak_cache_put(cmyth_conn_t conn, cmyth_proginfo_t prog, int kind,
+		    unsigned long gen, cmyth_commbreaklist_t cbl)
+{
+	struct commbreak_entry *ce;
+	struct commbreak_watch *cw;
+	cmyth_commbreaklist_t old;
+	time_t start;
+	int i;
+
+	if (!conn->conn_server || !prog->proginfo_rec_start_ts ||
+	    (strlen(conn->conn_server) >= COMMBREAK_CACHE_HOST)) {
+		return;
+	}
+	start = cmyth_timestamp_to_unixtime(prog->proginfo_rec_start_ts);
+
+	pthread_mutex_lock(&commbreak_mutex);
+
+	if (!commbreak_cache_on ||
+	    ((cw = commbreak_cache_watch(conn->conn_server,
+					 conn->conn_port)) == NULL) ||
+	    !commbreak_cache_live(cw) || (gen != commbreak_gen)) {
+		pthread_mutex_unlock(&commbreak_mutex);
+		return;
+	}
+
+	if ((ce=commbreak_cache_find(conn->conn_server, conn->conn_port, kind,
+				     prog->proginfo_chanId, start)) == NULL) {
+		ce = &commbreak_cache[0];
+		for (i = 0; i < COMMBREAK_CACHE_SIZE; i++) {
+			if (commbreak_cache[i].ce_list == NULL) {
+				ce = &commbreak_cache[i];
+				break;
+			}
+			if (commbreak_cache[i].ce_used < ce->ce_used) {
+				ce = &commbreak_cache[i];
+			}
+		}
+	}
+
+	old = ce->ce_list;
+	strcpy(ce->ce_host, conn->conn_server);
+	ce->ce_port = conn->conn_port;
+	ce->ce_kind = kind;
+	ce->ce_chanid = prog->proginfo_chanId;
+	ce->ce_start = start;
+	ce->ce_used = ++commbreak_clock;
+	ce->ce_list = ref_hold(cbl);
+
+	pthread_mutex_unlock(&commbreak_mutex);
+
+	ref_release(old);
+}
+
+/*
+ * cmyth_commbreak_cache_flush(void)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Empty the commercial break and cut list cache, and stop following the
+ * events of the backends it held lists for.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_commbreak_cache_flush(void)
+{
+	cmyth_commbreaklist_t old[COMMBREAK_CACHE_SIZE];
+	struct commbreak_watch *cw, *next;
+	int i;
+
+	pthread_mutex_lock(&commbreak_mutex);
+	for (i = 0; i < COMMBREAK_CACHE_SIZE; i++) {
+		old[i] = commbreak_cache[i].ce_list;
+		commbreak_cache[i].ce_list = NULL;
+	}
+	cw = commbreak_watches;
+	commbreak_watches = NULL;
+	pthread_mutex_unlock(&commbreak_mutex);
+
+	/*
+	 * Unsubscribing waits for a running callback, which takes the
+	 * cache mutex, so it is done without it.
+	 */
+	for (; cw; cw = next) {
+		next = cw->cw_next;
+		cmyth_event_unsubscribe(cw->cw_sub);
+		ref_release(cw->cw_sub);
+		free(cw);
+	}
+
+	for (i = 0; i < COMMBREAK_CACHE_SIZE; i++) {
+		ref_release(old[i]);
+	}
+}
+
+/*
+ * cmyth_commbreak_cache_enable(int enable)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Turn the commercial break and cut list cache on or off.  Turning it
+ * off empties it.  The cache is off by default.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_commbreak_cache_enable(int enable)
+{
+	pthread_mutex_lock(&commbreak_mutex);
+	commbreak_cache_on = enable;
+	pthread_mutex_unlock(&commbreak_mutex);
+
+	if (!enable) {
+		cmyth_commbreak_cache_flush();
+	}
+}
+
 cmyth_commbreaklist_t
 cmyth_get_commbreaklist(cmyth_conn_t conn, cmyth_proginfo_t prog)
 {
@@ -100,8 +602,14 @@ cmyth_get_commbreaklist(cmyth_conn_t conn, cmyth_proginfo_t prog)
 	int count;
 	char buf[len];
 	int r;
+	unsigned long gen = 0;
+	cmyth_commbreaklist_t breaklist;
 
-	cmyth_commbreaklist_t breaklist = cmyth_commbreaklist_create();
+	breaklist = commbreak_cache_get(conn, prog, COMMBREAK_KIND_COMMBREAK, &gen);
+	if (breaklist != NULL) {
+		return breaklist;
+	}
+	breaklist = cmyth_commbreaklist_create();
 
 	snprintf(buf, sizeof(buf), "%s %ld %i",
 		 "QUERY_COMMBREAK", prog->proginfo_chanId, 
@@ -128,6 +636,10 @@ cmyth_get_commbreaklist(cmyth_conn_t conn, cmyth_proginfo_t prog)
 			__FUNCTION__, r);
 		goto out;
 	}
+	if (err == 0) {
+		commbreak_cache_put(conn, prog, COMMBREAK_KIND_COMMBREAK, gen,
+				    breaklist);
+	}
 
 	out:
 	pthread_mutex_unlock(&conn->conn_mutex);
@@ -142,8 +654,14 @@ cmyth_get_cutlist(cmyth_conn_t conn, cmyth_proginfo_t prog)
 	int count;
 	char buf[len];
 	int r;
+	unsigned long gen = 0;
+	cmyth_commbreaklist_t breaklist;
 
-	cmyth_commbreaklist_t breaklist = cmyth_commbreaklist_create();
+	breaklist = commbreak_cache_get(conn, prog, COMMBREAK_KIND_CUTLIST, &gen);
+	if (breaklist != NULL) {
+		return breaklist;
+	}
+	breaklist = cmyth_commbreaklist_create();
 
 	pthread_mutex_lock(&conn->conn_mutex);
 
@@ -172,6 +690,10 @@ cmyth_get_cutlist(cmyth_conn_t conn, cmyth_proginfo_t prog)
 			__FUNCTION__, r);
 		goto out;
 	}
+	if (err == 0) {
+		commbreak_cache_put(conn, prog, COMMBREAK_KIND_CUTLIST, gen,
+				    breaklist);
+	}
 
 	out:
 	pthread_mutex_unlock(&conn->conn_mutex);
@@ -242,9 +764,7 @@ int cmyth_rcv_commbreaklist(cmyth_conn_t conn, int *err,
 				commbreak->start_mark = start;
 				commbreak->end_mark = mark;
 				start = -1;
-				breaklist->commbreak_list = realloc(breaklist->commbreak_list,
-					(++breaklist->commbreak_count) * sizeof(cmyth_commbreak_t));
-				breaklist->commbreak_list[breaklist->commbreak_count - 1] = commbreak;
+				cmyth_commbreaklist_add(breaklist, commbreak);
 			} else {
 				cmyth_dbg(CMYTH_DBG_WARN,
 					"%s: ignoring 'end' marker without a 'start' marker at %lld\n",
@@ -275,10 +795,17 @@ int cmyth_rcv_commbreaklist(cmyth_conn_t conn, int *err,
 cmyth_commbreaklist_t
 cmyth_mysql_get_commbreaklist(cmyth_database_t db, cmyth_conn_t conn, cmyth_proginfo_t prog)
 {
-	cmyth_commbreaklist_t breaklist = cmyth_commbreaklist_create();
+	cmyth_commbreaklist_t breaklist;
+	unsigned long gen = 0;
 	char *start_ts_dt;
 	int r;
 
+	breaklist = commbreak_cache_get(conn, prog, COMMBREAK_KIND_DATABASE, &gen);
+	if (breaklist != NULL) {
+		return breaklist;
+	}
+	breaklist = cmyth_commbreaklist_create();
+
 	start_ts_dt = cmyth_timestamp_display_string(prog->proginfo_rec_start_ts, 0);
 	pthread_mutex_lock(&conn->conn_mutex);
 	if ((r=cmyth_mysql_get_commbreak_list(db, prog->proginfo_chanId, start_ts_dt, breaklist, conn->conn_version)) < 0) {
@@ -290,12 +817,10 @@ cmyth_mysql_get_commbreaklist(cmyth_database_t db, cmyth_conn_t conn, cmyth_prog
 	}
 
 	ref_release(start_ts_dt);
-	fprintf(stderr, "Found %li commercial breaks for current program.\n", breaklist->commbreak_count);
-	if (r != breaklist->commbreak_count) {
-		fprintf(stderr, "commbreak error.  Setting number of commercial breaks to zero\n");
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s  - returned rows=%d commbreak_count=%li\n",__FUNCTION__, r,breaklist->commbreak_count);
-		breaklist->commbreak_count = 0;
-	}
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: found %li commercial breaks\n",
+		  __FUNCTION__, breaklist->commbreak_count);
+	commbreak_cache_put(conn, prog, COMMBREAK_KIND_DATABASE, gen,
+			    breaklist);
 	out:
 	pthread_mutex_unlock(&conn->conn_mutex);
 	return breaklist;
@@ -363,3 +888,299 @@ cmyth_commbreak_get_item(cmyth_commbreaklist_t cbl, unsigned int index)
 
 	return (cmyth_commbreak_t)ref_hold(cbl->commbreak_list[index]);
 }
+
+/*
+ * The lookups use the breaks of a list merged into sorted arrays of
+ * disjoint intervals, one by frame mark and one by byte offset, which
+ * are built the first time a list is searched.
+ */
+static pthread_mutex_t commbreak_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int
+commbreak_cmp_mark(const void *a, const void *b)
+{
+	cmyth_commbreak_t x = *(cmyth_commbreak_t*)a;
+	cmyth_commbreak_t y = *(cmyth_commbreak_t*)b;
+
+	if (x->start_mark != y->start_mark) {
+		return (x->start_mark < y->start_mark) ? -1 : 1;
+	}
+	return 0;
+}
+
+static int
+commbreak_cmp_offset(const void *a, const void *b)
+{
+	cmyth_commbreak_t x = *(cmyth_commbreak_t*)a;
+	cmyth_commbreak_t y = *(cmyth_commbreak_t*)b;
+
+	if (x->start_offset != y->start_offset) {
+		return (x->start_offset < y->start_offset) ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * commbreak_merge(cmyth_commbreaklist_t cbl, int by_offset, long *count)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Sort the breaks of the list 'cbl' which have a known extent by mark,
+ * or by byte offset if 'by_offset' is set, and merge the ones which
+ * overlap or touch into new breaks.  The new breaks only have the
+ * positions they were merged by, marks or offsets, as the other ones
+ * need not line up.  The number of merged breaks is placed in 'count'.
+ *
+ * Return Value:
+ *
+ * Success: A malloc()ed array of held breaks, or NULL if there are none
+ *
+ * Failure: NULL
+ */
+static cmyth_commbreak_t *
+commbreak_merge(cmyth_commbreaklist_t cbl, int by_offset, long *count)
+{
+	cmyth_commbreak_t *sorted, *ret, cb, cur;
+	long i, n = 0, m = 0;
+
+	*count = 0;
+	if (cbl->commbreak_count <= 0) {
+		return NULL;
+	}
+	sorted = malloc(cbl->commbreak_count * sizeof(*sorted));
+	ret = malloc(cbl->commbreak_count * sizeof(*ret));
+	if (!sorted || !ret) {
+		free(sorted);
+		free(ret);
+		return NULL;
+	}
+
+	for (i = 0; i < cbl->commbreak_count; i++) {
+		cb = cbl->commbreak_list[i];
+		if (!cb) {
+			continue;
+		}
+		if (by_offset ? (cb->end_offset > cb->start_offset) :
+		    (cb->end_mark >= cb->start_mark)) {
+			sorted[n++] = cb;
+		}
+	}
+	qsort(sorted, n, sizeof(*sorted),
+	      by_offset ? commbreak_cmp_offset : commbreak_cmp_mark);
+
+	cur = NULL;
+	for (i = 0; i < n; i++) {
+		cb = sorted[i];
+		if (cur && (by_offset ?
+			    (cb->start_offset <= cur->end_offset) :
+			    (cb->start_mark <= cur->end_mark))) {
+			if (by_offset) {
+				if (cb->end_offset > cur->end_offset) {
+					cur->end_offset = cb->end_offset;
+				}
+			} else if (cb->end_mark > cur->end_mark) {
+				cur->end_mark = cb->end_mark;
+			}
+			continue;
+		}
+		if ((cur = cmyth_commbreak_create()) == NULL) {
+			break;
+		}
+		if (by_offset) {
+			cur->start_offset = cb->start_offset;
+			cur->end_offset = cb->end_offset;
+		} else {
+			cur->start_mark = cb->start_mark;
+			cur->end_mark = cb->end_mark;
+		}
+		ret[m++] = cur;
+	}
+	free(sorted);
+
+	if (m == 0) {
+		free(ret);
+		return NULL;
+	}
+	*count = m;
+
+	return ret;
+}
+
+/*
+ * commbreak_search(cmyth_commbreaklist_t cbl, int *by_offset,
+ *                  long long pos)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Binary search the merged breaks of the list 'cbl' for the first one
+ * which ends after the frame mark, or byte offset if 'by_offset' is set,
+ * 'pos'.  The merged breaks are built first if need be.  Lists which
+ * came from the backend protocol have no offsets, so they are searched
+ * by mark instead, and 'by_offset' is cleared to say so.
+ *
+ * Return Value:
+ *
+ * Success: The break, not held
+ *
+ * Failure: NULL, if every break ends at or before 'pos'
+ */
+static cmyth_commbreak_t
+commbreak_search(cmyth_commbreaklist_t cbl, int *by_offset, long long pos)
+{
+	cmyth_commbreak_t *list;
+	long lo, hi, mid;
+
+	if (!cbl->commbreak_indexed) {
+		pthread_mutex_lock(&commbreak_index_mutex);
+		if (!cbl->commbreak_indexed) {
+			cbl->commbreak_marks =
+				commbreak_merge(cbl, 0,
+						&cbl->commbreak_marks_count);
+			cbl->commbreak_offsets =
+				commbreak_merge(cbl, 1,
+						&cbl->commbreak_offsets_count);
+			__sync_synchronize();
+			cbl->commbreak_indexed = 1;
+		}
+		pthread_mutex_unlock(&commbreak_index_mutex);
+	}
+	__sync_synchronize();
+
+	if (*by_offset && (cbl->commbreak_offsets_count == 0)) {
+		*by_offset = 0;
+	}
+	if (*by_offset) {
+		list = cbl->commbreak_offsets;
+		hi = cbl->commbreak_offsets_count;
+	} else {
+		list = cbl->commbreak_marks;
+		hi = cbl->commbreak_marks_count;
+	}
+
+	lo = 0;
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if ((*by_offset ? list[mid]->end_offset :
+		     list[mid]->end_mark) > pos) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	if ((list == NULL) ||
+	    (lo >= (*by_offset ? cbl->commbreak_offsets_count :
+		    cbl->commbreak_marks_count))) {
+		return NULL;
+	}
+
+	return list[lo];
+}
+
+/*
+ * cmyth_commbreak_find(cmyth_commbreaklist_t cbl, long long offset)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Find the commercial break of the list 'cbl' which covers the byte
+ * offset 'offset', from its start offset up to, but not including, its
+ * end offset.  Breaks which overlap are merged into one.  Only breaks
+ * whose offsets are known take part.  A list from the backend protocol
+ * has no offsets, and is matched by mark, with 'offset' taken as a
+ * frame number.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_commbreak_t
+ *
+ * Failure: NULL, if the offset is not in a break
+ */
+cmyth_commbreak_t
+cmyth_commbreak_find(cmyth_commbreaklist_t cbl, long long offset)
+{
+	cmyth_commbreak_t cb;
+	int by_offset = 1;
+
+	if (cbl == NULL) {
+		return NULL;
+	}
+	cb = commbreak_search(cbl, &by_offset, offset);
+	if ((cb == NULL) ||
+	    ((by_offset ? cb->start_offset : cb->start_mark) > offset)) {
+		return NULL;
+	}
+
+	return ref_hold(cb);
+}
+
+/*
+ * cmyth_commbreak_find_mark(cmyth_commbreaklist_t cbl, long long mark)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Find the commercial break of the list 'cbl' which covers the frame
+ * 'mark', from its start mark up to, but not including, its end mark.
+ * Breaks which overlap are merged into one.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_commbreak_t
+ *
+ * Failure: NULL, if the frame is not in a break
+ */
+cmyth_commbreak_t
+cmyth_commbreak_find_mark(cmyth_commbreaklist_t cbl, long long mark)
+{
+	cmyth_commbreak_t cb;
+	int by_offset = 0;
+
+	if (cbl == NULL) {
+		return NULL;
+	}
+	cb = commbreak_search(cbl, &by_offset, mark);
+	if ((cb == NULL) || (cb->start_mark > mark)) {
+		return NULL;
+	}
+
+	return ref_hold(cb);
+}
+
+/*
+ * cmyth_commbreak_next(cmyth_commbreaklist_t cbl, long long offset)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Find the first commercial break of the list 'cbl' which ends after
+ * the byte offset 'offset': the break covering it, or else the next
+ * one.  A player can read up to the start offset of the break returned
+ * without looking again.  Only breaks whose offsets are known take part,
+ * and a list without offsets is searched by mark, as with
+ * cmyth_commbreak_find().
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_commbreak_t
+ *
+ * Failure: NULL, if there is no break after the offset
+ */
+cmyth_commbreak_t
+cmyth_commbreak_next(cmyth_commbreaklist_t cbl, long long offset)
+{
+	int by_offset = 1;
+
+	if (cbl == NULL) {
+		return NULL;
+	}
+
+	return ref_hold(commbreak_search(cbl, &by_offset, offset));
+}
@@ -27,7 +27,6 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
-#include <signal.h>
 #include <cmyth_local.h>
 
 static char * cmyth_conn_get_setting_unlocked(cmyth_conn_t conn, const char* hostname, const char* setting);
@@ -63,49 +62,38 @@ static myth_protomap_t protomap[] = {
 	{0, ""}
 };
 
-#define VERSION_CACHE_SIZE	8
+static pthread_mutex_t connect_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-struct version_cache_s {
-	char *host;
-	unsigned int version;
-};
-
-static struct version_cache_s version_cache[VERSION_CACHE_SIZE];
+static unsigned long connect_count;
+static unsigned long connect_cache_hits;
+static unsigned long connect_retries;
+static unsigned long long connect_msecs;
 
-#ifdef _MSC_VER
-/*
- * shameless rip from:
- * http://memset.wordpress.com/2010/10/09/inet_ntop-for-win32/
- */
-static const char *
-inet_ntop(int af, const void* src, char* dst, int cnt)
+static int
+version_supported(unsigned long version)
 {
-	struct sockaddr_in srcaddr;
-
-	memset(&srcaddr, 0, sizeof(struct sockaddr_in));
-	memcpy(&(srcaddr.sin_addr), src, sizeof(srcaddr.sin_addr));
+	myth_protomap_t *map;
 
-	srcaddr.sin_family = af;
-	if (WSAAddressToString((struct sockaddr*) &srcaddr,
-			       sizeof(struct sockaddr_in), 0, dst,
-			       (LPDWORD) &cnt) != 0) {
-		return NULL;
+	if ((version < 62) || (version == 23056)) {
+		return (version > 0);
+	}
+	for (map = protomap; map->version != 0; map++) {
+		if (map->version == version) {
+			return 1;
+		}
 	}
 
-	return dst;
+	return 0;
 }
-#endif /* _MSC_VER */
 
-static unsigned int
-get_host_version(char *host)
+static unsigned long
+get_host_version(char *host, unsigned short port)
 {
-	int i;
+	unsigned long version;
 
-	for (i=0; i<VERSION_CACHE_SIZE; i++) {
-		if ((version_cache[i].host != NULL) &&
-		    (strcmp(host, version_cache[i].host) == 0)) {
-			return version_cache[i].version;
-		}
+	version = cmyth_version_get(host, port);
+	if (version_supported(version)) {
+		return version;
 	}
 
 	/*
@@ -115,41 +103,6 @@ get_host_version(char *host)
 	return 77;
 }
 
-static void
-set_host_version(char *host, unsigned int version)
-{
-	int i;
-
-	for (i=0; i<VERSION_CACHE_SIZE; i++) {
-		if ((version_cache[i].host != NULL) &&
-		    (strcmp(host, version_cache[i].host) == 0)) {
-			version_cache[i].version = version;
-			return;
-		}
-	}
-
-	for (i=0; i<VERSION_CACHE_SIZE; i++) {
-		if (version_cache[i].host == NULL) {
-			version_cache[i].host = strdup(host);
-			version_cache[i].version = version;
-			return;
-		}
-	}
-
-	/* Evict a host at random */
-#if defined(HAS_ARC4RANDOM)
-	i = arc4random_uniform(VERSION_CACHE_SIZE);
-#else
-	i = rand() % VERSION_CACHE_SIZE;
-#endif
-
-	if (version_cache[i].host) {
-		free(version_cache[i].host);
-	}
-	version_cache[i].host = strdup(host);
-	version_cache[i].version = version;
-}
-
 /*
  * cmyth_conn_destroy(cmyth_conn_t conn)
  * 
@@ -173,6 +126,7 @@ cmyth_conn_destroy(cmyth_conn_t conn)
 		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !\n", __FUNCTION__);
 		return;
 	}
+	cmyth_request_queue_stop(conn);
 	if (conn->conn_buf) {
 		free(conn->conn_buf);
 	}
@@ -188,6 +142,7 @@ cmyth_conn_destroy(cmyth_conn_t conn)
 		conn->conn_server = NULL;
 	}
 	pthread_mutex_destroy(&conn->conn_mutex);
+	pthread_mutex_destroy(&conn->conn_tune.tune_mutex);
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
 }
 
@@ -227,6 +182,11 @@ cmyth_conn_create(void)
 	ret->conn_hang = 0;
 	ret->conn_port = 0;
 	ret->conn_server = NULL;
+	ret->conn_timeout = CMYTH_IO_HANG_TIMEOUT;
+	ret->conn_deadline = 0;
+	ret->conn_pipeline = 1;
+	ret->conn_requests = NULL;
+	cmyth_tune_init(ret);
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
 	return ret;
 }
@@ -255,85 +215,25 @@ cmyth_conn_create(void)
  * Failure: A NULL cmyth_conn_t
  */
 static char my_hostname[128];
-static volatile cmyth_socket_t my_fd;
-
-static void
-sighandler(int sig)
-{
-	/*
-	 * XXX: This is not thread safe...
-	 */
-	closesocket(my_fd);
-	my_fd = -1;
-}
 
 static cmyth_conn_t
 cmyth_connect(char *server, unsigned short port, unsigned buflen,
 	      int tcp_rcvbuf)
 {
 	cmyth_conn_t ret = NULL;
-	struct sockaddr_storage addr;
+	struct cmyth_addr addrs[CMYTH_IO_POLL_MAX];
 	unsigned char *buf = NULL;
 	cmyth_socket_t fd;
-#ifndef _MSC_VER
-	void (*old_sighandler)(int);
-	int old_alarm;
-#endif
+	int naddrs, err;
 	int temp;
 	socklen_t size;
-	struct addrinfo hints;
-	struct addrinfo *res;
-	struct addrinfo *cur;
-	char dest[INET6_ADDRSTRLEN];
 
 	/*
 	 * First try to establish the connection with the server.
 	 * If this fails, we are going no further.
 	 */
-	memset(&addr, 0, sizeof(addr));
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = AF_UNSPEC;
-	if (getaddrinfo(server, NULL, &hints, &res)) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cannot resolve hostname '%s'\n",
-			  __FUNCTION__, server);
-		return NULL;
-	}
-	for (cur = res; cur; cur = cur->ai_next) {
-		if (cur->ai_family == AF_INET) {
-			((struct sockaddr_in *)cur->ai_addr)->sin_port =
-				htons(port);
-			inet_ntop(AF_INET,
-				  &((struct sockaddr_in *)cur->ai_addr)->sin_addr,
-				  dest, sizeof(dest));
-			memcpy(&addr, cur->ai_addr,
-                               sizeof(struct sockaddr_in));
-			temp = PF_INET;
-			break;
-		}
-		if (cur->ai_family == AF_INET6) {
-                        ((struct sockaddr_in6 *)cur->ai_addr)->sin6_port =
-				htons(port);
-			inet_ntop(AF_INET6,
-				  &((struct sockaddr_in6 *)cur->ai_addr)->sin6_addr,
-				  dest, sizeof(dest));
-			memcpy(&addr, cur->ai_addr,
-                               sizeof(struct sockaddr_in6));
-			temp = PF_INET6;
-			break;
-		}
-	}
-	freeaddrinfo(res);
-	if (!cur) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no AF_INET address for '%s'\n",
-			  __FUNCTION__, server);
-		return NULL;
-	}
-
-	fd = socket(temp, SOCK_STREAM, 0);
-	if (fd < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: cannot create socket (%d)\n",
-			  __FUNCTION__, errno);
+	naddrs = cmyth_resolve(server, port, addrs, CMYTH_IO_POLL_MAX);
+	if (naddrs < 0) {
 		return NULL;
 	}
 
@@ -347,10 +247,21 @@ cmyth_connect(char *server, unsigned short port, unsigned buflen,
 	if (tcp_rcvbuf == 0)
 		tcp_rcvbuf = 4096;
 
+	cmyth_dbg(CMYTH_DBG_PROTO, "%s: connecting to %s (%d addresses)\n",
+		  __FUNCTION__, server, naddrs);
+	err = cmyth_io_connect(addrs, naddrs, tcp_rcvbuf,
+			       CMYTH_IO_CONNECT_TIMEOUT, &fd);
+	if (err < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: connect failed on port %d to '%s' (%d)\n",
+			  __FUNCTION__, port, server, -err);
+		return NULL;
+	}
+	cmyth_dbg(CMYTH_DBG_PROTO, "%s: connected to %s fd = %d\n",
+		  __FUNCTION__, server, fd);
+
 	temp = tcp_rcvbuf;
 	size = sizeof(temp);
-	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void*)&temp, size);
-
 	if(getsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void*)&temp, &size)) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: could not get rcvbuf from socket(%d)\n",
 			  __FUNCTION__, errno);
@@ -358,30 +269,6 @@ cmyth_connect(char *server, unsigned short port, unsigned buflen,
 	}
 	tcp_rcvbuf = temp;
 
-	cmyth_dbg(CMYTH_DBG_PROTO, "%s: connecting to %s fd = %d\n",
-		  __FUNCTION__, dest, fd);
-#ifndef _MSC_VER
-	old_sighandler = signal(SIGALRM, sighandler);
-	old_alarm = alarm(5);
-#endif
-	my_fd = fd;
-	if (connect(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: connect failed on port %d to '%s' (%d)\n",
-			  __FUNCTION__, port, server, errno);
-		closesocket(fd);
-#ifndef _MSC_VER
-		signal(SIGALRM, old_sighandler);
-		alarm(old_alarm);
-#endif
-		return NULL;
-	}
-	my_fd = -1;
-#ifndef _MSC_VER
-	signal(SIGALRM, old_sighandler);
-	alarm(old_alarm);
-#endif
-
 	if ((my_hostname[0] == '\0') &&
 	    (gethostname(my_hostname, sizeof(my_hostname)) < 0)) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: gethostname failed (%d)\n",
@@ -411,7 +298,7 @@ cmyth_connect(char *server, unsigned short port, unsigned buflen,
 	ret->conn_buf = buf;
 	ret->conn_len = 0;
 	ret->conn_pos = 0;
-	ret->conn_version = get_host_version(server);
+	ret->conn_version = get_host_version(server, port);
 	ret->conn_tcp_rcvbuf = tcp_rcvbuf;
 	ret->conn_server = ref_strdup(server);
 	ret->conn_port = port;
@@ -424,7 +311,7 @@ cmyth_connect(char *server, unsigned short port, unsigned buflen,
 	}
 	cmyth_dbg(CMYTH_DBG_PROTO, "%s: error connecting to "
 		  "%s, shutdown and close fd = %d\n",
-		  __FUNCTION__, dest, fd);
+		  __FUNCTION__, server, fd);
 	shutdown(fd, 2);
 	closesocket(fd);
 	return NULL;
@@ -436,8 +323,13 @@ cmyth_conn_connect(char *server, unsigned short port, unsigned buflen,
 {
 	cmyth_conn_t conn;
 	char announcement[256];
+	char ann[256];
 	unsigned long tmp_ver;
 	int attempt = 0;
+	int speculate = 0;
+	long long start;
+
+	start = cmyth_io_now();
 
     top:
 	conn = cmyth_connect(server, port, buflen, tcp_rcvbuf);
@@ -452,10 +344,27 @@ cmyth_conn_connect(char *server, unsigned short port, unsigned buflen,
 	 * Find out what the Myth Protocol Version is for this connection.
 	 * Loop around until we get agreement from the server.
 	 */
-	if (attempt == 0)
+	if (attempt == 0) {
 		tmp_ver = conn->conn_version;
+		speculate = (cmyth_version_get(server, port) == tmp_ver);
+	}
 	conn->conn_version = tmp_ver;
 
+	/*
+	 * Generate a unique hostname for event connections, since the server
+	 * will not send the same event multiple times to the same host.
+	 */
+	if (event) {
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%s_%d_%p", my_hostname,
+			 getpid(), conn);
+		snprintf(ann, sizeof(ann),
+			 "ANN Playback %s %d", buf, event);
+	} else {
+		snprintf(ann, sizeof(ann),
+			 "ANN Playback %s 0", my_hostname);
+	}
+
 	/*
 	 * Myth 0.23.1 (Myth 0.23 + fixes) introduced an out of sequence protocol version number (23056)
 	 * due to the next protocol version number having already been bumped in trunk.
@@ -485,6 +394,20 @@ cmyth_conn_connect(char *server, unsigned short port, unsigned buflen,
 			  __FUNCTION__, announcement);
 		goto shut;
 	}
+
+	/*
+	 * When the version is already known to be right (it was cached, or
+	 * the server just told us), send the announcement without waiting
+	 * for the version to be accepted.  If the server rejects the version
+	 * anyway it drops the connection, and the announcement with it.
+	 */
+	if (speculate && (cmyth_send_message(conn, ann) < 0)) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_send_message('%s') failed\n",
+			  __FUNCTION__, ann);
+		goto shut;
+	}
+
 	if (cmyth_rcv_version(conn, &tmp_ver) < 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_version() failed\n",
@@ -502,32 +425,19 @@ cmyth_conn_connect(char *server, unsigned short port, unsigned buflen,
 			goto shut;
 		}
 		attempt = 1;
+		speculate = 1;
 		ref_release(conn);
 		goto top;
 	}
 	cmyth_dbg(CMYTH_DBG_PROTO, "%s: agreed on Version %ld protocol\n",
 		  __FUNCTION__, conn->conn_version);
 
-	set_host_version(server, conn->conn_version);
+	cmyth_version_put(server, port, conn->conn_version);
 
-	/*
-	 * Generate a unique hostname for event connections, since the server
-	 * will not send the same event multiple times to the same host.
-	 */
-	if (event) {
-		char buf[128];
-		snprintf(buf, sizeof(buf), "%s_%d_%p", my_hostname,
-			 getpid(), conn);
-		snprintf(announcement, sizeof(announcement),
-			 "ANN Playback %s %d", buf, event);
-	} else {
-		snprintf(announcement, sizeof(announcement),
-			 "ANN Playback %s 0", my_hostname);
-	}
-	if (cmyth_send_message(conn, announcement) < 0) {
+	if (!speculate && (cmyth_send_message(conn, ann) < 0)) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_send_message('%s') failed\n",
-			  __FUNCTION__, announcement);
+			  __FUNCTION__, ann);
 		goto shut;
 	}
 	if (cmyth_rcv_okay(conn) < 0) {
@@ -548,6 +458,15 @@ cmyth_conn_connect(char *server, unsigned short port, unsigned buflen,
 		conn->conn_version = 56;
 	}
 
+	pthread_mutex_lock(&connect_mutex);
+	connect_count++;
+	if (attempt == 0 && speculate) {
+		connect_cache_hits++;
+	}
+	connect_retries += attempt;
+	connect_msecs += cmyth_io_now() - start;
+	pthread_mutex_unlock(&connect_mutex);
+
 	return conn;
 
     shut:
@@ -555,6 +474,44 @@ cmyth_conn_connect(char *server, unsigned short port, unsigned buflen,
 	return NULL;
 }
 
+/*
+ * cmyth_conn_get_connect_stats(unsigned long *connects,
+ *                              unsigned long *cache_hits,
+ *                              unsigned long *retries,
+ *                              unsigned long long *msecs)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve statistics on the control and event connections established
+ * so far: how many there were, how many offered a cached protocol
+ * version which was accepted, how many had to reconnect with another
+ * version, and the total time taken to establish them.  Any of the
+ * pointers may be NULL.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_conn_get_connect_stats(unsigned long *connects,
+			     unsigned long *cache_hits,
+			     unsigned long *retries,
+			     unsigned long long *msecs)
+{
+	pthread_mutex_lock(&connect_mutex);
+	if (connects)
+		*connects = connect_count;
+	if (cache_hits)
+		*cache_hits = connect_cache_hits;
+	if (retries)
+		*retries = connect_retries;
+	if (msecs)
+		*msecs = connect_msecs;
+	pthread_mutex_unlock(&connect_mutex);
+}
+
 /*
  * cmyth_conn_connect_ctrl(char *server, unsigned short port, unsigned buflen)
  *
@@ -649,6 +606,8 @@ cmyth_conn_connect_pathname(cmyth_proginfo_t prog,  cmyth_conn_t control,
 			  __FUNCTION__);
 		goto shut;
 	}
+	ret->file_path = ref_strintern(pathname);
+	ret->file_host = ref_strintern(prog->proginfo_host);
 	cmyth_dbg(CMYTH_DBG_PROTO, "%s: connecting data connection\n",
 		  __FUNCTION__);
 	if (control->conn_version >= 17) {
@@ -974,8 +933,7 @@ cmyth_conn_connect_recorder(cmyth_recorder_t rec, unsigned buflen,
 int
 cmyth_conn_check_block(cmyth_conn_t conn, unsigned long size)
 {
-	fd_set check;
-	struct timeval timeout;
+	int r;
 	int length;
 	int err = 0;
 	unsigned long sent;
@@ -983,15 +941,12 @@ cmyth_conn_check_block(cmyth_conn_t conn, unsigned long size)
 	if (!conn) {
 		return -EINVAL;
 	}
-	timeout.tv_sec = timeout.tv_usec = 0;
-	FD_ZERO(&check);
-	FD_SET(conn->conn_fd, &check);
-	if (select(conn->conn_fd + 1, &check, NULL, NULL, &timeout) < 0) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s: select failed (%d)\n",
-			  __FUNCTION__, errno);
-		return -(errno);
+	if ((r = cmyth_io_wait(conn->conn_fd, CMYTH_IO_READ, 0)) < 0) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s: wait failed (%d)\n",
+			  __FUNCTION__, r);
+		return r;
 	}
-	if (FD_ISSET(conn->conn_fd, &check)) {
+	if (r & CMYTH_IO_READ) {
 		/*
 		 * We have a bite, reel it in.
 		 */
@@ -1277,103 +1232,195 @@ cmyth_conn_get_free_recorder(cmyth_conn_t conn)
 	return NULL;
 }
 
-int
-cmyth_conn_get_freespace(cmyth_conn_t control,
-			 long long *total, long long *used)
+/*
+ * cmyth_conn_freespace_rcv(cmyth_conn_t control, cmyth_request_t req,
+ *                          int count)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Receive the 'count' byte response to a free space query into the
+ * cmyth_freespace_t passed to cmyth_request_submit().
+ *
+ * Return Value:
+ *
+ * The number of bytes of the response which were not consumed.
+ */
+static int
+cmyth_conn_freespace_rcv(cmyth_conn_t control, cmyth_request_t req, int count)
 {
-	int err, count, ret = 0;
+	cmyth_freespace_t fs = req->req_arg;
+	int err = 0;
 	int r;
-	char msg[256];
 	char reply[256];
 	int64_t lreply;
 
-	if (control == NULL)
-		return -EINVAL;
-
-	if ((total == NULL) || (used == NULL))
-		return -EINVAL;
-
-	pthread_mutex_lock(&control->conn_mutex);
-
-	if (control->conn_version >= 32)
-		{ snprintf(msg, sizeof(msg), "QUERY_FREE_SPACE_SUMMARY"); }
-	else if (control->conn_version >= 17)	
-		{ snprintf(msg, sizeof(msg), "QUERY_FREE_SPACE"); }
-	else
-		{ snprintf(msg, sizeof(msg), "QUERY_FREESPACE"); }
-
-	if ((err = cmyth_send_message(control, msg)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_send_message() failed (%d)\n",
-			  __FUNCTION__, err);
-		ret = err;
-		goto out;
-	}
-
-	if ((count=cmyth_rcv_length(control)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_length() failed (%d)\n",
-			  __FUNCTION__, count);
-		ret = count;
-		goto out;
-	}
-	
 	if (control->conn_version >= 17) {
-		if ((r=cmyth_rcv_int64(control, &err, &lreply, count)) < 0) {
+		r = cmyth_rcv_int64(control, &err, &lreply, count);
+		if (err) {
 			cmyth_dbg(CMYTH_DBG_ERROR,
 				  "%s: cmyth_rcv_int64() failed (%d)\n",
 				  __FUNCTION__, err);
-			ret = err;
-			goto out;
+			req->req_status = (err < 0) ? err : -err;
+			return count - r;
 		}
 		count -= r;
-		*total = lreply;
-		if ((r=cmyth_rcv_int64(control, &err, &lreply, count)) < 0) {
+		fs->freespace_total = lreply;
+		r = cmyth_rcv_int64(control, &err, &lreply, count);
+		if (err) {
 			cmyth_dbg(CMYTH_DBG_ERROR,
 				  "%s: cmyth_rcv_int64() failed (%d)\n",
 				  __FUNCTION__, err);
-			ret = err;
-			goto out;
+			req->req_status = (err < 0) ? err : -err;
+			return count - r;
 		}
 		count -= r;
-		*used = lreply;
+		fs->freespace_used = lreply;
 	}
 	else
 		{
-			if ((r=cmyth_rcv_string(control, &err, reply,
-						sizeof(reply)-1, count)) < 0) {
+			r = cmyth_rcv_string(control, &err, reply,
+					     sizeof(reply)-1, count);
+			if (err) {
 				cmyth_dbg(CMYTH_DBG_ERROR,
 					  "%s: cmyth_rcv_string() failed (%d)\n",
 					  __FUNCTION__, err);
-				ret = err;
-				goto out;
+				req->req_status = (err < 0) ? err : -err;
+				return count - r;
 			}
 			count -= r;
-			*total = atoi(reply);
-			if ((r=cmyth_rcv_string(control, &err, reply,
-						sizeof(reply)-1,
-						count)) < 0) {
+			fs->freespace_total = atoi(reply);
+			r = cmyth_rcv_string(control, &err, reply,
+					     sizeof(reply)-1, count);
+			if (err) {
 				cmyth_dbg(CMYTH_DBG_ERROR,
 					  "%s: cmyth_rcv_string() failed (%d)\n",
 					  __FUNCTION__, err);
-				ret = err;
-				goto out;
+				req->req_status = (err < 0) ? err : -err;
+				return count - r;
 			}
 			count -= r;
-			*used = atoi(reply);
+			fs->freespace_used = atoi(reply);
 
-			*used *= 1024;
-			*total *= 1024;
+			fs->freespace_used *= 1024;
+			fs->freespace_total *= 1024;
 		}
 
 	if (count != 0) {
-		ret = -1;
+		req->req_status = -1;
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s(): %d extra bytes\n",
 			  __FUNCTION__, count);
+		return count;
 	}
 
-    out:
-	pthread_mutex_unlock(&control->conn_mutex);
+	req->req_result = ref_hold(fs);
+
+	return 0;
+}
+
+/*
+ * cmyth_conn_get_freespace_async(cmyth_conn_t control,
+ *                                cmyth_request_callback_t callback,
+ *                                void *data)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Queue a request on 'control' for the amount of free disk space on the
+ * backend.  Once it completes, cmyth_request_get_freespace() returns the
+ * totals.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+cmyth_request_t
+cmyth_conn_get_freespace_async(cmyth_conn_t control,
+			       cmyth_request_callback_t callback, void *data)
+{
+	char msg[256];
+	cmyth_freespace_t fs;
+
+	if (control == NULL)
+		return NULL;
+
+	if ((fs = cmyth_freespace_create()) == NULL)
+		return NULL;
+
+	if (control->conn_version >= 32)
+		{ snprintf(msg, sizeof(msg), "QUERY_FREE_SPACE_SUMMARY"); }
+	else if (control->conn_version >= 17)	
+		{ snprintf(msg, sizeof(msg), "QUERY_FREE_SPACE"); }
+	else
+		{ snprintf(msg, sizeof(msg), "QUERY_FREESPACE"); }
+
+	return cmyth_request_submit(control, msg, cmyth_conn_freespace_rcv, fs,
+				    callback, data);
+}
+
+/*
+ * cmyth_request_get_freespace(cmyth_request_t req,
+ *                             long long *total, long long *used)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Fill out 'total' and 'used' from the completed free space query 'req'.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(ERRNO)
+ */
+int
+cmyth_request_get_freespace(cmyth_request_t req,
+			    long long *total, long long *used)
+{
+	cmyth_freespace_t fs;
+	int ret;
+
+	if ((req == NULL) || (total == NULL) || (used == NULL))
+		return -EINVAL;
+
+	if ((ret = cmyth_request_get_status(req)) < 0)
+		return ret;
+
+	if ((fs = cmyth_request_get_result(req)) == NULL)
+		return -EINVAL;
+
+	*total = fs->freespace_total;
+	*used = fs->freespace_used;
+	ref_release(fs);
+
+	return 0;
+}
+
+int
+cmyth_conn_get_freespace(cmyth_conn_t control,
+			 long long *total, long long *used)
+{
+	cmyth_request_t req;
+	int ret;
+
+	if (control == NULL)
+		return -EINVAL;
+
+	if ((total == NULL) || (used == NULL))
+		return -EINVAL;
+
+	if ((req = cmyth_conn_get_freespace_async(control, NULL, NULL)) == NULL)
+		return -ENOMEM;
+
+	if ((ret = cmyth_request_wait(req)) >= 0)
+		ret = cmyth_request_get_freespace(req, total, used);
+
+	ref_release(req);
 
 	return ret;
 }
@@ -1448,12 +1495,46 @@ cmyth_conn_get_free_recorder_count(cmyth_conn_t conn)
 	return ret;
 }
 
+/*
+ * Receive the 'count' byte response to a QUERY_SETTING, returning the
+ * setting or NULL.
+ */
+static char *
+cmyth_conn_rcv_setting(cmyth_conn_t conn, int *count)
+{
+	char* result = NULL;
+	int err;
+
+	result = ref_alloc(*count+1);
+	*count -= cmyth_rcv_string(conn, &err,
+				    result, *count, *count);
+	if (err < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_string() failed (%d)\n",
+			  __FUNCTION__, err);
+		goto err;
+	}
+
+	while(*count > 0 && !err) {
+		char buffer[100];
+		*count -= cmyth_rcv_string(conn, &err, buffer, sizeof(buffer)-1, *count);
+		buffer[sizeof(buffer)-1] = 0;
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: odd left over data %s\n", __FUNCTION__, buffer);
+	}
+
+	return result;
+err:
+	if(result)
+		ref_release(result);
+
+	return NULL;
+}
+
 static char *
 cmyth_conn_get_setting_unlocked(cmyth_conn_t conn, const char* hostname, const char* setting)
 {
 	char msg[256];
 	int count, err;
-	char* result = NULL;
 
 	if (!conn) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
@@ -1472,49 +1553,86 @@ cmyth_conn_get_setting_unlocked(cmyth_conn_t conn, const char* hostname, const c
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_send_message() failed (%d)\n",
 			  __FUNCTION__, err);
-		goto err;
+		return NULL;
 	}
 
 	if ((count=cmyth_rcv_length(conn)) < 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_length() failed (%d)\n",
 			  __FUNCTION__, count);
-		goto err;
+		return NULL;
 	}
 
-	result = ref_alloc(count+1);
-	count -= cmyth_rcv_string(conn, &err,
-				    result, count, count);
-	if (err < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_string() failed (%d)\n",
-			  __FUNCTION__, err);
-		goto err;
+	return cmyth_conn_rcv_setting(conn, &count);
+}
+
+static int
+cmyth_conn_setting_rcv(cmyth_conn_t conn, cmyth_request_t req, int count)
+{
+	if ((req->req_result = cmyth_conn_rcv_setting(conn, &count)) == NULL) {
+		req->req_status = -EPROTO;
 	}
+	return count;
+}
 
-	while(count > 0 && !err) {
-		char buffer[100];
-		count -= cmyth_rcv_string(conn, &err, buffer, sizeof(buffer)-1, count);
-		buffer[sizeof(buffer)-1] = 0;
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: odd left over data %s\n", __FUNCTION__, buffer);
+/*
+ * cmyth_conn_get_setting_async(cmyth_conn_t conn, const char *hostname,
+ *                              const char *setting,
+ *                              cmyth_request_callback_t callback,
+ *                              void *data)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Queue a request on 'conn' for the MythTV setting 'setting' of the host
+ * 'hostname'.  The result of the request is the setting, as a reference
+ * counted string.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+cmyth_request_t
+cmyth_conn_get_setting_async(cmyth_conn_t conn, const char* hostname,
+			     const char* setting,
+			     cmyth_request_callback_t callback, void *data)
+{
+	char msg[256];
+
+	if (!conn) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
+			  __FUNCTION__);
+		return NULL;
 	}
 
-	return result;
-err:
-	if(result)
-		ref_release(result);
+	if(conn->conn_version < 17) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: protocol version doesn't support QUERY_SETTING\n",
+			  __FUNCTION__);
+		return NULL;
+	}
 
-	return NULL;
+	snprintf(msg, sizeof(msg), "QUERY_SETTING %s %s", hostname, setting);
+
+	return cmyth_request_submit(conn, msg, cmyth_conn_setting_rcv, NULL,
+				    callback, data);
 }
 
 char *
 cmyth_conn_get_setting(cmyth_conn_t conn, const char* hostname, const char* setting)
 {
+	cmyth_request_t req;
 	char* result = NULL;
 
-	pthread_mutex_lock(&conn->conn_mutex);
-	result = cmyth_conn_get_setting_unlocked(conn, hostname, setting);
-	pthread_mutex_unlock(&conn->conn_mutex);
+	req = cmyth_conn_get_setting_async(conn, hostname, setting, NULL, NULL);
+	if (req == NULL)
+		return NULL;
+
+	if (cmyth_request_wait(req) >= 0)
+		result = cmyth_request_get_result(req);
+	ref_release(req);
 
 	return result;
 }
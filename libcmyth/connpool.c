@@ -0,0 +1,247 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * connpool.c - Pools of control connections.  A control connection
+ *              serializes its commands, so a slow command holds up every
+ *              other thread using the same connection.  A pool opens up
+ *              to a fixed number of control connections to one backend,
+ *              as they are needed, and leases them out one command (or
+ *              a few) at a time, so that threads can talk to the backend
+ *              in parallel.
+ *
+ *              Idle connections are kept on a stack, so the most recently
+ *              used (and most likely still healthy) one is leased first.
+ *              A connection that is hung, or that has become readable
+ *              while idle (the backend closed it), is dropped instead of
+ *              being leased or returned.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <cmyth_local.h>
+
+struct cmyth_conn_pool {
+	pthread_mutex_t pool_mutex;
+	pthread_cond_t pool_cond;	/* a connection was returned */
+	char *pool_server;
+	unsigned short pool_port;
+	unsigned pool_buflen;
+	int pool_tcp_rcvbuf;
+	int pool_max;
+	int pool_count;			/* open, idle or leased */
+	int pool_nidle;
+	cmyth_conn_t *pool_idle;
+};
+
+static void
+cmyth_conn_pool_destroy(cmyth_conn_pool_t pool)
+{
+	int i;
+
+	for (i = 0; i < pool->pool_nidle; i++) {
+		ref_release(pool->pool_idle[i]);
+	}
+	free(pool->pool_idle);
+	ref_release(pool->pool_server);
+	pthread_cond_destroy(&pool->pool_cond);
+	pthread_mutex_destroy(&pool->pool_mutex);
+}
+
+/*
+ * An idle control connection has nothing to say, so if it is readable the
+ * backend has closed it (or it is out of step).
+ */
+static int
+cmyth_conn_pool_healthy(cmyth_conn_t conn)
+{
+	if (conn->conn_hang) {
+		return 0;
+	}
+	if (conn->conn_pos < conn->conn_len) {
+		return 0;
+	}
+	return cmyth_io_wait(conn->conn_fd, CMYTH_IO_READ, 0) == 0;
+}
+
+/*
+ * cmyth_conn_pool_create(char *server, unsigned short port,
+ *                        unsigned buflen, int tcp_rcvbuf, int max)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Create a pool of up to 'max' control connections to the backend at
+ * 'server' and 'port'.  The connections are opened with
+ * cmyth_conn_connect_ctrl() using 'buflen' and 'tcp_rcvbuf' as they are
+ * first needed by cmyth_conn_pool_get().
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_conn_pool_t
+ *
+ * Failure: NULL
+ */
+cmyth_conn_pool_t
+cmyth_conn_pool_create(char *server, unsigned short port, unsigned buflen,
+		       int tcp_rcvbuf, int max)
+{
+	cmyth_conn_pool_t ret;
+
+	if (!server || (max <= 0)) {
+		return NULL;
+	}
+
+	if ((ret = ref_alloc(sizeof(*ret))) == NULL) {
+		return NULL;
+	}
+	ref_set_destroy(ret, (ref_destroy_t)cmyth_conn_pool_destroy);
+
+	pthread_mutex_init(&ret->pool_mutex, NULL);
+	pthread_cond_init(&ret->pool_cond, NULL);
+	ret->pool_port = port;
+	ret->pool_buflen = buflen;
+	ret->pool_tcp_rcvbuf = tcp_rcvbuf;
+	ret->pool_max = max;
+	ret->pool_count = 0;
+	ret->pool_nidle = 0;
+	ret->pool_server = ref_strdup(server);
+	ret->pool_idle = calloc(max, sizeof(*ret->pool_idle));
+	if (!ret->pool_server || !ret->pool_idle) {
+		ref_release(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+/*
+ * cmyth_conn_pool_get(cmyth_conn_pool_t pool)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Lease a control connection from 'pool'.  An idle connection is reused
+ * if there is a healthy one, otherwise a new one is opened if the pool
+ * is not full.  If every connection is leased, wait for one to be
+ * returned.  The connection must be given back with cmyth_conn_pool_put()
+ * and must not be used after that.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_conn_t
+ *
+ * Failure: NULL if a new connection could not be opened
+ */
+cmyth_conn_t
+cmyth_conn_pool_get(cmyth_conn_pool_t pool)
+{
+	cmyth_conn_t conn;
+
+	if (!pool) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool->pool_mutex);
+	while (1) {
+		while (pool->pool_nidle > 0) {
+			conn = pool->pool_idle[--pool->pool_nidle];
+			if (cmyth_conn_pool_healthy(conn)) {
+				pthread_mutex_unlock(&pool->pool_mutex);
+				return conn;
+			}
+			cmyth_dbg(CMYTH_DBG_PROTO,
+				  "%s: dropping stale connection to %s\n",
+				  __FUNCTION__, pool->pool_server);
+			pool->pool_count--;
+			pthread_mutex_unlock(&pool->pool_mutex);
+			ref_release(conn);
+			pthread_mutex_lock(&pool->pool_mutex);
+		}
+		if (pool->pool_count < pool->pool_max) {
+			break;
+		}
+		pthread_cond_wait(&pool->pool_cond, &pool->pool_mutex);
+	}
+
+	/*
+	 * Claim the slot before dropping the lock to connect.
+	 */
+	pool->pool_count++;
+	pthread_mutex_unlock(&pool->pool_mutex);
+
+	conn = cmyth_conn_connect_ctrl(pool->pool_server, pool->pool_port,
+				       pool->pool_buflen,
+				       pool->pool_tcp_rcvbuf);
+	if (conn == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_conn_connect_ctrl(%s, %d) failed\n",
+			  __FUNCTION__, pool->pool_server, pool->pool_port);
+		pthread_mutex_lock(&pool->pool_mutex);
+		pool->pool_count--;
+		pthread_cond_signal(&pool->pool_cond);
+		pthread_mutex_unlock(&pool->pool_mutex);
+	}
+
+	return conn;
+}
+
+/*
+ * cmyth_conn_pool_put(cmyth_conn_pool_t pool, cmyth_conn_t conn)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Return the control connection 'conn', leased from 'pool' by
+ * cmyth_conn_pool_get(), to the pool.  A connection which has hung is
+ * closed rather than kept.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_conn_pool_put(cmyth_conn_pool_t pool, cmyth_conn_t conn)
+{
+	if (!pool || !conn) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->pool_mutex);
+	if (conn->conn_hang || (pool->pool_nidle >= pool->pool_max)) {
+		pool->pool_count--;
+	} else {
+		pool->pool_idle[pool->pool_nidle++] = conn;
+		conn = NULL;
+	}
+	pthread_cond_signal(&pool->pool_cond);
+	pthread_mutex_unlock(&pool->pool_mutex);
+
+	if (conn) {
+		cmyth_dbg(CMYTH_DBG_PROTO,
+			  "%s: dropping hung connection to %s\n",
+			  __FUNCTION__, pool->pool_server);
+		ref_release(conn);
+	}
+}
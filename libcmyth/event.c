@@ -23,25 +23,171 @@
 #include <errno.h>
 #include <cmyth_local.h>
 
-cmyth_event_t
-cmyth_event_get(cmyth_conn_t conn, char * data, int len)
+static void
+cmyth_eventinfo_destroy(cmyth_eventinfo_t ev)
 {
-	int count, err, consumed, i;
-	char tmp[1024];
-	cmyth_event_t event;
-	cmyth_proginfo_t proginfo = NULL;
+	int i;
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
+	if (!ev) {
+		return;
+	}
+
+	ref_release(ev->ev_data);
+	ref_release(ev->ev_proginfo);
+	for (i = 0; i < ev->ev_nvalues; i++) {
+		ref_release(ev->ev_names[i]);
+		ref_release(ev->ev_values[i]);
+	}
+	free(ev->ev_names);
+	free(ev->ev_values);
+}
+
+/*
+ * cmyth_eventinfo_create(cmyth_event_t type)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_eventinfo_create)
+ *
+ * Description
+ *
+ * Create an event of type 'type' with no data.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_eventinfo_t
+ *
+ * Failure: NULL
+ */
+cmyth_eventinfo_t
+cmyth_eventinfo_create(cmyth_event_t type)
+{
+	cmyth_eventinfo_t ret = ref_alloc(sizeof(*ret));
+
+	if (!ret) {
+		return NULL;
+	}
+	memset(ret, 0, sizeof(*ret));
+	ref_set_destroy(ret, (ref_destroy_t)cmyth_eventinfo_destroy);
+	ret->ev_type = type;
+
+	return ret;
+}
+
+/*
+ * Keep the part of the message 'msg' after its first 'skip' bytes as the
+ * data of the event.
+ */
+static void
+event_set_data(cmyth_eventinfo_t ev, char *msg, size_t skip)
+{
+	if (strlen(msg) < skip) {
+		skip = strlen(msg);
+	}
+	ev->ev_data = ref_strdup(msg + skip);
+}
+
+static int
+event_add_value(cmyth_eventinfo_t ev, char *name, char *value)
+{
+	char **names, **values;
+
+	names = realloc(ev->ev_names, (ev->ev_nvalues + 1) * sizeof(*names));
+	if (names == NULL) {
+		return -ENOMEM;
+	}
+	ev->ev_names = names;
+	values = realloc(ev->ev_values,
+			 (ev->ev_nvalues + 1) * sizeof(*values));
+	if (values == NULL) {
+		return -ENOMEM;
+	}
+	ev->ev_values = values;
+
+	names[ev->ev_nvalues] = ref_strdup(name);
+	values[ev->ev_nvalues] = ref_strdup(value);
+	ev->ev_nvalues++;
+
+	return 0;
+}
+
+/*
+ * Receive the program info which follows the message of some events.
+ */
+static int
+event_rcv_proginfo(cmyth_conn_t conn, cmyth_eventinfo_t ev, int count)
+{
+	cmyth_proginfo_t proginfo;
+	int err = 0;
+	int consumed;
+
+	proginfo = cmyth_proginfo_create();
+	if (!proginfo) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_proginfo_create() failed\n",
+			  __FUNCTION__);
+		return 0;
+	}
+	consumed = cmyth_rcv_proginfo(conn, &err, proginfo, count);
+	if (err) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_proginfo() failed (%d)\n",
+			  __FUNCTION__, err);
+		ref_release(proginfo);
+	} else {
+		ev->ev_proginfo = proginfo;
+	}
+
+	return consumed;
+}
+
+/*
+ * cmyth_event_next(cmyth_conn_t conn)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Wait for the next event on the event connection 'conn', and return it
+ * with everything the backend sent along with it: the rest of the
+ * message, the program info of RECORDING_LIST_CHANGE UPDATE and
+ * ASK_RECORDING events, and the signal monitor values of SIGNAL events.
+ * If the connection is lost the event is CMYTH_EVENT_CLOSE, and if the
+ * message cannot be understood it is CMYTH_EVENT_ERROR.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_eventinfo_t
+ *
+ * Failure: NULL
+ */
+cmyth_eventinfo_t
+cmyth_event_next(cmyth_conn_t conn)
+{
+	int count, size, err = 0, consumed, i;
+	char *tmp = NULL;
+	char *name;
+	cmyth_eventinfo_t ev = NULL;
 
 	if (conn == NULL)
-		goto fail;
+		return cmyth_eventinfo_create(CMYTH_EVENT_ERROR);
 
 	if ((count=cmyth_rcv_length(conn)) <= 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_length() failed (%d)\n",
 			  __FUNCTION__, count);
-		return CMYTH_EVENT_CLOSE;
+		return cmyth_eventinfo_create(CMYTH_EVENT_CLOSE);
+	}
+
+	/*
+	 * No string in the message can be longer than the message, and
+	 * leaving room to spare means they are always terminated.
+	 */
+	size = count + 2;
+	if ((tmp = malloc(size)) == NULL) {
+		goto fail;
 	}
 
-	consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count);
+	consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count);
 	count -= consumed;
 	if (strcmp(tmp, "BACKEND_MESSAGE") != 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
@@ -50,123 +196,407 @@ cmyth_event_get(cmyth_conn_t conn, char * data, int len)
 		goto fail;
 	}
 
-	consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count);
+	consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count);
 	count -= consumed;
+
+	if ((ev = cmyth_eventinfo_create(CMYTH_EVENT_UNKNOWN)) == NULL) {
+		goto fail;
+	}
+
 	if (strcmp(tmp, "RECORDING_LIST_CHANGE") == 0) {
-		event = CMYTH_EVENT_RECORDING_LIST_CHANGE;
+		ev->ev_type = CMYTH_EVENT_RECORDING_LIST_CHANGE;
 	} else if (strncmp(tmp, "RECORDING_LIST_CHANGE ADD", 25) == 0) {
-		event = CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD;
-		strncpy(data, tmp + 26, len);
+		ev->ev_type = CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD;
+		event_set_data(ev, tmp, 26);
 	} else if (strcmp(tmp, "RECORDING_LIST_CHANGE UPDATE") == 0) {
-		event = CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE;
-		/* receive a proginfo structure - do nothing with it (yet?)*/
-		proginfo = cmyth_proginfo_create();
-		if (!proginfo) {
-			cmyth_dbg(CMYTH_DBG_ERROR,
-				"%s: cmyth_proginfo_create() failed\n",
-				__FUNCTION__);
-			goto fail;
-		}
-		consumed = cmyth_rcv_proginfo(conn, &err, proginfo, count);
-		ref_release(proginfo);
-		proginfo = NULL;
-		count -= consumed;
+		ev->ev_type = CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE;
+		count -= event_rcv_proginfo(conn, ev, count);
 	} else if (strncmp(tmp, "RECORDING_LIST_CHANGE DELETE", 28) == 0) {
-		event = CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE;
-		strncpy(data, tmp + 29, len);
+		ev->ev_type = CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE;
+		event_set_data(ev, tmp, 29);
 	} else if (strcmp(tmp, "SCHEDULE_CHANGE") == 0) {
-		event = CMYTH_EVENT_SCHEDULE_CHANGE;
+		ev->ev_type = CMYTH_EVENT_SCHEDULE_CHANGE;
 	} else if (strncmp(tmp, "DONE_RECORDING", 14) == 0) {
-		event = CMYTH_EVENT_DONE_RECORDING;
+		ev->ev_type = CMYTH_EVENT_DONE_RECORDING;
+		event_set_data(ev, tmp, 15);
 	} else if (strncmp(tmp, "QUIT_LIVETV", 11) == 0) {
-		event = CMYTH_EVENT_QUIT_LIVETV;
+		ev->ev_type = CMYTH_EVENT_QUIT_LIVETV;
+		event_set_data(ev, tmp, 12);
 	} else if (strncmp(tmp, "LIVETV_WATCH", 12) == 0) {
-		event = CMYTH_EVENT_WATCH_LIVETV;
-		strncpy(data, tmp + 13, len);
+		ev->ev_type = CMYTH_EVENT_WATCH_LIVETV;
+		event_set_data(ev, tmp, 13);
 	/* Sergio: Added to support the new live tv protocol */
 	} else if (strncmp(tmp, "LIVETV_CHAIN UPDATE", 19) == 0) {
-		event = CMYTH_EVENT_LIVETV_CHAIN_UPDATE;
-		strncpy(data, tmp + 20, len);
+		ev->ev_type = CMYTH_EVENT_LIVETV_CHAIN_UPDATE;
+		event_set_data(ev, tmp, 20);
 	} else if (strncmp(tmp, "SIGNAL", 6) == 0) { 
-		event = CMYTH_EVENT_SIGNAL; 
+		ev->ev_type = CMYTH_EVENT_SIGNAL; 
+		event_set_data(ev, tmp, 7);
 		/* get slock, signal, seen_pat, matching_pat */ 
+		if ((name = malloc(size)) == NULL) {
+			goto fail;
+		}
 		while (count > 0) { 
 			/* get signalmonitorvalue name */ 
-			consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count); 
+			consumed = cmyth_rcv_string(conn, &err, name, size - 1, count); 
 			count -= consumed; 
 
 			/* get signalmonitorvalue status */ 
-			consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count); 
+			consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count); 
 			count -= consumed; 
+
+			if (err || (event_add_value(ev, name, tmp) < 0)) {
+				break;
+			}
 		}
+		free(name);
 	} else if (strncmp(tmp, "ASK_RECORDING", 13) == 0) {
-		event = CMYTH_EVENT_ASK_RECORDING;
+		ev->ev_type = CMYTH_EVENT_ASK_RECORDING;
+		event_set_data(ev, tmp, 14);
 		if (cmyth_conn_get_protocol_version(conn) < 37) {
 			/* receive 4 string - do nothing with them */
 			for (i = 0; i < 4; i++) {
-				consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) -1, count);
+				consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count);
 				count -= consumed;
 			}
 		} else {
-			/* receive a proginfo structure - do nothing with it (yet?)*/
-			proginfo = cmyth_proginfo_create();
-			if (!proginfo) {
-				cmyth_dbg(CMYTH_DBG_ERROR,
-					"%s: cmyth_proginfo_create() failed\n",
-					__FUNCTION__);
-				goto fail;
-			}
-			consumed = cmyth_rcv_proginfo(conn, &err, proginfo, count);
-			ref_release(proginfo);
-			proginfo = NULL;
-			count -= consumed;
+			count -= event_rcv_proginfo(conn, ev, count);
 		}
 	} else if (strncmp(tmp, "CLEAR_SETTINGS_CACHE", 20) == 0) {
-		event = CMYTH_EVENT_CLEAR_SETTINGS_CACHE;
+		ev->ev_type = CMYTH_EVENT_CLEAR_SETTINGS_CACHE;
 	} else if (strncmp(tmp, "GENERATED_PIXMAP", 16) == 0) {
 		/* capture the file which a pixmap has been generated for */
-		event = CMYTH_EVENT_GENERATED_PIXMAP;
-		consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count);
+		ev->ev_type = CMYTH_EVENT_GENERATED_PIXMAP;
+		consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count);
 		count -= consumed;
 		if (strncmp(tmp, "OK", 2) == 0) {
-			consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count);
+			consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count);
 			count -= consumed;
-			strncpy(data, tmp, len);
-		} else {
-			data[0] = 0;
+			event_set_data(ev, tmp, 0);
 		}
 	} else if (strncmp(tmp, "SYSTEM_EVENT", 12) == 0) {
-		event = CMYTH_EVENT_SYSTEM_EVENT;
-		strncpy(data, tmp + 13, len);
+		ev->ev_type = CMYTH_EVENT_SYSTEM_EVENT;
+		event_set_data(ev, tmp, 13);
 	} else if (strncmp(tmp, "UPDATE_FILE_SIZE", 16) == 0) {
-		event = CMYTH_EVENT_UPDATE_FILE_SIZE;
-		strncpy(data, tmp + 17, len);
+		ev->ev_type = CMYTH_EVENT_UPDATE_FILE_SIZE;
+		event_set_data(ev, tmp, 17);
 	} else if (strncmp(tmp, "COMMFLAG_START", 14) == 0) {
-		event = CMYTH_EVENT_COMMFLAG_START;
-		strncpy(data, tmp + 15, len);
+		ev->ev_type = CMYTH_EVENT_COMMFLAG_START;
+		event_set_data(ev, tmp, 15);
+	} else if (strncmp(tmp, "COMMFLAG_UPDATE", 15) == 0) {
+		ev->ev_type = CMYTH_EVENT_COMMFLAG_UPDATE;
+		event_set_data(ev, tmp, 16);
 	} else {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: unknown mythtv BACKEND_MESSAGE '%s'\n", __FUNCTION__, tmp);
-		event = CMYTH_EVENT_UNKNOWN;
-		strncpy(data, tmp, len);
+		ev->ev_type = CMYTH_EVENT_UNKNOWN;
+		event_set_data(ev, tmp, 0);
 	}
 
 	while(count > 0) {
-		consumed = cmyth_rcv_string(conn, &err, tmp, sizeof(tmp) - 1, count);
+		consumed = cmyth_rcv_string(conn, &err, tmp, size - 1, count);
 		count -= consumed;
 		cmyth_dbg(CMYTH_DBG_DEBUG, "%s: leftover data %s\n", __FUNCTION__, tmp);
 	}
 
-	return event;
+	free(tmp);
+
+	return ev;
 
  fail:
-	return CMYTH_EVENT_ERROR;
+	free(tmp);
+	ref_release(ev);
+	return cmyth_eventinfo_create(CMYTH_EVENT_ERROR);
+}
+
+/*
+ * cmyth_event_drain(cmyth_conn_t conn, cmyth_eventinfo_t *events, int max)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Read up to 'max' of the events which have already arrived on the event
+ * connection 'conn' into 'events', without waiting for more.  Each event
+ * returned must be released by the caller.  Nothing is read after a
+ * CMYTH_EVENT_CLOSE.
+ *
+ * Return Value:
+ *
+ * Success: The number of events, which is 0 if none were waiting
+ *
+ * Failure: -errno
+ */
+int
+cmyth_event_drain(cmyth_conn_t conn, cmyth_eventinfo_t *events, int max)
+{
+	int n = 0, r;
+
+	if ((conn == NULL) || (events == NULL) || (max < 0)) {
+		return -EINVAL;
+	}
+
+	while (n < max) {
+		if ((r = cmyth_io_wait(conn->conn_fd, CMYTH_IO_READ, 0)) < 0) {
+			return (n > 0) ? n : r;
+		}
+		if (r == 0) {
+			break;
+		}
+		if ((events[n] = cmyth_event_next(conn)) == NULL) {
+			break;
+		}
+		if (events[n++]->ev_type == CMYTH_EVENT_CLOSE) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * cmyth_event_get_proginfo(cmyth_conn_t conn, char *data, int len,
+ *                          cmyth_proginfo_t *prog)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Read the next event from the event connection 'conn', copying up to
+ * 'len' bytes of any data it carries into 'data'.  The program info
+ * carried by the event is returned held in 'prog' if it is not NULL.
+ * Otherwise 'prog' is set to NULL.
+ *
+ * Return Value:
+ *
+ * The type of the event
+ */
+cmyth_event_t
+cmyth_event_get_proginfo(cmyth_conn_t conn, char *data, int len,
+			 cmyth_proginfo_t *prog)
+{
+	cmyth_eventinfo_t ev;
+	cmyth_event_t event;
+
+	if (prog)
+		*prog = NULL;
+
+	if ((ev = cmyth_event_next(conn)) == NULL)
+		return CMYTH_EVENT_ERROR;
+
+	event = ev->ev_type;
+	if (ev->ev_data) {
+		strncpy(data, ev->ev_data, len);
+	} else if (event == CMYTH_EVENT_GENERATED_PIXMAP) {
+		data[0] = 0;
+	}
+	if (prog)
+		*prog = ref_hold(ev->ev_proginfo);
+
+	ref_release(ev);
+
+	return event;
+}
+
+/*
+ * cmyth_event_get(cmyth_conn_t conn, char *data, int len)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Read the next event from the event connection 'conn', copying up to
+ * 'len' bytes of any data it carries into 'data'.  DONE_RECORDING,
+ * QUIT_LIVETV, SIGNAL and ASK_RECORDING events leave 'data' untouched,
+ * as they always have; their data is only available through
+ * cmyth_event_next() and cmyth_event_get_proginfo().
+ *
+ * Return Value:
+ *
+ * The type of the event
+ */
+cmyth_event_t
+cmyth_event_get(cmyth_conn_t conn, char * data, int len)
+{
+	cmyth_eventinfo_t ev;
+	cmyth_event_t event;
+
+	if ((ev = cmyth_event_next(conn)) == NULL)
+		return CMYTH_EVENT_ERROR;
+
+	event = ev->ev_type;
+	switch (event) {
+	case CMYTH_EVENT_DONE_RECORDING:
+	case CMYTH_EVENT_QUIT_LIVETV:
+	case CMYTH_EVENT_SIGNAL:
+	case CMYTH_EVENT_ASK_RECORDING:
+		break;
+	default:
+		if (ev->ev_data) {
+			strncpy(data, ev->ev_data, len);
+		} else if (event == CMYTH_EVENT_GENERATED_PIXMAP) {
+			data[0] = 0;
+		}
+		break;
+	}
+
+	ref_release(ev);
+
+	return event;
+}
+
+/*
+ * cmyth_eventinfo_type(cmyth_eventinfo_t ev)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the type of the event 'ev'.
+ *
+ * Return Value:
+ *
+ * Success: The event type
+ *
+ * Failure: CMYTH_EVENT_ERROR
+ */
+cmyth_event_t
+cmyth_eventinfo_type(cmyth_eventinfo_t ev)
+{
+	if (!ev) {
+		return CMYTH_EVENT_ERROR;
+	}
+	return ev->ev_type;
+}
+
+/*
+ * cmyth_eventinfo_data(cmyth_eventinfo_t ev)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the data of the event 'ev': the rest of the backend message
+ * after the name of the event, or the file name of a GENERATED_PIXMAP
+ * event.
+ *
+ * Return Value:
+ *
+ * Success: A held string
+ *
+ * Failure: NULL, if the event has no data
+ */
+char *
+cmyth_eventinfo_data(cmyth_eventinfo_t ev)
+{
+	if (!ev) {
+		return NULL;
+	}
+	return ref_hold(ev->ev_data);
+}
+
+/*
+ * cmyth_eventinfo_proginfo(cmyth_eventinfo_t ev)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the program info sent with the event 'ev', which is the
+ * recording of a RECORDING_LIST_CHANGE UPDATE event or the upcoming
+ * recording of an ASK_RECORDING event.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_proginfo_t
+ *
+ * Failure: NULL, if the event has no program info
+ */
+cmyth_proginfo_t
+cmyth_eventinfo_proginfo(cmyth_eventinfo_t ev)
+{
+	if (!ev) {
+		return NULL;
+	}
+	return ref_hold(ev->ev_proginfo);
+}
+
+/*
+ * cmyth_eventinfo_value_count(cmyth_eventinfo_t ev)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the number of named values sent with the event 'ev', such as
+ * the signal monitor values of a SIGNAL event.
+ *
+ * Return Value:
+ *
+ * Success: The number of values
+ *
+ * Failure: -EINVAL
+ */
+int
+cmyth_eventinfo_value_count(cmyth_eventinfo_t ev)
+{
+	if (!ev) {
+		return -EINVAL;
+	}
+	return ev->ev_nvalues;
+}
+
+/*
+ * cmyth_eventinfo_value_name(cmyth_eventinfo_t ev, int index)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the name of value 'index' of the event 'ev'.
+ *
+ * Return Value:
+ *
+ * Success: A held string
+ *
+ * Failure: NULL
+ */
+char *
+cmyth_eventinfo_value_name(cmyth_eventinfo_t ev, int index)
+{
+	if (!ev || (index < 0) || (index >= ev->ev_nvalues)) {
+		return NULL;
+	}
+	return ref_hold(ev->ev_names[index]);
+}
+
+/*
+ * cmyth_eventinfo_value(cmyth_eventinfo_t ev, int index)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve value 'index' of the event 'ev'.
+ *
+ * Return Value:
+ *
+ * Success: A held string
+ *
+ * Failure: NULL
+ */
+char *
+cmyth_eventinfo_value(cmyth_eventinfo_t ev, int index)
+{
+	if (!ev || (index < 0) || (index >= ev->ev_nvalues)) {
+		return NULL;
+	}
+	return ref_hold(ev->ev_values[index]);
 }
 
 int
 cmyth_event_select(cmyth_conn_t conn, struct timeval *timeout)
 {
-	fd_set fds;
 	int ret;
 	cmyth_socket_t fd;
 
@@ -178,10 +608,7 @@ cmyth_event_select(cmyth_conn_t conn, struct timeval *timeout)
 
 	fd = conn->conn_fd;
 
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
-
-	ret = select((int)fd+1, &fds, NULL, NULL, timeout);
+	ret = cmyth_io_wait(fd, CMYTH_IO_READ, cmyth_io_timeval(timeout));
 
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s [%s:%d]: (trace) }\n",
 				__FUNCTION__, __FILE__, __LINE__);
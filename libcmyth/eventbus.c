@@ -0,0 +1,562 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * eventbus.c - Process wide event dispatcher.  Every part of a program
+ *              that wants the events of a backend subscribes here, and
+ *              shares a single event connection to that backend and a
+ *              single thread reading from it.  The connection is opened
+ *              when the first subscriber of a backend arrives, reopened
+ *              if it is lost, and closed when the last one leaves.
+ *
+ *              A subscriber either has a callback, which is called on
+ *              the dispatcher thread, or reads its events from a queue.
+ *              The queue is a ring with a single writer (the dispatcher)
+ *              and a single reader, so neither side takes a lock unless
+ *              the reader has to sleep.  When the ring is full, events
+ *              are dropped until the reader has caught up, at which
+ *              point it gets a CMYTH_EVENT_ERROR event to tell it so.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <cmyth_local.h>
+
+#define EVENT_RETRY_MIN		1	/* seconds */
+#define EVENT_RETRY_MAX		30	/* seconds */
+
+struct event_bus {
+	char *eb_server;
+	unsigned short eb_port;
+	cmyth_conn_t eb_conn;
+	pthread_t eb_thread;
+	cmyth_event_sub_t eb_subs;
+	cmyth_event_sub_t eb_busy;	/* subscriber in its callback */
+	unsigned long eb_serial;	/* connections made so far */
+	int eb_stop;
+	struct event_bus *eb_next;
+};
+
+/*
+ * bus_mutex protects the list of backends, the subscribers of each and
+ * everything in struct event_bus.  bus_cond is signalled when a callback
+ * returns and when a backend is stopped.
+ */
+static pthread_mutex_t bus_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bus_cond = PTHREAD_COND_INITIALIZER;
+static struct event_bus *bus_list;
+
+static void
+event_deadline(struct timespec *ts, int ms)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	ts->tv_sec = tv.tv_sec + ms / 1000;
+	ts->tv_nsec = tv.tv_usec * 1000 + (ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static void
+cmyth_event_sub_destroy(cmyth_event_sub_t sub)
+{
+	int i;
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
+	if (!sub) {
+		return;
+	}
+
+	for (i = 0; i < CMYTH_EVENT_QUEUE_SIZE; i++) {
+		ref_release(sub->sub_queue[i]);
+	}
+	pthread_mutex_destroy(&sub->sub_mutex);
+	pthread_cond_destroy(&sub->sub_cond);
+}
+
+/*
+ * Add the event 'ev' to the queue of 'sub'.  Only the dispatcher thread
+ * writes to a queue.
+ */
+static void
+event_sub_push(cmyth_event_sub_t sub, cmyth_eventinfo_t ev)
+{
+	unsigned int tail = sub->sub_tail;
+
+	if (sub->sub_lost ||
+	    (tail - sub->sub_head >= CMYTH_EVENT_QUEUE_SIZE)) {
+		__sync_fetch_and_add(&sub->sub_lost, 1);
+		return;
+	}
+
+	sub->sub_queue[tail % CMYTH_EVENT_QUEUE_SIZE] = ref_hold(ev);
+	__sync_synchronize();
+	sub->sub_tail = tail + 1;
+	__sync_synchronize();
+
+	if (sub->sub_waiting) {
+		pthread_mutex_lock(&sub->sub_mutex);
+		pthread_cond_signal(&sub->sub_cond);
+		pthread_mutex_unlock(&sub->sub_mutex);
+	}
+}
+
+/*
+ * Hand the event 'ev' to every subscriber of 'eb' which wants it.
+ * CLOSE and ERROR events go to everyone, since they mean events may have
+ * been missed.  Called with bus_mutex held, which is dropped around each
+ * callback, so the subscribers are collected first.
+ */
+static void
+event_bus_dispatch(struct event_bus *eb, cmyth_eventinfo_t ev)
+{
+	cmyth_event_sub_t sub, *subs;
+	unsigned long bit = CMYTH_EVENT_MASK(ev->ev_type);
+	int i, n = 0;
+
+	if ((ev->ev_type == CMYTH_EVENT_CLOSE) ||
+	    (ev->ev_type == CMYTH_EVENT_ERROR)) {
+		bit = CMYTH_EVENT_MASK_ALL;
+	}
+
+	for (sub = eb->eb_subs; sub; sub = sub->sub_next) {
+		n++;
+	}
+	if ((n == 0) || ((subs = malloc(n * sizeof(*subs))) == NULL)) {
+		return;
+	}
+	n = 0;
+	for (sub = eb->eb_subs; sub; sub = sub->sub_next) {
+		if (sub->sub_mask & bit) {
+			subs[n++] = ref_hold(sub);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		sub = subs[i];
+		if (!sub->sub_active) {
+			/* unsubscribed by an earlier callback */
+		} else if (sub->sub_callback == NULL) {
+			event_sub_push(sub, ev);
+		} else {
+			eb->eb_busy = sub;
+			pthread_mutex_unlock(&bus_mutex);
+			sub->sub_callback(sub, ev, sub->sub_data);
+			pthread_mutex_lock(&bus_mutex);
+			eb->eb_busy = NULL;
+			pthread_cond_broadcast(&bus_cond);
+		}
+		ref_release(sub);
+	}
+
+	free(subs);
+}
+
+static void*
+event_bus_loop(void *arg)
+{
+	struct event_bus *eb = (struct event_bus*)arg;
+	struct timespec ts;
+	cmyth_conn_t conn;
+	cmyth_eventinfo_t ev;
+	int delay = EVENT_RETRY_MIN;
+	int retry = 0;
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s(): thread started for %s:%d\n",
+		  __FUNCTION__, eb->eb_server, eb->eb_port);
+
+	pthread_detach(pthread_self());
+
+	pthread_mutex_lock(&bus_mutex);
+
+	while (!eb->eb_stop) {
+		if (eb->eb_conn == NULL) {
+			/*
+			 * Only the first connect is made straight away.  A
+			 * backend which keeps accepting the connection and
+			 * dropping it is backed off from just like one which
+			 * refuses it.
+			 */
+			if (retry) {
+				event_deadline(&ts, delay * 1000);
+				while (!eb->eb_stop &&
+				       (pthread_cond_timedwait(&bus_cond,
+							       &bus_mutex,
+							       &ts) == 0))
+					;
+				if (delay < EVENT_RETRY_MAX) {
+					delay *= 2;
+				}
+				if (eb->eb_stop) {
+					continue;
+				}
+			}
+			retry = 1;
+			pthread_mutex_unlock(&bus_mutex);
+			conn = cmyth_conn_connect_event(eb->eb_server,
+							eb->eb_port,
+							16*1024, 4096);
+			pthread_mutex_lock(&bus_mutex);
+			if (conn == NULL) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: cannot connect to %s:%d, "
+					  "retrying in %d seconds\n",
+					  __FUNCTION__, eb->eb_server,
+					  eb->eb_port, delay);
+				continue;
+			}
+			eb->eb_conn = conn;
+			eb->eb_serial++;
+			continue;
+		}
+
+		conn = ref_hold(eb->eb_conn);
+		pthread_mutex_unlock(&bus_mutex);
+		ev = cmyth_event_next(conn);
+		ref_release(conn);
+		pthread_mutex_lock(&bus_mutex);
+
+		if (ev == NULL) {
+			continue;
+		}
+		if (ev->ev_type == CMYTH_EVENT_CLOSE) {
+			ref_release(eb->eb_conn);
+			eb->eb_conn = NULL;
+		} else if (ev->ev_type != CMYTH_EVENT_ERROR) {
+			/*
+			 * The connection works, so the next drop starts
+			 * backing off from the beginning again.
+			 */
+			delay = EVENT_RETRY_MIN;
+		}
+		if (!eb->eb_stop) {
+			event_bus_dispatch(eb, ev);
+		}
+		ref_release(ev);
+	}
+
+	pthread_mutex_unlock(&bus_mutex);
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s(): thread done for %s:%d\n",
+		  __FUNCTION__, eb->eb_server, eb->eb_port);
+
+	ref_release(eb->eb_conn);
+	free(eb->eb_server);
+	free(eb);
+
+	return NULL;
+}
+
+/*
+ * cmyth_event_subscribe(char *server, unsigned short port,
+ *                       unsigned long mask,
+ *                       cmyth_event_callback_t callback, void *data)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Subscribe to the events of the backend at 'server' and 'port' whose
+ * types are in 'mask', a combination of CMYTH_EVENT_MASK() values.  All
+ * the subscribers of a backend share one event connection, which is
+ * opened in the background by the first of them.  CLOSE and ERROR
+ * events are delivered whatever the mask says, as they mean events may
+ * have been missed; after a CLOSE the connection is reopened.
+ *
+ * If 'callback' is not NULL it is called with each event and 'data',
+ * on the dispatcher thread, which is shared with every other subscriber
+ * of the backend and should not be kept waiting.  The event is only
+ * valid during the call unless the callback holds it.  Otherwise the
+ * events are queued, to be read by one thread with cmyth_event_sub_next().
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_event_sub_t, to be passed to
+ *          cmyth_event_unsubscribe() and then released
+ *
+ * Failure: NULL
+ */
+cmyth_event_sub_t
+cmyth_event_subscribe(char *server, unsigned short port, unsigned long mask,
+		      cmyth_event_callback_t callback, void *data)
+{
+	cmyth_event_sub_t sub, *last;
+	struct event_bus *eb;
+
+	if (!server) {
+		return NULL;
+	}
+
+	sub = ref_alloc(sizeof(*sub));
+	if (!sub) {
+		return NULL;
+	}
+	memset(sub, 0, sizeof(*sub));
+	pthread_mutex_init(&sub->sub_mutex, NULL);
+	pthread_cond_init(&sub->sub_cond, NULL);
+	ref_set_destroy(sub, (ref_destroy_t)cmyth_event_sub_destroy);
+	sub->sub_mask = mask;
+	sub->sub_callback = callback;
+	sub->sub_data = data;
+
+	pthread_mutex_lock(&bus_mutex);
+
+	for (eb = bus_list; eb; eb = eb->eb_next) {
+		if ((eb->eb_port == port) &&
+		    (strcmp(eb->eb_server, server) == 0)) {
+			break;
+		}
+	}
+
+	if (eb == NULL) {
+		if ((eb = calloc(1, sizeof(*eb))) == NULL) {
+			goto fail;
+		}
+		if ((eb->eb_server = strdup(server)) == NULL) {
+			free(eb);
+			goto fail;
+		}
+		eb->eb_port = port;
+		if (pthread_create(&eb->eb_thread, NULL, event_bus_loop,
+				   (void*)eb) != 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: pthread_create() failed\n",
+				  __FUNCTION__);
+			free(eb->eb_server);
+			free(eb);
+			goto fail;
+		}
+		eb->eb_next = bus_list;
+		bus_list = eb;
+	}
+
+	for (last = &eb->eb_subs; *last; last = &(*last)->sub_next)
+		;
+	*last = ref_hold(sub);
+	sub->sub_bus = eb;
+	sub->sub_active = 1;
+
+	pthread_mutex_unlock(&bus_mutex);
+
+	return sub;
+
+    fail:
+	pthread_mutex_unlock(&bus_mutex);
+	ref_release(sub);
+	return NULL;
+}
+
+/*
+ * cmyth_event_unsubscribe(cmyth_event_sub_t sub)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Stop delivering events to the subscriber 'sub'.  If its callback is
+ * running on another thread, wait for it to return, so that whatever it
+ * uses may be freed afterwards.  A reader waiting in
+ * cmyth_event_sub_next() is woken up.  When the last subscriber of a
+ * backend leaves, its event connection is closed.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_event_unsubscribe(cmyth_event_sub_t sub)
+{
+	cmyth_event_sub_t *p;
+	struct event_bus *eb, **e;
+
+	if (!sub) {
+		return;
+	}
+
+	pthread_mutex_lock(&bus_mutex);
+
+	if (!sub->sub_active) {
+		pthread_mutex_unlock(&bus_mutex);
+		return;
+	}
+	sub->sub_active = 0;
+	eb = sub->sub_bus;
+	sub->sub_bus = NULL;
+
+	for (p = &eb->eb_subs; *p; p = &(*p)->sub_next) {
+		if (*p == sub) {
+			*p = sub->sub_next;
+			break;
+		}
+	}
+	sub->sub_next = NULL;
+
+	while ((eb->eb_busy == sub) &&
+	       !pthread_equal(eb->eb_thread, pthread_self())) {
+		pthread_cond_wait(&bus_cond, &bus_mutex);
+	}
+
+	if (eb->eb_subs == NULL) {
+		for (e = &bus_list; *e; e = &(*e)->eb_next) {
+			if (*e == eb) {
+				*e = eb->eb_next;
+				break;
+			}
+		}
+		eb->eb_stop = 1;
+		if (eb->eb_conn && (eb->eb_conn->conn_fd >= 0)) {
+			/* wake the dispatcher up from its read */
+			shutdown(eb->eb_conn->conn_fd, SHUT_RDWR);
+		}
+		pthread_cond_broadcast(&bus_cond);
+	}
+
+	pthread_mutex_unlock(&bus_mutex);
+
+	pthread_mutex_lock(&sub->sub_mutex);
+	pthread_cond_signal(&sub->sub_cond);
+	pthread_mutex_unlock(&sub->sub_mutex);
+
+	ref_release(sub);
+}
+
+/*
+ * cmyth_event_sub_next(cmyth_event_sub_t sub, int timeout)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Take the next event from the queue of the subscriber 'sub', which was
+ * subscribed without a callback, waiting up to 'timeout' milliseconds
+ * for one to arrive (forever if 'timeout' is negative).  Only one thread
+ * may read from a subscriber.  If events had to be dropped because the
+ * queue was full, a CMYTH_EVENT_ERROR event is returned after the ones
+ * that were queued.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_eventinfo_t
+ *
+ * Failure: NULL on timeout, or if the subscriber was unsubscribed
+ */
+cmyth_eventinfo_t
+cmyth_event_sub_next(cmyth_event_sub_t sub, int timeout)
+{
+	cmyth_eventinfo_t ev;
+	struct timespec ts;
+	unsigned int head;
+	char msg[64];
+	int lost, rc = 0;
+
+	if (!sub || sub->sub_callback) {
+		return NULL;
+	}
+
+	if (timeout > 0) {
+		event_deadline(&ts, timeout);
+	}
+
+	while (1) {
+		head = sub->sub_head;
+		if (head != sub->sub_tail) {
+			__sync_synchronize();
+			ev = sub->sub_queue[head % CMYTH_EVENT_QUEUE_SIZE];
+			sub->sub_queue[head % CMYTH_EVENT_QUEUE_SIZE] = NULL;
+			__sync_synchronize();
+			sub->sub_head = head + 1;
+			return ev;
+		}
+
+		if ((lost = __sync_fetch_and_and(&sub->sub_lost, 0)) > 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: %d events lost\n", __FUNCTION__, lost);
+			ev = cmyth_eventinfo_create(CMYTH_EVENT_ERROR);
+			if (ev) {
+				snprintf(msg, sizeof(msg),
+					 "%d events lost", lost);
+				ev->ev_data = ref_strdup(msg);
+			}
+			return ev;
+		}
+
+		if ((timeout == 0) || (rc != 0) || !sub->sub_active) {
+			return NULL;
+		}
+
+		pthread_mutex_lock(&sub->sub_mutex);
+		sub->sub_waiting = 1;
+		__sync_synchronize();
+		if ((sub->sub_head == sub->sub_tail) && !sub->sub_lost &&
+		    sub->sub_active) {
+			if (timeout < 0) {
+				pthread_cond_wait(&sub->sub_cond,
+						  &sub->sub_mutex);
+			} else {
+				rc = pthread_cond_timedwait(&sub->sub_cond,
+							    &sub->sub_mutex,
+							    &ts);
+			}
+		}
+		sub->sub_waiting = 0;
+		pthread_mutex_unlock(&sub->sub_mutex);
+	}
+}
+
+/*
+ * cmyth_event_sub_connected(cmyth_event_sub_t sub)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Tell whether the event connection shared by the subscriber 'sub' is
+ * up.  Each connection to the backend gets a new number, so a caller
+ * can tell whether events may have been missed between two calls
+ * by comparing the numbers returned.
+ *
+ * Return Value:
+ *
+ * Success: The number of the connection, which is never 0
+ *
+ * Failure: 0, if the connection is down or 'sub' was unsubscribed
+ */
+unsigned long
+cmyth_event_sub_connected(cmyth_event_sub_t sub)
+{
+	unsigned long ret = 0;
+
+	if (!sub) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&bus_mutex);
+	if (sub->sub_active && sub->sub_bus && sub->sub_bus->eb_conn) {
+		ret = sub->sub_bus->eb_serial;
+	}
+	pthread_mutex_unlock(&bus_mutex);
+
+	return ret;
+}
@@ -17,13 +17,96 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <cmyth_local.h>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#define FILE_HAS_SPLICE
+#endif
+
+/*
+ * Requests sent in one pass of the read-ahead thread before it lets go of
+ * the control connection, so other users of the connection get a turn.
+ */
+#define RA_ROUND_MAX	64
+
+/*
+ * cmyth_file_copy_to_fd() keeps COPY_DEPTH requests in flight, of the
+ * size chosen by the block size controller of the data connection.  Data
+ * which cannot be spliced bounces through a buffer of COPY_BLOCK_MIN.
+ */
+#define COPY_BLOCK_MIN	(128 * 1024)
+#define COPY_DEPTH	4
+#define COPY_PIPE_SIZE	(1024 * 1024)
+
+/*
+ * Read-ahead state of a file.  The ring holds ra_nslots buffers of
+ * ra_block bytes.  The ra_count buffers starting at ra_head hold data
+ * which has not been consumed yet, and the consumer has used the first
+ * ra_off bytes of the buffer at ra_head.  The thread owns the rest of the
+ * ring.  Everything here is protected by ra_mutex, except the buffer
+ * contents, which belong to whichever side owns the buffer.
+ *
+ * The read-ahead thread always takes the control connection mutex before
+ * ra_mutex, so nothing may wait for the control connection while
+ * holding ra_mutex.
+ */
+struct cmyth_file_readahead {
+	pthread_t ra_thread;
+	pthread_mutex_t ra_mutex;
+	pthread_cond_t ra_cond;
+	int ra_depth;			/* requests kept in flight */
+	unsigned long ra_block;		/* largest request */
+	int ra_nslots;
+	char **ra_buf;
+	long *ra_len;
+	unsigned long *ra_asked;	/* request for each buffer */
+	long long *ra_sent;		/* when it was sent */
+	int ra_head;
+	int ra_count;
+	long ra_off;
+	uint64_t ra_pos;		/* position of the consumer */
+	int ra_stop;
+	int ra_pause;
+	int ra_busy;			/* thread is using the connections */
+	int ra_eof;
+	int ra_err;
+};
+
+/*
+ * Block cache state of a file.  fc_block holds fc_len bytes from the
+ * start of block fc_index, which is a complete block unless it is the
+ * end of the file.  fc_pending bytes at fc_data have been requested with
+ * cmyth_file_request_block() but not yet read.  Reading from the cache
+ * does not move the backend, so its position is tracked in fc_remote.
+ */
+struct cmyth_file_cache {
+	uint64_t fc_remote;
+	uint64_t fc_index;
+	long fc_len;
+	char *fc_data;
+	long fc_pending;
+	char fc_block[CMYTH_CACHE_BLOCK];
+};
+
+#define FC_REMOTE_UNKNOWN	((uint64_t)-1)
+
+static void cmyth_file_readahead_stop(cmyth_file_t file);
+static long cmyth_file_cache_fill(cmyth_file_t file, unsigned long len);
+static long long cmyth_file_seek_backend(cmyth_file_t file,
+					 long long offset, int whence);
+
 /*
  * cmyth_file_destroy(cmyth_file_t file)
  * 
@@ -50,6 +133,9 @@ cmyth_file_destroy(cmyth_file_t file)
 		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!\n", __FUNCTION__);
 		return;
 	}
+	if (file->file_ra) {
+		cmyth_file_readahead_stop(file);
+	}
 	if (file->file_control) {
 		pthread_mutex_lock(&file->file_control->conn_mutex);
 
@@ -80,6 +166,11 @@ cmyth_file_destroy(cmyth_file_t file)
 	if (file->file_data) {
 		ref_release(file->file_data);
 	}
+	if (file->file_cache) {
+		free(file->file_cache);
+	}
+	ref_release(file->file_path);
+	ref_release(file->file_host);
 
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
 }
@@ -119,6 +210,10 @@ cmyth_file_create(cmyth_conn_t control)
 	ret->file_start = 0;
 	ret->file_length = 0;
 	ret->file_pos = 0;
+	ret->file_ra = NULL;
+	ret->file_path = NULL;
+	ret->file_host = NULL;
+	ret->file_cache = NULL;
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
 	return ret;
 }
@@ -201,47 +296,23 @@ cmyth_file_length(cmyth_file_t file)
 }
 
 /*
- * cmyth_file_get_block(cmyth_file_t file, char *buf, unsigned long len)
- * 
- * Scope: PUBLIC
- *
- * Description
- *
- * Read incoming file data off the network into a buffer of length len.
- *
- * Return Value:
- *
- * Sucess: number of bytes read into buf
- *
- * Failure: -1
+ * Read whatever data has arrived on the data connection, up to 'len'
+ * bytes.
  */
-int
-cmyth_file_get_block(cmyth_file_t file, char *buf, unsigned long len)
+static int
+cmyth_file_rcv_block(cmyth_file_t file, char *buf, unsigned long len)
 {
-	struct timeval tv;
-	fd_set fds;
-
-	if (file == NULL || file->file_data == NULL)
-		return -EINVAL;
-
 	while (1) {
 		int rc;
 
-		tv.tv_sec = 10;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(file->file_data->conn_fd, &fds);
-		rc = select(file->file_data->conn_fd+1, NULL, &fds, NULL, &tv);
+		rc = cmyth_io_wait(file->file_data->conn_fd, CMYTH_IO_READ,
+				   file->file_data->conn_timeout);
 
 		if (rc == 0) {
 			file->file_data->conn_hang = 1;
 			return 0;
 		} else if (rc < 0) {
-			if (errno == EINTR) {
-				continue;
-			} else {
-				return -errno;
-			}
+			return rc;
 		} else {
 			file->file_data->conn_hang = 0;
 		}
@@ -260,22 +331,84 @@ cmyth_file_get_block(cmyth_file_t file, char *buf, unsigned long len)
 	}
 }
 
+/*
+ * cmyth_file_get_block(cmyth_file_t file, char *buf, unsigned long len)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Read incoming file data off the network into a buffer of length len.
+ *
+ * Return Value:
+ *
+ * Sucess: number of bytes read into buf
+ *
+ * Failure: -1
+ */
+int
+cmyth_file_get_block(cmyth_file_t file, char *buf, unsigned long len)
+{
+	if (file == NULL || file->file_data == NULL)
+		return -EINVAL;
+	if (file->file_ra)
+		return -EBUSY;
+
+	if (file->file_cache) {
+		struct cmyth_file_cache *fc = file->file_cache;
+
+		if ((long)len > fc->fc_pending)
+			len = fc->fc_pending;
+		memcpy(buf, fc->fc_data, len);
+		fc->fc_data += len;
+		fc->fc_pending -= len;
+		return len;
+	}
+
+	return cmyth_file_rcv_block(file, buf, len);
+}
+
+/*
+ * Read all 'len' bytes of a requested block off the data connection.
+ * Returns 0 or -errno.
+ */
+static int
+cmyth_file_rcv_data(cmyth_file_t file, char *buf, long len)
+{
+	long tot = 0;
+	int n;
+
+	while (tot < len) {
+		n = cmyth_file_rcv_block(file, buf + tot, len - tot);
+		if (n < 0) {
+			return n;
+		}
+		if (n == 0) {
+			return file->file_data->conn_hang ? -ETIMEDOUT
+							  : -ECONNRESET;
+		}
+		tot += n;
+	}
+
+	return 0;
+}
+
 int
 cmyth_file_select(cmyth_file_t file, struct timeval *timeout)
 {
-	fd_set fds;
 	int ret;
 	cmyth_socket_t fd;
 
 	if (file == NULL || file->file_data == NULL)
 		return -EINVAL;
+	if (file->file_ra)
+		return -EBUSY;
+	if (file->file_cache)
+		return file->file_cache->fc_pending > 0;
 
 	fd = file->file_data->conn_fd;
 
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
-
-	ret = select(fd+1, &fds, NULL, NULL, timeout);
+	ret = cmyth_io_wait(fd, CMYTH_IO_READ, cmyth_io_timeval(timeout));
 
 	if (ret == 0)
 		file->file_data->conn_hang = 1;
@@ -286,37 +419,15 @@ cmyth_file_select(cmyth_file_t file, struct timeval *timeout)
 }
 
 /*
- * cmyth_file_request_block(cmyth_file_t file, unsigned long len)
- * 
- * Scope: PUBLIC
- *
- * Description
- *
- * Request a file data block of a certain size, and return when the
- * block has been transfered.
- *
- * Return Value:
- *
- * Sucess: number of bytes transfered
- *
- * Failure: an int containing -errno
+ * Send a REQUEST_BLOCK for 'len' bytes.  The caller must hold the control
+ * connection mutex.
  */
-int
-cmyth_file_request_block(cmyth_file_t file, unsigned long len)
+static int
+cmyth_file_send_request(cmyth_file_t file, unsigned long len)
 {
-	int err, count;
-	int r;
-	long c, ret;
+	int err;
 	char msg[256];
 
-	if (!file) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
-			  __FUNCTION__);
-		return -EINVAL;
-	}
-
-	pthread_mutex_lock(&file->file_control->conn_mutex);
-
 #ifdef LIBCMYTH_READ_SINGLE_THREAD
 	if(len > (unsigned int)file->file_control->conn_tcp_rcvbuf)
 		len = (unsigned int)file->file_control->conn_tcp_rcvbuf;
@@ -330,137 +441,1385 @@ cmyth_file_request_block(cmyth_file_t file, unsigned long len)
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_send_message() failed (%d)\n",
 			  __FUNCTION__, err);
-		ret = err;
-		goto out;
 	}
 
+	return err;
+}
+
+/*
+ * Receive the reply to a REQUEST_BLOCK, which is the number of bytes the
+ * backend sent on the data connection, into 'len'.  The backend sends the
+ * data before the reply.  The caller must hold the control connection
+ * mutex.  Returns 0 or -errno.
+ */
+static int
+cmyth_file_rcv_request(cmyth_file_t file, long *len)
+{
+	int err, count;
+	int r;
+
 	if ((count=cmyth_rcv_length(file->file_control)) < 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_length() failed (%d)\n",
 			  __FUNCTION__, count);
-		ret = count;
-		goto out;
+		return count;
 	}
-	if ((r=cmyth_rcv_long(file->file_control, &err, &c, count)) < 0) {
+	if ((r=cmyth_rcv_long(file->file_control, &err, len, count)) < 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_long() failed (%d)\n",
 			  __FUNCTION__, r);
-		ret = err;
-		goto out;
+		return err;
 	}
 
-	if (c > 0) {
-		file->file_pos += c;
-	}
-	ret = c;
+	return 0;
+}
 
-    out:
-	pthread_mutex_unlock(&file->file_control->conn_mutex);
+/*
+ * Shut a connection down which is out of step with the backend, so that
+ * whatever uses it next fails rather than reading the wrong replies.
+ * The connection pool and cmyth_conn_hung() see it as hung.
+ */
+static void
+cmyth_file_conn_kill(cmyth_conn_t conn)
+{
+	cmyth_dbg(CMYTH_DBG_ERROR, "%s: dropping connection fd = %d\n",
+		  __FUNCTION__, conn->conn_fd);
+	conn->conn_pos = conn->conn_len = 0;
+	conn->conn_hang = 1;
+	shutdown(conn->conn_fd, SHUT_RDWR);
+}
 
-	return ret;
+/*
+ * Clean up after a pipelined round failed with 'inflight' REQUEST_BLOCK
+ * replies still to come.  The data of those replies, and maybe of the
+ * one that failed, was never read, so the data connection is shut
+ * down.  If 'control_ok' is set the control connection is still in
+ * step, and the replies are read and thrown away.  Otherwise, or if
+ * reading them fails, it is shut down too.  The caller must hold the
+ * control connection mutex.
+ */
+static void
+cmyth_file_abort_round(cmyth_file_t file, int inflight, int control_ok)
+{
+	long c;
+
+	cmyth_file_conn_kill(file->file_data);
+
+	while (control_ok && (inflight-- > 0)) {
+		if (cmyth_file_rcv_request(file, &c) < 0) {
+			control_ok = 0;
+		}
+	}
+	if (!control_ok) {
+		cmyth_file_conn_kill(file->file_control);
+	}
 }
 
 /*
- * cmyth_file_seek(cmyth_file_t file, long long offset, int whence)
+ * cmyth_file_request_block(cmyth_file_t file, unsigned long len)
  * 
  * Scope: PUBLIC
  *
  * Description
  *
- * Seek to a new position in the file based on the value of whence:
- *	SEEK_SET
- *		The offset is set to offset bytes.
- *	SEEK_CUR
- *		The offset is set to the current position plus offset bytes.
- *	SEEK_END
- *		The offset is set to the size of the file minus offset bytes.
+ * Request a file data block of a certain size, and return when the
+ * block has been transfered.
  *
  * Return Value:
  *
- * Sucess: 0
+ * Sucess: number of bytes transfered
  *
  * Failure: an int containing -errno
  */
-long long
-cmyth_file_seek(cmyth_file_t file, long long offset, int whence)
+int
+cmyth_file_request_block(cmyth_file_t file, unsigned long len)
 {
-	char msg[128];
 	int err;
-	int count;
-	int64_t c;
-	long r;
-	long long ret;
+	long c, ret;
+	long long sent;
 
-	if (file == NULL)
+	if (!file) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
+			  __FUNCTION__);
 		return -EINVAL;
-
-	if ((offset == 0) && (whence == SEEK_CUR))
-		return file->file_pos;
-
-	pthread_mutex_lock(&file->file_control->conn_mutex);
-
-	if (file->file_control->conn_version >= 66) {
-		/*
-		 * Since protocol 66 mythbackend expects to receive a single 64 bit integer rather than
-		 * two 32 bit hi and lo integers.
-		 */
-		snprintf(msg, sizeof(msg),
-			 "QUERY_FILETRANSFER %ld[]:[]SEEK[]:[]%"PRIu64"[]:[]%d[]:[]%"PRIu64,
-			 file->file_id,
-			 (int64_t)offset,
-			 whence,
-			 (int64_t)file->file_pos);
 	}
-	else {
-		snprintf(msg, sizeof(msg),
-			 "QUERY_FILETRANSFER %ld[]:[]SEEK[]:[]%d[]:[]%d[]:[]%d[]:[]%d[]:[]%d",
-			 file->file_id,
-			 (int32_t)(offset >> 32),
-			 (int32_t)(offset & 0xffffffff),
-			 whence,
-			 (int32_t)(file->file_pos >> 32),
-			 (int32_t)(file->file_pos & 0xffffffff));
+	if (file->file_ra) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: read-ahead is active\n",
+			  __FUNCTION__);
+		return -EBUSY;
 	}
-
-	if ((err = cmyth_send_message(file->file_control, msg)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_send_message() failed (%d)\n",
-			  __FUNCTION__, err);
-		ret = err;
-		goto out;
+	if (file->file_cache) {
+		return cmyth_file_cache_fill(file, len);
 	}
 
-	if ((count=cmyth_rcv_length(file->file_control)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_length() failed (%d)\n",
-			  __FUNCTION__, count);
-		ret = count;
+	pthread_mutex_lock(&file->file_control->conn_mutex);
+
+	len = cmyth_tune_block(file->file_data, len, 0);
+	sent = cmyth_io_now();
+	if ((err = cmyth_file_send_request(file, len)) < 0) {
+		ret = err;
 		goto out;
 	}
-	if ((r=cmyth_rcv_int64(file->file_control, &err, &c, count)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_int64() failed (%d)\n",
-			  __FUNCTION__, r);
+	if ((err = cmyth_file_rcv_request(file, &c)) < 0) {
 		ret = err;
 		goto out;
 	}
+	cmyth_tune_sample(file->file_data, len, c, sent);
 
-	switch (whence) {
-	case SEEK_SET:
-		file->file_pos = offset;
-		break;
-	case SEEK_CUR:
-		file->file_pos += offset;
-		break;
-	case SEEK_END:
-		file->file_pos = file->file_length - offset;
-		break;
+	if (c > 0) {
+		file->file_pos += c;
 	}
-
-	ret = file->file_pos;
+	ret = c;
 
     out:
 	pthread_mutex_unlock(&file->file_control->conn_mutex);
-	
+
 	return ret;
 }
+
+/*
+ * One pass of the read-ahead thread.  Keep up to ra_depth requests in
+ * flight, and as each reply arrives read its data into the next free
+ * buffer and hand the buffer to the consumer.  New requests are only
+ * sent while there are buffers for them, and the pass ends once nothing
+ * is in flight, so the control connection is always left in sync.  If
+ * the pass fails, the replies still in flight are read and thrown away,
+ * or the connections are shut down where that is not possible.
+ * Returns 0 or -errno.
+ */
+static int
+cmyth_file_readahead_round(cmyth_file_t file)
+{
+	struct cmyth_file_readahead *ra = file->file_ra;
+	int inflight = 0, sent = 0;
+	int i, n, slot, ret = 0;
+	int req = -1, rep = -1;
+	long c;
+
+	pthread_mutex_lock(&file->file_control->conn_mutex);
+
+	while (1) {
+		pthread_mutex_lock(&ra->ra_mutex);
+		n = 0;
+		if (!ra->ra_stop && !ra->ra_pause && !ra->ra_eof) {
+			n = ra->ra_nslots - ra->ra_count - inflight;
+			if (n > ra->ra_depth - inflight)
+				n = ra->ra_depth - inflight;
+			if (n > RA_ROUND_MAX - sent)
+				n = RA_ROUND_MAX - sent;
+		}
+		slot = (ra->ra_head + ra->ra_count) % ra->ra_nslots;
+		pthread_mutex_unlock(&ra->ra_mutex);
+
+		/*
+		 * The data of each reply goes into the first free buffer,
+		 * but an empty reply takes no buffer, so the requests are
+		 * kept track of separately.  'req' is where the next
+		 * request is noted, and 'rep' the request the next reply
+		 * answers.
+		 */
+		if (req < 0) {
+			req = rep = slot;
+		}
+
+		for (i = 0; i < n; i++) {
+			ra->ra_asked[req] = cmyth_tune_block(file->file_data,
+							     ra->ra_block, 0);
+			ra->ra_sent[req] = cmyth_io_now();
+			if ((ret = cmyth_file_send_request(file,
+							   ra->ra_asked[req])) < 0) {
+				goto broken;
+			}
+			req = (req + 1) % ra->ra_nslots;
+			inflight++;
+			sent++;
+		}
+		if (inflight == 0) {
+			break;
+		}
+
+		ret = cmyth_file_rcv_request(file, &c);
+		inflight--;
+		if (ret < 0) {
+			goto broken;
+		}
+		if ((c < 0) || (c > (long)ra->ra_asked[rep])) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: backend sent %ld bytes\n",
+				  __FUNCTION__, c);
+			ret = -EIO;
+			goto broken;
+		}
+		cmyth_tune_sample(file->file_data, ra->ra_asked[rep], c,
+				  ra->ra_sent[rep]);
+		rep = (rep + 1) % ra->ra_nslots;
+		if (c > 0) {
+			ret = cmyth_file_rcv_data(file, ra->ra_buf[slot], c);
+			if (ret < 0) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: reading data failed (%d)\n",
+					  __FUNCTION__, ret);
+				cmyth_file_abort_round(file, inflight, 1);
+				goto out;
+			}
+			file->file_pos += c;
+		}
+
+		pthread_mutex_lock(&ra->ra_mutex);
+		if (c > 0) {
+			ra->ra_len[slot] = c;
+			ra->ra_count++;
+		} else {
+			ra->ra_eof = 1;
+		}
+		pthread_cond_broadcast(&ra->ra_cond);
+		pthread_mutex_unlock(&ra->ra_mutex);
+	}
+
+	goto out;
+
+    broken:
+	cmyth_file_abort_round(file, inflight, 0);
+
+    out:
+	pthread_mutex_unlock(&file->file_control->conn_mutex);
+
+	return ret;
+}
+
+static void *
+cmyth_file_readahead_thread(void *arg)
+{
+	cmyth_file_t file = (cmyth_file_t)arg;
+	struct cmyth_file_readahead *ra = file->file_ra;
+	int err;
+
+	pthread_mutex_lock(&ra->ra_mutex);
+	while (!ra->ra_stop) {
+		if (ra->ra_pause || ra->ra_eof || ra->ra_err ||
+		    (ra->ra_count == ra->ra_nslots)) {
+			pthread_cond_wait(&ra->ra_cond, &ra->ra_mutex);
+			continue;
+		}
+		ra->ra_busy = 1;
+		pthread_mutex_unlock(&ra->ra_mutex);
+
+		err = cmyth_file_readahead_round(file);
+
+		pthread_mutex_lock(&ra->ra_mutex);
+		if (err < 0) {
+			ra->ra_err = err;
+		}
+		ra->ra_busy = 0;
+		pthread_cond_broadcast(&ra->ra_cond);
+	}
+	pthread_mutex_unlock(&ra->ra_mutex);
+
+	return NULL;
+}
+
+static void
+cmyth_file_readahead_free(struct cmyth_file_readahead *ra)
+{
+	int i;
+
+	if (ra->ra_buf) {
+		for (i = 0; i < ra->ra_nslots; i++) {
+			free(ra->ra_buf[i]);
+		}
+		free(ra->ra_buf);
+	}
+	free(ra->ra_len);
+	free(ra->ra_asked);
+	free(ra->ra_sent);
+	pthread_cond_destroy(&ra->ra_cond);
+	pthread_mutex_destroy(&ra->ra_mutex);
+	free(ra);
+}
+
+/*
+ * Shut down the read-ahead thread and throw away its buffers.  The
+ * backend is left wherever the thread got to.
+ */
+static void
+cmyth_file_readahead_stop(cmyth_file_t file)
+{
+	struct cmyth_file_readahead *ra = file->file_ra;
+
+	pthread_mutex_lock(&ra->ra_mutex);
+	ra->ra_stop = 1;
+	pthread_cond_broadcast(&ra->ra_cond);
+	pthread_mutex_unlock(&ra->ra_mutex);
+
+	pthread_join(ra->ra_thread, NULL);
+
+	file->file_ra = NULL;
+	cmyth_file_readahead_free(ra);
+}
+
+/*
+ * Wait for the read-ahead thread to go idle and throw away what it has
+ * read, so the caller can use the control connection.  file_pos is set
+ * back to the reader's position.
+ */
+static void
+cmyth_file_readahead_pause(cmyth_file_t file)
+{
+	struct cmyth_file_readahead *ra = file->file_ra;
+
+	pthread_mutex_lock(&ra->ra_mutex);
+	ra->ra_pause = 1;
+	pthread_cond_broadcast(&ra->ra_cond);
+	while (ra->ra_busy) {
+		pthread_cond_wait(&ra->ra_cond, &ra->ra_mutex);
+	}
+	ra->ra_head = 0;
+	ra->ra_count = 0;
+	ra->ra_off = 0;
+	file->file_pos = ra->ra_pos;
+	pthread_mutex_unlock(&ra->ra_mutex);
+}
+
+/*
+ * Restart the read-ahead thread from file_pos.
+ */
+static void
+cmyth_file_readahead_resume(cmyth_file_t file)
+{
+	struct cmyth_file_readahead *ra = file->file_ra;
+
+	pthread_mutex_lock(&ra->ra_mutex);
+	ra->ra_pos = file->file_pos;
+	ra->ra_eof = 0;
+	ra->ra_err = 0;
+	ra->ra_pause = 0;
+	pthread_cond_broadcast(&ra->ra_cond);
+	pthread_mutex_unlock(&ra->ra_mutex);
+}
+
+/*
+ * cmyth_file_set_readahead(cmyth_file_t file, int depth, unsigned long block)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Turn read-ahead on for a file, with 'depth' requests of up to 'block'
+ * bytes kept in flight, or turn it off if 'depth' is 0.  A background thread
+ * then streams the file into a ring of 2 * 'depth' buffers, so reading
+ * costs no more than one round trip to the backend every 'depth' blocks.
+ * The data is read with cmyth_file_read().  Changing the settings or
+ * turning read-ahead off keeps the current position.
+ *
+ * Return Value:
+ *
+ * Sucess: 0
+ *
+ * Failure: an int containing -errno
+ */
+int
+cmyth_file_set_readahead(cmyth_file_t file, int depth, unsigned long block)
+{
+	struct cmyth_file_readahead *ra;
+	uint64_t pos;
+	long long r;
+	int i, err;
+
+	if (!file || (depth < 0) || ((depth > 0) && (block == 0))) {
+		return -EINVAL;
+	}
+	if (file->file_cache && (depth > 0)) {
+		return -EBUSY;
+	}
+
+	if (file->file_ra) {
+		pthread_mutex_lock(&file->file_ra->ra_mutex);
+		pos = file->file_ra->ra_pos;
+		pthread_mutex_unlock(&file->file_ra->ra_mutex);
+		cmyth_file_readahead_stop(file);
+		if (file->file_pos != pos) {
+			if ((r = cmyth_file_seek(file, pos, SEEK_SET)) < 0) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: cmyth_file_seek() failed (%lld)\n",
+					  __FUNCTION__, r);
+				return (int)r;
+			}
+		}
+	}
+
+	if (depth == 0) {
+		return 0;
+	}
+
+	ra = calloc(1, sizeof(*ra));
+	if (!ra) {
+		return -ENOMEM;
+	}
+	pthread_mutex_init(&ra->ra_mutex, NULL);
+	pthread_cond_init(&ra->ra_cond, NULL);
+	ra->ra_depth = depth;
+	ra->ra_block = block;
+	ra->ra_nslots = depth * 2;
+	ra->ra_pos = file->file_pos;
+
+	ra->ra_buf = calloc(ra->ra_nslots, sizeof(*ra->ra_buf));
+	ra->ra_len = calloc(ra->ra_nslots, sizeof(*ra->ra_len));
+	ra->ra_asked = calloc(ra->ra_nslots, sizeof(*ra->ra_asked));
+	ra->ra_sent = calloc(ra->ra_nslots, sizeof(*ra->ra_sent));
+	if (!ra->ra_buf || !ra->ra_len || !ra->ra_asked || !ra->ra_sent) {
+		goto nomem;
+	}
+	for (i = 0; i < ra->ra_nslots; i++) {
+		if ((ra->ra_buf[i] = malloc(block)) == NULL) {
+			goto nomem;
+		}
+	}
+
+	file->file_ra = ra;
+	if ((err = pthread_create(&ra->ra_thread, NULL,
+				  cmyth_file_readahead_thread, file)) != 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: pthread_create() failed (%d)\n",
+			  __FUNCTION__, err);
+		file->file_ra = NULL;
+		cmyth_file_readahead_free(ra);
+		return -err;
+	}
+
+	return 0;
+
+    nomem:
+	cmyth_dbg(CMYTH_DBG_ERROR, "%s: out of memory for %d blocks\n",
+		  __FUNCTION__, ra->ra_nslots);
+	cmyth_file_readahead_free(ra);
+	return -ENOMEM;
+}
+
+/*
+ * cmyth_file_read(cmyth_file_t file, char *buf, unsigned long len)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Read up to 'len' bytes from the current position of a file into
+ * 'buf'.  With read-ahead on, this waits until read-ahead data is
+ * available and copies as much of it as fits.  Otherwise a single block
+ * is requested from the backend.
+ *
+ * At the end of the file 0 is returned once, and the next read asks
+ * the backend again, so a recording in progress can be followed.
+ *
+ * Return Value:
+ *
+ * Sucess: number of bytes read into buf, 0 at the end of the file
+ *
+ * Failure: an int containing -errno
+ */
+int
+cmyth_file_read(cmyth_file_t file, char *buf, unsigned long len)
+{
+	struct cmyth_file_readahead *ra;
+	int head, avail, freed = 0;
+	long off, n, ret = 0;
+
+	if (!file || !buf || !file->file_data) {
+		return -EINVAL;
+	}
+
+	if (file->file_cache) {
+		if ((ret = cmyth_file_cache_fill(file, len)) > 0) {
+			memcpy(buf, file->file_cache->fc_data, ret);
+			file->file_cache->fc_pending = 0;
+		}
+		return ret;
+	}
+
+	if ((ra = file->file_ra) == NULL) {
+		if ((ret = cmyth_file_request_block(file, len)) <= 0) {
+			return ret;
+		}
+		if (ret > (long)len) {
+			return -EIO;
+		}
+		if ((n = cmyth_file_rcv_data(file, buf, ret)) < 0) {
+			return n;
+		}
+		return ret;
+	}
+
+	pthread_mutex_lock(&ra->ra_mutex);
+	while (!ra->ra_count && !ra->ra_eof && !ra->ra_err) {
+		pthread_cond_wait(&ra->ra_cond, &ra->ra_mutex);
+	}
+	head = ra->ra_head;
+	avail = ra->ra_count;
+	off = ra->ra_off;
+	pthread_mutex_unlock(&ra->ra_mutex);
+
+	/*
+	 * The buffers being consumed belong to us, so copy them without
+	 * holding the lock.
+	 */
+	while ((len > 0) && (avail > 0)) {
+		n = ra->ra_len[head] - off;
+		if (n > (long)len)
+			n = len;
+		memcpy(buf + ret, ra->ra_buf[head] + off, n);
+		ret += n;
+		len -= n;
+		off += n;
+		if (off == ra->ra_len[head]) {
+			head = (head + 1) % ra->ra_nslots;
+			avail--;
+			freed++;
+			off = 0;
+		}
+	}
+
+	pthread_mutex_lock(&ra->ra_mutex);
+	ra->ra_head = head;
+	ra->ra_count -= freed;
+	ra->ra_off = off;
+	ra->ra_pos += ret;
+	if (ret == 0) {
+		if (ra->ra_err) {
+			ret = ra->ra_err;
+		} else {
+			ra->ra_eof = 0;
+		}
+	}
+	if (freed || (ret == 0)) {
+		pthread_cond_broadcast(&ra->ra_cond);
+	}
+	pthread_mutex_unlock(&ra->ra_mutex);
+
+	return ret;
+}
+
+/*
+ * State of a cmyth_file_copy_to_fd() transfer.  With splice() the data
+ * goes from the data connection into cc_pipe and on to the output
+ * without being copied into user space, otherwise it bounces through
+ * cc_buf.
+ */
+struct cmyth_file_copy {
+	int cc_fd;
+	int cc_pipe[2];
+	int cc_splice;
+	char *cc_buf;
+};
+
+static int
+cmyth_file_write_all(int fd, const char *buf, long len)
+{
+	long n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+#if defined(FILE_HAS_SPLICE)
+/*
+ * Move 'len' bytes that are sitting in the pipe to the output.  If the
+ * output turns out not to support splice(), read them back out of the
+ * pipe and write them, and stop using splice() for this transfer.
+ */
+static int
+cmyth_file_copy_drain(struct cmyth_file_copy *cc, long len)
+{
+	long n;
+	int ret;
+
+	while (len > 0) {
+		if (cc->cc_splice) {
+			n = splice(cc->cc_pipe[0], NULL, cc->cc_fd, NULL, len,
+				   SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (n > 0) {
+				len -= n;
+				continue;
+			}
+			if ((n < 0) && (errno == EINTR))
+				continue;
+			if ((n == 0) || ((errno != EINVAL) &&
+					 (errno != ENOSYS))) {
+				return (n == 0) ? -EIO : -errno;
+			}
+			cmyth_dbg(CMYTH_DBG_DEBUG,
+				  "%s: output does not splice, copying\n",
+				  __FUNCTION__);
+			cc->cc_splice = 0;
+		}
+		if (!cc->cc_buf &&
+		    ((cc->cc_buf = malloc(COPY_BLOCK_MIN)) == NULL)) {
+			return -ENOMEM;
+		}
+		n = read(cc->cc_pipe[0], cc->cc_buf,
+			 (len < COPY_BLOCK_MIN) ? len : COPY_BLOCK_MIN);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0) {
+			return -EIO;
+		}
+		if ((ret = cmyth_file_write_all(cc->cc_fd, cc->cc_buf, n)) < 0) {
+			return ret;
+		}
+		len -= n;
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * Move whatever has arrived on the data connection, up to 'len' bytes, to
+ * the output.  Returns the number of bytes moved, 0 if the connection
+ * hung, or -errno.
+ */
+static long
+cmyth_file_copy_some(cmyth_file_t file, struct cmyth_file_copy *cc, long len)
+{
+	cmyth_conn_t data = file->file_data;
+	long n;
+	int ret;
+
+#if defined(FILE_HAS_SPLICE)
+	while (cc->cc_splice) {
+		ret = cmyth_io_wait(data->conn_fd, CMYTH_IO_READ,
+				    data->conn_timeout);
+		if (ret == 0) {
+			data->conn_hang = 1;
+			return 0;
+		} else if (ret < 0) {
+			return ret;
+		}
+		data->conn_hang = 0;
+
+		n = splice(data->conn_fd, NULL, cc->cc_pipe[1], NULL, len,
+			   SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EINVAL) || (errno == ENOSYS)) {
+				cc->cc_splice = 0;
+				break;
+			}
+			return -errno;
+		}
+		if (n == 0) {
+			return -ECONNRESET;
+		}
+		if ((ret = cmyth_file_copy_drain(cc, n)) < 0) {
+			return ret;
+		}
+		return n;
+	}
+#endif
+
+	if (!cc->cc_buf && ((cc->cc_buf = malloc(COPY_BLOCK_MIN)) == NULL)) {
+		return -ENOMEM;
+	}
+	n = cmyth_file_rcv_block(file, cc->cc_buf,
+				 (len < COPY_BLOCK_MIN) ? len : COPY_BLOCK_MIN);
+	if (n <= 0) {
+		if ((n == 0) && !data->conn_hang) {
+			return -ECONNRESET;
+		}
+		return n;
+	}
+	if ((ret = cmyth_file_write_all(cc->cc_fd, cc->cc_buf, n)) < 0) {
+		return ret;
+	}
+
+	return n;
+}
+
+/*
+ * Move exactly 'len' bytes from the data connection to the output.
+ */
+static int
+cmyth_file_copy_data(cmyth_file_t file, struct cmyth_file_copy *cc, long len)
+{
+	long n;
+
+	while (len > 0) {
+		if ((n = cmyth_file_copy_some(file, cc, len)) < 0) {
+			return n;
+		}
+		if (n == 0) {
+			return -ETIMEDOUT;
+		}
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * One pass of cmyth_file_copy_to_fd().  Like a read-ahead round, keep
+ * COPY_DEPTH requests in flight, and finish with nothing in flight so
+ * the control connection can be let go, failed or not.  'left' is the number of bytes
+ * still wanted, or -1 for everything.  A reply of 0 bytes ends the copy.
+ *
+ * The backend sends the data for a request before the reply, and a
+ * block may be bigger than the socket buffers, so data is moved to the
+ * output as it arrives rather than after the reply.  'got' counts the
+ * bytes moved ahead of their reply.
+ *
+ * Returns the number of bytes copied or -errno.
+ */
+static long long
+cmyth_file_copy_round(cmyth_file_t file, struct cmyth_file_copy *cc,
+		      long long left, int *eof)
+{
+	cmyth_conn_t control = file->file_control;
+	struct cmyth_io_fd fds[2];
+	unsigned long asked[COPY_DEPTH];
+	long long sent_at[COPY_DEPTH];
+	long long copied = 0, pending = 0, got = 0;
+	int head = 0, inflight = 0, sent = 0;
+	long c, n;
+	int ret = 0;
+
+	pthread_mutex_lock(&control->conn_mutex);
+
+	while (1) {
+		while (!*eof && (inflight < COPY_DEPTH) &&
+		       (sent < RA_ROUND_MAX) &&
+		       ((left < 0) || (copied + pending < left))) {
+			unsigned long want = LONG_MAX;
+
+			if ((left >= 0) &&
+			    (left - copied - pending < (long long)want))
+				want = left - copied - pending;
+			want = cmyth_tune_block(file->file_data, want, 1);
+			sent_at[(head + inflight) % COPY_DEPTH] = cmyth_io_now();
+			if ((ret = cmyth_file_send_request(file, want)) < 0) {
+				goto broken;
+			}
+			asked[(head + inflight) % COPY_DEPTH] = want;
+			pending += want;
+			inflight++;
+			sent++;
+		}
+		if (inflight == 0) {
+			break;
+		}
+
+		if (control->conn_pos >= control->conn_len) {
+			fds[0].fd = control->conn_fd;
+			fds[0].events = CMYTH_IO_READ;
+			fds[1].fd = file->file_data->conn_fd;
+			fds[1].events = CMYTH_IO_READ;
+			ret = cmyth_io_poll(fds, (got < pending) ? 2 : 1,
+					    control->conn_timeout);
+			if (ret < 0) {
+				goto broken;
+			}
+			if (ret == 0) {
+				control->conn_hang = 1;
+				continue;
+			}
+			control->conn_hang = 0;
+			if ((got < pending) && fds[1].ready) {
+				n = cmyth_file_copy_some(file, cc,
+							 pending - got);
+				if (n < 0) {
+					ret = n;
+					goto fail;
+				}
+				got += n;
+				continue;
+			}
+		}
+
+		ret = cmyth_file_rcv_request(file, &c);
+		if (ret < 0) {
+			goto broken;
+		}
+		if ((c < 0) || (c > (long)asked[head])) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: backend sent %ld bytes\n",
+				  __FUNCTION__, c);
+			ret = -EIO;
+			goto broken;
+		}
+		cmyth_tune_sample(file->file_data, asked[head], c,
+				  sent_at[head]);
+		pending -= asked[head];
+		head = (head + 1) % COPY_DEPTH;
+		inflight--;
+
+		if (c == 0) {
+			*eof = 1;
+			continue;
+		}
+		if (got >= c) {
+			got -= c;
+		} else {
+			ret = cmyth_file_copy_data(file, cc, c - got);
+			if (ret < 0) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: moving data failed (%d)\n",
+					  __FUNCTION__, ret);
+				goto fail;
+			}
+			got = 0;
+		}
+		file->file_pos += c;
+		copied += c;
+	}
+
+	goto out;
+
+    fail:
+	cmyth_file_abort_round(file, inflight, 1);
+	goto out;
+
+    broken:
+	cmyth_file_abort_round(file, inflight, 0);
+
+    out:
+	pthread_mutex_unlock(&control->conn_mutex);
+
+	return (ret < 0) ? ret : copied;
+}
+
+/*
+ * cmyth_file_copy_to_fd(cmyth_file_t file, int fd, long long offset,
+ *                       long long len)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Copy 'len' bytes of a file starting at 'offset' to the file descriptor
+ * 'fd', or everything up to the end of the file if 'len' is negative.
+ * A negative 'offset' copies from the current position.  Several block
+ * requests are kept in flight, and the block size grows while that
+ * improves the throughput.  On Linux the data is spliced from the socket
+ * to 'fd' without passing through user space, where 'fd' allows it.
+ * The file position is left after the last byte copied.
+ *
+ * The copy cannot be used while read-ahead or the block cache is on.
+ *
+ * Return Value:
+ *
+ * Sucess: number of bytes copied, which is less than 'len' if the end
+ *         of the file was reached
+ *
+ * Failure: a long long containing -errno
+ */
+long long
+cmyth_file_copy_to_fd(cmyth_file_t file, int fd, long long offset,
+		      long long len)
+{
+	struct cmyth_file_copy cc;
+	long long ret = 0, r;
+	int eof = 0;
+
+	if (!file || !file->file_data || (fd < 0)) {
+		return -EINVAL;
+	}
+	if (file->file_ra || file->file_cache) {
+		return -EBUSY;
+	}
+
+	if ((offset >= 0) && ((uint64_t)offset != file->file_pos)) {
+		if ((r = cmyth_file_seek(file, offset, SEEK_SET)) < 0) {
+			return r;
+		}
+	}
+
+	memset(&cc, 0, sizeof(cc));
+	cc.cc_fd = fd;
+	cc.cc_pipe[0] = -1;
+	cc.cc_pipe[1] = -1;
+#if defined(FILE_HAS_SPLICE)
+	if (pipe(cc.cc_pipe) == 0) {
+		cc.cc_splice = 1;
+		fcntl(cc.cc_pipe[1], F_SETPIPE_SZ, COPY_PIPE_SIZE);
+	}
+#endif
+
+	while (!eof && ((len < 0) || (ret < len))) {
+		r = cmyth_file_copy_round(file, &cc, (len < 0) ? -1 : len - ret,
+					  &eof);
+		if (r < 0) {
+			ret = r;
+			break;
+		}
+		ret += r;
+	}
+
+#if defined(FILE_HAS_SPLICE)
+	if (cc.cc_pipe[0] >= 0) {
+		close(cc.cc_pipe[0]);
+		close(cc.cc_pipe[1]);
+	}
+#endif
+	free(cc.cc_buf);
+
+	return ret;
+}
+
+/*
+ * cmyth_file_get_tune_stats(cmyth_file_t file, unsigned long *block,
+ *                           int *rcvbuf, unsigned long long *rate,
+ *                           int *latency)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Report the state of the block size controller of the data connection
+ * of a file.  Any of the pointers may be NULL.
+ *
+ * Return Value:
+ *
+ * Sucess: 0
+ *
+ * Failure: an int containing -errno
+ */
+int
+cmyth_file_get_tune_stats(cmyth_file_t file, unsigned long *block,
+			  int *rcvbuf, unsigned long long *rate, int *latency)
+{
+	if (!file || !file->file_data) {
+		return -EINVAL;
+	}
+
+	cmyth_tune_get_stats(file->file_data, block, rcvbuf, rate, latency);
+
+	return 0;
+}
+
+/*
+ * cmyth_file_seek(cmyth_file_t file, long long offset, int whence)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Seek to a new position in the file based on the value of whence:
+ *	SEEK_SET
+ *		The offset is set to offset bytes.
+ *	SEEK_CUR
+ *		The offset is set to the current position plus offset bytes.
+ *	SEEK_END
+ *		The offset is set to the size of the file minus offset bytes.
+ *
+ * Return Value:
+ *
+ * Sucess: 0
+ *
+ * Failure: an int containing -errno
+ */
+long long
+cmyth_file_seek(cmyth_file_t file, long long offset, int whence)
+{
+	long long ret;
+
+	if (file == NULL)
+		return -EINVAL;
+
+	if ((offset == 0) && (whence == SEEK_CUR)) {
+		if (file->file_ra) {
+			pthread_mutex_lock(&file->file_ra->ra_mutex);
+			ret = file->file_ra->ra_pos;
+			pthread_mutex_unlock(&file->file_ra->ra_mutex);
+			return ret;
+		}
+		return file->file_pos;
+	}
+
+	if (file->file_cache) {
+		/*
+		 * The backend is only moved when a block has to be
+		 * fetched from it.
+		 */
+		switch (whence) {
+		case SEEK_SET:
+			file->file_pos = offset;
+			break;
+		case SEEK_CUR:
+			file->file_pos += offset;
+			break;
+		case SEEK_END:
+			file->file_pos = file->file_length - offset;
+			break;
+		default:
+			return -EINVAL;
+		}
+		file->file_cache->fc_pending = 0;
+		return file->file_pos;
+	}
+
+	if (file->file_ra) {
+		/*
+		 * The backend is ahead of the reader by whatever has been
+		 * read ahead, so make the seek absolute.
+		 */
+		cmyth_file_readahead_pause(file);
+		if (whence == SEEK_CUR) {
+			offset += file->file_pos;
+			whence = SEEK_SET;
+		}
+	}
+
+	ret = cmyth_file_seek_backend(file, offset, whence);
+
+	if (file->file_ra) {
+		cmyth_file_readahead_resume(file);
+	}
+
+	return ret;
+}
+
+/*
+ * cmyth_file_seek_frame(cmyth_file_t file, cmyth_posmap_t pm,
+ *                       long long frame)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Seek the file 'file' to the last key frame at or before the frame
+ * 'frame', using the position map 'pm' of the recording.  The offset
+ * is looked up locally, so only the seek itself goes to the backend.
+ *
+ * Return Value:
+ *
+ * Success: The new position in the file (>= 0)
+ *
+ * Failure: -(ERRNO)
+ */
+long long
+cmyth_file_seek_frame(cmyth_file_t file, cmyth_posmap_t pm, long long frame)
+{
+	long long offset;
+
+	if (!file || !pm) {
+		return -EINVAL;
+	}
+	if ((offset=cmyth_posmap_frame_offset(pm, frame, NULL)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: no offset for frame %lld (%lld)\n",
+			  __FUNCTION__, frame, offset);
+		return offset;
+	}
+
+	return cmyth_file_seek(file, offset, SEEK_SET);
+}
+
+/*
+ * cmyth_file_seek_time(cmyth_file_t file, cmyth_posmap_t pm,
+ *                      long long msec)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Seek the file 'file' to the last key frame at or before 'msec'
+ * milliseconds into the recording, using the position map 'pm' of the
+ * recording.  The map has to carry key frame times.
+ *
+ * Return Value:
+ *
+ * Success: The new position in the file (>= 0)
+ *
+ * Failure: -(ERRNO)
+ */
+long long
+cmyth_file_seek_time(cmyth_file_t file, cmyth_posmap_t pm, long long msec)
+{
+	long long frame;
+
+	if (!file || !pm) {
+		return -EINVAL;
+	}
+	if ((frame=cmyth_posmap_time_frame(pm, msec)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: no key frame at %lld ms (%lld)\n",
+			  __FUNCTION__, msec, frame);
+		return frame;
+	}
+
+	return cmyth_file_seek_frame(file, pm, frame);
+}
+
+/*
+ * Ask the backend to seek, and update file_pos to match.
+ */
+static long long
+cmyth_file_seek_backend(cmyth_file_t file, long long offset, int whence)
+{
+	char msg[128];
+	int err;
+	int count;
+	int64_t c;
+	long r;
+	long long ret;
+
+	pthread_mutex_lock(&file->file_control->conn_mutex);
+
+	if (file->file_control->conn_version >= 66) {
+		/*
+		 * Since protocol 66 mythbackend expects to receive a single 64 bit integer rather than
+		 * two 32 bit hi and lo integers.
+		 */
+		snprintf(msg, sizeof(msg),
+			 "QUERY_FILETRANSFER %ld[]:[]SEEK[]:[]%"PRIu64"[]:[]%d[]:[]%"PRIu64,
+			 file->file_id,
+			 (int64_t)offset,
+			 whence,
+			 (int64_t)file->file_pos);
+	}
+	else {
+		snprintf(msg, sizeof(msg),
+			 "QUERY_FILETRANSFER %ld[]:[]SEEK[]:[]%d[]:[]%d[]:[]%d[]:[]%d[]:[]%d",
+			 file->file_id,
+			 (int32_t)(offset >> 32),
+			 (int32_t)(offset & 0xffffffff),
+			 whence,
+			 (int32_t)(file->file_pos >> 32),
+			 (int32_t)(file->file_pos & 0xffffffff));
+	}
+
+	if ((err = cmyth_send_message(file->file_control, msg)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_send_message() failed (%d)\n",
+			  __FUNCTION__, err);
+		ret = err;
+		goto out;
+	}
+
+	if ((count=cmyth_rcv_length(file->file_control)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_length() failed (%d)\n",
+			  __FUNCTION__, count);
+		ret = count;
+		goto out;
+	}
+	if ((r=cmyth_rcv_int64(file->file_control, &err, &c, count)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_int64() failed (%d)\n",
+			  __FUNCTION__, r);
+		ret = err;
+		goto out;
+	}
+
+	switch (whence) {
+	case SEEK_SET:
+		file->file_pos = offset;
+		break;
+	case SEEK_CUR:
+		file->file_pos += offset;
+		break;
+	case SEEK_END:
+		file->file_pos = file->file_length - offset;
+		break;
+	}
+
+	ret = file->file_pos;
+
+    out:
+	pthread_mutex_unlock(&file->file_control->conn_mutex);
+	
+	return ret;
+}
+
+/*
+ * Fetch the rest of block 'index' from the backend into the file's
+ * block buffer.  If the buffer holds the start of the block and the
+ * backend is still positioned after it, only the missing part is
+ * requested, which is how the growing end of a recording in progress
+ * is followed.  Complete blocks are added to the block cache.
+ * Returns 0 or -errno.
+ */
+static int
+cmyth_file_cache_fetch(cmyth_file_t file, uint64_t index)
+{
+	struct cmyth_file_cache *fc = file->file_cache;
+	uint64_t start = index * CMYTH_CACHE_BLOCK;
+	uint64_t pos = file->file_pos;
+	unsigned long len;
+	long long r;
+	long c;
+	int ret;
+
+	if ((fc->fc_index != index) ||
+	    (fc->fc_remote != start + fc->fc_len)) {
+		fc->fc_index = index;
+		fc->fc_len = 0;
+	}
+	if (fc->fc_remote != start + fc->fc_len) {
+		file->file_pos = fc->fc_remote;
+		if ((r = cmyth_file_seek_backend(file, start, SEEK_SET)) < 0) {
+			fc->fc_remote = FC_REMOTE_UNKNOWN;
+			ret = (int)r;
+			goto out;
+		}
+		fc->fc_remote = start;
+	}
+
+	len = CMYTH_CACHE_BLOCK - fc->fc_len;
+
+	pthread_mutex_lock(&file->file_control->conn_mutex);
+	if ((ret = cmyth_file_send_request(file, len)) == 0) {
+		ret = cmyth_file_rcv_request(file, &c);
+	}
+	pthread_mutex_unlock(&file->file_control->conn_mutex);
+	if (ret < 0) {
+		fc->fc_remote = FC_REMOTE_UNKNOWN;
+		goto out;
+	}
+	if ((c < 0) || (c > (long)len)) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: backend sent %ld bytes\n",
+			  __FUNCTION__, c);
+		fc->fc_remote = FC_REMOTE_UNKNOWN;
+		ret = -EIO;
+		goto out;
+	}
+	if ((c > 0) &&
+	    (ret = cmyth_file_rcv_data(file, fc->fc_block + fc->fc_len,
+				       c)) < 0) {
+		fc->fc_remote = FC_REMOTE_UNKNOWN;
+		fc->fc_len = 0;
+		goto out;
+	}
+	fc->fc_remote += c;
+	fc->fc_len += c;
+
+	if (fc->fc_len == CMYTH_CACHE_BLOCK) {
+		cmyth_cache_put(file->file_path, file->file_host,
+				index, fc->fc_block);
+	}
+
+    out:
+	file->file_pos = pos;
+	return ret;
+}
+
+/*
+ * Make up to 'len' bytes at the current position available in the
+ * file's block buffer, from the block cache if possible, and advance the
+ * position past them.  The data never extends past the end of a block.
+ * Returns the number of bytes, 0 at the end of the file, or -errno.
+ */
+static long
+cmyth_file_cache_fill(cmyth_file_t file, unsigned long len)
+{
+	struct cmyth_file_cache *fc = file->file_cache;
+	uint64_t index = file->file_pos / CMYTH_CACHE_BLOCK;
+	long off = file->file_pos % CMYTH_CACHE_BLOCK;
+	long n;
+	int err;
+
+	fc->fc_pending = 0;
+
+	if ((fc->fc_index != index) || (fc->fc_len <= off)) {
+		if (cmyth_cache_get(file->file_path, file->file_host,
+				    index, fc->fc_block) == 0) {
+			fc->fc_index = index;
+			fc->fc_len = CMYTH_CACHE_BLOCK;
+		} else if ((err = cmyth_file_cache_fetch(file, index)) < 0) {
+			return err;
+		}
+	}
+	if (fc->fc_len <= off) {
+		return 0;
+	}
+
+	n = fc->fc_len - off;
+	if (n > (long)len)
+		n = len;
+	fc->fc_data = fc->fc_block + off;
+	fc->fc_pending = n;
+	file->file_pos += n;
+
+	return n;
+}
+
+/*
+ * cmyth_file_set_cache(cmyth_file_t file, int enable)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Turn the block cache (see cmyth_cache_configure()) on or off for a
+ * file.  With the cache on, cmyth_file_request_block() and
+ * cmyth_file_read() are served from cached blocks where possible, and
+ * cmyth_file_seek() does not talk to the backend.  Requests never
+ * cross a block boundary, so they may return less than was asked for.
+ * The cache cannot be used together with read-ahead.
+ *
+ * Return Value:
+ *
+ * Sucess: 0
+ *
+ * Failure: an int containing -errno
+ */
+int
+cmyth_file_set_cache(cmyth_file_t file, int enable)
+{
+	struct cmyth_file_cache *fc;
+	uint64_t pos;
+	long long r;
+
+	if (!file || (enable && !file->file_path)) {
+		return -EINVAL;
+	}
+	if (file->file_ra) {
+		return -EBUSY;
+	}
+
+	if (enable) {
+		if (file->file_cache) {
+			return 0;
+		}
+		if ((fc = malloc(sizeof(*fc))) == NULL) {
+			return -ENOMEM;
+		}
+		fc->fc_remote = file->file_pos;
+		fc->fc_index = 0;
+		fc->fc_len = 0;
+		fc->fc_data = NULL;
+		fc->fc_pending = 0;
+		file->file_cache = fc;
+		return 0;
+	}
+
+	if ((fc = file->file_cache) == NULL) {
+		return 0;
+	}
+	file->file_cache = NULL;
+	pos = file->file_pos;
+	file->file_pos = fc->fc_remote;
+	free(fc);
+
+	if (file->file_pos != pos) {
+		if ((r = cmyth_file_seek_backend(file, pos, SEEK_SET)) < 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: cmyth_file_seek() failed (%lld)\n",
+				  __FUNCTION__, r);
+			return (int)r;
+		}
+	}
+
+	return 0;
+}
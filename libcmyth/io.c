@@ -0,0 +1,510 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * io.c -      Socket readiness for libcmyth.  All waiting for a socket to
+ *             become readable or writable goes through here, using poll()
+ *             so there is no limit on descriptor numbers.  Blocking calls
+ *             wait in steps of the connection's hang timeout, flagging
+ *             conn_hang each time a step expires, until the connection's
+ *             deadline (if any) runs out.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <cmyth_local.h>
+
+#if !defined(_MSC_VER)
+#include <poll.h>
+#endif
+
+/*
+ * cmyth_io_now(void)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_io_now)
+ *
+ * Description
+ *
+ * Read a monotonic clock.
+ *
+ * Return Value:
+ *
+ * The time in milliseconds.
+ */
+long long
+cmyth_io_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+/*
+ * cmyth_io_poll(struct cmyth_io_fd *fds, int nfds, int timeout)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_io_poll)
+ *
+ * Description
+ *
+ * Wait up to 'timeout' milliseconds for any of the 'nfds' sockets in
+ * 'fds' to become ready for their 'events' (CMYTH_IO_READ and/or
+ * CMYTH_IO_WRITE).  A negative 'timeout' waits forever.  The events which
+ * are ready are stored in 'ready'.  Errors and hangups on a socket are
+ * reported as ready, so that the following recv() or send() picks up the
+ * error.  Interrupted waits are resumed for the remaining time.
+ *
+ * Return Value:
+ *
+ * Success: The number of ready sockets, or 0 if the time ran out.
+ *
+ * Failure: -errno
+ */
+int
+cmyth_io_poll(struct cmyth_io_fd *fds, int nfds, int timeout)
+{
+	long long end = 0;
+	int i, r;
+#if !defined(_MSC_VER)
+	struct pollfd pfd[CMYTH_IO_POLL_MAX];
+#else
+	fd_set rfds, wfds;
+	struct timeval tv;
+	int maxfd = 0;
+#endif
+
+	if ((nfds <= 0) || (nfds > CMYTH_IO_POLL_MAX)) {
+		return -EINVAL;
+	}
+	if (timeout > 0)
+		end = cmyth_io_now() + timeout;
+
+	while (1) {
+#if !defined(_MSC_VER)
+		for (i = 0; i < nfds; i++) {
+			pfd[i].fd = fds[i].fd;
+			pfd[i].events = 0;
+			pfd[i].revents = 0;
+			if (fds[i].events & CMYTH_IO_READ)
+				pfd[i].events |= POLLIN;
+			if (fds[i].events & CMYTH_IO_WRITE)
+				pfd[i].events |= POLLOUT;
+		}
+		r = poll(pfd, nfds, timeout);
+#else
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		for (i = 0; i < nfds; i++) {
+			if (fds[i].events & CMYTH_IO_READ)
+				FD_SET(fds[i].fd, &rfds);
+			if (fds[i].events & CMYTH_IO_WRITE)
+				FD_SET(fds[i].fd, &wfds);
+			if ((int)fds[i].fd > maxfd)
+				maxfd = (int)fds[i].fd;
+		}
+		tv.tv_sec = timeout / 1000;
+		tv.tv_usec = (timeout % 1000) * 1000;
+		r = select(maxfd+1, &rfds, &wfds, NULL,
+			   (timeout < 0) ? NULL : &tv);
+#endif
+		if (r >= 0) {
+			break;
+		}
+		if (errno != EINTR) {
+			return -errno;
+		}
+		if (timeout > 0) {
+			timeout = (int)(end - cmyth_io_now());
+			if (timeout < 0)
+				timeout = 0;
+		}
+	}
+
+	r = 0;
+	for (i = 0; i < nfds; i++) {
+		fds[i].ready = 0;
+#if !defined(_MSC_VER)
+		if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+			fds[i].ready = fds[i].events;
+		if (pfd[i].revents & POLLIN)
+			fds[i].ready |= CMYTH_IO_READ;
+		if (pfd[i].revents & POLLOUT)
+			fds[i].ready |= CMYTH_IO_WRITE;
+#else
+		if (FD_ISSET(fds[i].fd, &rfds))
+			fds[i].ready |= CMYTH_IO_READ;
+		if (FD_ISSET(fds[i].fd, &wfds))
+			fds[i].ready |= CMYTH_IO_WRITE;
+#endif
+		fds[i].ready &= fds[i].events;
+		if (fds[i].ready)
+			r++;
+	}
+
+	return r;
+}
+
+/*
+ * cmyth_io_wait(cmyth_socket_t fd, int events, int timeout)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_io_wait)
+ *
+ * Description
+ *
+ * Wait up to 'timeout' milliseconds for 'fd' to become ready for
+ * 'events', like cmyth_io_poll() for a single socket.
+ *
+ * Return Value:
+ *
+ * Success: The events which are ready, or 0 if the time ran out.
+ *
+ * Failure: -errno
+ */
+int
+cmyth_io_wait(cmyth_socket_t fd, int events, int timeout)
+{
+	struct cmyth_io_fd iofd;
+	int r;
+
+	iofd.fd = fd;
+	iofd.events = events;
+	if ((r = cmyth_io_poll(&iofd, 1, timeout)) <= 0) {
+		return r;
+	}
+	return iofd.ready;
+}
+
+/*
+ * cmyth_conn_wait(cmyth_conn_t conn, int events)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_conn_wait)
+ *
+ * Description
+ *
+ * Wait for the socket of 'conn' to become ready for 'events', on behalf
+ * of a blocking call.  Each time the connection's hang timeout passes
+ * without the socket becoming ready, conn_hang is set.  It is cleared
+ * once the socket is ready.  If the connection has a deadline, give up
+ * once that much time has passed.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -ETIMEDOUT if the deadline passed, or some other -errno
+ */
+int
+cmyth_conn_wait(cmyth_conn_t conn, int events)
+{
+	long long end = 0;
+	int timeout, r;
+
+	if (conn->conn_deadline > 0) {
+		end = cmyth_io_now() + conn->conn_deadline;
+	}
+
+	while (1) {
+		timeout = conn->conn_timeout;
+		if (end) {
+			r = (int)(end - cmyth_io_now());
+			if (r <= 0) {
+				return -ETIMEDOUT;
+			}
+			if ((timeout < 0) || (r < timeout))
+				timeout = r;
+		}
+		r = cmyth_io_wait(conn->conn_fd, events, timeout);
+		if (r > 0) {
+			conn->conn_hang = 0;
+			return 0;
+		}
+		if (r < 0) {
+			return r;
+		}
+		conn->conn_hang = 1;
+	}
+}
+
+/*
+ * cmyth_io_timeval(struct timeval *tv)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_io_timeval)
+ *
+ * Description
+ *
+ * Convert a select() style timeout to milliseconds.
+ *
+ * Return Value:
+ *
+ * The timeout in milliseconds, or -1 if 'tv' is NULL.
+ */
+int
+cmyth_io_timeval(struct timeval *tv)
+{
+	if (!tv) {
+		return -1;
+	}
+	return (int)(tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000);
+}
+
+static int
+cmyth_io_set_blocking(cmyth_socket_t fd, int blocking)
+{
+#if defined(_MSC_VER)
+	u_long arg = !blocking;
+
+	return (ioctlsocket(fd, FIONBIO, &arg) == 0) ? 0 : -1;
+#else
+	int flags;
+
+	if ((flags = fcntl(fd, F_GETFL, 0)) < 0) {
+		return -1;
+	}
+	if (blocking)
+		flags &= ~O_NONBLOCK;
+	else
+		flags |= O_NONBLOCK;
+	return fcntl(fd, F_SETFL, flags);
+#endif
+}
+
+static int
+cmyth_io_in_progress(void)
+{
+#if defined(_MSC_VER)
+	return (WSAGetLastError() == WSAEWOULDBLOCK);
+#else
+	return (errno == EINPROGRESS);
+#endif
+}
+
+/*
+ * Start a non-blocking connect to 'addr'.  Returns 1 if it completed
+ * straight away, 0 if it is in progress, or -errno.
+ */
+static int
+cmyth_io_connect_start(struct cmyth_addr *addr, int tcp_rcvbuf,
+		       cmyth_socket_t *fdp)
+{
+	cmyth_socket_t fd;
+	int err;
+
+	fd = socket(addr->addr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0) {
+		err = errno;
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: cannot create socket (%d)\n",
+			  __FUNCTION__, err);
+		return -err;
+	}
+
+	/*
+	 * The receive buffer must be sized before connecting, so that the
+	 * right window scale is negotiated.
+	 */
+	if (tcp_rcvbuf > 0) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void*)&tcp_rcvbuf,
+			   sizeof(tcp_rcvbuf));
+	}
+
+	if (cmyth_io_set_blocking(fd, 0) < 0) {
+		err = errno;
+		closesocket(fd);
+		return -err;
+	}
+
+	*fdp = fd;
+	if (connect(fd, (struct sockaddr *)&addr->addr, addr->len) == 0) {
+		return 1;
+	}
+	if (cmyth_io_in_progress()) {
+		return 0;
+	}
+
+	err = errno;
+	closesocket(fd);
+	return -err;
+}
+
+/*
+ * cmyth_io_connect(struct cmyth_addr *addrs, int naddrs, int tcp_rcvbuf,
+ *                  int timeout, cmyth_socket_t *fdp)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_io_connect)
+ *
+ * Description
+ *
+ * Connect a TCP socket to the first of the 'naddrs' addresses in 'addrs'
+ * that answers, giving up after 'timeout' milliseconds.  The attempts
+ * race each other: the next address is tried as soon as the previous
+ * attempt fails, or after CMYTH_IO_CONNECT_STAGGER milliseconds if it
+ * has not finished by then, and the first to succeed wins.  Each socket
+ * has its receive buffer set to 'tcp_rcvbuf' (if it is positive) before
+ * it connects.  The connected socket is left in blocking mode and stored
+ * in 'fdp'.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -ETIMEDOUT if the time ran out, or the -errno of the last
+ *          failed attempt
+ */
+int
+cmyth_io_connect(struct cmyth_addr *addrs, int naddrs, int tcp_rcvbuf,
+		 int timeout, cmyth_socket_t *fdp)
+{
+	struct cmyth_io_fd fds[CMYTH_IO_POLL_MAX];
+	cmyth_socket_t fd = 0;
+	long long now, end, next_start;
+	int next = 0, n = 0;
+	int err = -ENOENT;
+	int i, r, wait;
+
+	if (!addrs || (naddrs <= 0) || !fdp) {
+		return -EINVAL;
+	}
+	if (naddrs > CMYTH_IO_POLL_MAX) {
+		naddrs = CMYTH_IO_POLL_MAX;
+	}
+
+	now = cmyth_io_now();
+	end = now + timeout;
+	next_start = now;
+
+	while (1) {
+		now = cmyth_io_now();
+
+		if ((next < naddrs) && ((n == 0) || (now >= next_start))) {
+			r = cmyth_io_connect_start(&addrs[next++], tcp_rcvbuf,
+						   &fd);
+			if (r == 1) {
+				goto done;
+			}
+			if (r < 0) {
+				err = r;
+				next_start = now;
+				continue;
+			}
+			fds[n].fd = fd;
+			fds[n].events = CMYTH_IO_WRITE;
+			n++;
+			next_start = now + CMYTH_IO_CONNECT_STAGGER;
+			continue;
+		}
+
+		if (n == 0) {
+			break;
+		}
+		if (now >= end) {
+			err = -ETIMEDOUT;
+			break;
+		}
+
+		wait = (int)(end - now);
+		if ((next < naddrs) && (next_start - now < wait)) {
+			wait = (int)(next_start - now);
+		}
+		if ((r = cmyth_io_poll(fds, n, wait)) < 0) {
+			err = r;
+			break;
+		}
+
+		for (i = 0; (r > 0) && (i < n); i++) {
+			int soerr = 0;
+			socklen_t len = sizeof(soerr);
+
+			if (!fds[i].ready) {
+				continue;
+			}
+			if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR,
+				       (void*)&soerr, &len) < 0) {
+				soerr = errno;
+			}
+			if (soerr == 0) {
+				fd = fds[i].fd;
+				fds[i] = fds[--n];
+				goto done;
+			}
+			err = -soerr;
+			closesocket(fds[i].fd);
+			fds[i--] = fds[--n];
+			r--;
+			next_start = now;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		closesocket(fds[i].fd);
+	}
+	return err;
+
+    done:
+	for (i = 0; i < n; i++) {
+		closesocket(fds[i].fd);
+	}
+	if (cmyth_io_set_blocking(fd, 1) < 0) {
+		err = -errno;
+		closesocket(fd);
+		return err;
+	}
+	*fdp = fd;
+
+	return 0;
+}
+
+/*
+ * cmyth_conn_set_timeout(cmyth_conn_t conn, int timeout, int deadline)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Set how long, in milliseconds, a blocking call may wait on 'conn'
+ * before the connection is flagged as hung ('timeout', 10 seconds by
+ * default), and how long it may wait before it gives up with -ETIMEDOUT
+ * ('deadline', 0 by default, which means never).
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -EINVAL
+ */
+int
+cmyth_conn_set_timeout(cmyth_conn_t conn, int timeout, int deadline)
+{
+	if (!conn || (timeout <= 0) || (deadline < 0)) {
+		return -EINVAL;
+	}
+	conn->conn_timeout = timeout;
+	conn->conn_deadline = deadline;
+
+	return 0;
+}
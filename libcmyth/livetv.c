@@ -402,6 +402,56 @@ cmyth_livetv_request_block(cmyth_recorder_t rec, unsigned long size)
 	return rtrn;
 }
 
+/*
+ * cmyth_livetv_get_tune_stats(cmyth_recorder_t rec, unsigned long *block,
+ *                             int *rcvbuf, unsigned long long *rate,
+ *                             int *latency)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Report the state of the block size controller of the data connection
+ * live TV is currently read from, which is the current chain file or the
+ * ring buffer depending on the protocol.  Any of the pointers may be
+ * NULL.
+ *
+ * Return Value:
+ *
+ * Sucess: 0
+ *
+ * Failure: an int containing -errno
+ */
+int
+cmyth_livetv_get_tune_stats(cmyth_recorder_t rec, unsigned long *block,
+			    int *rcvbuf, unsigned long long *rate, int *latency)
+{
+	cmyth_file_t file;
+	int rc;
+
+	if (!rec || !rec->rec_connected) {
+		return -EINVAL;
+	}
+
+	if (rec->rec_conn->conn_version >= 26) {
+		if ((file=cmyth_livetv_current_file(rec)) == NULL) {
+			return -EINVAL;
+		}
+		rc = cmyth_file_get_tune_stats(file, block, rcvbuf, rate,
+					       latency);
+		ref_release(file);
+		return rc;
+	}
+
+	if (!rec->rec_ring || !rec->rec_ring->conn_data) {
+		return -EINVAL;
+	}
+	cmyth_tune_get_stats(rec->rec_ring->conn_data, block, rcvbuf, rate,
+			     latency);
+
+	return 0;
+}
+
 int
 cmyth_livetv_select(cmyth_recorder_t rec, struct timeval *timeout)
 {
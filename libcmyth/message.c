@@ -0,0 +1,557 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * message.c - functions to receive a complete MythTV protocol reply
+ *             in one buffer and decode its tokens in place.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <errno.h>
+#include <cmyth_local.h>
+
+static char separator[] = "[]:[]";
+
+static void
+cmyth_msg_destroy(cmyth_msg_t msg)
+{
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
+	if (!msg) {
+		return;
+	}
+	if (msg->msg_buf) {
+		free(msg->msg_buf);
+	}
+	if (msg->msg_tokens) {
+		free(msg->msg_tokens);
+	}
+}
+
+/*
+ * cmyth_msg_add_token(cmyth_msg_t msg, int off, int len)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Append the token starting at 'off' and running for 'len' bytes to
+ * the token list of 'msg', growing the list as needed.  The byte
+ * following the token is overwritten with a '\0' so that the token
+ * can be used in place as a C string.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -ENOMEM
+ */
+static int
+cmyth_msg_add_token(cmyth_msg_t msg, int off, int len)
+{
+	struct cmyth_token *tokens;
+	int max;
+
+	if (msg->msg_count == msg->msg_max) {
+		max = msg->msg_max ? (msg->msg_max * 2) : 64;
+		tokens = realloc(msg->msg_tokens, max * sizeof(*tokens));
+		if (!tokens) {
+			return -ENOMEM;
+		}
+		msg->msg_tokens = tokens;
+		msg->msg_max = max;
+	}
+	msg->msg_tokens[msg->msg_count].tok_off = off;
+	msg->msg_tokens[msg->msg_count].tok_len = len;
+	msg->msg_count++;
+	msg->msg_buf[off + len] = '\0';
+
+	return 0;
+}
+
+/*
+ * cmyth_msg_tokenize(cmyth_msg_t msg)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Split the payload held in 'msg' into tokens at each []:[]
+ * separator.  Separators are matched exactly the way
+ * cmyth_rcv_string() matches them on the socket: a partial match is
+ * abandoned at the first byte that does not fit and that byte is not
+ * reconsidered as the start of a new separator.  A payload ending in
+ * a separator yields a final empty token.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -ENOMEM
+ */
+static int
+cmyth_msg_tokenize(cmyth_msg_t msg)
+{
+	char *buf = msg->msg_buf;
+	char *end = buf + msg->msg_len;
+	char *p = buf;
+	char *s;
+	int start = 0;
+	int i;
+
+	while (p < end) {
+		if ((s=memchr(p, separator[0], end - p)) == NULL) {
+			break;
+		}
+		for (i = 1; (separator[i] != '\0') && (s + i < end); ++i) {
+			if (s[i] != separator[i]) {
+				break;
+			}
+		}
+		if (separator[i] != '\0') {
+			p = s + i + 1;
+			continue;
+		}
+		if (cmyth_msg_add_token(msg, start, (s - buf) - start) < 0) {
+			return -ENOMEM;
+		}
+		start = (s - buf) + i;
+		p = buf + start;
+	}
+
+	return cmyth_msg_add_token(msg, start, msg->msg_len - start);
+}
+
+/*
+ * cmyth_rcv_msg(cmyth_conn_t conn, int *err, int count)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_rcv_msg)
+ *
+ * Description
+ *
+ * Receive the remaining 'count' bytes of a MythTV Protocol message
+ * from the connection 'conn' into a single buffer and split it into
+ * tokens.  Any part of the message already sitting in the connection
+ * buffer is used first, the rest is read straight from the socket.
+ * The tokens can then be decoded with the cmyth_msg_*() functions
+ * without further socket traffic.  If an error is encountered and
+ * 'err' is not NULL, an indication of the nature of the error will
+ * be recorded by placing an error code in the location pointed to by
+ * 'err'.  If all goes well, 'err' wil be set to 0.
+ *
+ * Return Value:
+ *
+ * Success: A held message handle
+ *
+ * Failure: NULL
+ */
+cmyth_msg_t
+cmyth_rcv_msg(cmyth_conn_t conn, int *err, int count)
+{
+	cmyth_msg_t ret;
+	int have = 0;
+	int tmp;
+
+	if (!err) {
+		err = &tmp;
+	}
+	if (count < 0) {
+		*err = EINVAL;
+		return NULL;
+	}
+	*err = 0;
+	if (!conn || (conn->conn_fd < 0)) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: not connected\n",
+			  __FUNCTION__);
+		*err = EBADF;
+		return NULL;
+	}
+
+	ret = ref_alloc(sizeof(*ret));
+	if (!ret) {
+		*err = ENOMEM;
+		return NULL;
+	}
+	ref_set_destroy(ret, (ref_destroy_t)cmyth_msg_destroy);
+
+	ret->msg_buf = malloc(count + 1);
+	if (!ret->msg_buf) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: malloc(%d) failed\n",
+			  __FUNCTION__, count + 1);
+		*err = ENOMEM;
+		goto fail;
+	}
+	ret->msg_len = count;
+	ret->msg_version = conn->conn_version;
+
+	if (conn->conn_pos < conn->conn_len) {
+		have = conn->conn_len - conn->conn_pos;
+		if (have > count) {
+			have = count;
+		}
+		memcpy(ret->msg_buf, conn->conn_buf + conn->conn_pos, have);
+	}
+	conn->conn_pos = conn->conn_len = 0;
+
+	if (have < count) {
+		if (cmyth_rcv_data(conn, err,
+				   (unsigned char*)ret->msg_buf + have,
+				   count - have) != (count - have)) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: cmyth_rcv_data() failed (%d)\n",
+				  __FUNCTION__, *err);
+			if (*err == 0) {
+				*err = EBADF;
+			}
+			goto fail;
+		}
+	}
+
+	if (cmyth_msg_tokenize(ret) < 0) {
+		*err = ENOMEM;
+		goto fail;
+	}
+
+	cmyth_dbg(CMYTH_DBG_PROTO, "%s: %d bytes, %d tokens\n",
+		  __FUNCTION__, ret->msg_len, ret->msg_count);
+
+	return ret;
+
+    fail:
+	ref_release(ret);
+	return NULL;
+}
+
+/*
+ * cmyth_msg_remaining(cmyth_msg_t msg)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_remaining)
+ *
+ * Description
+ *
+ * Report how many bytes of the message 'msg' have not been consumed
+ * yet.  This corresponds to the 'count' that would be left over when
+ * reading the same tokens with the cmyth_rcv_*() functions.
+ *
+ * Return Value:
+ *
+ * The number of unconsumed bytes (0 when the message is exhausted)
+ */
+int
+cmyth_msg_remaining(cmyth_msg_t msg)
+{
+	if (!msg || (msg->msg_next >= msg->msg_count)) {
+		return 0;
+	}
+	return msg->msg_len - msg->msg_tokens[msg->msg_next].tok_off;
+}
+
+/*
+ * cmyth_msg_string(cmyth_msg_t msg)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_string)
+ *
+ * Description
+ *
+ * Consume the next token of 'msg' and return it as a '\0' terminated
+ * string.  The string points into the message buffer and is only
+ * valid while 'msg' is held.  Once the message is exhausted an empty
+ * string is returned, just like cmyth_rcv_string() does when asked to
+ * read zero bytes.
+ *
+ * Return Value:
+ *
+ * A pointer to the token (never NULL)
+ */
+char *
+cmyth_msg_string(cmyth_msg_t msg)
+{
+	static char empty[] = "";
+	char *ret;
+
+	if (!msg || (msg->msg_next >= msg->msg_count)) {
+		return empty;
+	}
+	ret = msg->msg_buf + msg->msg_tokens[msg->msg_next].tok_off;
+	msg->msg_next++;
+
+	cmyth_dbg(CMYTH_DBG_PROTO, "%s: string received '%s'\n",
+		  __FUNCTION__, ret);
+
+	return ret;
+}
+
+/*
+ * cmyth_msg_number(cmyth_msg_t msg, int is_signed,
+ *                  unsigned long long limit, long long *buf)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Consume the next token of 'msg' and convert it to an integer whose
+ * absolute value may not exceed 'limit'.  A leading '-' is accepted
+ * only when 'is_signed' is set.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -EINVAL (no token, or the token is not numeric)
+ *          -ERANGE (the value exceeds 'limit')
+ */
+static int
+cmyth_msg_number(cmyth_msg_t msg, int is_signed, unsigned long long limit,
+		 long long *buf)
+{
+	unsigned long long val = 0;
+	unsigned int digit;
+	int sign = 1;
+	char *num, *num_p;
+
+	if (cmyth_msg_remaining(msg) <= 0) {
+		return -EINVAL;
+	}
+	num = num_p = cmyth_msg_string(msg);
+
+	if (is_signed && (*num_p == '-')) {
+		++num_p;
+		sign = -1;
+	}
+	while (*num_p) {
+		if (!isdigit((int)*num_p)) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: received illegal integer: '%s'\n",
+				  __FUNCTION__, num);
+			return -EINVAL;
+		}
+		digit = *num_p - '0';
+		if (val > (limit - digit) / 10) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: integer out of range: '%s'\n",
+				  __FUNCTION__, num);
+			return -ERANGE;
+		}
+		val = (val * 10) + digit;
+		num_p++;
+	}
+
+	*buf = sign * (long long)val;
+
+	return 0;
+}
+
+/*
+ * cmyth_msg_long(cmyth_msg_t msg, long *buf)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_long)
+ *
+ * Description
+ *
+ * Consume the next token of 'msg' as a signed 32 bit integer and
+ * place it in 'buf'.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(errno)
+ */
+int
+cmyth_msg_long(cmyth_msg_t msg, long *buf)
+{
+	long long val;
+	int ret;
+
+	if ((ret=cmyth_msg_number(msg, 1, 0x7fffffff, &val)) == 0) {
+		*buf = (long)val;
+	}
+	return ret;
+}
+
+/*
+ * cmyth_msg_ulong(cmyth_msg_t msg, unsigned long *buf)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_ulong)
+ *
+ * Description
+ *
+ * Consume the next token of 'msg' as an unsigned 32 bit integer and
+ * place it in 'buf'.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(errno)
+ */
+int
+cmyth_msg_ulong(cmyth_msg_t msg, unsigned long *buf)
+{
+	long long val;
+	int ret;
+
+	if ((ret=cmyth_msg_number(msg, 0, 0xffffffff, &val)) == 0) {
+		*buf = (unsigned long)val;
+	}
+	return ret;
+}
+
+/*
+ * cmyth_msg_ushort(cmyth_msg_t msg, unsigned short *buf)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_ushort)
+ *
+ * Description
+ *
+ * Consume the next token of 'msg' as an unsigned 16 bit integer and
+ * place it in 'buf'.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(errno)
+ */
+int
+cmyth_msg_ushort(cmyth_msg_t msg, unsigned short *buf)
+{
+	long long val;
+	int ret;
+
+	if ((ret=cmyth_msg_number(msg, 0, 0xffff, &val)) == 0) {
+		*buf = (unsigned short)val;
+	}
+	return ret;
+}
+
+/*
+ * cmyth_msg_int64(cmyth_msg_t msg, int64_t *buf, int forced)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_int64)
+ *
+ * Description
+ *
+ * Consume a signed 64 bit integer from 'msg' and place it in 'buf'.
+ * Depending on the protocol version of the connection the message was
+ * received on, this is either a single token or a pair of unsigned
+ * 32 bit hi and lo tokens.  See cmyth_rcv_new_int64() for the meaning
+ * of 'forced'.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(errno)
+ */
+int
+cmyth_msg_int64(cmyth_msg_t msg, int64_t *buf, int forced)
+{
+	unsigned long hi, lo;
+	long long val;
+	int ret;
+
+	if ((msg->msg_version < 57) ||
+	    ((msg->msg_version < 66) && !forced)) {
+		if ((ret=cmyth_msg_ulong(msg, &hi)) < 0) {
+			return ret;
+		}
+		if ((ret=cmyth_msg_ulong(msg, &lo)) < 0) {
+			return ret;
+		}
+		*buf = (((long long)hi) << 32) | ((long long)(lo & 0xFFFFFFFF));
+		return 0;
+	}
+
+	if ((ret=cmyth_msg_number(msg, 1, 0x7fffffffffffffffLL, &val)) == 0) {
+		*buf = val;
+	}
+	return ret;
+}
+
+/*
+ * cmyth_msg_timestamp(cmyth_msg_t msg, cmyth_timestamp_t ts)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_timestamp)
+ *
+ * Description
+ *
+ * Consume a timestamp in international format (see
+ * cmyth_rcv_timestamp()) from 'msg' and fill out the timestamp
+ * structure 'ts' with it.  An empty or single character token, as
+ * sent for livetv, leaves 'ts' untouched.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(errno)
+ */
+int
+cmyth_msg_timestamp(cmyth_msg_t msg, cmyth_timestamp_t ts)
+{
+	char tbuf[CMYTH_TIMESTAMP_LEN + 1];
+
+	if (cmyth_msg_remaining(msg) <= 0) {
+		return -EINVAL;
+	}
+	strncpy(tbuf, cmyth_msg_string(msg), CMYTH_TIMESTAMP_LEN);
+	tbuf[CMYTH_TIMESTAMP_LEN] = '\0';
+
+	if (strlen(tbuf) <= 1) {
+		return 0;
+	}
+
+	if (cmyth_timestamp_set_string(ts, tbuf) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_timestamp_set_string() failed\n",
+			  __FUNCTION__);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/*
+ * cmyth_msg_datetime(cmyth_msg_t msg, cmyth_timestamp_t ts)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_msg_datetime)
+ *
+ * Description
+ *
+ * Consume a datetime, given as the number of seconds since
+ * Jan 1, 1970, from 'msg' and fill out the timestamp structure 'ts'
+ * with it.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(errno)
+ */
+int
+cmyth_msg_datetime(cmyth_msg_t msg, cmyth_timestamp_t ts)
+{
+	if (cmyth_msg_remaining(msg) <= 0) {
+		return -EINVAL;
+	}
+	cmyth_timestamp_set_unixtime(ts,
+				     (time_t)atoi(cmyth_msg_string(msg)));
+	return 0;
+}
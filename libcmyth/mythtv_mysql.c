@@ -734,76 +734,62 @@ cmyth_get_bookmark_offset(cmyth_database_t db, long chanid, long long mark, char
 	return offset;
 }
 
-int
-cmyth_mysql_query_commbreak_count(cmyth_database_t db, int chanid, char * start_ts_dt) {
-	MYSQL_RES *res = NULL;
-	int count = 0;
-	char * query_str;
-	query_str = "SELECT * FROM recordedmarkup WHERE chanid = ? AND starttime = ? AND TYPE IN ( 4 )"; 
-	cmyth_mysql_query_t * query;
-
-	query = cmyth_mysql_query_create(db,query_str);
-	if ( (cmyth_mysql_query_param_int(query, chanid) < 0
-		|| cmyth_mysql_query_param_str(query, start_ts_dt) < 0
-		) ) {
-		cmyth_dbg(CMYTH_DBG_ERROR,"%s, binding of query parameters failed! Maybe we're out of memory?\n", __FUNCTION__);
-		ref_release(query);
-		return -1;
-	}
-	res = cmyth_mysql_query_result(query);
-	ref_release(query);
-	if (res == NULL) {
-		cmyth_dbg(CMYTH_DBG_ERROR,"%s, finalisation/execution of query failed!\n", __FUNCTION__);
-		return -1;
-	}
-	count = mysql_num_rows(res);
-	mysql_free_result(res);
-	return (count);
-} 
-
+/*
+ * cmyth_mysql_get_commbreak_list(cmyth_database_t db, int chanid,
+ *                                char *start_ts_dt,
+ *                                cmyth_commbreaklist_t breaklist,
+ *                                int conn_version)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Add the commercial breaks of the recording 'chanid' and 'start_ts_dt'
+ * to 'breaklist', with the byte offsets of their start and end marks.
+ * From protocol version 43 on, the offset of a mark is that of the last
+ * key frame at or before it, looked up in the same query.
+ *
+ * Return Value:
+ *
+ * Success: The number of breaks added
+ *
+ * Failure: -1
+ */
 int
 cmyth_mysql_get_commbreak_list(cmyth_database_t db, int chanid, char * start_ts_dt, cmyth_commbreaklist_t breaklist, int conn_version) 
 {
 	MYSQL_RES *res = NULL;
 	MYSQL_ROW row;
-	int resolution = 30;
 	char * query_str;
 	int rows = 0;
 	cmyth_mysql_query_t * query;
 	cmyth_commbreak_t commbreak = NULL;
-	int i = 0;
-	long long start_previous = 0;
-	long long end_previous = 0;
+	int type;
 
 	if (conn_version>=43) {
-		query_str = "SELECT m.type,m.mark,s.mark,s.offset  FROM recordedmarkup m INNER JOIN recordedseek AS s ON m.chanid = s.chanid AND m.starttime = s.starttime  WHERE m.chanid = ? AND m.starttime = ? AND m.type in (?,?) and FLOOR(m.mark/?)=FLOOR(s.mark/?) ORDER BY `m`.`mark` LIMIT 300 ";
+		/*
+		 * At equal marks the end of a break sorts before the start
+		 * of the next one, so that adjacent breaks pair up.
+		 */
+		query_str = "SELECT m.type, m.mark, (SELECT s.offset FROM recordedseek AS s WHERE s.chanid = m.chanid AND s.starttime = m.starttime AND s.type = ? AND s.mark <= m.mark ORDER BY s.mark DESC LIMIT 1) AS offset FROM recordedmarkup m WHERE m.chanid = ? AND m.starttime = ? AND m.type IN (?, ?) ORDER BY m.mark, m.type DESC";
 	}
 	else { 
 		query_str = "SELECT m.type AS type, m.mark AS mark, s.offset AS offset FROM recordedmarkup m INNER JOIN recordedseek AS s ON (m.chanid = s.chanid AND m.starttime = s.starttime AND (FLOOR(m.mark / 15) + 1) = s.mark) WHERE m.chanid = ? AND m.starttime = ? AND m.type IN (?, ?) ORDER BY mark;";
 	}
 
 	query = cmyth_mysql_query_create(db,query_str);
-		
-	cmyth_dbg(CMYTH_DBG_ERROR,"%s, query=%s\n", __FUNCTION__,query_str);
 
-	if ( (conn_version>=43) && ( 
-		cmyth_mysql_query_param_int(query, chanid) < 0
-		|| cmyth_mysql_query_param_str(query, start_ts_dt) < 0
-		|| cmyth_mysql_query_param_int(query, CMYTH_COMMBREAK_START) < 0
-		|| cmyth_mysql_query_param_int(query, CMYTH_COMMBREAK_END) < 0
-		|| cmyth_mysql_query_param_int(query, resolution ) < 0
-		|| cmyth_mysql_query_param_int(query, resolution ) < 0
-		) ) {
+	if ( (conn_version>=43) &&
+		cmyth_mysql_query_param_int(query, CMYTH_MARK_GOP_BYFRAME) < 0 ) {
 		cmyth_dbg(CMYTH_DBG_ERROR,"%s, binding of query parameters failed! Maybe we're out of memory?\n", __FUNCTION__);
 		ref_release(query);
 		return -1;
 	}
-		
-	if ( (conn_version < 43) && (cmyth_mysql_query_param_int(query, chanid) < 0
+	if ( cmyth_mysql_query_param_int(query, chanid) < 0
 		|| cmyth_mysql_query_param_str(query, start_ts_dt) < 0
 		|| cmyth_mysql_query_param_int(query, CMYTH_COMMBREAK_START) < 0
 		|| cmyth_mysql_query_param_int(query, CMYTH_COMMBREAK_END) < 0
-		) ) {
+		) {
 		cmyth_dbg(CMYTH_DBG_ERROR,"%s, binding of query parameters failed! Maybe we're out of memory?\n", __FUNCTION__);
 		ref_release(query);
 		return -1;
@@ -815,101 +801,39 @@ cmyth_mysql_get_commbreak_list(cmyth_database_t db, int chanid, char * start_ts_
 		return -1;
 	}
 
-	if (conn_version >=43) {
-		breaklist->commbreak_count = cmyth_mysql_query_commbreak_count(db,chanid,start_ts_dt);
-	}
-	else {
-		breaklist->commbreak_count = mysql_num_rows(res) / 2;
-	}
-	breaklist->commbreak_list = malloc(breaklist->commbreak_count * sizeof(cmyth_commbreak_t));
-	//cmyth_dbg(CMYTH_DBG_ERROR, "%s: %ld\n",__FUNCTION__,breaklist->commbreak_count);
-
-	if (!breaklist->commbreak_list) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: malloc() failed for list\n",
-			__FUNCTION__);
-		return -1;
-	}
-	memset(breaklist->commbreak_list, 0, breaklist->commbreak_count * sizeof(cmyth_commbreak_t));
-
-	if (conn_version >=43) {
-		while ((row = mysql_fetch_row(res))) {
-			if (safe_atoi(row[0]) == CMYTH_COMMBREAK_START) {
-				if ( safe_atoll(row[1]) != start_previous ) {
-					commbreak = cmyth_commbreak_create();
-					commbreak->start_mark = safe_atoll(row[1]);
-					commbreak->start_offset = safe_atoll(row[3]);
-					start_previous = commbreak->start_mark;
-				}
-				else if ( safe_atoll(row[1]) == safe_atoll(row[2]) ) { 
-					commbreak = cmyth_commbreak_create();
-					commbreak->start_mark = safe_atoll(row[1]);
-					commbreak->start_offset = safe_atoll(row[3]);
-				}
-			} else if (safe_atoi(row[0]) == CMYTH_COMMBREAK_END) {
-				if ( safe_atoll(row[1]) != end_previous ) {
-					if (commbreak == NULL) {
-						cmyth_dbg(CMYTH_DBG_ERROR,
-							  "%s: error at %d\n",
-							  __FUNCTION__,
-							  __LINE__);
-						return -1;
-					}
-					commbreak->end_mark = safe_atoll(row[1]);
-					commbreak->end_offset = safe_atoll(row[3]);
-					breaklist->commbreak_list[rows] = commbreak;
-					end_previous = commbreak->end_mark;
-					rows++;
-				}
-				else if ( safe_atoll(row[1]) == safe_atoll(row[2]) ) {
-					if (commbreak == NULL) {
-						cmyth_dbg(CMYTH_DBG_ERROR,
-							  "%s: error at %d\n",
-							  __FUNCTION__,
-							  __LINE__);
-						return -1;
-					}
-					commbreak->end_mark = safe_atoll(row[1]);
-					commbreak->end_offset = safe_atoll(row[3]);
-					breaklist->commbreak_list[rows] = commbreak;
-					if (end_previous != safe_atoll(row[1]) ) {
-						rows++;
-					}
+	/*
+	 * A start without an end is dropped, and so is an end without a
+	 * start.  A second start replaces the first.
+	 */
+	while ((row = mysql_fetch_row(res))) {
+		type = safe_atoi(row[0]);
+		if (type == CMYTH_COMMBREAK_START) {
+			if (commbreak == NULL) {
+				commbreak = cmyth_commbreak_create();
+				if (commbreak == NULL) {
+					break;
 				}
 			}
-			else {
-				cmyth_dbg(CMYTH_DBG_ERROR, "%s: Unknown COMMBREAK returned\n", 
-					__FUNCTION__);
-				return -1;
+			commbreak->start_mark = safe_atoll(row[1]);
+			commbreak->start_offset = safe_atoll(row[2]);
+		} else if (type == CMYTH_COMMBREAK_END) {
+			if (commbreak == NULL) {
+				continue;
 			}
-			i++;
-		}
-	}
-
-	// mythtv protolcol version < 43 
-	else {
-		while ((row = mysql_fetch_row(res))) {
-			if ((i % 2) == 0) {
-				if (safe_atoi(row[0]) != CMYTH_COMMBREAK_START) {
-					return -1;
-				}
-				commbreak = cmyth_commbreak_create();
-				commbreak->start_mark = safe_atoll(row[1]);
-				commbreak->start_offset = safe_atoll(row[2]);
-				i++;
-			} else {
-				if (safe_atoi(row[0]) != CMYTH_COMMBREAK_END) {
-					return -1;
-				}
-				commbreak->end_mark = safe_atoll(row[1]);
-				commbreak->end_offset = safe_atoll(row[2]);
-				breaklist->commbreak_list[rows] = commbreak;
-				i = 0;
+			commbreak->end_mark = safe_atoll(row[1]);
+			commbreak->end_offset = safe_atoll(row[2]);
+			if (cmyth_commbreaklist_add(breaklist, commbreak) == 0) {
 				rows++;
 			}
+			commbreak = NULL;
+		} else {
+			cmyth_dbg(CMYTH_DBG_ERROR, "%s: Unknown COMMBREAK returned\n", 
+				__FUNCTION__);
 		}
 	}
+	ref_release(commbreak);
 	mysql_free_result(res);
-	cmyth_dbg(CMYTH_DBG_ERROR, "%s: COMMBREAK rows= %d\n", __FUNCTION__, rows);
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: COMMBREAK rows= %d\n", __FUNCTION__, rows);
 	return rows;
 }
 
@@ -977,3 +901,191 @@ cmyth_mysql_testdb_connection(cmyth_database_t db,char **message) {
 	*message=buf;
 	return 1;
 }
+
+/*
+ * cmyth_mysql_get_chanlist(cmyth_database_t db, long sourceid)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Build the list of the visible channels of the video source 'sourceid'
+ * with a single query, in the order of their channel numbers.  The
+ * channels are described as the program guide of a recorder describes
+ * them: the name is the channel number and the sign is the call sign.
+ *
+ * Return Value:
+ *
+ * Success: A held cmyth_chanlist_t
+ *
+ * Failure: NULL
+ */
+cmyth_chanlist_t
+cmyth_mysql_get_chanlist(cmyth_database_t db, long sourceid)
+{
+	MYSQL_RES *res = NULL;
+	MYSQL_ROW row;
+	const char *query_str = "SELECT chanid, channum, callsign, icon FROM channel WHERE sourceid = ? AND visible = 1 ORDER BY channum + 0, channum";
+	cmyth_mysql_query_t *query;
+	cmyth_chanlist_t list;
+	cmyth_channel_t channel;
+	char buf[128];
+
+	query = cmyth_mysql_query_create(db, query_str);
+	if (cmyth_mysql_query_param_long(query, sourceid) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s, binding of query parameters failed! Maybe we're out of memory?\n", __FUNCTION__);
+		ref_release(query);
+		return NULL;
+	}
+	res = cmyth_mysql_query_result(query);
+	ref_release(query);
+	if (res == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s, finalisation/execution of query failed!\n", __FUNCTION__);
+		return NULL;
+	}
+
+	list = cmyth_chanlist_create();
+	if (list == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s, cmyth_chanlist_create() failed\n", __FUNCTION__);
+		mysql_free_result(res);
+		return NULL;
+	}
+	while ((row = mysql_fetch_row(res))) {
+		char *num = row[1] ? row[1] : "";
+		char *sign = row[2] ? row[2] : "";
+		char *icon = row[3] ? row[3] : "";
+
+		snprintf(buf, sizeof(buf), "%s %s", num, sign);
+		channel = cmyth_channel_create(safe_atol(row[0]), num, sign,
+					       buf, icon);
+		cmyth_chanlist_add(list, channel);
+		ref_release(channel);
+	}
+	mysql_free_result(res);
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: %ld channels on source %ld\n",
+		  __FUNCTION__, list->chanlist_count, sourceid);
+
+	return list;
+}
+
+/*
+ * cmyth_mysql_get_card_source(cmyth_database_t db, int cardid)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_mysql_get_card_source)
+ *
+ * Description
+ *
+ * Look up the video source of the first input of the capture card
+ * 'cardid', which is the source a new live TV session starts on.  Before
+ * MythTV 0.28 the inputs were kept in their own table.
+ *
+ * Return Value:
+ *
+ * Success: The source id
+ *
+ * Failure: -1
+ */
+long
+cmyth_mysql_get_card_source(cmyth_database_t db, int cardid)
+{
+	MYSQL_RES *res = NULL;
+	MYSQL_ROW row;
+	const char *query_str[] = {
+		"SELECT sourceid FROM cardinput WHERE cardid = ? ORDER BY cardinputid LIMIT 1",
+		"SELECT sourceid FROM capturecard WHERE cardid = ?",
+	};
+	cmyth_mysql_query_t *query;
+	long sourceid = -1;
+	unsigned int i;
+
+	for (i = 0; (i < sizeof(query_str) / sizeof(query_str[0])) &&
+		     (sourceid < 0); i++) {
+		query = cmyth_mysql_query_create(db, query_str[i]);
+		if (cmyth_mysql_query_param_int(query, cardid) < 0) {
+			ref_release(query);
+			return -1;
+		}
+		res = cmyth_mysql_query_result(query);
+		ref_release(query);
+		if (res == NULL) {
+			continue;
+		}
+		if (((row = mysql_fetch_row(res)) != NULL) && row[0]) {
+			sourceid = safe_atol(row[0]);
+		}
+		mysql_free_result(res);
+	}
+
+	return sourceid;
+}
+
+/*
+ * cmyth_mysql_get_posmap(cmyth_database_t db, cmyth_proginfo_t prog)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Load the whole seek table of the recording 'prog' from the
+ * recordedseek table with a single query: the byte offset of every key
+ * frame and, where the backend has stored them, the key frame times.
+ * Recordings whose table only holds GOP numbers rather than frame
+ * numbers give an empty map.
+ *
+ * Return Value:
+ *
+ * Success: A held position map
+ *
+ * Failure: NULL
+ */
+cmyth_posmap_t
+cmyth_mysql_get_posmap(cmyth_database_t db, cmyth_proginfo_t prog)
+{
+	MYSQL_RES *res = NULL;
+	MYSQL_ROW row;
+	const char *query_str = "SELECT type, mark, offset FROM recordedseek WHERE chanid = ? AND starttime = ? AND type IN (?, ?) ORDER BY type, mark";
+	cmyth_mysql_query_t *query;
+	cmyth_posmap_t pm;
+	char *start_ts_dt;
+
+	if (!db || !prog) {
+		return NULL;
+	}
+
+	start_ts_dt = cmyth_timestamp_display_string(prog->proginfo_rec_start_ts, 0);
+	query = cmyth_mysql_query_create(db, query_str);
+	if (cmyth_mysql_query_param_long(query, prog->proginfo_chanId) < 0
+	    || cmyth_mysql_query_param_str(query, start_ts_dt) < 0
+	    || cmyth_mysql_query_param_int(query, CMYTH_MARK_GOP_BYFRAME) < 0
+	    || cmyth_mysql_query_param_int(query, CMYTH_MARK_DURATION_MS) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s, binding of query parameters failed! Maybe we're out of memory?\n", __FUNCTION__);
+		ref_release(start_ts_dt);
+		ref_release(query);
+		return NULL;
+	}
+	ref_release(start_ts_dt);
+	res = cmyth_mysql_query_result(query);
+	ref_release(query);
+	if (res == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s, finalisation/execution of query failed!\n", __FUNCTION__);
+		return NULL;
+	}
+
+	if ((pm = cmyth_posmap_create()) == NULL) {
+		mysql_free_result(res);
+		return NULL;
+	}
+	while ((row = mysql_fetch_row(res))) {
+		cmyth_posmap_add(pm,
+				 safe_atoi(row[0]) == CMYTH_MARK_DURATION_MS,
+				 safe_atoll(row[1]), safe_atoll(row[2]));
+	}
+	mysql_free_result(res);
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: %lu key frame offsets, %lu times\n",
+		  __FUNCTION__, pm->posmap_pos.pi_count,
+		  pm->posmap_dur.pi_count);
+
+	return pm;
+}
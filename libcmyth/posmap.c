@@ -27,8 +27,39 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
 #include <cmyth_local.h>
 
+/*
+ * The largest encoding of one pair: two 64 bit values at 7 bits per byte.
+ */
+#define POSMAP_PAIR_MAX 20
+
+/*
+ * cmyth_posmap_index_free(struct cmyth_posmap_index *idx)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Release the arrays of the position map index 'idx'.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+cmyth_posmap_index_free(struct cmyth_posmap_index *idx)
+{
+	free(idx->pi_key);
+	free(idx->pi_val);
+	free(idx->pi_off);
+	free(idx->pi_data);
+	memset(idx, 0, sizeof(*idx));
+}
+
 /*
  * cmyth_posmap_destroy(cmyth_posmap_t pm)
  * 
@@ -48,28 +79,24 @@
 static void
 cmyth_posmap_destroy(cmyth_posmap_t pm)
 {
-	unsigned int i;
-
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
 	if (!pm) {
 		return;
 	}
-	if (pm->posmap_list) {
-		for (i = 0; i < pm->posmap_count; ++i) {
-			ref_release(pm->posmap_list[i]);
-		}
-		free(pm->posmap_list);
-	}
+	cmyth_posmap_index_free(&pm->posmap_pos);
+	cmyth_posmap_index_free(&pm->posmap_dur);
 }
 
 /*
  * cmyth_posmap_create(void)
  * 
- * Scope: PUBLIC
+ * Scope: PRIVATE (mapped to __cmyth_posmap_create)
  *
  * Description
  *
- * Allocate and initialize a position map structure.
+ * Allocate and initialize an empty position map structure.  The map is
+ * filled with cmyth_posmap_add() by the functions which load it, and is
+ * not changed after that, so it can be shared between threads.
  *
  * Return Value:
  *
@@ -88,7 +115,346 @@ cmyth_posmap_create(void)
 	}
 	ref_set_destroy(ret, (ref_destroy_t)cmyth_posmap_destroy);
 
-	ret->posmap_count = 0;
-	ret->posmap_list = NULL;
+	memset(&ret->posmap_pos, 0, sizeof(ret->posmap_pos));
+	memset(&ret->posmap_dur, 0, sizeof(ret->posmap_dur));
 	return ret;
 }
+
+/*
+ * Variable length encoding of the deltas, 7 bits per byte with the high
+ * bit set on all but the last byte.  Signed deltas are zigzag encoded so
+ * that small negative values stay short.
+ */
+static int
+cmyth_posmap_put(unsigned char *p, uint64_t val)
+{
+	int n = 0;
+
+	while (val >= 0x80) {
+		p[n++] = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	p[n++] = (unsigned char)val;
+
+	return n;
+}
+
+static uint64_t
+cmyth_posmap_get(const unsigned char **pp)
+{
+	const unsigned char *p = *pp;
+	uint64_t val = 0;
+	int shift = 0;
+
+	do {
+		val |= (uint64_t)(*p & 0x7f) << shift;
+		shift += 7;
+	} while ((*p++ & 0x80) && (shift < 64));
+	*pp = p;
+
+	return val;
+}
+
+static inline uint64_t
+cmyth_posmap_zigzag(int64_t val)
+{
+	return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t
+cmyth_posmap_unzigzag(uint64_t val)
+{
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+/*
+ * cmyth_posmap_add(cmyth_posmap_t pm, int duration,
+ *                  int64_t frame, int64_t value)
+ * 
+ * Scope: PRIVATE (mapped to __cmyth_posmap_add)
+ *
+ * Description
+ *
+ * Append the key frame 'frame' to the position map 'pm'.  If 'duration'
+ * is zero 'value' is the byte offset of the key frame in the recording,
+ * otherwise it is the time of the key frame in milliseconds from the
+ * start of the recording.  Key frames must be added in ascending order.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(ERRNO)
+ */
+int
+cmyth_posmap_add(cmyth_posmap_t pm, int duration, int64_t frame,
+		 int64_t value)
+{
+	struct cmyth_posmap_index *idx;
+	unsigned long max;
+	uint32_t size;
+	void *p;
+
+	if (!pm) {
+		return -EINVAL;
+	}
+	idx = duration ? &pm->posmap_dur : &pm->posmap_pos;
+
+	if (idx->pi_count && (frame <= idx->pi_last_key)) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: key frame %"PRId64" out of order\n",
+			  __FUNCTION__, frame);
+		return -EINVAL;
+	}
+
+	if ((idx->pi_count % CMYTH_POSMAP_BLOCK) == 0) {
+		if (idx->pi_blocks == idx->pi_max) {
+			max = idx->pi_max ? (idx->pi_max * 2) : 16;
+			if ((p = realloc(idx->pi_key,
+					 max * sizeof(*idx->pi_key))) == NULL) {
+				goto nomem;
+			}
+			idx->pi_key = p;
+			if ((p = realloc(idx->pi_val,
+					 max * sizeof(*idx->pi_val))) == NULL) {
+				goto nomem;
+			}
+			idx->pi_val = p;
+			if ((p = realloc(idx->pi_off,
+					 max * sizeof(*idx->pi_off))) == NULL) {
+				goto nomem;
+			}
+			idx->pi_off = p;
+			idx->pi_max = max;
+		}
+		idx->pi_key[idx->pi_blocks] = frame;
+		idx->pi_val[idx->pi_blocks] = value;
+		idx->pi_off[idx->pi_blocks] = idx->pi_len;
+		idx->pi_blocks++;
+	} else {
+		if ((idx->pi_size - idx->pi_len) < POSMAP_PAIR_MAX) {
+			if (idx->pi_size >= 0x80000000) {
+				goto nomem;
+			}
+			size = idx->pi_size ? (idx->pi_size * 2) : 1024;
+			if ((p = realloc(idx->pi_data, size)) == NULL) {
+				goto nomem;
+			}
+			idx->pi_data = p;
+			idx->pi_size = size;
+		}
+		idx->pi_len += cmyth_posmap_put(idx->pi_data + idx->pi_len,
+						frame - idx->pi_last_key);
+		idx->pi_len += cmyth_posmap_put(idx->pi_data + idx->pi_len,
+						cmyth_posmap_zigzag(value - idx->pi_last_val));
+	}
+
+	idx->pi_last_key = frame;
+	idx->pi_last_val = value;
+	idx->pi_count++;
+
+	return 0;
+
+    nomem:
+	cmyth_dbg(CMYTH_DBG_ERROR, "%s: out of memory at %lu key frames\n",
+		  __FUNCTION__, idx->pi_count);
+	return -ENOMEM;
+}
+
+/*
+ * cmyth_posmap_find(struct cmyth_posmap_index *idx, int by_value,
+ *                   int64_t target, int64_t *key, int64_t *value)
+ * 
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Find the last pair in 'idx' whose key (or value, if 'by_value' is set)
+ * is not above 'target', or the first pair if there is none.  The block
+ * holding the pair is found by binary search on the whole first pairs,
+ * and then at most CMYTH_POSMAP_BLOCK - 1 deltas are decoded.
+ *
+ * Return Value:
+ *
+ * Success: 0, with the pair in 'key' and 'value'
+ *
+ * Failure: -ENOENT if the index is empty
+ */
+static int
+cmyth_posmap_find(struct cmyth_posmap_index *idx, int by_value,
+		  int64_t target, int64_t *key, int64_t *value)
+{
+	const unsigned char *p;
+	unsigned long lo, hi, mid, n, i;
+	int64_t k, v, nk, nv;
+
+	if (idx->pi_count == 0) {
+		return -ENOENT;
+	}
+
+	lo = 0;
+	hi = idx->pi_blocks;
+	while ((hi - lo) > 1) {
+		mid = lo + ((hi - lo) / 2);
+		if ((by_value ? idx->pi_val[mid] : idx->pi_key[mid]) <= target) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	k = idx->pi_key[lo];
+	v = idx->pi_val[lo];
+	n = idx->pi_count - (lo * CMYTH_POSMAP_BLOCK);
+	if (n > CMYTH_POSMAP_BLOCK) {
+		n = CMYTH_POSMAP_BLOCK;
+	}
+	p = idx->pi_data + idx->pi_off[lo];
+	for (i = 1; i < n; i++) {
+		nk = k + (int64_t)cmyth_posmap_get(&p);
+		nv = v + cmyth_posmap_unzigzag(cmyth_posmap_get(&p));
+		if ((by_value ? nv : nk) > target) {
+			break;
+		}
+		k = nk;
+		v = nv;
+	}
+
+	*key = k;
+	*value = v;
+
+	return 0;
+}
+
+/*
+ * cmyth_posmap_get_count(cmyth_posmap_t pm)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Report the number of key frames with a known byte offset in the
+ * position map 'pm'.
+ *
+ * Return Value:
+ *
+ * Success: The number of key frames (>= 0)
+ *
+ * Failure: -EINVAL
+ */
+long
+cmyth_posmap_get_count(cmyth_posmap_t pm)
+{
+	if (!pm) {
+		return -EINVAL;
+	}
+
+	return pm->posmap_pos.pi_count;
+}
+
+/*
+ * cmyth_posmap_frame_offset(cmyth_posmap_t pm, long long frame,
+ *                           long long *keyframe)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Look up the byte offset of the last key frame at or before the frame
+ * 'frame' in the position map 'pm'.  Frames before the first key frame
+ * map to the first key frame.  If 'keyframe' is not NULL the number of
+ * the key frame found is placed there.
+ *
+ * Return Value:
+ *
+ * Success: The byte offset (>= 0)
+ *
+ * Failure: -EINVAL, or -ENOENT if the map has no offsets
+ */
+long long
+cmyth_posmap_frame_offset(cmyth_posmap_t pm, long long frame,
+			  long long *keyframe)
+{
+	int64_t key, offset;
+	int ret;
+
+	if (!pm) {
+		return -EINVAL;
+	}
+	if ((ret=cmyth_posmap_find(&pm->posmap_pos, 0, frame,
+				   &key, &offset)) < 0) {
+		return ret;
+	}
+	if (keyframe) {
+		*keyframe = key;
+	}
+
+	return offset;
+}
+
+/*
+ * cmyth_posmap_time_frame(cmyth_posmap_t pm, long long msec)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Look up the last key frame at or before 'msec' milliseconds into the
+ * recording in the position map 'pm'.
+ *
+ * Return Value:
+ *
+ * Success: The key frame number (>= 0)
+ *
+ * Failure: -EINVAL, or -ENOENT if the map has no key frame times
+ */
+long long
+cmyth_posmap_time_frame(cmyth_posmap_t pm, long long msec)
+{
+	int64_t key, time;
+	int ret;
+
+	if (!pm) {
+		return -EINVAL;
+	}
+	if ((ret=cmyth_posmap_find(&pm->posmap_dur, 1, msec,
+				   &key, &time)) < 0) {
+		return ret;
+	}
+
+	return key;
+}
+
+/*
+ * cmyth_posmap_frame_time(cmyth_posmap_t pm, long long frame)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Look up the time, in milliseconds from the start of the recording, of
+ * the last key frame at or before the frame 'frame' in the position map
+ * 'pm'.
+ *
+ * Return Value:
+ *
+ * Success: The time in milliseconds (>= 0)
+ *
+ * Failure: -EINVAL, or -ENOENT if the map has no key frame times
+ */
+long long
+cmyth_posmap_frame_time(cmyth_posmap_t pm, long long frame)
+{
+	int64_t key, time;
+	int ret;
+
+	if (!pm) {
+		return -EINVAL;
+	}
+	if ((ret=cmyth_posmap_find(&pm->posmap_dur, 0, frame,
+				   &key, &time)) < 0) {
+		return ret;
+	}
+
+	return time;
+}
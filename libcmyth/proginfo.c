@@ -171,19 +171,23 @@ cmyth_proginfo_destroy(cmyth_proginfo_t p)
 	if (p->proginfo_recpriority_2) {
 		ref_release(p->proginfo_recpriority_2);
 	}
+	if (p->proginfo_syndicatedepisode) {
+		ref_release(p->proginfo_syndicatedepisode);
+	}
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
 }
 
 /*
- * cmyth_proginfo_create(void)
+ * cmyth_proginfo_alloc(void)
  * 
- * Scope: PUBLIC
+ * Scope: PRIVATE (mapped to __cmyth_proginfo_alloc)
  *
  * Description
  *
- * Create a programinfo structure to be used to hold program
- * information and return a pointer to the structure.  The structure
- * is initialized to default values.
+ * Create a programinfo structure initialized to default values, but
+ * without any of its timestamps allocated.  This is meant for
+ * structures that are about to be filled in by cmyth_msg_proginfo(),
+ * which supplies every string and timestamp from a single arena.
  *
  * Return Value:
  *
@@ -192,7 +196,7 @@ cmyth_proginfo_destroy(cmyth_proginfo_t p)
  * Failure: A NULL cmyth_proginfo_t
  */
 cmyth_proginfo_t
-cmyth_proginfo_create(void)
+cmyth_proginfo_alloc(void)
 {
 	cmyth_proginfo_t ret = ref_alloc(sizeof(*ret));
 
@@ -203,36 +207,6 @@ cmyth_proginfo_create(void)
 	}
 	ref_set_destroy(ret, (ref_destroy_t)cmyth_proginfo_destroy);
 
-	ret->proginfo_start_ts = cmyth_timestamp_create();
-	if (!ret->proginfo_start_ts) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!!\n", __FUNCTION__);
-		goto err;
-	}
-	ret->proginfo_end_ts = cmyth_timestamp_create();
-	if (!ret->proginfo_end_ts) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!!!\n", __FUNCTION__);
-		goto err;
-	}
-	ret->proginfo_rec_start_ts = cmyth_timestamp_create();
-	if (!ret->proginfo_rec_start_ts) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!!!!\n", __FUNCTION__);
-		goto err;
-	}
-	ret->proginfo_rec_end_ts = cmyth_timestamp_create();
-	if (!ret->proginfo_rec_end_ts) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !!!!!\n", __FUNCTION__);
-		goto err;
-	}
-	ret->proginfo_lastmodified = cmyth_timestamp_create();
-	if (!ret->proginfo_lastmodified) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !!!!!!\n", __FUNCTION__);
-		goto err;
-	}
-	ret->proginfo_originalairdate = cmyth_timestamp_create();
-	if (!ret->proginfo_originalairdate) {
-		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !!!!!!!\n", __FUNCTION__);
-		goto err;
-	}
 	ret->proginfo_title = NULL;
 	ret->proginfo_subtitle = NULL;
 	ret->proginfo_description = NULL;
@@ -290,6 +264,68 @@ cmyth_proginfo_create(void)
 	ret->proginfo_recordedid = 0;
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
 	return ret;
+}
+
+/*
+ * cmyth_proginfo_create(void)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Create a programinfo structure to be used to hold program
+ * information and return a pointer to the structure.  The structure
+ * is initialized to default values.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL cmyth_proginfo_t (this type is a pointer)
+ *
+ * Failure: A NULL cmyth_proginfo_t
+ */
+cmyth_proginfo_t
+cmyth_proginfo_create(void)
+{
+	cmyth_proginfo_t ret = cmyth_proginfo_alloc();
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s {\n", __FUNCTION__);
+	if (!ret) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!\n", __FUNCTION__);
+		return NULL;
+	}
+
+	ret->proginfo_start_ts = cmyth_timestamp_create();
+	if (!ret->proginfo_start_ts) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!!\n", __FUNCTION__);
+		goto err;
+	}
+	ret->proginfo_end_ts = cmyth_timestamp_create();
+	if (!ret->proginfo_end_ts) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!!!\n", __FUNCTION__);
+		goto err;
+	}
+	ret->proginfo_rec_start_ts = cmyth_timestamp_create();
+	if (!ret->proginfo_rec_start_ts) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s }!!!!\n", __FUNCTION__);
+		goto err;
+	}
+	ret->proginfo_rec_end_ts = cmyth_timestamp_create();
+	if (!ret->proginfo_rec_end_ts) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !!!!!\n", __FUNCTION__);
+		goto err;
+	}
+	ret->proginfo_lastmodified = cmyth_timestamp_create();
+	if (!ret->proginfo_lastmodified) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !!!!!!\n", __FUNCTION__);
+		goto err;
+	}
+	ret->proginfo_originalairdate = cmyth_timestamp_create();
+	if (!ret->proginfo_originalairdate) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s } !!!!!!!\n", __FUNCTION__);
+		goto err;
+	}
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s }\n", __FUNCTION__);
+	return ret;
 
     err:
 	ref_release(ret);
@@ -298,9 +334,9 @@ cmyth_proginfo_create(void)
 }
 
 /*
- * cmyth_proginfo_create(void)
+ * cmyth_proginfo_dup(cmyth_proginfo_t p)
  * 
- * Scope: PRIVATE (static)
+ * Scope: PRIVATE (mapped to __cmyth_proginfo_dup)
  *
  * Description
  *
@@ -313,10 +349,10 @@ cmyth_proginfo_create(void)
  *
  * Failure: A NULL cmyth_proginfo_t
  */
-static cmyth_proginfo_t
+cmyth_proginfo_t
 cmyth_proginfo_dup(cmyth_proginfo_t p)
 {
-	cmyth_proginfo_t ret = cmyth_proginfo_create();
+	cmyth_proginfo_t ret = cmyth_proginfo_alloc();
 
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s {\n", __FUNCTION__);
 	if (!ret) {
@@ -390,11 +426,71 @@ cmyth_proginfo_dup(cmyth_proginfo_t p)
 	return ret;
 }
 
+/*
+ * Receive the response to a proginfo command, which is a single number.
+ */
 static int
-proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
-		 long *result)
+proginfo_command_rcv(cmyth_conn_t control, cmyth_request_t req, int count,
+		     long *c)
+{
+	int err = 0;
+	int r;
+
+	r = cmyth_rcv_long(control, &err, c, count);
+	if (err) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_long() failed (%d)\n",
+			  __FUNCTION__, err);
+		req->req_status = (err < 0) ? err : -err;
+	}
+
+	return count - r;
+}
+
+static int
+proginfo_okay_rcv(cmyth_conn_t control, cmyth_request_t req, int count)
+{
+	long c = 0;
+
+	return proginfo_command_rcv(control, req, count, &c);
+}
+
+static int
+proginfo_check_rcv(cmyth_conn_t control, cmyth_request_t req, int count)
 {
 	long c = 0;
+
+	count = proginfo_command_rcv(control, req, count, &c);
+	if (req->req_status >= 0) {
+		req->req_status = c;
+	}
+
+	return count;
+}
+
+/*
+ * proginfo_command_async(cmyth_conn_t control, cmyth_proginfo_t prog,
+ *                        char *cmd, cmyth_request_rcv_t rcv,
+ *                        cmyth_request_callback_t callback, void *data)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Queue the command 'cmd' for the program 'prog' on 'control', with
+ * 'rcv' receiving the response.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+static cmyth_request_t
+proginfo_command_async(cmyth_conn_t control, cmyth_proginfo_t prog,
+		       char *cmd, cmyth_request_rcv_t rcv,
+		       cmyth_request_callback_t callback, void *data)
+{
 	char *buf;
 	unsigned int len = ((2 * CMYTH_LONGLONG_LEN) + 
 			    (6 * CMYTH_TIMESTAMP_LEN) +
@@ -405,17 +501,19 @@ proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
 	char *rec_end_ts = NULL;
 	char *originalairdate = NULL;
 	char *lastmodified = NULL;
-	int err = 0;
-	int count = 0;
-	long r = 0;
-	int ret = -1;
+	cmyth_request_t ret = NULL;
 	int buflen = 0;
 	int cur = 0;
 
+	if (!control) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
+			  __FUNCTION__);
+		return NULL;
+	}
 	if (!prog) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no program info\n",
 			  __FUNCTION__);
-		return -EINVAL;
+		return NULL;
 	}
 
 	len += strlen(prog->proginfo_title);
@@ -443,7 +541,7 @@ proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
 	buflen = len + 1 + 2048;
 	buf = alloca(buflen);
 	if (!buf) {
-		return -ENOMEM;
+		return NULL;
 	}
 
 	if(control->conn_version < 12)
@@ -451,7 +549,7 @@ proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: delete not supported with protocol ver %d\n",
 			  __FUNCTION__, control->conn_version);
-		return -EINVAL;
+		return NULL;
 	}
 	if(control->conn_version < 14)
 	{
@@ -570,6 +668,9 @@ proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
 		buf_extend("%ld[]:[]", prog->proginfo_recordedid);
 	}
 
+	ret = cmyth_request_submit(control, buf, rcv, NULL, callback, data);
+
+    out:
 	ref_release(start_ts);
 	ref_release(end_ts);
 	ref_release(rec_start_ts);
@@ -577,33 +678,22 @@ proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
 	ref_release(originalairdate);
 	ref_release(lastmodified);
 
-	pthread_mutex_lock(&control->conn_mutex);
-
-	if ((err = cmyth_send_message(control, buf)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_send_message() failed (%d)\n",
-			  __FUNCTION__, err);
-		ret = err;
-		goto out;
-	}
+	return ret;
+}
 
-	count = cmyth_rcv_length(control);
-	if ((r=cmyth_rcv_long(control, &err, &c, count)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_length() failed (%d)\n",
-			  __FUNCTION__, r);
-		ret = err;
-		goto out;
-	}
+static int
+proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
+		 cmyth_request_rcv_t rcv)
+{
+	cmyth_request_t req;
+	int ret;
 
-	if (result) {
-		*result = c;
+	req = proginfo_command_async(control, prog, cmd, rcv, NULL, NULL);
+	if (req == NULL) {
+		return -EINVAL;
 	}
-
-	ret = 0;
-
-    out:
-	pthread_mutex_unlock(&control->conn_mutex);
+	ret = cmyth_request_wait(req);
+	ref_release(req);
 
 	return ret;
 }
@@ -628,7 +718,8 @@ proginfo_command(cmyth_conn_t control, cmyth_proginfo_t prog, char *cmd,
 int
 cmyth_proginfo_stop_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 {
-	return proginfo_command(control, prog, "STOP_RECORDING", NULL);
+	return proginfo_command(control, prog, "STOP_RECORDING",
+				proginfo_okay_rcv);
 }
 
 /*
@@ -651,15 +742,48 @@ cmyth_proginfo_stop_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 int
 cmyth_proginfo_check_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 {
-	long result;
+	int result;
 
-	if (proginfo_command(control, prog, "CHECK_RECORDING", &result) == 0) {
+	result = proginfo_command(control, prog, "CHECK_RECORDING",
+				  proginfo_check_rcv);
+	if (result >= 0) {
 		return result;
 	} else {
 		return -1;
 	}
 }
 
+/*
+ * cmyth_proginfo_check_recording_async(cmyth_conn_t control,
+ *                                      cmyth_proginfo_t prog,
+ *                                      cmyth_request_callback_t callback,
+ *                                      void *data)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Queue a request on the control connection 'control' to check the
+ * recording status of the program 'prog' on the MythTV back end.  The
+ * status of the request is 0 if the program is not recording, or the
+ * recorder number if it is.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+cmyth_request_t
+cmyth_proginfo_check_recording_async(cmyth_conn_t control,
+				     cmyth_proginfo_t prog,
+				     cmyth_request_callback_t callback,
+				     void *data)
+{
+	return proginfo_command_async(control, prog, "CHECK_RECORDING",
+				      proginfo_check_rcv, callback, data);
+}
+
 /*
  * cmyth_proginfo_delete_recording(cmyth_conn_t control,
  *                                 cmyth_proginfo_t prog)
@@ -680,7 +804,8 @@ cmyth_proginfo_check_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 int
 cmyth_proginfo_delete_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 {
-	return proginfo_command(control, prog, "DELETE_RECORDING", NULL);
+	return proginfo_command(control, prog, "DELETE_RECORDING",
+				proginfo_okay_rcv);
 }
 
 /*
@@ -703,7 +828,8 @@ cmyth_proginfo_delete_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 int
 cmyth_proginfo_forget_recording(cmyth_conn_t control, cmyth_proginfo_t prog)
 {
-	return proginfo_command(control, prog, "FORGET_RECORDING", NULL);
+	return proginfo_command(control, prog, "FORGET_RECORDING",
+				proginfo_okay_rcv);
 }
 
 /*
@@ -1582,9 +1708,11 @@ cmyth_proginfo_fill(cmyth_conn_t control, cmyth_proginfo_t prog)
 		ret = count;
 		goto out;
 	}
-	if (cmyth_rcv_proginfo(control, &err, prog, count) != count) {
+	if ((cmyth_rcv_proginfo(control, &err, prog, count) != count) ||
+	    err) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_proginfo() < count\n", __FUNCTION__);
+			  "%s: cmyth_rcv_proginfo() failed (%d)\n",
+			  __FUNCTION__, err);
 		ret = err;
 		goto out;
 	}
@@ -1655,6 +1783,100 @@ cmyth_proginfo_get_detail(cmyth_conn_t control, cmyth_proginfo_t p)
 	return ret;
 }
 
+/*
+ * cmyth_proginfo_get_from_timeslot(cmyth_conn_t control, long chanid,
+ *                                  char *recstart)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Look up the recording made on channel 'chanid' which started at
+ * 'recstart'.  The time is given as the backend sends it, for instance in
+ * a RECORDING_LIST_CHANGE ADD event, so that a single new recording can
+ * be fetched without asking for the whole list again.
+ *
+ * Return Value:
+ *
+ * Success: A held, Non-NULL program_info
+ *
+ * Failure: NULL
+ */
+cmyth_proginfo_t
+cmyth_proginfo_get_from_timeslot(cmyth_conn_t control, long chanid,
+				 char *recstart)
+{
+	char msg[256];
+	char reply[32];
+	cmyth_proginfo_t prog = NULL;
+	int err = 0;
+	int count, r;
+
+	if (!control || !recstart) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: invalid arguments\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+
+	snprintf(msg, sizeof(msg), "QUERY_RECORDING TIMESLOT %ld %s",
+		 chanid, recstart);
+
+	pthread_mutex_lock(&control->conn_mutex);
+
+	if ((err=cmyth_send_message(control, msg)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_send_message() failed (%d)\n",
+			  __FUNCTION__, err);
+		goto out;
+	}
+
+	if ((count=cmyth_rcv_length(control)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_length() failed (%d)\n",
+			  __FUNCTION__, count);
+		goto out;
+	}
+
+	r = cmyth_rcv_string(control, &err, reply, sizeof(reply) - 1, count);
+	if (err) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_string() failed (%d)\n",
+			  __FUNCTION__, err);
+		goto out;
+	}
+	count -= r;
+
+	if (strcmp(reply, "OK") != 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no recording at %ld %s\n",
+			  __FUNCTION__, chanid, recstart);
+		while ((count > 0) && !err) {
+			count -= cmyth_rcv_string(control, &err, reply,
+						  sizeof(reply) - 1, count);
+		}
+		goto out;
+	}
+
+	if ((prog=cmyth_proginfo_create()) == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_proginfo_create() failed\n",
+			  __FUNCTION__);
+		goto out;
+	}
+	if ((cmyth_rcv_proginfo(control, &err, prog, count) != count) ||
+	    err) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_proginfo() failed (%d)\n",
+			  __FUNCTION__, err);
+		ref_release(prog);
+		prog = NULL;
+	}
+
+    out:
+	pthread_mutex_unlock(&control->conn_mutex);
+
+	return prog;
+}
+
 /*
  * cmyth_proginfo_compare(cmyth_proginfo_t a, cmyth_proginfo_t b)
  *
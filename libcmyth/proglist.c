@@ -124,23 +124,30 @@ cmyth_proglist_create(void)
 cmyth_proginfo_t
 cmyth_proglist_get_item(cmyth_proglist_t pl, int index)
 {
+	cmyth_proginfo_t ret = NULL;
+
 	if (!pl) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL program list\n",
 			  __FUNCTION__);
 		return NULL;
 	}
+
+	/*
+	 * The list of a cmyth_reclist_t changes under its users.
+	 */
+	pthread_mutex_lock(&pl->proglist_mutex);
 	if (!pl->proglist_list) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL list\n",
 			  __FUNCTION__);
-		return NULL;
-	}
-	if ((index < 0) || (index >= pl->proglist_count)) {
+	} else if ((index < 0) || (index >= pl->proglist_count)) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: index %d out of range\n",
 			  __FUNCTION__, index);
-		return NULL;
+	} else {
+		ret = ref_hold(pl->proglist_list[index]);
 	}
-	ref_hold(pl->proglist_list[index]);
-	return pl->proglist_list[index];
+	pthread_mutex_unlock(&pl->proglist_mutex);
+
+	return ret;
 }
 
 int
@@ -210,90 +217,176 @@ cmyth_proglist_get_count(cmyth_proglist_t pl)
 }
 
 /*
- * cmyth_proglist_get_list(cmyth_conn_t conn,
- *                         cmyth_proglist_t proglist,
- *                         char *msg, char *func)
+ * cmyth_proglist_rcv(cmyth_conn_t conn, cmyth_request_t req, int count)
  * 
  * Scope: PRIVATE (static)
  *
  * Description
  *
- * Obtain a program list from the query specified in 'msg' from the
- * function 'func'.  Make the query on 'conn' and put the results in
- * 'proglist'.
+ * Receive the 'count' byte response to the program list query 'req'
+ * on 'conn', putting the results in the program list passed to
+ * cmyth_request_submit().
  *
  * Return Value:
  *
- * Success: 0
- *
- * Failure: -(ERRNO)
+ * The number of bytes of the response which were not consumed.
  */
 static int
-cmyth_proglist_get_list(cmyth_conn_t conn,
-			cmyth_proglist_t proglist,
-			char *msg, const char *func)
+cmyth_proglist_rcv(cmyth_conn_t conn, cmyth_request_t req, int count)
 {
+	cmyth_proglist_t proglist = req->req_arg;
 	int err = 0;
-	int count;
-	int ret;
+	int r;
 
-	if (!conn) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n", func);
-		return -EINVAL;
-	}
-	if (!proglist) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no program list\n", func);
-		return -EINVAL;
-	}
-
-	pthread_mutex_lock(&conn->conn_mutex);
-
-	if ((err = cmyth_send_message(conn, msg)) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_send_message() failed (%d)\n",
-			  func, err);
-		ret = err;
-		goto out;
-	}
-	count = cmyth_rcv_length(conn);
-	if (count < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_length() failed (%d)\n",
-			  func, count);
-		ret = count;
-		goto out;
-	}
-	if (strcmp(msg, "QUERY_GETALLPENDING") == 0) {
+	if (strcmp(req->req_msg, "QUERY_GETALLPENDING") == 0) {
 		long c;
-		int r;
-		if ((r=cmyth_rcv_long(conn, &err, &c, count)) < 0) {
+		r = cmyth_rcv_long(conn, &err, &c, count);
+		if (err) {
 			cmyth_dbg(CMYTH_DBG_ERROR,
-				  "%s: cmyth_rcv_length() failed (%d)\n",
-				  __FUNCTION__, r);
-			ret = err;
-			goto out;
+				  "%s: cmyth_rcv_long() failed (%d)\n",
+				  __FUNCTION__, err);
+			req->req_status = -1 * err;
+			return count - r;
 		}
 		count -= r;
 	}
-	if (cmyth_rcv_proglist(conn, &err, proglist, count) != count) {
+	r = cmyth_rcv_proglist(conn, &err, proglist, count);
+	if (r != count) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_proglist() < count\n",
-			  func);
+			  __FUNCTION__);
 	}
 	if (err) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_rcv_proglist() failed (%d)\n",
+			  __FUNCTION__, err);
+		req->req_status = -1 * err;
+		return count - r;
+	}
+
+	req->req_result = ref_hold(proglist);
+
+	return count - r;
+}
+
+/*
+ * cmyth_proglist_get_list(cmyth_conn_t conn, char *msg, char *func,
+ *                         cmyth_request_callback_t callback, void *data)
+ * 
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Queue the program list query specified in 'msg' from the function
+ * 'func' on 'conn'.  The result of the request is the program list.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+static cmyth_request_t
+cmyth_proglist_get_list(cmyth_conn_t conn, char *msg, const char *func,
+			cmyth_request_callback_t callback, void *data)
+{
+	cmyth_proglist_t proglist;
+	cmyth_request_t req;
+
+	if (!conn) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n", func);
+		return NULL;
+	}
+	if ((proglist = cmyth_proglist_create()) == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_proglist_create() failed\n", func);
+		return NULL;
+	}
+
+	req = cmyth_request_submit(conn, msg, cmyth_proglist_rcv, proglist,
+				   callback, data);
+	if (req == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_request_submit() failed\n", func);
+	}
+
+	return req;
+}
+
+/*
+ * cmyth_proglist_wait(cmyth_request_t req, char *func)
+ * 
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Wait for the program list query 'req' made by 'func' and release it.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_proglist_t
+ *
+ * Failure: NULL
+ */
+static cmyth_proglist_t
+cmyth_proglist_wait(cmyth_request_t req, const char *func)
+{
+	cmyth_proglist_t proglist = NULL;
+	int err;
+
+	if (req == NULL) {
+		return NULL;
+	}
+	if ((err = cmyth_request_wait(req)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_proglist_get_list() failed (%d)\n",
 			  func, err);
-		ret = -1 * err;
-		goto out;
+	} else {
+		proglist = cmyth_request_get_result(req);
 	}
+	ref_release(req);
 
-	ret = 0;
+	return proglist;
+}
 
-    out:
-	pthread_mutex_unlock(&conn->conn_mutex);
+/*
+ * cmyth_proglist_get_all_recorded_async(cmyth_conn_t control,
+ *                                       cmyth_request_callback_t callback,
+ *                                       void *data)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Queue a request on the control connection 'control' to obtain a list
+ * of completed or in-progress recordings.  The result of the request is
+ * the program list, and 'callback' (if not NULL) is called with 'data'
+ * when it completes.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+cmyth_request_t
+cmyth_proglist_get_all_recorded_async(cmyth_conn_t control,
+				      cmyth_request_callback_t callback,
+				      void *data)
+{
+	char query[32];
 
-	return ret;
+	if (!control) {
+		return NULL;
+	}
+	if (control->conn_version < 65) {
+		strncpy(query, "QUERY_RECORDINGS Play", sizeof(query));
+	}
+	else {
+		strncpy(query, "QUERY_RECORDINGS Ascending", sizeof(query));
+	}
+	return cmyth_proglist_get_list(control, query, __FUNCTION__,
+				       callback, data);
 }
 
 /*
@@ -318,36 +411,43 @@ cmyth_proglist_get_list(cmyth_conn_t conn,
 cmyth_proglist_t
 cmyth_proglist_get_all_recorded(cmyth_conn_t control)
 {
-	char query[32];
-	cmyth_proglist_t proglist = cmyth_proglist_create();
+	cmyth_proglist_t proglist;
 
 	ref_get_refcount("Before cmyth_proglist_get_all_recorded:");
-	if (proglist == NULL) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_create() failed\n",
-			  __FUNCTION__);
-		return NULL;
-	}
-
-	if (control->conn_version < 65) {
-		strncpy(query, "QUERY_RECORDINGS Play", sizeof(query));
-	}
-	else {
-		strncpy(query, "QUERY_RECORDINGS Ascending", sizeof(query));
-	}
-	if (cmyth_proglist_get_list(control, proglist,
-				    query,
-				    __FUNCTION__) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_get_list() failed\n",
-			  __FUNCTION__);
-		ref_release(proglist);
-		return NULL;
-	}
+	proglist = cmyth_proglist_wait(
+		cmyth_proglist_get_all_recorded_async(control, NULL, NULL),
+		__FUNCTION__);
 	ref_get_refcount("After cmyth_proglist_get_all_recorded:");
 	return proglist;
 }
 
+/*
+ * cmyth_proglist_get_all_pending_async(cmyth_conn_t control,
+ *                                      cmyth_request_callback_t callback,
+ *                                      void *data)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Queue a request on the control connection 'control' to obtain a list
+ * of pending recordings.  The result of the request is the program list.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+cmyth_request_t
+cmyth_proglist_get_all_pending_async(cmyth_conn_t control,
+				     cmyth_request_callback_t callback,
+				     void *data)
+{
+	return cmyth_proglist_get_list(control, "QUERY_GETALLPENDING",
+				       __FUNCTION__, callback, data);
+}
+
 /*
  * cmyth_proglist_get_all_pending(cmyth_conn_t control,
  *                                cmyth_proglist_t *proglist)
@@ -370,28 +470,44 @@ cmyth_proglist_get_all_recorded(cmyth_conn_t control)
 cmyth_proglist_t
 cmyth_proglist_get_all_pending(cmyth_conn_t control)
 {
-	cmyth_proglist_t proglist = cmyth_proglist_create();
-        ref_get_refcount("Before cmyth_get_all_pending:");
-	if (proglist == NULL) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_create() failed\n",
-			  __FUNCTION__);
-		return NULL;
-	}
+	cmyth_proglist_t proglist;
 
-	if (cmyth_proglist_get_list(control, proglist,
-				    "QUERY_GETALLPENDING",
-				    __FUNCTION__) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_get_list() failed\n",
-			  __FUNCTION__);
-		ref_release(proglist);
-		return NULL;
-	}
+        ref_get_refcount("Before cmyth_get_all_pending:");
+	proglist = cmyth_proglist_wait(
+		cmyth_proglist_get_all_pending_async(control, NULL, NULL),
+		__FUNCTION__);
         ref_get_refcount("Before cmyth_get_all_pending:");
 	return proglist;
 }
 
+/*
+ * cmyth_proglist_get_all_scheduled_async(cmyth_conn_t control,
+ *                                        cmyth_request_callback_t callback,
+ *                                        void *data)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Queue a request on the control connection 'control' to obtain a list
+ * of scheduled recordings.  The result of the request is the program
+ * list.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL
+ */
+cmyth_request_t
+cmyth_proglist_get_all_scheduled_async(cmyth_conn_t control,
+				       cmyth_request_callback_t callback,
+				       void *data)
+{
+	return cmyth_proglist_get_list(control, "QUERY_GETALLSCHEDULED",
+				       __FUNCTION__, callback, data);
+}
+
 /*
  * cmyth_proglist_get_all_scheduled(cmyth_conn_t control,
  *                                  cmyth_proglist_t *proglist)
@@ -414,25 +530,9 @@ cmyth_proglist_get_all_pending(cmyth_conn_t control)
 cmyth_proglist_t
 cmyth_proglist_get_all_scheduled(cmyth_conn_t control)
 {
-	cmyth_proglist_t proglist = cmyth_proglist_create();
-
-	if (proglist == NULL) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_create() failed\n",
-			  __FUNCTION__);
-		return NULL;
-	}
-
-	if (cmyth_proglist_get_list(control, proglist,
-				    "QUERY_GETALLSCHEDULED",
-				    __FUNCTION__) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_get_list() failed\n",
-			  __FUNCTION__);
-		ref_release(proglist);
-		return NULL;
-	}
-	return proglist;
+	return cmyth_proglist_wait(
+		cmyth_proglist_get_all_scheduled_async(control, NULL, NULL),
+		__FUNCTION__);
 }
 
 /*
@@ -457,25 +557,10 @@ cmyth_proglist_get_all_scheduled(cmyth_conn_t control)
 cmyth_proglist_t
 cmyth_proglist_get_conflicting(cmyth_conn_t control)
 {
-	cmyth_proglist_t proglist = cmyth_proglist_create();
-
-	if (proglist == NULL) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_create() failed\n",
-			  __FUNCTION__);
-		return NULL;
-	}
-
-	if (cmyth_proglist_get_list(control, proglist,
-				    "QUERY_GETCONFLICTING",
-				    __FUNCTION__) < 0) {
-		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_proglist_get_list() failed\n",
-			  __FUNCTION__);
-		ref_release(proglist);
-		return NULL;
-	}
-	return proglist;
+	return cmyth_proglist_wait(
+		cmyth_proglist_get_list(control, "QUERY_GETCONFLICTING",
+					__FUNCTION__, NULL, NULL),
+		__FUNCTION__);
 }
 
 /*
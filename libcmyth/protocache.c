@@ -0,0 +1,290 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * protocache.c - Cache of the protocol version agreed with each backend,
+ *                keyed by host and port, so that a connection can offer
+ *                the right version straight away instead of being
+ *                rejected and reconnecting.
+ *
+ *                The table lives in process memory until
+ *                cmyth_version_cache_open() is called, after which it
+ *                lives in a memory mapped file that persists and is
+ *                shared with every other process using the same file.
+ *                Access to the file is serialized with a lock on it.
+ *                Entries are evicted least recently used first.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cmyth_local.h>
+
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#define VERSION_HAS_MMAP
+#endif
+
+#define VERSION_CACHE_SIZE	32
+#define VERSION_CACHE_HOST	64
+#define VERSION_CACHE_MAGIC	0x636d7076
+
+struct version_entry {
+	char ve_host[VERSION_CACHE_HOST];
+	uint32_t ve_port;
+	uint32_t ve_version;
+	uint32_t ve_used;		/* vt_clock at last use */
+	uint32_t ve_pad;
+};
+
+struct version_table {
+	uint32_t vt_magic;
+	uint32_t vt_size;		/* sizeof(struct version_table) */
+	uint32_t vt_clock;
+	uint32_t vt_pad;
+	struct version_entry vt_entry[VERSION_CACHE_SIZE];
+};
+
+static pthread_mutex_t version_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct version_table version_local;
+static struct version_table *version_table = &version_local;
+static int version_fd = -1;
+
+static void
+version_lock(void)
+{
+	pthread_mutex_lock(&version_mutex);
+#if defined(VERSION_HAS_MMAP)
+	if (version_fd >= 0) {
+		while ((lockf(version_fd, F_LOCK, 0) < 0) && (errno == EINTR))
+			;
+	}
+#endif
+}
+
+static void
+version_unlock(void)
+{
+#if defined(VERSION_HAS_MMAP)
+	if (version_fd >= 0) {
+		lockf(version_fd, F_ULOCK, 0);
+	}
+#endif
+	pthread_mutex_unlock(&version_mutex);
+}
+
+static struct version_entry *
+version_find(const char *host, unsigned short port)
+{
+	int i;
+
+	for (i = 0; i < VERSION_CACHE_SIZE; i++) {
+		struct version_entry *ve = &version_table->vt_entry[i];
+
+		if ((ve->ve_port == port) &&
+		    (strncmp(ve->ve_host, host, VERSION_CACHE_HOST) == 0)) {
+			return ve;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+version_close(void)
+{
+#if defined(VERSION_HAS_MMAP)
+	if (version_table != &version_local) {
+		munmap(version_table, sizeof(*version_table));
+	}
+	if (version_fd >= 0) {
+		close(version_fd);
+	}
+#endif
+	version_table = &version_local;
+	version_fd = -1;
+}
+
+/*
+ * cmyth_version_cache_open(const char *path)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Keep the protocol version cache in the file 'path', which is created
+ * if needed and memory mapped.  The file persists, so later processes
+ * using the same file start with the versions learned by earlier ones.
+ * A file which is not a version cache is reinitialized.  If 'path' is
+ * NULL the file is closed and the cache goes back to process memory.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -errno
+ */
+int
+cmyth_version_cache_open(const char *path)
+{
+#if defined(VERSION_HAS_MMAP)
+	struct version_table *vt;
+	struct stat st;
+	int fd;
+	int ret = 0;
+
+	pthread_mutex_lock(&version_mutex);
+
+	version_close();
+
+	if (path == NULL) {
+		goto out;
+	}
+
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+		ret = -errno;
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: open(%s) failed (%d)\n",
+			  __FUNCTION__, path, errno);
+		goto out;
+	}
+	while ((lockf(fd, F_LOCK, 0) < 0) && (errno == EINTR))
+		;
+	if ((fstat(fd, &st) < 0) ||
+	    ((st.st_size != sizeof(*vt)) && (ftruncate(fd, sizeof(*vt)) < 0))) {
+		ret = -errno;
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: cannot size %s (%d)\n",
+			  __FUNCTION__, path, errno);
+		close(fd);
+		goto out;
+	}
+	vt = mmap(NULL, sizeof(*vt), PROT_READ | PROT_WRITE, MAP_SHARED,
+		  fd, 0);
+	if (vt == MAP_FAILED) {
+		ret = -errno;
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: mmap() failed (%d)\n",
+			  __FUNCTION__, errno);
+		close(fd);
+		goto out;
+	}
+	if ((vt->vt_magic != VERSION_CACHE_MAGIC) ||
+	    (vt->vt_size != sizeof(*vt))) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s: initializing %s\n",
+			  __FUNCTION__, path);
+		memset(vt, 0, sizeof(*vt));
+		vt->vt_magic = VERSION_CACHE_MAGIC;
+		vt->vt_size = sizeof(*vt);
+	}
+	lockf(fd, F_ULOCK, 0);
+
+	version_table = vt;
+	version_fd = fd;
+
+    out:
+	pthread_mutex_unlock(&version_mutex);
+
+	return ret;
+#else
+	return -ENOSYS;
+#endif
+}
+
+/*
+ * cmyth_version_get(const char *host, unsigned short port)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_version_get)
+ *
+ * Description
+ *
+ * Look up the protocol version last agreed with the backend at 'host'
+ * and 'port'.
+ *
+ * Return Value:
+ *
+ * Success: The protocol version
+ *
+ * Failure: 0 if the backend is not in the cache
+ */
+unsigned long
+cmyth_version_get(const char *host, unsigned short port)
+{
+	struct version_entry *ve;
+	unsigned long ret = 0;
+
+	if (!host) {
+		return 0;
+	}
+
+	version_lock();
+	if ((ve = version_find(host, port)) != NULL) {
+		ve->ve_used = ++version_table->vt_clock;
+		ret = ve->ve_version;
+	}
+	version_unlock();
+
+	return ret;
+}
+
+/*
+ * cmyth_version_put(const char *host, unsigned short port,
+ *                   unsigned long version)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_version_put)
+ *
+ * Description
+ *
+ * Record that the backend at 'host' and 'port' agreed to protocol
+ * 'version', evicting the least recently used backend if the cache is
+ * full.  Host names too long to store are not cached.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_version_put(const char *host, unsigned short port,
+		  unsigned long version)
+{
+	struct version_entry *ve;
+	int i;
+
+	if (!host || (strlen(host) >= VERSION_CACHE_HOST)) {
+		return;
+	}
+
+	version_lock();
+	if ((ve = version_find(host, port)) == NULL) {
+		ve = &version_table->vt_entry[0];
+		for (i = 1; i < VERSION_CACHE_SIZE; i++) {
+			if (version_table->vt_entry[i].ve_used < ve->ve_used) {
+				ve = &version_table->vt_entry[i];
+			}
+		}
+		memset(ve, 0, sizeof(*ve));
+		strcpy(ve->ve_host, host);
+		ve->ve_port = port;
+	}
+	ve->ve_version = version;
+	ve->ve_used = ++version_table->vt_clock;
+	version_unlock();
+}
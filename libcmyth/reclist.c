@@ -0,0 +1,556 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * reclist.c - A copy of the recording list of a backend which is kept up
+ *             to date from backend events.  Fetching every recording again
+ *             each time one of them changes is expensive with a large
+ *             library, so recordings are added, updated and removed one at
+ *             a time, in place.  A recording is known by its channel and
+ *             start time, which is what the events carry.
+ *
+ *             The whole list is only fetched again when a change cannot
+ *             be applied: when the backend does not say what changed, when
+ *             a new recording cannot be fetched, or when events may have
+ *             been missed because the event connection was lost.
+ *
+ *             The list subscribes to the events of the backend itself, so
+ *             it follows the backend without help from the caller.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <cmyth_local.h>
+
+static void
+cmyth_reclist_destroy(cmyth_reclist_t rl)
+{
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
+	if (!rl) {
+		return;
+	}
+
+	if (rl->rl_event) {
+		cmyth_event_unsubscribe(rl->rl_event);
+		ref_release(rl->rl_event);
+	}
+
+	ref_release(rl->rl_list);
+	ref_release(rl->rl_control);
+	pthread_mutex_destroy(&rl->rl_fetch_mutex);
+	pthread_mutex_destroy(&rl->rl_mutex);
+}
+
+/*
+ * Find the recording made on 'chanid' at 'start'.  Called with the
+ * mutex of the program list held.
+ */
+static int
+reclist_find(cmyth_proglist_t pl, long chanid, time_t start)
+{
+	cmyth_proginfo_t prog;
+	int i;
+
+	for (i = 0; i < pl->proglist_count; i++) {
+		prog = pl->proglist_list[i];
+		if ((prog->proginfo_chanId == chanid) &&
+		    prog->proginfo_rec_start_ts &&
+		    (cmyth_timestamp_to_unixtime(prog->proginfo_rec_start_ts)
+		     == start)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * Put the recording 'prog' into the list, in place of the one made on
+ * 'chanid' at 'start' if there is one, or else at the end, where the
+ * newest recordings go.
+ */
+static int
+reclist_put(cmyth_proglist_t pl, long chanid, time_t start,
+	    cmyth_proginfo_t prog, cmyth_event_t *change)
+{
+	cmyth_proginfo_t *list;
+	int i, ret = 0;
+
+	pthread_mutex_lock(&pl->proglist_mutex);
+
+	if ((i = reclist_find(pl, chanid, start)) >= 0) {
+		ref_release(pl->proglist_list[i]);
+		pl->proglist_list[i] = ref_hold(prog);
+		*change = CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE;
+		goto out;
+	}
+
+	list = realloc(pl->proglist_list,
+		       (pl->proglist_count + 1) * sizeof(*list));
+	if (list == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	list[pl->proglist_count++] = ref_hold(prog);
+	pl->proglist_list = list;
+	*change = CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD;
+
+    out:
+	pthread_mutex_unlock(&pl->proglist_mutex);
+
+	return ret;
+}
+
+/*
+ * Fetch the whole list again, swapping the new recordings into the
+ * existing list so that those holding it see the change.  Called with
+ * rl_fetch_mutex held, which keeps other changes out, but not rl_mutex,
+ * so readers are not held up by the fetch.
+ */
+static int
+reclist_refresh(cmyth_reclist_t rl)
+{
+	cmyth_proglist_t pl;
+	cmyth_proginfo_t *list;
+	unsigned long conn, version;
+	long count;
+
+	/*
+	 * Events which arrive on a later event connection than this one may
+	 * have been missed by the fetch.
+	 */
+	conn = cmyth_event_sub_connected(rl->rl_event);
+
+	if ((pl = cmyth_proglist_get_all_recorded(rl->rl_control)) == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_proglist_get_all_recorded() failed\n",
+			  __FUNCTION__);
+		pthread_mutex_lock(&rl->rl_mutex);
+		rl->rl_stale = 1;
+		pthread_mutex_unlock(&rl->rl_mutex);
+		return -EIO;
+	}
+
+	pthread_mutex_lock(&rl->rl_mutex);
+
+	pthread_mutex_lock(&rl->rl_list->proglist_mutex);
+	list = rl->rl_list->proglist_list;
+	count = rl->rl_list->proglist_count;
+	rl->rl_list->proglist_list = pl->proglist_list;
+	rl->rl_list->proglist_count = pl->proglist_count;
+	pthread_mutex_unlock(&rl->rl_list->proglist_mutex);
+
+	rl->rl_conn = conn;
+	rl->rl_stale = 0;
+	version = ++rl->rl_version;
+
+	pthread_mutex_unlock(&rl->rl_mutex);
+
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: %ld recordings, version %lu\n",
+		  __FUNCTION__, pl->proglist_count, version);
+
+	pl->proglist_list = list;
+	pl->proglist_count = count;
+	ref_release(pl);
+
+	return 0;
+}
+
+/*
+ * Apply a single change to the list.  Called with rl_fetch_mutex held.
+ *
+ * Returns 1 if the list changed, with the recording in 'changed', 0 if
+ * there was nothing to do, or a negative error if the change could not
+ * be applied.
+ */
+static int
+reclist_apply(cmyth_reclist_t rl, cmyth_event_t event, char *data,
+	      cmyth_proginfo_t prog, cmyth_event_t *change,
+	      cmyth_proginfo_t *changed)
+{
+	cmyth_proglist_t pl = rl->rl_list;
+	cmyth_proginfo_t p = NULL;
+	char recstart[64];
+	char *rest;
+	long chanid;
+	time_t start;
+	long long size;
+	int i, ret;
+
+	switch (event) {
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD:
+		if ((ret = cmyth_timeslot_parse(data, &chanid, recstart,
+						sizeof(recstart), &start,
+						NULL)) < 0) {
+			return ret;
+		}
+		p = cmyth_proginfo_get_from_timeslot(rl->rl_control, chanid,
+						     recstart);
+		if (p == NULL) {
+			return -EIO;
+		}
+		break;
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE:
+		if ((prog == NULL) || (prog->proginfo_rec_start_ts == NULL)) {
+			return -EINVAL;
+		}
+		chanid = prog->proginfo_chanId;
+		start = cmyth_timestamp_to_unixtime(
+			prog->proginfo_rec_start_ts);
+		p = ref_hold(prog);
+		break;
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE:
+		if ((ret = cmyth_timeslot_parse(data, &chanid, recstart,
+						sizeof(recstart), &start,
+						NULL)) < 0) {
+			return ret;
+		}
+		pthread_mutex_lock(&pl->proglist_mutex);
+		if ((i = reclist_find(pl, chanid, start)) >= 0) {
+			p = pl->proglist_list[i];
+			memmove(pl->proglist_list + i,
+				pl->proglist_list + i + 1,
+				(pl->proglist_count - i - 1) * sizeof(p));
+			pl->proglist_count--;
+		}
+		pthread_mutex_unlock(&pl->proglist_mutex);
+		if (p == NULL) {
+			return 0;
+		}
+		*change = event;
+		*changed = p;
+		return 1;
+	case CMYTH_EVENT_UPDATE_FILE_SIZE:
+		if ((ret = cmyth_timeslot_parse(data, &chanid, recstart,
+						sizeof(recstart), &start,
+						&rest)) < 0) {
+			return ret;
+		}
+		size = strtoll(rest, NULL, 10);
+		pthread_mutex_lock(&pl->proglist_mutex);
+		if (((i = reclist_find(pl, chanid, start)) >= 0) &&
+		    (pl->proglist_list[i]->proginfo_Length != size)) {
+			/*
+			 * Others may hold the old program info, so it is
+			 * replaced rather than changed.
+			 */
+			if ((p = cmyth_proginfo_dup(pl->proglist_list[i]))) {
+				p->proginfo_Length = size;
+				ref_release(pl->proglist_list[i]);
+				pl->proglist_list[i] = ref_hold(p);
+			}
+		}
+		pthread_mutex_unlock(&pl->proglist_mutex);
+		if (p == NULL) {
+			return 0;
+		}
+		*change = CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE;
+		*changed = p;
+		return 1;
+	default:
+		return 0;
+	}
+
+	if ((ret = reclist_put(pl, chanid, start, p, change)) < 0) {
+		ref_release(p);
+		return ret;
+	}
+	*changed = p;
+
+	return 1;
+}
+
+/*
+ * Apply the backend event 'event', with the data 'data' and the program
+ * info 'prog', to the recording list 'rl'.  Events which do not concern
+ * recordings are ignored.  If the event connection was lost the list is
+ * marked stale, and the next change fetches the whole list again.
+ *
+ * Returns 1 if the list changed, 0 if not, or a negative error.
+ */
+static int
+reclist_update(cmyth_reclist_t rl, cmyth_event_t event, char *data,
+	       cmyth_proginfo_t prog)
+{
+	cmyth_proginfo_t changed = NULL;
+	cmyth_event_t change = event;
+	unsigned long conn, version;
+	int stale, ret;
+
+	switch (event) {
+	case CMYTH_EVENT_CLOSE:
+	case CMYTH_EVENT_ERROR:
+		pthread_mutex_lock(&rl->rl_mutex);
+		rl->rl_stale = 1;
+		pthread_mutex_unlock(&rl->rl_mutex);
+		return 0;
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE:
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD:
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE:
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE:
+	case CMYTH_EVENT_UPDATE_FILE_SIZE:
+		break;
+	default:
+		return 0;
+	}
+
+	pthread_mutex_lock(&rl->rl_fetch_mutex);
+
+	conn = cmyth_event_sub_connected(rl->rl_event);
+	pthread_mutex_lock(&rl->rl_mutex);
+	stale = rl->rl_stale || (rl->rl_conn != conn);
+	pthread_mutex_unlock(&rl->rl_mutex);
+
+	if (stale || (event == CMYTH_EVENT_RECORDING_LIST_CHANGE) ||
+	    ((ret = reclist_apply(rl, event, data, prog, &change,
+				  &changed)) < 0)) {
+		change = CMYTH_EVENT_RECORDING_LIST_CHANGE;
+		if ((ret = reclist_refresh(rl)) == 0) {
+			ret = 1;
+		}
+	} else if (ret == 1) {
+		pthread_mutex_lock(&rl->rl_mutex);
+		rl->rl_version++;
+		pthread_mutex_unlock(&rl->rl_mutex);
+	}
+	version = rl->rl_version;
+
+	pthread_mutex_unlock(&rl->rl_fetch_mutex);
+
+	if ((ret == 1) && rl->rl_callback) {
+		rl->rl_callback(rl, change, changed, version, rl->rl_data);
+	}
+	ref_release(changed);
+
+	return ret;
+}
+
+/*
+ * Called by the event dispatcher with each event of the backend which
+ * concerns recordings.  As with chains, the subscription does not hold
+ * the list, which is only held here while it is still live.
+ */
+static void
+reclist_event(cmyth_event_sub_t sub, cmyth_eventinfo_t ev, void *data)
+{
+	cmyth_reclist_t rl;
+	cmyth_proginfo_t prog;
+	char *str;
+
+	if ((rl = ref_hold_live(data)) == NULL) {
+		return;
+	}
+
+	str = cmyth_eventinfo_data(ev);
+	prog = cmyth_eventinfo_proginfo(ev);
+
+	reclist_update(rl, cmyth_eventinfo_type(ev), str, prog);
+
+	ref_release(prog);
+	ref_release(str);
+	ref_release(rl);
+}
+
+/*
+ * cmyth_reclist_create(cmyth_conn_t control,
+ *                      cmyth_reclist_callback_t callback, void *data)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Fetch the list of recordings using the control connection 'control',
+ * which is held to fetch recordings as they change, and subscribe to the
+ * events of its backend to keep the list up to date.  'callback' (if not
+ * NULL) is called with 'data' after every change to the list, on the
+ * event dispatcher thread unless the change was asked for with
+ * cmyth_reclist_refresh().
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_reclist_t
+ *
+ * Failure: NULL
+ */
+cmyth_reclist_t
+cmyth_reclist_create(cmyth_conn_t control, cmyth_reclist_callback_t callback,
+		     void *data)
+{
+	cmyth_reclist_t ret;
+	unsigned long mask;
+	int rc;
+
+	if (!control) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+
+	ret = ref_alloc(sizeof(*ret));
+	if (!ret) {
+		return NULL;
+	}
+	memset(ret, 0, sizeof(*ret));
+	ref_set_destroy(ret, (ref_destroy_t)cmyth_reclist_destroy);
+	pthread_mutex_init(&ret->rl_mutex, NULL);
+	pthread_mutex_init(&ret->rl_fetch_mutex, NULL);
+
+	ret->rl_control = ref_hold(control);
+	ret->rl_callback = callback;
+	ret->rl_data = data;
+
+	if ((ret->rl_list = cmyth_proglist_create()) == NULL) {
+		ref_release(ret);
+		return NULL;
+	}
+
+	/*
+	 * Subscribe before the first fetch, so that no change is missed
+	 * between the two.
+	 */
+	mask = CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_UPDATE) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE) |
+		CMYTH_EVENT_MASK(CMYTH_EVENT_UPDATE_FILE_SIZE);
+	ret->rl_event = cmyth_event_subscribe(control->conn_server,
+					      control->conn_port, mask,
+					      reclist_event, (void*)ret);
+	if (ret->rl_event == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_event_subscribe() failed\n",
+			  __FUNCTION__);
+		ref_release(ret);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&ret->rl_fetch_mutex);
+	rc = reclist_refresh(ret);
+	pthread_mutex_unlock(&ret->rl_fetch_mutex);
+
+	if (rc < 0) {
+		ref_release(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+/*
+ * cmyth_reclist_refresh(cmyth_reclist_t rl)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Fetch the whole recording list 'rl' again.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -errno
+ */
+int
+cmyth_reclist_refresh(cmyth_reclist_t rl)
+{
+	unsigned long version;
+	int ret;
+
+	if (!rl) {
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&rl->rl_fetch_mutex);
+	ret = reclist_refresh(rl);
+	version = rl->rl_version;
+	pthread_mutex_unlock(&rl->rl_fetch_mutex);
+
+	if ((ret == 0) && rl->rl_callback) {
+		rl->rl_callback(rl, CMYTH_EVENT_RECORDING_LIST_CHANGE, NULL,
+				version, rl->rl_data);
+	}
+
+	return ret;
+}
+
+/*
+ * cmyth_reclist_get_list(cmyth_reclist_t rl)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the program list of the recording list 'rl'.  This is the
+ * list itself rather than a copy, so it changes as updates are applied.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_proglist_t
+ *
+ * Failure: NULL
+ */
+cmyth_proglist_t
+cmyth_reclist_get_list(cmyth_reclist_t rl)
+{
+	cmyth_proglist_t ret;
+
+	if (!rl) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&rl->rl_mutex);
+	ret = ref_hold(rl->rl_list);
+	pthread_mutex_unlock(&rl->rl_mutex);
+
+	return ret;
+}
+
+/*
+ * cmyth_reclist_get_version(cmyth_reclist_t rl)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the version of the recording list 'rl', which goes up by one
+ * with every change to the list.
+ *
+ * Return Value:
+ *
+ * The version, or 0 if 'rl' is NULL
+ */
+unsigned long
+cmyth_reclist_get_version(cmyth_reclist_t rl)
+{
+	unsigned long ret;
+
+	if (!rl) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&rl->rl_mutex);
+	ret = rl->rl_version;
+	pthread_mutex_unlock(&rl->rl_mutex);
+
+	return ret;
+}
@@ -347,6 +347,169 @@ cmyth_recorder_get_keyframe_pos(cmyth_recorder_t rec, unsigned long keynum)
 	return (long long)-ENOSYS;
 }
 
+/*
+ * cmyth_recorder_fill_posmap(cmyth_recorder_t rec, cmyth_posmap_t pm,
+ *                            int duration, long long start, long long end)
+ * 
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Ask the recorder 'rec' for the key frames from 'start' to 'end' of the
+ * recording it is making, and add them to the position map 'pm'.  If
+ * 'duration' is set the key frame times are fetched, otherwise their
+ * byte offsets.  The whole table comes back in one reply.  The caller
+ * holds the connection mutex.
+ *
+ * Return Value:
+ *
+ * Success: The number of key frames added
+ *
+ * Failure: -(ERRNO)
+ */
+static int
+cmyth_recorder_fill_posmap(cmyth_recorder_t rec, cmyth_posmap_t pm,
+			   int duration, long long start, long long end)
+{
+	cmyth_msg_t msg;
+	char buf[128];
+	int64_t frame, value;
+	int err, count, i, n = 0;
+	char *status;
+
+	snprintf(buf, sizeof(buf),
+		 "QUERY_RECORDER %u[]:[]%s[]:[]%lld[]:[]%lld", rec->rec_id,
+		 duration ? "FILL_DURATION_MAP" : "FILL_POSITION_MAP",
+		 start, end);
+
+	if ((err=cmyth_send_message(rec->rec_conn, buf)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_send_message() failed (%d)\n",
+			  __FUNCTION__, err);
+		return err;
+	}
+
+	if ((count=cmyth_rcv_length(rec->rec_conn)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_length() failed (%d)\n",
+			  __FUNCTION__, count);
+		return count;
+	}
+	if ((msg=cmyth_rcv_msg(rec->rec_conn, &err, count)) == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_rcv_msg() failed (%d)\n",
+			  __FUNCTION__, err);
+		return -err;
+	}
+
+	/*
+	 * An empty map is answered with "OK", a failure with "error".
+	 */
+	if (msg->msg_count % 2) {
+		/*
+		 * The status points into the message buffer.
+		 */
+		status = cmyth_msg_string(msg);
+		if (strcmp(status, "OK") != 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR, "%s: backend said '%s'\n",
+				  __FUNCTION__, status);
+			n = -EIO;
+		}
+		ref_release(msg);
+		return n;
+	}
+
+	for (i = 0; i < msg->msg_count; i += 2) {
+		if ((cmyth_msg_int64(msg, &frame, 1) < 0) ||
+		    (cmyth_msg_int64(msg, &value, 1) < 0)) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: bad key frame entry %d\n",
+				  __FUNCTION__, i / 2);
+			n = -EPROTO;
+			break;
+		}
+		if (cmyth_posmap_add(pm, duration, frame, value) == 0) {
+			n++;
+		}
+	}
+	ref_release(msg);
+
+	return n;
+}
+
+/*
+ * cmyth_recorder_get_posmap(cmyth_recorder_t rec, long long start,
+ *                           long long end)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Fetch the seek table of the recording being made by the recorder
+ * 'rec', for the key frames numbered 'start' to 'end' ('end' < 0 means
+ * up to the latest one).  The byte offsets, and on backends which
+ * support it the key frame times, come back in one reply each instead
+ * of one round trip per key frame.  The protocol only offers this for
+ * recordings in progress; the table of a finished recording can be read
+ * from the database with cmyth_mysql_get_posmap().
+ *
+ * Return Value:
+ *
+ * Success: A held position map
+ *
+ * Failure: NULL
+ */
+cmyth_posmap_t
+cmyth_recorder_get_posmap(cmyth_recorder_t rec, long long start,
+			  long long end)
+{
+	cmyth_posmap_t ret;
+	int n;
+
+	if (!rec || !rec->rec_conn) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no recorder connection\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+	if (rec->rec_conn->conn_version < 66) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: not supported by protocol version %lu\n",
+			  __FUNCTION__, rec->rec_conn->conn_version);
+		return NULL;
+	}
+	if (end < 0) {
+		end = 0x7fffffffffffffffLL;
+	}
+
+	if ((ret=cmyth_posmap_create()) == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&rec->rec_conn->conn_mutex);
+
+	if ((n=cmyth_recorder_fill_posmap(rec, ret, 0, start, end)) < 0) {
+		ref_release(ret);
+		ret = NULL;
+		goto out;
+	}
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: %d key frame offsets\n",
+		  __FUNCTION__, n);
+
+	/*
+	 * Without the times the map is still good for seeking by frame.
+	 */
+	if (rec->rec_conn->conn_version >= 77) {
+		n = cmyth_recorder_fill_posmap(rec, ret, 1, start, end);
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s: %d key frame times\n",
+			  __FUNCTION__, n);
+	}
+
+    out:
+	pthread_mutex_unlock(&rec->rec_conn->conn_mutex);
+
+	return ret;
+}
+
 /*
  * cmyth_recorder_get_recording(cmyth_recorder_t rec)
  * 
@@ -948,7 +1111,7 @@ cmyth_recorder_check_channel_prefix(cmyth_recorder_t rec, char *channame)
 static cmyth_proginfo_t
 cmyth_recorder_get_program_info(cmyth_recorder_t rec)
 {
-	int err, count, ct;
+	int err = 0, count, ct;
 	char msg[256];
 	cmyth_proginfo_t proginfo = NULL;
 
@@ -989,9 +1152,10 @@ cmyth_recorder_get_program_info(cmyth_recorder_t rec)
 	else
 		ct = cmyth_rcv_chaninfo(rec->rec_conn, &err, proginfo, count);
 		
-	if (ct != count) {
+	if ((ct != count) || err) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_proginfo() < count\n", __FUNCTION__);
+			  "%s: cmyth_rcv_proginfo() failed (%d)\n",
+			  __FUNCTION__, err);
 		ref_release(proginfo);
 		proginfo = NULL;
 		goto out;
@@ -1563,33 +1727,25 @@ cmyth_recorder_get_recorder_id(cmyth_recorder_t rec)
 	return rec->rec_id;
 }
 
-int
-cmyth_recorder_add_chanlist(cmyth_recorder_t rec)
+/*
+ * Get a list of channels for the recorder by cycling through the current
+ * program guide, starting after 'first'.  This costs a round trip to
+ * the backend per channel.
+ */
+static cmyth_chanlist_t
+cmyth_recorder_browse_chanlist(cmyth_recorder_t rec, cmyth_proginfo_t first)
 {
-	cmyth_proginfo_t zero, first, prog;
+	cmyth_proginfo_t prog;
 	char *first_name;
 	cmyth_chanlist_t list;
 	cmyth_channel_t channel;
 
-	/*
-	 * Get a list of channels for the recorder by cycling through the
-	 * current program guide.  For some reason, the first proginfo
-	 * structure retrieved seems to be empty, so just ignore it.
-	 */
-
-	zero = cmyth_recorder_get_cur_proginfo(rec);
+	first_name = cmyth_proginfo_channame(first);
 
-	if (zero == NULL) {
-		return -1;
+	if (first_name == NULL) {
+		return NULL;
 	}
 
-	first = cmyth_recorder_get_next_proginfo(rec, zero,
-						 BROWSE_DIRECTION_UP);
-
-	ref_release(zero);
-
-	first_name = cmyth_proginfo_channame(first);
-
 	prog = ref_hold(first);
 
 	list = cmyth_chanlist_create();
@@ -1603,6 +1759,7 @@ cmyth_recorder_add_chanlist(cmyth_recorder_t rec)
 							BROWSE_DIRECTION_UP);
 
 		if (prog == NULL) {
+			ref_release(prev);
 			break;
 		}
 
@@ -1630,12 +1787,85 @@ cmyth_recorder_add_chanlist(cmyth_recorder_t rec)
 		ref_release(name);
 	}
 
-	rec->rec_chanlist = list;
-
 	ref_release(first_name);
-	ref_release(first);
 	ref_release(prog);
 
+	return list;
+}
+
+int
+cmyth_recorder_add_chanlist(cmyth_recorder_t rec)
+{
+	cmyth_proginfo_t zero, first;
+	cmyth_chanlist_t list;
+	long source;
+#if defined(HAS_MYSQL)
+	cmyth_database_t db;
+#endif
+
+	/*
+	 * For some reason, the first proginfo structure retrieved seems to
+	 * be empty, so just ignore it.  It does name the video source when
+	 * the recorder is busy.
+	 */
+
+	zero = cmyth_recorder_get_cur_proginfo(rec);
+
+	if (zero == NULL) {
+		return -1;
+	}
+
+	source = zero->proginfo_source_id;
+
+#if defined(HAS_MYSQL)
+	db = cmyth_chanlist_get_database();
+
+	if (db && (source <= 0)) {
+		source = cmyth_mysql_get_card_source(db, rec->rec_id);
+	}
+#endif
+
+	/*
+	 * Without a source, the list is cached for this recorder alone.
+	 */
+	if (source <= 0) {
+		source = -rec->rec_id;
+	}
+
+	list = cmyth_chanlist_cache_get(rec->rec_server, rec->rec_port,
+					source);
+
+#if defined(HAS_MYSQL)
+	if ((list == NULL) && db && (source > 0)) {
+		list = cmyth_mysql_get_chanlist(db, source);
+	}
+	ref_release(db);
+#endif
+
+	if (list == NULL) {
+		first = cmyth_recorder_get_next_proginfo(rec, zero,
+							 BROWSE_DIRECTION_UP);
+
+		if (first == NULL) {
+			ref_release(zero);
+			return -1;
+		}
+
+		list = cmyth_recorder_browse_chanlist(rec, first);
+
+		ref_release(first);
+	}
+
+	ref_release(zero);
+
+	if (list == NULL) {
+		return -1;
+	}
+
+	cmyth_chanlist_cache_put(rec->rec_server, rec->rec_port, source, list);
+
+	rec->rec_chanlist = list;
+
 	return 0;
 }
 
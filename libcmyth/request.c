@@ -0,0 +1,547 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * request.c - Asynchronous control commands.  A command submitted with
+ *             cmyth_request_submit() is queued on its connection and
+ *             handed back as a cmyth_request_t, which completes later.
+ *             Each connection that has been used this way gets a worker
+ *             thread, which sends the queued commands in order and
+ *             receives their responses.  Up to conn_pipeline commands
+ *             are sent before waiting for the first response.
+ *
+ *             The worker holds conn_mutex while it has commands in
+ *             flight, so the synchronous commands which still talk to the
+ *             socket directly are never interleaved with queued ones.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <cmyth_local.h>
+
+struct cmyth_request_queue {
+	pthread_t q_thread;
+	pthread_mutex_t q_mutex;
+	pthread_cond_t q_cond;		/* a request was queued */
+	pthread_cond_t q_done;		/* a request completed */
+	cmyth_conn_t q_conn;		/* not held */
+	cmyth_request_t q_head;
+	cmyth_request_t q_tail;
+	int q_stop;
+	int q_detached;
+};
+
+static pthread_mutex_t request_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+cmyth_request_destroy(cmyth_request_t req)
+{
+	if (!req) {
+		return;
+	}
+	ref_release(req->req_msg);
+	ref_release(req->req_arg);
+	ref_release(req->req_result);
+	ref_release(req->req_conn);
+}
+
+static void
+cmyth_request_queue_free(struct cmyth_request_queue *q)
+{
+	pthread_cond_destroy(&q->q_done);
+	pthread_cond_destroy(&q->q_cond);
+	pthread_mutex_destroy(&q->q_mutex);
+	free(q);
+}
+
+/*
+ * Take the next request off the queue, or return NULL if it is empty.
+ */
+static cmyth_request_t
+cmyth_request_pop(struct cmyth_request_queue *q)
+{
+	cmyth_request_t req;
+
+	pthread_mutex_lock(&q->q_mutex);
+	if ((req = q->q_head) != NULL) {
+		q->q_head = req->req_next;
+		if (q->q_head == NULL) {
+			q->q_tail = NULL;
+		}
+		req->req_next = NULL;
+	}
+	pthread_mutex_unlock(&q->q_mutex);
+
+	return req;
+}
+
+static void
+cmyth_request_complete(struct cmyth_request_queue *q, cmyth_request_t req)
+{
+	pthread_mutex_lock(&q->q_mutex);
+	req->req_done = 1;
+	pthread_cond_broadcast(&q->q_done);
+	pthread_mutex_unlock(&q->q_mutex);
+
+	if (req->req_callback) {
+		req->req_callback(req, req->req_data);
+	}
+
+	/*
+	 * Drop the reference the queue was holding.
+	 */
+	ref_release(req);
+}
+
+/*
+ * Consume whatever part of a response the receive function left behind,
+ * so the next response in the pipeline starts at the right place.
+ */
+static void
+cmyth_request_toss(cmyth_conn_t conn, int count)
+{
+	char buf[256];
+	int err = 0;
+
+	cmyth_dbg(CMYTH_DBG_ERROR, "%s: tossing %d bytes\n",
+		  __FUNCTION__, count);
+	while ((count > 0) && !err) {
+		count -= cmyth_rcv_string(conn, &err, buf, sizeof(buf) - 1,
+					  count);
+	}
+}
+
+/*
+ * Send and receive queued requests until the queue runs dry.  Called
+ * with conn_mutex held.
+ */
+static void
+cmyth_request_run(struct cmyth_request_queue *q, cmyth_conn_t conn)
+{
+	cmyth_request_t sent = NULL, *tail = &sent, req;
+	int n = 0, depth, count, err;
+
+	depth = (conn->conn_pipeline > 0) ? conn->conn_pipeline : 1;
+
+	while (1) {
+		while ((n < depth) &&
+		       ((req = cmyth_request_pop(q)) != NULL)) {
+			if ((err = cmyth_send_message(conn, req->req_msg)) < 0) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: cmyth_send_message() failed "
+					  "(%d)\n", __FUNCTION__, err);
+				req->req_status = err;
+				cmyth_request_complete(q, req);
+				continue;
+			}
+			*tail = req;
+			tail = &req->req_next;
+			n++;
+		}
+		if ((req = sent) == NULL) {
+			break;
+		}
+		if ((sent = req->req_next) == NULL) {
+			tail = &sent;
+		}
+		req->req_next = NULL;
+		n--;
+
+		if ((count = cmyth_rcv_length(conn)) < 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: cmyth_rcv_length() failed (%d)\n",
+				  __FUNCTION__, count);
+			req->req_status = count;
+		} else {
+			req->req_status = 0;
+			count = req->req_rcv(conn, req, count);
+			if (count > 0) {
+				cmyth_request_toss(conn, count);
+			} else if ((count < 0) && (req->req_status >= 0)) {
+				req->req_status = count;
+			}
+		}
+		cmyth_request_complete(q, req);
+	}
+}
+
+static void *
+cmyth_request_thread(void *arg)
+{
+	struct cmyth_request_queue *q = arg;
+	cmyth_conn_t conn;
+	int detached;
+
+	pthread_mutex_lock(&q->q_mutex);
+	while (1) {
+		while (!q->q_head && !q->q_stop) {
+			pthread_cond_wait(&q->q_cond, &q->q_mutex);
+		}
+		if (q->q_stop) {
+			break;
+		}
+
+		/*
+		 * The queued requests hold the connection, but the last of
+		 * them may be released before we are done with it.
+		 */
+		conn = ref_hold(q->q_conn);
+		pthread_mutex_unlock(&q->q_mutex);
+
+		pthread_mutex_lock(&conn->conn_mutex);
+		cmyth_request_run(q, conn);
+		pthread_mutex_unlock(&conn->conn_mutex);
+
+		/*
+		 * If this is the last reference, the connection is destroyed
+		 * right here and the queue is marked as stopped.
+		 */
+		ref_release(conn);
+
+		pthread_mutex_lock(&q->q_mutex);
+	}
+	detached = q->q_detached;
+	pthread_mutex_unlock(&q->q_mutex);
+
+	if (detached) {
+		cmyth_request_queue_free(q);
+	}
+
+	return NULL;
+}
+
+/*
+ * Return the request queue of 'conn', starting it if need be.
+ */
+static struct cmyth_request_queue *
+cmyth_request_queue(cmyth_conn_t conn)
+{
+	struct cmyth_request_queue *q;
+
+	pthread_mutex_lock(&request_mutex);
+
+	if ((q = conn->conn_requests) != NULL) {
+		goto out;
+	}
+	if ((q = calloc(1, sizeof(*q))) == NULL) {
+		goto out;
+	}
+	pthread_mutex_init(&q->q_mutex, NULL);
+	pthread_cond_init(&q->q_cond, NULL);
+	pthread_cond_init(&q->q_done, NULL);
+	q->q_conn = conn;
+	if (pthread_create(&q->q_thread, NULL,
+			   cmyth_request_thread, q) != 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: pthread_create() failed\n",
+			  __FUNCTION__);
+		cmyth_request_queue_free(q);
+		q = NULL;
+		goto out;
+	}
+	conn->conn_requests = q;
+
+    out:
+	pthread_mutex_unlock(&request_mutex);
+
+	return q;
+}
+
+/*
+ * cmyth_request_queue_stop(cmyth_conn_t conn)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_request_queue_stop)
+ *
+ * Description
+ *
+ * Stop the worker thread of 'conn', if it has one.  This is called when
+ * the connection is destroyed, at which point no requests can be queued
+ * on it.  The connection may be destroyed by the worker itself, when it
+ * drops its reference, in which case the worker cleans up after itself
+ * once it gets back to its loop.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_request_queue_stop(cmyth_conn_t conn)
+{
+	struct cmyth_request_queue *q = conn->conn_requests;
+	int self;
+
+	if (!q) {
+		return;
+	}
+	conn->conn_requests = NULL;
+
+	self = pthread_equal(pthread_self(), q->q_thread);
+
+	pthread_mutex_lock(&q->q_mutex);
+	q->q_stop = 1;
+	q->q_detached = self;
+	pthread_cond_broadcast(&q->q_cond);
+	pthread_mutex_unlock(&q->q_mutex);
+
+	if (self) {
+		pthread_detach(q->q_thread);
+	} else {
+		pthread_join(q->q_thread, NULL);
+		cmyth_request_queue_free(q);
+	}
+}
+
+/*
+ * cmyth_request_submit(cmyth_conn_t conn, char *msg,
+ *                      cmyth_request_rcv_t rcv, void *arg,
+ *                      cmyth_request_callback_t callback, void *data)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_request_submit)
+ *
+ * Description
+ *
+ * Queue the command 'msg' on the control connection 'conn'.  When the
+ * response arrives, the worker thread calls 'rcv' to read its 'count'
+ * bytes, and then 'callback' (if not NULL) with 'data'.  The receive
+ * function sets req_status and req_result, and returns the number of
+ * bytes of the response it did not consume, or -errno if the connection
+ * failed.  'arg' is a reference which is handed over to the request for
+ * the use of 'rcv' (it may be NULL), and is released along with it.
+ *
+ * Return Value:
+ *
+ * Success: A held, non-NULL cmyth_request_t
+ *
+ * Failure: NULL ('arg' is released)
+ */
+cmyth_request_t
+cmyth_request_submit(cmyth_conn_t conn, char *msg, cmyth_request_rcv_t rcv,
+		     void *arg, cmyth_request_callback_t callback, void *data)
+{
+	struct cmyth_request_queue *q;
+	cmyth_request_t req;
+
+	if (!conn || !msg || !rcv) {
+		ref_release(arg);
+		return NULL;
+	}
+	if ((q = cmyth_request_queue(conn)) == NULL) {
+		ref_release(arg);
+		return NULL;
+	}
+	if ((req = ref_alloc(sizeof(*req))) == NULL) {
+		ref_release(arg);
+		return NULL;
+	}
+	ref_set_destroy(req, (ref_destroy_t)cmyth_request_destroy);
+
+	req->req_next = NULL;
+	req->req_queue = q;
+	req->req_conn = ref_hold(conn);
+	req->req_rcv = rcv;
+	req->req_arg = arg;
+	req->req_result = NULL;
+	req->req_status = 0;
+	req->req_done = 0;
+	req->req_callback = callback;
+	req->req_data = data;
+	if ((req->req_msg = ref_strdup(msg)) == NULL) {
+		ref_release(req);
+		return NULL;
+	}
+
+	/*
+	 * The queue holds its own reference until the request completes.
+	 */
+	ref_hold(req);
+
+	pthread_mutex_lock(&q->q_mutex);
+	if (q->q_tail) {
+		q->q_tail->req_next = req;
+	} else {
+		q->q_head = req;
+	}
+	q->q_tail = req;
+	pthread_cond_signal(&q->q_cond);
+	pthread_mutex_unlock(&q->q_mutex);
+
+	return req;
+}
+
+/*
+ * cmyth_request_wait(cmyth_request_t req)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Wait for the request 'req' to complete.  This must not be called from
+ * a completion callback on the same connection, since the callback runs
+ * on the thread that would complete the request.
+ *
+ * Return Value:
+ *
+ * Success: The status of the request (>= 0)
+ *
+ * Failure: -(ERRNO)
+ */
+int
+cmyth_request_wait(cmyth_request_t req)
+{
+	struct cmyth_request_queue *q;
+	int ret;
+
+	if (!req) {
+		return -EINVAL;
+	}
+	q = req->req_queue;
+
+	pthread_mutex_lock(&q->q_mutex);
+	if (!req->req_done && pthread_equal(pthread_self(), q->q_thread)) {
+		pthread_mutex_unlock(&q->q_mutex);
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: waiting from a completion callback\n",
+			  __FUNCTION__);
+		return -EDEADLK;
+	}
+	while (!req->req_done) {
+		pthread_cond_wait(&q->q_done, &q->q_mutex);
+	}
+	ret = req->req_status;
+	pthread_mutex_unlock(&q->q_mutex);
+
+	return ret;
+}
+
+/*
+ * cmyth_request_done(cmyth_request_t req)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Check whether the request 'req' has completed, without waiting.
+ *
+ * Return Value:
+ *
+ * Success: 1 if the request has completed, 0 if it has not
+ *
+ * Failure: -(ERRNO)
+ */
+int
+cmyth_request_done(cmyth_request_t req)
+{
+	struct cmyth_request_queue *q;
+	int ret;
+
+	if (!req) {
+		return -EINVAL;
+	}
+	q = req->req_queue;
+
+	pthread_mutex_lock(&q->q_mutex);
+	ret = req->req_done;
+	pthread_mutex_unlock(&q->q_mutex);
+
+	return ret;
+}
+
+/*
+ * cmyth_request_get_status(cmyth_request_t req)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Obtain the status of the completed request 'req'.
+ *
+ * Return Value:
+ *
+ * Success: The status of the request (>= 0)
+ *
+ * Failure: -EINPROGRESS if the request has not completed, or the error
+ *          the request failed with
+ */
+int
+cmyth_request_get_status(cmyth_request_t req)
+{
+	int ret;
+
+	if ((ret = cmyth_request_done(req)) <= 0) {
+		return (ret == 0) ? -EINPROGRESS : ret;
+	}
+	return req->req_status;
+}
+
+/*
+ * cmyth_request_get_result(cmyth_request_t req)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Obtain the result of the completed request 'req', such as the program
+ * list of cmyth_proglist_get_all_recorded_async().
+ *
+ * Return Value:
+ *
+ * Success: A held reference to the result, to be released with
+ *          ref_release()
+ *
+ * Failure: NULL if the request has not completed, has failed, or does
+ *          not produce a result
+ */
+void *
+cmyth_request_get_result(cmyth_request_t req)
+{
+	if (cmyth_request_get_status(req) < 0) {
+		return NULL;
+	}
+	return ref_hold(req->req_result);
+}
+
+/*
+ * cmyth_conn_set_pipeline(cmyth_conn_t conn, int depth)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Allow up to 'depth' requests queued on 'conn' to be sent before the
+ * response to the first of them has arrived.  The default of 1 waits for
+ * each response before sending the next request, which is what every
+ * backend is known to handle.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -EINVAL
+ */
+int
+cmyth_conn_set_pipeline(cmyth_conn_t conn, int depth)
+{
+	if (!conn || (depth <= 0)) {
+		return -EINVAL;
+	}
+	conn->conn_pipeline = depth;
+
+	return 0;
+}
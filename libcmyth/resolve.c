@@ -0,0 +1,217 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * resolve.c - Host name resolution.  Every file, ring buffer and recorder
+ *             connection resolves the backend name again, so the
+ *             addresses are cached for a short time.  getaddrinfo() does
+ *             not say how long a result is good for, so a fixed lifetime
+ *             is used.  Failed lookups are not cached.
+ *
+ *             Addresses are kept in the resolver's order of preference,
+ *             but with the address families interleaved, so that a
+ *             connection attempt to one family which stalls is quickly
+ *             followed by one to the other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <cmyth_local.h>
+
+#define RESOLVE_CACHE_SIZE	16
+#define RESOLVE_CACHE_TTL	60000	/* milliseconds */
+
+struct resolve_entry {
+	char *re_host;
+	long long re_expires;
+	unsigned long re_used;
+	int re_naddrs;
+	struct cmyth_addr re_addrs[CMYTH_IO_POLL_MAX];
+};
+
+static pthread_mutex_t resolve_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct resolve_entry resolve_cache[RESOLVE_CACHE_SIZE];
+static unsigned long resolve_clock;
+
+static int
+resolve_lookup(const char *host, struct cmyth_addr *addrs, int max)
+{
+	struct addrinfo hints;
+	struct addrinfo *res, *cur;
+	struct addrinfo *family[2][CMYTH_IO_POLL_MAX];
+	int count[2] = { 0, 0 };
+	int first = -1;
+	int i, f, n = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, NULL, &hints, &res)) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cannot resolve hostname '%s'\n",
+			  __FUNCTION__, host);
+		return -ENOENT;
+	}
+
+	for (cur = res; cur; cur = cur->ai_next) {
+		if (cur->ai_family == AF_INET) {
+			f = 0;
+		} else if (cur->ai_family == AF_INET6) {
+			f = 1;
+		} else {
+			continue;
+		}
+		if (first < 0) {
+			first = f;
+		}
+		if ((count[f] < max) &&
+		    (cur->ai_addrlen <= sizeof(addrs->addr))) {
+			family[f][count[f]++] = cur;
+		}
+	}
+
+	/*
+	 * Alternate between the families, starting with the one the
+	 * resolver prefers.
+	 */
+	for (i = 0; (n < max) && ((i < count[0]) || (i < count[1])); i++) {
+		for (f = 0; f < 2; f++) {
+			int which = (f == 0) ? first : !first;
+
+			if ((i < count[which]) && (n < max)) {
+				cur = family[which][i];
+				memset(&addrs[n], 0, sizeof(addrs[n]));
+				memcpy(&addrs[n].addr, cur->ai_addr,
+				       cur->ai_addrlen);
+				addrs[n].len = cur->ai_addrlen;
+				n++;
+			}
+		}
+	}
+	freeaddrinfo(res);
+
+	if (n == 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no address for '%s'\n",
+			  __FUNCTION__, host);
+		return -ENOENT;
+	}
+
+	return n;
+}
+
+/*
+ * cmyth_resolve(const char *host, unsigned short port,
+ *               struct cmyth_addr *addrs, int max)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_resolve)
+ *
+ * Description
+ *
+ * Resolve 'host' into up to 'max' IPv4 and IPv6 addresses with the port
+ * set to 'port', stored in 'addrs' in the order they should be tried.
+ * Results are cached for RESOLVE_CACHE_TTL milliseconds.
+ *
+ * Return Value:
+ *
+ * Success: The number of addresses
+ *
+ * Failure: -errno
+ */
+int
+cmyth_resolve(const char *host, unsigned short port,
+	      struct cmyth_addr *addrs, int max)
+{
+	struct resolve_entry *re = NULL;
+	long long now;
+	int i, n;
+
+	if (!host || !addrs || (max <= 0)) {
+		return -EINVAL;
+	}
+	if (max > CMYTH_IO_POLL_MAX) {
+		max = CMYTH_IO_POLL_MAX;
+	}
+
+	now = cmyth_io_now();
+
+	pthread_mutex_lock(&resolve_mutex);
+	for (i = 0; i < RESOLVE_CACHE_SIZE; i++) {
+		if (resolve_cache[i].re_host &&
+		    (strcmp(resolve_cache[i].re_host, host) == 0)) {
+			re = &resolve_cache[i];
+			break;
+		}
+	}
+	if (re && (re->re_expires > now)) {
+		re->re_used = ++resolve_clock;
+		n = (re->re_naddrs < max) ? re->re_naddrs : max;
+		memcpy(addrs, re->re_addrs, n * sizeof(*addrs));
+		pthread_mutex_unlock(&resolve_mutex);
+		goto out;
+	}
+	pthread_mutex_unlock(&resolve_mutex);
+
+	/*
+	 * Do not hold the lock over the lookup, it may take a while.
+	 */
+	if ((n = resolve_lookup(host, addrs, max)) < 0) {
+		return n;
+	}
+
+	pthread_mutex_lock(&resolve_mutex);
+	re = NULL;
+	for (i = 0; i < RESOLVE_CACHE_SIZE; i++) {
+		struct resolve_entry *e = &resolve_cache[i];
+
+		if (e->re_host && (strcmp(e->re_host, host) == 0)) {
+			re = e;
+			break;
+		}
+		if (!re || (e->re_used < re->re_used)) {
+			re = e;
+		}
+	}
+	if (!re->re_host || (strcmp(re->re_host, host) != 0)) {
+		free(re->re_host);
+		re->re_host = strdup(host);
+	}
+	if (re->re_host) {
+		memcpy(re->re_addrs, addrs, n * sizeof(*addrs));
+		re->re_naddrs = n;
+		re->re_expires = now + RESOLVE_CACHE_TTL;
+		re->re_used = ++resolve_clock;
+	}
+	pthread_mutex_unlock(&resolve_mutex);
+
+    out:
+	for (i = 0; i < n; i++) {
+		if (addrs[i].addr.ss_family == AF_INET6) {
+			((struct sockaddr_in6 *)&addrs[i].addr)->sin6_port =
+				htons(port);
+		} else {
+			((struct sockaddr_in *)&addrs[i].addr)->sin_port =
+				htons(port);
+		}
+	}
+
+	return n;
+}
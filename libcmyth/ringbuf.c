@@ -258,22 +258,21 @@ cmyth_ringbuf_setup(cmyth_recorder_t rec)
 int
 cmyth_ringbuf_get_block(cmyth_recorder_t rec, char *buf, unsigned long len)
 {
-	struct timeval tv;
-	fd_set fds;
+	cmyth_conn_t conn;
+	int r;
 
 	if (rec == NULL)
 		return -EINVAL;
 
-	tv.tv_sec = 10;
-	tv.tv_usec = 0;
-	FD_ZERO(&fds);
-	FD_SET(rec->rec_ring->conn_data->conn_fd, &fds);
-	if (select((int)rec->rec_ring->conn_data->conn_fd+1,
-		   NULL, &fds, NULL, &tv) == 0) {
-		rec->rec_ring->conn_data->conn_hang = 1;
+	conn = rec->rec_ring->conn_data;
+	r = cmyth_io_wait(conn->conn_fd, CMYTH_IO_READ, conn->conn_timeout);
+	if (r == 0) {
+		conn->conn_hang = 1;
 		return 0;
+	} else if (r < 0) {
+		return r;
 	} else {
-		rec->rec_ring->conn_data->conn_hang = 0;
+		conn->conn_hang = 0;
 	}
 	return recv(rec->rec_ring->conn_data->conn_fd, buf, len, 0);
 }
@@ -281,7 +280,6 @@ cmyth_ringbuf_get_block(cmyth_recorder_t rec, char *buf, unsigned long len)
 int
 cmyth_ringbuf_select(cmyth_recorder_t rec, struct timeval *timeout)
 {
-	fd_set fds;
 	int ret;
 	cmyth_socket_t fd;
 	if (rec == NULL)
@@ -289,10 +287,7 @@ cmyth_ringbuf_select(cmyth_recorder_t rec, struct timeval *timeout)
 
 	fd = rec->rec_ring->conn_data->conn_fd;
 
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
-
-	ret = select((int)fd+1, &fds, NULL, NULL, timeout);
+	ret = cmyth_io_wait(fd, CMYTH_IO_READ, cmyth_io_timeval(timeout));
 
 	if (ret == 0)
 		rec->rec_ring->conn_data->conn_hang = 1;
@@ -324,6 +319,7 @@ cmyth_ringbuf_request_block(cmyth_recorder_t rec, unsigned long len)
 	int err, count;
 	int r;
 	long c, ret;
+	long long sent;
 	char msg[256];
 
 	if (!rec) {
@@ -338,11 +334,13 @@ cmyth_ringbuf_request_block(cmyth_recorder_t rec, unsigned long len)
 	if(len > (unsigned int)rec->rec_conn->conn_tcp_rcvbuf)
 		len = (unsigned int)rec->rec_conn->conn_tcp_rcvbuf;
 #endif
+	len = cmyth_tune_block(rec->rec_ring->conn_data, len, 0);
 
 	snprintf(msg, sizeof(msg),
 		 "QUERY_RECORDER %u[]:[]REQUEST_BLOCK_RINGBUF[]:[]%ld",
 		 rec->rec_id, len);
 
+	sent = cmyth_io_now();
 	if ((err = cmyth_send_message(rec->rec_conn, msg)) < 0) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: cmyth_send_message() failed (%d)\n",
@@ -359,6 +357,7 @@ cmyth_ringbuf_request_block(cmyth_recorder_t rec, unsigned long len)
 		ret = err;
 		goto out;
 	}
+	cmyth_tune_sample(rec->rec_ring->conn_data, len, c, sent);
 
 	rec->rec_ring->file_pos += c;
 	ret = c;
@@ -390,8 +389,9 @@ int cmyth_ringbuf_read(cmyth_recorder_t rec, char *buf, unsigned long len)
 	int ret, req, nfds;
 	char *end, *cur;
 	char msg[256];
-	struct timeval tv;
-	fd_set fds;
+	struct cmyth_io_fd fds[2];
+	unsigned long asked;
+	long long sent;
 
 	if (!rec)
 	{
@@ -402,10 +402,15 @@ int cmyth_ringbuf_read(cmyth_recorder_t rec, char *buf, unsigned long len)
 
 	pthread_mutex_lock (&rec->rec_conn->conn_mutex);
 
+	/* data is read as it arrives, so it need not fit the socket */
+	len = cmyth_tune_block(rec->rec_ring->conn_data, len, 1);
+	asked = len;
+
 	snprintf(msg, sizeof(msg),
 		 "QUERY_RECORDER %u[]:[]REQUEST_BLOCK_RINGBUF[]:[]%ld",
 		 rec->rec_id, len);
 
+	sent = cmyth_io_now();
 	if ( (err = cmyth_send_message (rec->rec_conn, msg) ) < 0)
 	{
 		cmyth_dbg (CMYTH_DBG_ERROR,
@@ -415,29 +420,23 @@ int cmyth_ringbuf_read(cmyth_recorder_t rec, char *buf, unsigned long len)
 		goto out;
 	}
 
-	nfds = 0;
 	req = 1;
 	cur = buf;
 	end = buf+len;
 
+	fds[0].fd = rec->rec_ring->conn_data->conn_fd;
+	fds[0].events = CMYTH_IO_READ;
+	fds[1].fd = rec->rec_conn->conn_fd;
+	fds[1].events = CMYTH_IO_READ;
+
 	while (cur < end || req)
 	{
-		tv.tv_sec = 20;
-		tv.tv_usec = 0;
-		FD_ZERO (&fds);
-		if(req) {
-			if((int)rec->rec_conn->conn_fd > nfds)
-				nfds = (int)rec->rec_conn->conn_fd;
-			FD_SET (rec->rec_conn->conn_fd, &fds);
-		}
-		if((int)rec->rec_ring->conn_data->conn_fd > nfds)
-			nfds = (int)rec->rec_ring->conn_data->conn_fd;
-		FD_SET (rec->rec_ring->conn_data->conn_fd, &fds);
-
-		if ((ret = select (nfds+1, &fds, NULL, NULL,&tv)) < 0)
+		nfds = req ? 2 : 1;
+		if ((ret = cmyth_io_poll (fds, nfds,
+					  2 * rec->rec_conn->conn_timeout)) < 0)
 		{
 			cmyth_dbg (CMYTH_DBG_ERROR,
-			           "%s: select(() failed (%d)\n",
+			           "%s: cmyth_io_poll() failed (%d)\n",
 			           __FUNCTION__, ret);
 			goto out;
 		}
@@ -451,7 +450,7 @@ int cmyth_ringbuf_read(cmyth_recorder_t rec, char *buf, unsigned long len)
 		}
 
 		/* check control connection */
-		if (FD_ISSET(rec->rec_conn->conn_fd, &fds) )
+		if ((nfds > 1) && fds[1].ready)
 		{
 
 			if ((count = cmyth_rcv_length (rec->rec_conn)) < 0)
@@ -472,13 +471,15 @@ int cmyth_ringbuf_read(cmyth_recorder_t rec, char *buf, unsigned long len)
 				goto out;
 			}
 
+			cmyth_tune_sample(rec->rec_ring->conn_data, asked,
+					  len, sent);
 			rec->rec_ring->file_pos += len;
 			req = 0;
 			end = buf+len;
 		}
 
 		/* check data connection */
-		if (FD_ISSET(rec->rec_ring->conn_data->conn_fd, &fds))
+		if (fds[0].ready)
 		{
 
 			if ((ret = recv (rec->rec_ring->conn_data->conn_fd, cur, end-cur, 0)) < 0)
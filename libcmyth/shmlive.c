@@ -0,0 +1,901 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * shmlive.c - Sharing one live TV stream between the processes of a host.
+ *             One process pulls the stream through the live TV chain and
+ *             writes it into a POSIX shared memory ring.  Other processes
+ *             map the ring read-only and read it in place, so a channel
+ *             costs one tuner and one backend stream however many local
+ *             clients watch it.
+ *
+ *             The publisher never waits for readers.  A reader which
+ *             falls a whole ring behind notices it, and is moved forward
+ *             to the live edge.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#include <cmyth_local.h>
+
+/*
+ * The largest block requested from the backend, and so the largest amount
+ * of data which can be in flight in the ring while readers look at it.
+ */
+#define SHMLIVE_CHUNK (128 * 1024)
+
+/*
+ * How long a reader sleeps at most before it checks that the publisher
+ * is still alive, and how long the publisher waits when the backend has
+ * no new data yet.
+ */
+#define SHMLIVE_POLL_MS 1000
+#define SHMLIVE_IDLE_US 50000
+
+/*
+ * cmyth_shmlive_wake(struct cmyth_shmlive_hdr *hdr)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Wake up every reader sleeping on the sequence number of a ring.  The
+ * futex is not process private, since the readers live in other
+ * processes.  Without futexes readers poll, and nothing needs to be done.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+cmyth_shmlive_wake(struct cmyth_shmlive_hdr *hdr)
+{
+#if defined(__linux__)
+	syscall(SYS_futex, &hdr->sh_seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+	(void)hdr;
+#endif
+}
+
+/*
+ * cmyth_shmlive_sleep(struct cmyth_shmlive_hdr *hdr, uint32_t seq, int ms)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Sleep for at most 'ms' milliseconds, or until the sequence number of the
+ * ring moves on from 'seq'.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+cmyth_shmlive_sleep(struct cmyth_shmlive_hdr *hdr, uint32_t seq, int ms)
+{
+#if defined(__linux__)
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	syscall(SYS_futex, &hdr->sh_seq, FUTEX_WAIT, seq, &ts, NULL, 0);
+#else
+	if (hdr->sh_seq == seq) {
+		usleep((ms < 10 ? ms : 10) * 1000);
+	}
+#endif
+}
+
+/*
+ * cmyth_shmlive_alive(struct cmyth_shmlive_hdr *hdr)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Tell whether the publisher of a ring is still writing to it.  A
+ * publisher which died without ending the ring is noticed through its
+ * process id.
+ *
+ * Return Value:
+ *
+ * 1 if the publisher is alive, 0 if not.
+ */
+static int
+cmyth_shmlive_alive(struct cmyth_shmlive_hdr *hdr)
+{
+	if (hdr->sh_state) {
+		return 0;
+	}
+	if ((kill((pid_t)hdr->sh_pid, 0) < 0) && (errno == ESRCH)) {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * cmyth_shmlive_head(struct cmyth_shmlive_hdr *hdr, uint32_t *seqp)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Read the number of bytes written to a ring.  The sequence number is
+ * odd while the publisher changes the count, so the count is read again
+ * until the sequence number is even and the same on both sides of the
+ * read.  The sequence number is returned in 'seqp', if it is not NULL,
+ * for a later cmyth_shmlive_sleep().
+ *
+ * Return Value:
+ *
+ * The number of bytes written to the ring.
+ */
+static uint64_t
+cmyth_shmlive_head(struct cmyth_shmlive_hdr *hdr, uint32_t *seqp)
+{
+	uint32_t seq;
+	uint64_t head;
+	int spins = 0;
+
+	for (;;) {
+		seq = hdr->sh_seq;
+		__sync_synchronize();
+		head = hdr->sh_head;
+		__sync_synchronize();
+		if (((seq & 1) == 0) && (hdr->sh_seq == seq)) {
+			break;
+		}
+		/*
+		 * A publisher which died half way through an update never
+		 * makes the sequence number even again.
+		 */
+		if ((++spins % 1000) == 0 && !cmyth_shmlive_alive(hdr)) {
+			break;
+		}
+	}
+	if (seqp) {
+		*seqp = seq;
+	}
+	return head;
+}
+
+/*
+ * cmyth_shmlive_overrun(cmyth_shmlive_t sl, uint64_t head)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Check whether the unread data of a reader may have been overwritten.
+ * The publisher can be writing anywhere in the 'sl_chunk' bytes after
+ * 'head', so only the data within 'sl_size - sl_chunk' bytes of 'head'
+ * is safe.  A reader which fell further behind is moved to 'head'.
+ *
+ * Return Value:
+ *
+ * 1 if the reader was moved, 0 if its data is intact.
+ */
+static int
+cmyth_shmlive_overrun(cmyth_shmlive_t sl, uint64_t head)
+{
+	if (sl->sl_pos + sl->sl_size >= head + sl->sl_chunk) {
+		return 0;
+	}
+	cmyth_dbg(CMYTH_DBG_WARN, "%s: reader of %s skipped %llu bytes\n",
+		  __FUNCTION__, sl->sl_name,
+		  (unsigned long long)(head - sl->sl_pos));
+	sl->sl_pos = head;
+	return 1;
+}
+
+/*
+ * cmyth_shmlive_destroy(cmyth_shmlive_t sl)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Clean up and free a shared live TV handle.  This should only be called
+ * by ref_release().  A publisher is stopped, its ring is ended so that
+ * readers see the end of the stream, and the shared memory name is
+ * removed.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+static void
+cmyth_shmlive_destroy(cmyth_shmlive_t sl)
+{
+	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
+	if (!sl) {
+		return;
+	}
+	if (sl->sl_running) {
+		sl->sl_stop = 1;
+		pthread_join(sl->sl_thread, NULL);
+	}
+	if (sl->sl_hdr) {
+		if (sl->sl_writer) {
+			cmyth_shmlive_end(sl);
+			shm_unlink(sl->sl_name);
+		}
+		munmap(sl->sl_hdr, sl->sl_maplen);
+	}
+	ref_release(sl->sl_rec);
+	ref_release(sl->sl_name);
+}
+
+/*
+ * cmyth_shmlive_alloc(const char *name)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Allocate an empty shared live TV handle for the shared memory object
+ * 'name'.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL cmyth_shmlive_t (this type is a pointer)
+ *
+ * Failure: A NULL cmyth_shmlive_t
+ */
+static cmyth_shmlive_t
+cmyth_shmlive_alloc(const char *name)
+{
+	cmyth_shmlive_t sl;
+
+	sl = ref_alloc(sizeof(*sl));
+	if (!sl) {
+		return NULL;
+	}
+	ref_set_destroy(sl, (ref_destroy_t)cmyth_shmlive_destroy);
+	if ((sl->sl_name = ref_strdup((char *)name)) == NULL) {
+		ref_release(sl);
+		return NULL;
+	}
+	return sl;
+}
+
+/*
+ * cmyth_shmlive_busy(const char *name)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * Tell whether the shared memory object 'name' is a ring which a live
+ * process still publishes.  Anything else found under the name is left
+ * over from a publisher which went away, and may be replaced.
+ *
+ * Return Value:
+ *
+ * 1 if the ring is in use, 0 if not.
+ */
+static int
+cmyth_shmlive_busy(const char *name)
+{
+	struct cmyth_shmlive_hdr *hdr;
+	struct stat st;
+	int fd, busy = 0;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+		return 0;
+	}
+	if ((fstat(fd, &st) == 0) && (st.st_size >= CMYTH_SHMLIVE_HDR)) {
+		hdr = mmap(NULL, CMYTH_SHMLIVE_HDR, PROT_READ, MAP_SHARED,
+			   fd, 0);
+		if (hdr != MAP_FAILED) {
+			busy = ((hdr->sh_magic == CMYTH_SHMLIVE_MAGIC) &&
+				cmyth_shmlive_alive(hdr));
+			munmap(hdr, CMYTH_SHMLIVE_HDR);
+		}
+	}
+	close(fd);
+	return busy;
+}
+
+/*
+ * cmyth_shmlive_create(const char *name, unsigned long size)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_shmlive_create)
+ *
+ * Description
+ *
+ * Create the shared memory ring 'name' with room for 'size' bytes of
+ * stream data, rounded up to a whole page, and return a publisher handle
+ * for it which does not pull any stream yet.  A ring left behind under
+ * the same name by a dead publisher is replaced, one still in use is not.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL cmyth_shmlive_t (this type is a pointer)
+ *
+ * Failure: A NULL cmyth_shmlive_t
+ */
+cmyth_shmlive_t
+cmyth_shmlive_create(const char *name, unsigned long size)
+{
+	cmyth_shmlive_t sl;
+	struct cmyth_shmlive_hdr *hdr;
+	uint64_t len;
+	int fd, tries;
+
+	if (!name) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no name specified\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+	len = ((uint64_t)size + CMYTH_SHMLIVE_HDR - 1) &
+		~((uint64_t)CMYTH_SHMLIVE_HDR - 1);
+	if (len < 4 * CMYTH_SHMLIVE_HDR) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: ring size %lu too small\n",
+			  __FUNCTION__, size);
+		return NULL;
+	}
+
+	for (tries = 0; ; ++tries) {
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if ((fd >= 0) || (errno != EEXIST) || (tries > 0)) {
+			break;
+		}
+		if (cmyth_shmlive_busy(name)) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: %s is already published\n",
+				  __FUNCTION__, name);
+			return NULL;
+		}
+		shm_unlink(name);
+	}
+	if (fd < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: shm_open(%s) failed (%d)\n",
+			  __FUNCTION__, name, errno);
+		return NULL;
+	}
+
+	if ((sl = cmyth_shmlive_alloc(name)) == NULL) {
+		goto fail;
+	}
+	sl->sl_writer = 1;
+	sl->sl_size = len;
+	sl->sl_chunk = (len / 4 < SHMLIVE_CHUNK) ? len / 4 : SHMLIVE_CHUNK;
+	sl->sl_maplen = CMYTH_SHMLIVE_HDR + len;
+	if (ftruncate(fd, sl->sl_maplen) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: ftruncate() failed (%d)\n",
+			  __FUNCTION__, errno);
+		goto fail;
+	}
+	hdr = mmap(NULL, sl->sl_maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fd, 0);
+	if (hdr == MAP_FAILED) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: mmap() failed (%d)\n",
+			  __FUNCTION__, errno);
+		goto fail;
+	}
+	close(fd);
+	sl->sl_hdr = hdr;
+	sl->sl_data = (char *)hdr + CMYTH_SHMLIVE_HDR;
+
+	hdr->sh_version = CMYTH_SHMLIVE_VERSION;
+	hdr->sh_size = sl->sl_size;
+	hdr->sh_chunk = sl->sl_chunk;
+	hdr->sh_pid = (int32_t)getpid();
+	/*
+	 * Readers check the magic number first, so it goes in last.
+	 */
+	__sync_synchronize();
+	hdr->sh_magic = CMYTH_SHMLIVE_MAGIC;
+
+	return sl;
+
+    fail:
+	close(fd);
+	shm_unlink(name);
+	ref_release(sl);
+	return NULL;
+}
+
+/*
+ * cmyth_shmlive_reserve(cmyth_shmlive_t sl, char **data)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_shmlive_reserve)
+ *
+ * Description
+ *
+ * Find where the publisher writes next in its ring.  The space returned
+ * in 'data' is contiguous, and never more than the ring allows to be in
+ * flight at once.  Readers do not see the data until it is passed to
+ * cmyth_shmlive_commit().
+ *
+ * Return Value:
+ *
+ * Success: The number of bytes which may be written at 'data'
+ *
+ * Failure: -(ERRNO)
+ */
+long
+cmyth_shmlive_reserve(cmyth_shmlive_t sl, char **data)
+{
+	uint64_t off, len;
+
+	if (!sl || !sl->sl_writer || !data) {
+		return -EINVAL;
+	}
+	off = sl->sl_hdr->sh_head % sl->sl_size;
+	len = sl->sl_size - off;
+	if (len > sl->sl_chunk) {
+		len = sl->sl_chunk;
+	}
+	*data = sl->sl_data + off;
+	return (long)len;
+}
+
+/*
+ * cmyth_shmlive_commit(cmyth_shmlive_t sl, unsigned long len)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_shmlive_commit)
+ *
+ * Description
+ *
+ * Hand 'len' bytes written at the space returned by
+ * cmyth_shmlive_reserve() over to the readers, and wake them up.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(ERRNO)
+ */
+int
+cmyth_shmlive_commit(cmyth_shmlive_t sl, unsigned long len)
+{
+	struct cmyth_shmlive_hdr *hdr;
+	char *data;
+
+	if (cmyth_shmlive_reserve(sl, &data) < (long)len) {
+		return -EINVAL;
+	}
+	hdr = sl->sl_hdr;
+	hdr->sh_seq++;
+	__sync_synchronize();
+	hdr->sh_head += len;
+	__sync_synchronize();
+	hdr->sh_seq++;
+	cmyth_shmlive_wake(hdr);
+	return 0;
+}
+
+/*
+ * cmyth_shmlive_end(cmyth_shmlive_t sl)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_shmlive_end)
+ *
+ * Description
+ *
+ * Mark the stream of a ring as ended.  Readers get the data which is
+ * left, and then -EPIPE.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_shmlive_end(cmyth_shmlive_t sl)
+{
+	struct cmyth_shmlive_hdr *hdr;
+
+	if (!sl || !sl->sl_writer || sl->sl_hdr->sh_state) {
+		return;
+	}
+	hdr = sl->sl_hdr;
+	hdr->sh_state = 1;
+	__sync_synchronize();
+	hdr->sh_seq += 2;
+	cmyth_shmlive_wake(hdr);
+}
+
+/*
+ * cmyth_shmlive_pump(void *arg)
+ *
+ * Scope: PRIVATE (static)
+ *
+ * Description
+ *
+ * The publisher thread.  Blocks are requested from the live TV stream of
+ * the recorder, which moves along the chain by itself, and received
+ * straight into the ring.  The ring is ended when the stream fails.
+ *
+ * Return Value:
+ *
+ * NULL
+ */
+static void *
+cmyth_shmlive_pump(void *arg)
+{
+	cmyth_shmlive_t sl = (cmyth_shmlive_t)arg;
+	struct timeval tv;
+	char *data;
+	long room;
+	int len, got, ret;
+
+	while (!sl->sl_stop) {
+		room = cmyth_shmlive_reserve(sl, &data);
+		len = cmyth_livetv_request_block(sl->sl_rec, room);
+		if (len < 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: request block failed (%d)\n",
+				  __FUNCTION__, len);
+			break;
+		}
+		if (len == 0) {
+			usleep(SHMLIVE_IDLE_US);
+			continue;
+		}
+		for (got = 0; got < len; got += ret) {
+			tv.tv_sec = 5;
+			tv.tv_usec = 0;
+			if ((ret = cmyth_livetv_select(sl->sl_rec, &tv)) <= 0) {
+				break;
+			}
+			ret = cmyth_livetv_get_block(sl->sl_rec, data + got,
+						     len - got);
+			if (ret <= 0) {
+				break;
+			}
+		}
+		if (got < len) {
+			cmyth_dbg(CMYTH_DBG_ERROR,
+				  "%s: got %d of %d bytes (%d)\n",
+				  __FUNCTION__, got, len, ret);
+			break;
+		}
+		cmyth_shmlive_commit(sl, len);
+	}
+	cmyth_shmlive_end(sl);
+
+	return NULL;
+}
+
+/*
+ * cmyth_shmlive_publish(cmyth_recorder_t rec, const char *name,
+ *                       unsigned long size)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Create the shared memory ring 'name' of 'size' bytes, and start a
+ * thread which pulls the live TV stream of 'rec' into it.  The recorder
+ * must not be read from by anything else while it is published.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL cmyth_shmlive_t (this type is a pointer)
+ *
+ * Failure: A NULL cmyth_shmlive_t
+ */
+cmyth_shmlive_t
+cmyth_shmlive_publish(cmyth_recorder_t rec, const char *name,
+		      unsigned long size)
+{
+	cmyth_shmlive_t sl;
+	int err;
+
+	if (!rec) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no recorder specified\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+	if ((sl = cmyth_shmlive_create(name, size)) == NULL) {
+		return NULL;
+	}
+	sl->sl_rec = ref_hold(rec);
+	if ((err = pthread_create(&sl->sl_thread, NULL,
+				  cmyth_shmlive_pump, sl)) != 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: pthread_create() failed (%d)\n",
+			  __FUNCTION__, err);
+		ref_release(sl);
+		return NULL;
+	}
+	sl->sl_running = 1;
+
+	return sl;
+}
+
+/*
+ * cmyth_shmlive_attach(const char *name)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Map the shared memory ring 'name' read-only, and return a reader
+ * handle for it which starts at the live edge of the stream.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL cmyth_shmlive_t (this type is a pointer)
+ *
+ * Failure: A NULL cmyth_shmlive_t
+ */
+cmyth_shmlive_t
+cmyth_shmlive_attach(const char *name)
+{
+	cmyth_shmlive_t sl = NULL;
+	struct cmyth_shmlive_hdr *hdr;
+	struct stat st;
+	int fd;
+
+	if (!name) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no name specified\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: shm_open(%s) failed (%d)\n",
+			  __FUNCTION__, name, errno);
+		return NULL;
+	}
+	if ((fstat(fd, &st) < 0) || (st.st_size < 5 * CMYTH_SHMLIVE_HDR)) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: %s is not a ring\n",
+			  __FUNCTION__, name);
+		goto out;
+	}
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: mmap() failed (%d)\n",
+			  __FUNCTION__, errno);
+		goto out;
+	}
+	__sync_synchronize();
+	if ((hdr->sh_magic != CMYTH_SHMLIVE_MAGIC) ||
+	    (hdr->sh_version != CMYTH_SHMLIVE_VERSION) ||
+	    (hdr->sh_size + CMYTH_SHMLIVE_HDR > (uint64_t)st.st_size) ||
+	    (hdr->sh_chunk == 0) || (hdr->sh_chunk > hdr->sh_size)) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: %s is not a ring\n",
+			  __FUNCTION__, name);
+		munmap(hdr, st.st_size);
+		goto out;
+	}
+	if ((sl = cmyth_shmlive_alloc(name)) == NULL) {
+		munmap(hdr, st.st_size);
+		goto out;
+	}
+	sl->sl_hdr = hdr;
+	sl->sl_data = (char *)hdr + CMYTH_SHMLIVE_HDR;
+	sl->sl_maplen = st.st_size;
+	sl->sl_size = hdr->sh_size;
+	sl->sl_chunk = hdr->sh_chunk;
+	sl->sl_pos = cmyth_shmlive_head(hdr, NULL);
+
+    out:
+	close(fd);
+	return sl;
+}
+
+/*
+ * cmyth_shmlive_wait(cmyth_shmlive_t sl, int timeout)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Wait up to 'timeout' milliseconds for data to read from a ring.  A
+ * 'timeout' of 0 polls, and a negative one waits forever.
+ *
+ * Return Value:
+ *
+ * Success: The number of bytes available, or 0 on timeout
+ *
+ * Failure: -(ERRNO), -EPIPE once the stream has ended
+ */
+long
+cmyth_shmlive_wait(cmyth_shmlive_t sl, int timeout)
+{
+	struct cmyth_shmlive_hdr *hdr;
+	long long end = 0, left;
+	uint64_t head;
+	uint32_t seq;
+	int alive, ms;
+
+	if (!sl || sl->sl_writer) {
+		return -EINVAL;
+	}
+	hdr = sl->sl_hdr;
+	if (timeout > 0) {
+		end = cmyth_io_now() + timeout;
+	}
+	for (;;) {
+		/*
+		 * The publisher writes its last data before it ends the
+		 * ring, so the data is looked for after the end.
+		 */
+		alive = cmyth_shmlive_alive(hdr);
+		__sync_synchronize();
+		head = cmyth_shmlive_head(hdr, &seq);
+		if (head != sl->sl_pos) {
+			if (head - sl->sl_pos > sl->sl_size) {
+				return (long)sl->sl_size;
+			}
+			return (long)(head - sl->sl_pos);
+		}
+		if (!alive) {
+			return -EPIPE;
+		}
+		if (timeout == 0) {
+			return 0;
+		}
+		ms = SHMLIVE_POLL_MS;
+		if (timeout > 0) {
+			left = end - cmyth_io_now();
+			if (left <= 0) {
+				return 0;
+			}
+			if (left < ms) {
+				ms = (int)left;
+			}
+		}
+		cmyth_shmlive_sleep(hdr, seq, ms);
+	}
+}
+
+/*
+ * cmyth_shmlive_peek(cmyth_shmlive_t sl, const char **data)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Point 'data' at the next unread data of a ring, in the shared memory
+ * itself.  The data is only known to be intact once it has been released
+ * with cmyth_shmlive_consume().
+ *
+ * Return Value:
+ *
+ * Success: The number of contiguous bytes at 'data', or 0 if there are
+ *          none
+ *
+ * Failure: -(ERRNO), -EOVERFLOW if the reader was moved to the live edge
+ */
+long
+cmyth_shmlive_peek(cmyth_shmlive_t sl, const char **data)
+{
+	uint64_t head, off, len;
+
+	if (!sl || sl->sl_writer || !data) {
+		return -EINVAL;
+	}
+	head = cmyth_shmlive_head(sl->sl_hdr, NULL);
+	if (head == sl->sl_pos) {
+		return 0;
+	}
+	if (cmyth_shmlive_overrun(sl, head)) {
+		return -EOVERFLOW;
+	}
+	off = sl->sl_pos % sl->sl_size;
+	len = head - sl->sl_pos;
+	if (len > sl->sl_size - off) {
+		len = sl->sl_size - off;
+	}
+	*data = sl->sl_data + off;
+	return (long)len;
+}
+
+/*
+ * cmyth_shmlive_consume(cmyth_shmlive_t sl, unsigned long len)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Move a reader past 'len' bytes returned by cmyth_shmlive_peek(), after
+ * checking that the publisher did not overwrite them while they were
+ * being used.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(ERRNO), -EOVERFLOW if the data was overwritten and the
+ *          reader was moved to the live edge
+ */
+int
+cmyth_shmlive_consume(cmyth_shmlive_t sl, unsigned long len)
+{
+	uint64_t head;
+
+	if (!sl || sl->sl_writer) {
+		return -EINVAL;
+	}
+	__sync_synchronize();
+	head = cmyth_shmlive_head(sl->sl_hdr, NULL);
+	if (cmyth_shmlive_overrun(sl, head)) {
+		return -EOVERFLOW;
+	}
+	if (len > head - sl->sl_pos) {
+		return -EINVAL;
+	}
+	sl->sl_pos += len;
+	return 0;
+}
+
+/*
+ * cmyth_shmlive_read(cmyth_shmlive_t sl, char *buf, unsigned long len,
+ *                    int timeout)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Copy up to 'len' bytes from a ring into 'buf', waiting up to 'timeout'
+ * milliseconds for data as cmyth_shmlive_wait() does.
+ *
+ * Return Value:
+ *
+ * Success: The number of bytes copied, or 0 on timeout
+ *
+ * Failure: -(ERRNO), -EOVERFLOW if the reader was moved to the live edge,
+ *          -EPIPE once the stream has ended
+ */
+long
+cmyth_shmlive_read(cmyth_shmlive_t sl, char *buf, unsigned long len,
+		   int timeout)
+{
+	const char *data;
+	long n, ret;
+
+	if (!buf) {
+		return -EINVAL;
+	}
+	for (;;) {
+		if ((n = cmyth_shmlive_peek(sl, &data)) != 0) {
+			break;
+		}
+		if ((ret = cmyth_shmlive_wait(sl, timeout)) <= 0) {
+			return ret;
+		}
+	}
+	if (n < 0) {
+		return n;
+	}
+	if ((unsigned long)n > len) {
+		n = len;
+	}
+	memcpy(buf, data, n);
+	if ((ret = cmyth_shmlive_consume(sl, n)) < 0) {
+		return ret;
+	}
+	return n;
+}
@@ -67,8 +67,6 @@ cmyth_send_message(cmyth_conn_t conn, char *request)
 	int reqlen, msglen;
 	int written = 0;
 	int w;
-	struct timeval tv;
-	fd_set fds;
 
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
 	if (!conn) {
@@ -99,15 +97,10 @@ cmyth_send_message(cmyth_conn_t conn, char *request)
 		  __FUNCTION__, msg);
 	reqlen += 8;
 	do {
-		tv.tv_sec = 10;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(conn->conn_fd, &fds);
-		if (select((int)conn->conn_fd+1, NULL, &fds, NULL, &tv) == 0) {
-			conn->conn_hang = 1;
-			continue;
-		} else {
-			conn->conn_hang = 0;
+		if ((w = cmyth_conn_wait(conn, CMYTH_IO_WRITE)) < 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR, "%s: wait failed (%d)\n",
+				  __FUNCTION__, w);
+			return w;
 		}
 		w = send(conn->conn_fd, msg + written, reqlen - written, 0);
 		if (w < 0) {
@@ -144,8 +137,6 @@ cmyth_rcv_length(cmyth_conn_t conn)
 	int rtot = 0;
 	int r;
 	int ret;
-	struct timeval tv;
-	fd_set fds;
 
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
 	if (!conn) {
@@ -160,17 +151,12 @@ cmyth_rcv_length(cmyth_conn_t conn)
 	}
 	buf[8] ='\0';
 	do {
-		tv.tv_sec = 10;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(conn->conn_fd, &fds);
-		if ((r=select((int)conn->conn_fd+1, &fds, NULL, NULL, &tv)) == 0) {
-			conn->conn_hang = 1;
-			continue;
-		} else if (r > 0) {
-			conn->conn_hang = 0;
-			r = recv(conn->conn_fd, &buf[rtot], 8 - rtot, 0);
+		if ((r = cmyth_conn_wait(conn, CMYTH_IO_READ)) < 0) {
+			cmyth_dbg(CMYTH_DBG_ERROR, "%s: wait failed (%d)\n",
+				  __FUNCTION__, r);
+			return r;
 		}
+		r = recv(conn->conn_fd, &buf[rtot], 8 - rtot, 0);
 		if (r < 0) {
 			if (errno == EINTR) {
 				continue;
@@ -214,8 +200,6 @@ cmyth_conn_refill(cmyth_conn_t conn, int len)
 	int r;
 	int total = 0;
 	unsigned char *p;
-	struct timeval tv;
-	fd_set fds;
 
 	if (!conn) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: no connection\n",
@@ -232,17 +216,16 @@ cmyth_conn_refill(cmyth_conn_t conn, int len)
 	}
 	p = conn->conn_buf;
 	while (len > 0) {
-		tv.tv_sec = 10;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(conn->conn_fd, &fds);
-		if ((r=select((int)conn->conn_fd+1, &fds, NULL, NULL, &tv)) == 0) {
-			conn->conn_hang = 1;
-			continue;
-		} else if (r > 0) {
-			conn->conn_hang = 0;
-			r = recv(conn->conn_fd, p, len, 0);
+		if ((r = cmyth_conn_wait(conn, CMYTH_IO_READ)) < 0) {
+			if (total == 0) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: wait failed (%d)\n",
+					  __FUNCTION__, r);
+				return r;
+			}
+			break;
 		}
+		r = recv(conn->conn_fd, p, len, 0);
 		if (r <= 0) {
 			if (errno == EINTR) {
 				continue;
@@ -368,6 +351,38 @@ cmyth_rcv_string(cmyth_conn_t conn, int *err, char *buf, int buflen, int count)
 			}
 		}
 
+		if (state == separator) {
+			/*
+			 * Not in the middle of a separator, so nothing
+			 * up to the next '[' can end the token.  Find
+			 * it with memchr() and copy the run in one go
+			 * rather than walking it a byte at a time.
+			 */
+			unsigned char *start, *end;
+			int avail, run, n;
+
+			avail = conn->conn_len - conn->conn_pos;
+			if (avail > count - consumed) {
+				avail = count - consumed;
+			}
+			start = &conn->conn_buf[conn->conn_pos];
+			end = memchr(start, separator[0], avail);
+			run = end ? (int)(end - start) : avail;
+			if (run > 0) {
+				n = buflen - placed;
+				if (n > run) {
+					n = run;
+				}
+				if (n > 0) {
+					memcpy(&buf[placed], start, n);
+					placed += n;
+				}
+				conn->conn_pos += run;
+				consumed += run;
+				continue;
+			}
+		}
+
 		if (conn->conn_buf[conn->conn_pos] == (unsigned char)*state) {
 			/*
 			 * We matched the next (possibly first) step
@@ -1516,31 +1531,254 @@ cmyth_rcv_datetime(cmyth_conn_t conn, int *err, cmyth_timestamp_t *ts,
 	return consumed;
 }
 
+/*
+ * The strings and timestamps of a program information structure all
+ * share its lifetime, so cmyth_msg_proginfo() collects them in a
+ * proginfo_arena while decoding and then places them as sub-blocks of
+ * a single allocation (see ref_sub_alloc()).  Each field holds its own
+ * reference on the arena, so the rest of the proginfo code can keep
+ * treating them as ordinary reference counted pointers.
+ *
+ * Fields that only take a handful of distinct values across a program
+ * list (host names, channels, groups, categories) are interned with
+ * ref_strintern() instead, so that all programs share one copy.
+ */
+#define PROGINFO_ARENA_STRINGS		32
+#define PROGINFO_ARENA_TIMESTAMPS	6	/* one per timestamp field */
+#define PROGINFO_INTERN_MAX		256
+
+struct proginfo_arena {
+	int arena_nstr;
+	struct {
+		char **field;
+		const char *str;
+		size_t len;
+		const char *suffix;
+		int intern;
+		char *interned;
+	} arena_str[PROGINFO_ARENA_STRINGS];
+	int arena_nts;
+	struct {
+		cmyth_timestamp_t *field;
+		struct cmyth_timestamp ts;
+	} arena_ts[PROGINFO_ARENA_TIMESTAMPS];
+};
+
+/*
+ * Arrange for the first 'len' bytes of 'str' to be stored in '*field',
+ * followed by a space and 'suffix' if 'suffix' is not NULL.  A NULL
+ * 'str' stores NULL.  If 'intern' is set the result is interned rather
+ * than placed in the arena.  'str' and 'suffix' must stay valid until
+ * proginfo_arena_commit().
+ */
+static void
+proginfo_arena_add(struct proginfo_arena *a, char **field,
+		   const char *str, size_t len, const char *suffix, int intern)
+{
+	int i = a->arena_nstr;
+
+	if (i >= PROGINFO_ARENA_STRINGS) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: arena is full\n",
+			  __FUNCTION__);
+		return;
+	}
+	a->arena_nstr++;
+	a->arena_str[i].field = field;
+	a->arena_str[i].str = str;
+	a->arena_str[i].len = len;
+	a->arena_str[i].suffix = str ? suffix : NULL;
+	a->arena_str[i].intern = str ? intern : 0;
+	a->arena_str[i].interned = NULL;
+}
+
+static void
+proginfo_arena_string(struct proginfo_arena *a, char **field, const char *str)
+{
+	proginfo_arena_add(a, field, str, str ? strlen(str) : 0, NULL, 0);
+}
+
+static void
+proginfo_arena_intern(struct proginfo_arena *a, char **field, const char *str)
+{
+	proginfo_arena_add(a, field, str, str ? strlen(str) : 0, NULL, 1);
+}
+
+/*
+ * Return a timestamp structure that will be stored in '*field'.  It
+ * starts out as a copy of the current '*field', if any, so a decoder
+ * that leaves it untouched leaves the timestamp unchanged.
+ */
+static cmyth_timestamp_t
+proginfo_arena_timestamp(struct proginfo_arena *a, cmyth_timestamp_t *field)
+{
+	int i = a->arena_nts++;
+
+	a->arena_ts[i].field = field;
+	if (*field) {
+		a->arena_ts[i].ts = **field;
+	} else {
+		memset(&a->arena_ts[i].ts, 0, sizeof(a->arena_ts[i].ts));
+	}
+	return &a->arena_ts[i].ts;
+}
+
+static size_t
+proginfo_arena_strlen(struct proginfo_arena *a, int i)
+{
+	size_t len = a->arena_str[i].len + 1;
+
+	if (a->arena_str[i].suffix) {
+		len += strlen(a->arena_str[i].suffix) + 1;
+	}
+	return len;
+}
+
+static void
+proginfo_arena_copy(struct proginfo_arena *a, int i, char *str)
+{
+	memcpy(str, a->arena_str[i].str, a->arena_str[i].len);
+	if (a->arena_str[i].suffix) {
+		str[a->arena_str[i].len] = ' ';
+		strcpy(str + a->arena_str[i].len + 1, a->arena_str[i].suffix);
+	} else {
+		str[a->arena_str[i].len] = '\0';
+	}
+}
+
+/*
+ * Intern the strings that asked for it.  Anything too long to assemble
+ * here, or that cannot be interned, is left for the arena.
+ */
+static void
+proginfo_arena_intern_all(struct proginfo_arena *a)
+{
+	char buf[PROGINFO_INTERN_MAX];
+	const char *str;
+	int i;
+
+	for (i = 0; i < a->arena_nstr; ++i) {
+		if (!a->arena_str[i].intern) {
+			continue;
+		}
+		str = a->arena_str[i].str;
+		if (a->arena_str[i].suffix || str[a->arena_str[i].len]) {
+			if (proginfo_arena_strlen(a, i) > sizeof(buf)) {
+				a->arena_str[i].intern = 0;
+				continue;
+			}
+			proginfo_arena_copy(a, i, buf);
+			str = buf;
+		}
+		a->arena_str[i].interned = ref_strintern(str);
+		if (!a->arena_str[i].interned) {
+			a->arena_str[i].intern = 0;
+		}
+	}
+}
+
+/*
+ * Allocate the arena, copy everything collected into it and replace
+ * the fields, releasing whatever they held before.  Empty strings all
+ * share one sub-block.
+ */
+static int
+proginfo_arena_commit(struct proginfo_arena *a)
+{
+	unsigned char *arena;
+	char *empty = NULL;
+	char *str;
+	cmyth_timestamp_t ts;
+	size_t size = 0, off = 0, len;
+	int i, have_empty = 0;
+
+	proginfo_arena_intern_all(a);
+
+	for (i = 0; i < a->arena_nstr; ++i) {
+		if (!a->arena_str[i].str || a->arena_str[i].intern) {
+			continue;
+		}
+		len = proginfo_arena_strlen(a, i);
+		if (len == 1) {
+			if (have_empty) {
+				continue;
+			}
+			have_empty = 1;
+		}
+		size += ref_sub_size(len);
+	}
+	size += a->arena_nts * ref_sub_size(sizeof(struct cmyth_timestamp));
+
+	if ((arena = ref_alloc(size)) == NULL) {
+		for (i = 0; i < a->arena_nstr; ++i) {
+			ref_release(a->arena_str[i].interned);
+		}
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < a->arena_nstr; ++i) {
+		str = NULL;
+		if (a->arena_str[i].intern) {
+			str = a->arena_str[i].interned;
+		} else if (a->arena_str[i].str) {
+			len = proginfo_arena_strlen(a, i);
+			if (len == 1 && empty) {
+				str = ref_hold(empty);
+			} else {
+				str = ref_sub_alloc(arena, off, len);
+				off += ref_sub_size(len);
+				proginfo_arena_copy(a, i, str);
+				if (len == 1) {
+					empty = str;
+				}
+			}
+		}
+		if (*a->arena_str[i].field)
+			ref_release(*a->arena_str[i].field);
+		*a->arena_str[i].field = str;
+	}
+	for (i = 0; i < a->arena_nts; ++i) {
+		ts = ref_sub_alloc(arena, off, sizeof(*ts));
+		off += ref_sub_size(sizeof(*ts));
+		*ts = a->arena_ts[i].ts;
+		if (*a->arena_ts[i].field)
+			ref_release(*a->arena_ts[i].field);
+		*a->arena_ts[i].field = ts;
+	}
+
+	/*
+	 * From here on the fields hold the only references to the arena.
+	 */
+	ref_release(arena);
+
+	return 0;
+}
+
 static void
-cmyth_proginfo_parse_url(cmyth_proginfo_t p)
+cmyth_proginfo_parse_url(struct proginfo_arena *a, cmyth_proginfo_t p,
+			 const char *url, const char *hostname)
 {
 	static const char service[]="myth://";
-	char *host = NULL;
-	char *port = NULL;
-	char *path = NULL;
+	const char *host = NULL;
+	const char *port = NULL;
+	const char *path = NULL;
 
-        if (!p || ! p->proginfo_url ||
-	    (!strcmp(p->proginfo_url, "none")) ||
-	    (!strcmp(p->proginfo_url, " "))) {
+        if (!p || !url ||
+	    (!strcmp(url, "none")) ||
+	    (!strcmp(url, " "))) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
 			  "%s: proginfo or url was NULL, p = %p, url = %p\n",
-			  __FUNCTION__, p, p ? p->proginfo_url : NULL);
+			  __FUNCTION__, p, url);
 		return;
 	}
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: url is: '%s'\n",
-		  __FUNCTION__, p->proginfo_url);
-	path = p->proginfo_url;
-	if (strncmp(p->proginfo_url, service, sizeof(service) - 1) == 0) {
+		  __FUNCTION__, url);
+	path = url;
+	if (strncmp(url, service, sizeof(service) - 1) == 0) {
 		/*
 		 * The URL starts with myth://.  The rest looks like
 		 * <host>:<port>/<filename>.
 		 */
-		host = p->proginfo_url + strlen(service);
+		host = url + strlen(service);
 		port = strchr(host, ':');
 		if (!port) {
 			/*
@@ -1562,286 +1800,173 @@ cmyth_proginfo_parse_url(cmyth_proginfo_t p)
 
     out:
 	if (host && port && path) {
-		char tmp = *(port - 1);
-		*(port - 1) = '\0';
-		if (p->proginfo_host)
-			ref_release(p->proginfo_host);
-		p->proginfo_host = ref_strdup(host);
-		*(port - 1) = tmp;
-		tmp = *(path);
-		*(path) = '\0';
+		proginfo_arena_add(a, &p->proginfo_host,
+				   host, port - 1 - host, NULL, 1);
 		p->proginfo_port = atoi(port);
-		*(path) = tmp;
 	} else {
-		if (p->proginfo_host)
-			ref_release(p->proginfo_host);
-		p->proginfo_host = ref_strdup(p->proginfo_hostname);
+		proginfo_arena_intern(a, &p->proginfo_host, hostname);
 		p->proginfo_port = 6543;
 	}
-	if (p->proginfo_pathname)
-		ref_release(p->proginfo_pathname);
-	p->proginfo_pathname = ref_strdup(path);
+	proginfo_arena_string(a, &p->proginfo_pathname, path);
 }
 
 /*
- * cmyth_rcv_proginfo(cmyth_conn_t conn, cmyth_proginfo_t buf, int count)
+ * cmyth_msg_proginfo(cmyth_msg_t msg, cmyth_proginfo_t buf)
  * 
- * Scope: PRIVATE (mapped to __cmyth_rcv_proginfo)
+ * Scope: PRIVATE (mapped to __cmyth_msg_proginfo)
  *
  * Description
  *
- * Receive a program information structure from a list of tokens in a
- * MythTV Protocol message.  Tokens in MythTV Protocol messages are
- * separated by the string: []:[] or terminated by running out of
- * message.  Up to 'count' Bytes will be consumed from the socket
- * specified by 'conn' (stopping when a separator is seen or 'count'
- * is exhausted).  The proginfo structure specified in 'buf' will be
- * filled out.  If an error is encountered and 'err' is not NULL, an
- * indication of the nature of the error will be recorded by placing
- * an error code in the location pointed to by 'err'.  If all goes
- * well, 'err' wil be set to 0.
+ * Decode a program information structure from the next tokens of the
+ * received message 'msg'.  The proginfo structure specified in 'buf'
+ * will be filled out.  All of its strings and timestamps are placed in
+ * a single allocation, and are only replaced once the whole structure
+ * has been decoded successfully.
  *
  * Return Value:
  *
- * A value >=0 indicating the number of bytes consumed.
+ * Success: 0
+ *
+ * Failure: -(errno)
  *
  * Error Codes:
  *
- * In addition to system call error codes, the following errors may be
- * placed in 'err':
+ * ERANGE       A token did not parse into a program information
+ *              structure
  *
- * ERANGE       The token received did not parse into a program
- *              information structure
+ * EINVAL       A token is not numeric or is signed, or the message
+ *              ran out of tokens
  *
- * EINVAL       The token received is not numeric or is signed
+ * ENOMEM       The strings and timestamps could not be allocated
  */
 int
-cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
-		   int count)
+cmyth_msg_proginfo(cmyth_msg_t msg, cmyth_proginfo_t buf)
 {
-	int consumed;
-	int total = 0;
+	int err;
 	char *failed = NULL;
-	char tmp_str[32768];
+	char *str, *chanstr, *chansign, *url, *hostname;
+	char stars[16];
+	struct proginfo_arena arena;
+	cmyth_timestamp_t start_ts, end_ts, rec_start_ts, rec_end_ts;
+	cmyth_timestamp_t lastmodified, originalairdate;
 
-	if (count <= 0) {
-		*err = EINVAL;
-		return 0;
-	}
-
-	tmp_str[sizeof(tmp_str) - 1] = '\0';
-
-	buf->proginfo_version = conn->conn_version;
+	buf->proginfo_version = msg->msg_version;
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: VERSION IS %ld\n",
 		  __FUNCTION__, buf->proginfo_version);
 
+	/*
+	 * All timestamps are given a place in the arena, whether or not
+	 * this protocol version sends them.
+	 */
+	arena.arena_nstr = 0;
+	arena.arena_nts = 0;
+	start_ts = proginfo_arena_timestamp(&arena, &buf->proginfo_start_ts);
+	end_ts = proginfo_arena_timestamp(&arena, &buf->proginfo_end_ts);
+	rec_start_ts = proginfo_arena_timestamp(&arena,
+						&buf->proginfo_rec_start_ts);
+	rec_end_ts = proginfo_arena_timestamp(&arena,
+					      &buf->proginfo_rec_end_ts);
+	lastmodified = proginfo_arena_timestamp(&arena,
+						&buf->proginfo_lastmodified);
+	originalairdate =
+		proginfo_arena_timestamp(&arena,
+					 &buf->proginfo_originalairdate);
+
 	/*
 	 * Get proginfo_title (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string title";
-		goto fail;
-	}
-	if (buf->proginfo_title)
-		ref_release(buf->proginfo_title);
-	buf->proginfo_title = ref_strdup(tmp_str);
+	proginfo_arena_string(&arena, &buf->proginfo_title,
+			      cmyth_msg_string(msg));
 
 	/*
 	 * Get proginfo_subtitle (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string subtitle";
-		goto fail;
-	}
-	if (buf->proginfo_subtitle)
-		ref_release(buf->proginfo_subtitle);
-	buf->proginfo_subtitle = ref_strdup(tmp_str);
+	proginfo_arena_string(&arena, &buf->proginfo_subtitle,
+			      cmyth_msg_string(msg));
 
 	/*
 	 * Get proginfo_description (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string description";
-		goto fail;
-	}
-	if (buf->proginfo_description)
-		ref_release(buf->proginfo_description);
-	buf->proginfo_description = ref_strdup(tmp_str);
+	proginfo_arena_string(&arena, &buf->proginfo_description,
+			      cmyth_msg_string(msg));
 
 	if (buf->proginfo_version >= 67) {
 		/*
 		 * Get season and episode (unsigned int)
 		 */
-		consumed = cmyth_rcv_ushort(conn, err,
-					   &buf->proginfo_season, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ushort season";
+		if ((err=cmyth_msg_ushort(msg, &buf->proginfo_season)) < 0) {
+			failed = "cmyth_msg_ushort season";
 			goto fail;
 		}
-
-		consumed = cmyth_rcv_ushort(conn, err,
-					   &buf->proginfo_episode, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ushort episode";
+		if ((err=cmyth_msg_ushort(msg, &buf->proginfo_episode)) < 0) {
+			failed = "cmyth_msg_ushort episode";
 			goto fail;
 		}
 	}
 
 	if (buf->proginfo_version >= 76) {
-		consumed = cmyth_rcv_string(conn, err,
-					    tmp_str, sizeof(tmp_str)-1, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string syndicatedepisode";
-			goto fail;
-		}
-		if (buf->proginfo_syndicatedepisode)
-			ref_release(buf->proginfo_syndicatedepisode);
-		buf->proginfo_syndicatedepisode = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena, &buf->proginfo_syndicatedepisode,
+				      cmyth_msg_string(msg));
 	}
 
 	/*
 	 * Get proginfo_category (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string category";
-		goto fail;
-	}
-	if (buf->proginfo_category)
-		ref_release(buf->proginfo_category);
-	buf->proginfo_category = ref_strdup(tmp_str);
+	proginfo_arena_intern(&arena, &buf->proginfo_category,
+			      cmyth_msg_string(msg));
 
 	/*
 	 * Get proginfo_chanId (long)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_long chanId";
-		goto fail;
-	}
-	buf->proginfo_chanId = atoi(tmp_str);
+	buf->proginfo_chanId = atoi(cmyth_msg_string(msg));
 
 	/*
 	 * Get proginfo_chanstr (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string chanstr";
-		goto fail;
-	}
-	if (buf->proginfo_chanstr)
-		ref_release(buf->proginfo_chanstr);
-	buf->proginfo_chanstr = ref_strdup(tmp_str);
+	chanstr = cmyth_msg_string(msg);
+	proginfo_arena_intern(&arena, &buf->proginfo_chanstr, chanstr);
 
 	/*
 	 * Get proginfo_chansign (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string chansign";
-		goto fail;
-	}
-	if (buf->proginfo_chansign)
-		ref_release(buf->proginfo_chansign);
-	buf->proginfo_chansign = ref_strdup(tmp_str);
+	chansign = cmyth_msg_string(msg);
+	proginfo_arena_intern(&arena, &buf->proginfo_chansign, chansign);
 
 	/*
 	 * Get proginfo_channame (string) Version 1 or proginfo_chanicon
 	 * (string) Version 8.
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string chanicon";
-		goto fail;
-	}
+	str = cmyth_msg_string(msg);
 	/* FIXME: doesn't seem to match the dump? */
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: GOT TO ICON/NAME\n", __FUNCTION__);
-	if (buf->proginfo_chanicon)
-		ref_release(buf->proginfo_chanicon);
-	if (buf->proginfo_channame)
-		ref_release(buf->proginfo_channame);
 	if (buf->proginfo_version >= 8) {
-		buf->proginfo_chanicon = ref_strdup(tmp_str);
+		proginfo_arena_intern(&arena, &buf->proginfo_chanicon, str);
 		/*
 		 * Simulate a channel name (Number and Callsign) for
 		 * compatibility.
 		 */
-		snprintf(tmp_str, sizeof(tmp_str),
-			 "%s %s", buf->proginfo_chanstr,
-			 buf->proginfo_chansign);
-		buf->proginfo_channame = ref_strdup(tmp_str);
+		proginfo_arena_add(&arena, &buf->proginfo_channame,
+				   chanstr, strlen(chanstr), chansign, 1);
 	} else { /* Assume version 1 */
-		buf->proginfo_channame = ref_strdup(tmp_str);
-		buf->proginfo_chanicon = ref_strdup("");
+		proginfo_arena_intern(&arena, &buf->proginfo_channame, str);
+		proginfo_arena_intern(&arena, &buf->proginfo_chanicon, "");
 	}
 
 	/*
 	 * Get proginfo_url (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string url";
-		goto fail;
-	}
-	if (buf->proginfo_url)
-		ref_release(buf->proginfo_url);
-	buf->proginfo_url = ref_strdup(tmp_str);
+	url = cmyth_msg_string(msg);
+	proginfo_arena_string(&arena, &buf->proginfo_url, url);
 
 	/*
 	 * Get proginfo_Length (long_long)
+	 *
+	 * Since protocol 57 mythbackend sends a single 64 bit integer
+	 * rather than two 32 bit hi and lo integers for the proginfo
+	 * length.
 	 */
-	if (buf->proginfo_version < 57) {
-		consumed = cmyth_rcv_old_int64(conn, err, &buf->proginfo_Length,
-					       count);
-	} else {
-		/*
-		 * Since protocol 57 mythbackend now sends a single 64 bit
-		 * integer rather than two 32 bit hi and lo integers for the
-		 * proginfo length.
-		 */
-		consumed = cmyth_rcv_new_int64(conn, err, &buf->proginfo_Length,
-					       count, 1);
-	}
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "rcv_64 length";
+	if ((err=cmyth_msg_int64(msg, &buf->proginfo_Length, 1)) < 0) {
+		failed = "msg_64 length";
 		goto fail;
 	}
 
@@ -1850,19 +1975,13 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 	 */
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: GOT TO START_TS\n", __FUNCTION__);
 	if (buf->proginfo_version >= 14) {
-		consumed = cmyth_rcv_datetime(conn, err,
-					      &(buf->proginfo_start_ts),
-					      count);
+		err = cmyth_msg_datetime(msg, start_ts);
 	}
 	else {
-		consumed = cmyth_rcv_timestamp(conn, err,
-					       &(buf->proginfo_start_ts),
-					       count);
-	}	
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "proginfo_start_ts cmyth_rcv start";
+		err = cmyth_msg_timestamp(msg, start_ts);
+	}
+	if (err < 0) {
+		failed = "proginfo_start_ts cmyth_msg start";
 		goto fail;
 	}
 
@@ -1871,17 +1990,13 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 	 */
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s: GOT TO END_TS\n", __FUNCTION__);
 	if (buf->proginfo_version >= 14) {
-		consumed = cmyth_rcv_datetime(conn, err,
-					      &(buf->proginfo_end_ts), count);
+		err = cmyth_msg_datetime(msg, end_ts);
 	}
 	else {
-		consumed = cmyth_rcv_timestamp(conn, err,
-					       &(buf->proginfo_end_ts), count);
-	}	
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_timestamp end";
+		err = cmyth_msg_timestamp(msg, end_ts);
+	}
+	if (err < 0) {
+		failed = "cmyth_msg_timestamp end";
 		goto fail;
 	}
 
@@ -1890,25 +2005,12 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		 * Get proginfo_conflicting (ulong in Version 1, string in Version 8)
 		 */
 		if (buf->proginfo_version >= 8) {
-			consumed = cmyth_rcv_string(conn, err,
-						    tmp_str, sizeof(tmp_str) - 1,
-						    count);
-			count -= consumed;
-			total += consumed;
-			if (*err) {
-				failed = "cmyth_rcv_string";
-				goto fail;
-			}
-			if (buf->proginfo_unknown_0)
-				ref_release(buf->proginfo_unknown_0);
-			buf->proginfo_unknown_0 = ref_strdup(tmp_str);
+			proginfo_arena_string(&arena, &buf->proginfo_unknown_0,
+					      cmyth_msg_string(msg));
 		} else { /* Assume version 1 */
-			consumed = cmyth_rcv_ulong(conn, err,
-						   &buf->proginfo_conflicting, count);
-			count -= consumed;
-			total += consumed;
-			if (*err) {
-				failed = "cmyth_rcv_ulong";
+			if ((err=cmyth_msg_ulong(msg,
+						 &buf->proginfo_conflicting)) < 0) {
+				failed = "cmyth_msg_ulong";
 				goto fail;
 			}
 		}
@@ -1916,11 +2018,8 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		/*
 		 * Get proginfo_recording (ulong)
 		 */
-		consumed = cmyth_rcv_ulong(conn, err, &buf->proginfo_recording, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong";
+		if ((err=cmyth_msg_ulong(msg, &buf->proginfo_recording)) < 0) {
+			failed = "cmyth_msg_ulong";
 			goto fail;
 		}
 	}
@@ -1928,118 +2027,76 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 	/*
 	 * Get proginfo_override (ulong)
 	 */
-	consumed = cmyth_rcv_ulong(conn, err, &buf->proginfo_override, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong override";
+	if ((err=cmyth_msg_ulong(msg, &buf->proginfo_override)) < 0) {
+		failed = "cmyth_msg_ulong override";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_hostname (string)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string hostname";
-		goto fail;
-	}
-	if (buf->proginfo_hostname)
-		ref_release(buf->proginfo_hostname);
-	buf->proginfo_hostname = ref_strdup(tmp_str);
+	hostname = cmyth_msg_string(msg);
+	proginfo_arena_intern(&arena, &buf->proginfo_hostname, hostname);
 
 	/*
 	 * Get proginfo_source_id (long)
 	 */
-	consumed = cmyth_rcv_long(conn, err, &buf->proginfo_source_id, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong source_id";
+	if ((err=cmyth_msg_long(msg, &buf->proginfo_source_id)) < 0) {
+		failed = "cmyth_msg_long source_id";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_card_id (long)
 	 */
-	consumed = cmyth_rcv_long(conn, err, &buf->proginfo_card_id, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong card_id";
+	if ((err=cmyth_msg_long(msg, &buf->proginfo_card_id)) < 0) {
+		failed = "cmyth_msg_long card_id";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_input_id (long)
 	 */
-	consumed = cmyth_rcv_long(conn, err, &buf->proginfo_input_id, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong input_id";
+	if ((err=cmyth_msg_long(msg, &buf->proginfo_input_id)) < 0) {
+		failed = "cmyth_msg_long input_id";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_rec_priority (long)
 	 */
-	consumed = cmyth_rcv_string(conn, err,
-				    tmp_str, sizeof(tmp_str) - 1, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_string rec_priority";
-		goto fail;
-	}
-	if (buf->proginfo_rec_priority)
-		ref_release(buf->proginfo_rec_priority);
-	buf->proginfo_rec_priority = ref_strdup(tmp_str);
+	proginfo_arena_string(&arena, &buf->proginfo_rec_priority,
+			      cmyth_msg_string(msg));
 
 	/*
 	 * Get proginfo_rec_status (ulong)
 	 */
-	consumed = cmyth_rcv_long(conn, err, &buf->proginfo_rec_status, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong rec_status";
+	if ((err=cmyth_msg_long(msg, &buf->proginfo_rec_status)) < 0) {
+		failed = "cmyth_msg_long rec_status";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_record_id (ulong)
 	 */
-	consumed = cmyth_rcv_ulong(conn, err, &buf->proginfo_record_id, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong record_id";
+	if ((err=cmyth_msg_ulong(msg, &buf->proginfo_record_id)) < 0) {
+		failed = "cmyth_msg_ulong record_id";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_rec_type (ulong)
 	 */
-	consumed = cmyth_rcv_ulong(conn, err, &buf->proginfo_rec_type, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong rec_type";
+	if ((err=cmyth_msg_ulong(msg, &buf->proginfo_rec_type)) < 0) {
+		failed = "cmyth_msg_ulong rec_type";
 		goto fail;
 	}
 
 	/*
 	 * Get proginfo_rec_dups (ulong)
 	 */
-	consumed = cmyth_rcv_ulong(conn, err, &buf->proginfo_rec_dups, count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_ulong rec_dups";
+	if ((err=cmyth_msg_ulong(msg, &buf->proginfo_rec_dups)) < 0) {
+		failed = "cmyth_msg_ulong rec_dups";
 		goto fail;
 	}
 
@@ -2047,12 +2104,9 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		/*
 		 * Get proginfo_rec_dupmethod (long)
 		 */
-		consumed = cmyth_rcv_ulong(conn, err,
-					   &buf->proginfo_rec_dupmethod, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong dupmethod";
+		if ((err=cmyth_msg_ulong(msg,
+					 &buf->proginfo_rec_dupmethod)) < 0) {
+			failed = "cmyth_msg_ulong dupmethod";
 			goto fail;
 		}
 	}
@@ -2061,20 +2115,13 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 	 * Get proginfo_rec_start_ts (timestamp)
 	 */
 	if (buf->proginfo_version >= 14) {
-		consumed = cmyth_rcv_datetime(conn, err,
-					      &(buf->proginfo_rec_start_ts),
-					      count);
+		err = cmyth_msg_datetime(msg, rec_start_ts);
 	}
 	else {
-		consumed = cmyth_rcv_timestamp(conn, err,
-					       &(buf->proginfo_rec_start_ts),
-					       count);
-	}	
-
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_timestamp rec_start_ts";
+		err = cmyth_msg_timestamp(msg, rec_start_ts);
+	}
+	if (err < 0) {
+		failed = "cmyth_msg_timestamp rec_start_ts";
 		goto fail;
 	}
 
@@ -2082,20 +2129,13 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 	 * Get proginfo_rec_end_ts (timestamp)
 	 */
 	if (buf->proginfo_version >= 14) {
-		consumed = cmyth_rcv_datetime(conn, err,
-					      &(buf->proginfo_rec_end_ts),
-					      count);
+		err = cmyth_msg_datetime(msg, rec_end_ts);
 	}
 	else {
-		consumed = cmyth_rcv_timestamp(conn, err,
-					       &(buf->proginfo_rec_end_ts),
-					       count);
-	}	
-	
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_timestamp rec_end_ts";
+		err = cmyth_msg_timestamp(msg, rec_end_ts);
+	}
+	if (err < 0) {
+		failed = "cmyth_msg_timestamp rec_end_ts";
 		goto fail;
 	}
 
@@ -2103,11 +2143,8 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		/*
 		 * Get proginfo_repeat (ulong)
 		 */
-		consumed = cmyth_rcv_ulong(conn, err, &buf->proginfo_repeat, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong";
+		if ((err=cmyth_msg_ulong(msg, &buf->proginfo_repeat)) < 0) {
+			failed = "cmyth_msg_ulong";
 			goto fail;
 		}
 	}
@@ -2115,12 +2152,8 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 	/*
 	 * Get proginfo_program_flags (long)
 	 */
-	consumed = cmyth_rcv_long(conn, err, &buf->proginfo_program_flags,
-				  count);
-	count -= consumed;
-	total += consumed;
-	if (*err) {
-		failed = "cmyth_rcv_long program_flags";
+	if ((err=cmyth_msg_long(msg, &buf->proginfo_program_flags)) < 0) {
+		failed = "cmyth_msg_long program_flags";
 		goto fail;
 	}
 
@@ -2128,106 +2161,49 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		/*
 		 * Get proginfo_recgroup (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err,
-					    tmp_str, sizeof(tmp_str) - 1,
-					    count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string recgroup";
-			goto fail;
-		}
-		if (buf->proginfo_recgroup)
-			ref_release(buf->proginfo_recgroup);
-		buf->proginfo_recgroup = ref_strdup(tmp_str);
+		proginfo_arena_intern(&arena, &buf->proginfo_recgroup,
+				      cmyth_msg_string(msg));
 	}
 
 	if (buf->proginfo_version >= 8 && buf->proginfo_version < 57) {
 		/*
 		 * Get proginfo_chancommfree (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err,
-					    tmp_str, sizeof(tmp_str) - 1,
-					    count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string chancommfree";
-			goto fail;
-		}
-		if (buf->proginfo_chancommfree)
-			ref_release(buf->proginfo_chancommfree);
-		buf->proginfo_chancommfree = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena, &buf->proginfo_chancommfree,
+				      cmyth_msg_string(msg));
 	}
 
 	if (buf->proginfo_version >= 8) {
 		/*
 		 * Get proginfo_chan_output_filters (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err,
-					    tmp_str, sizeof(tmp_str) - 1,
-					    count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string";
-			goto fail;
-		}
-		if (buf->proginfo_chan_output_filters)
-			ref_release(buf->proginfo_chan_output_filters);
-		buf->proginfo_chan_output_filters = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena,
+				      &buf->proginfo_chan_output_filters,
+				      cmyth_msg_string(msg));
 	}
 
 	if (buf->proginfo_version >= 8) {
 		/*
 		 * Get proginfo_seriesid (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err,
-					    tmp_str, sizeof(tmp_str) - 1,
-					    count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string seriesid";
-			goto fail;
-		}
-		if (buf->proginfo_seriesid)
-			ref_release(buf->proginfo_seriesid);
-		buf->proginfo_seriesid = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena, &buf->proginfo_seriesid,
+				      cmyth_msg_string(msg));
 	}
 
 	if (buf->proginfo_version >= 8) {
 		/*
 		 * Get programid (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err, tmp_str,
-					    sizeof(tmp_str) - 1, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string programid";
-			goto fail;
-		}
-		if (buf->proginfo_programid)
-			ref_release(buf->proginfo_programid);
-		buf->proginfo_programid = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena, &buf->proginfo_programid,
+				      cmyth_msg_string(msg));
 	}
 
 	if (buf->proginfo_version >= 67) {
 		/*
 		 * Get inetref (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err, tmp_str,
-						sizeof(tmp_str) - 1, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string inetref";
-			goto fail;
-		}
-		if (buf->proginfo_inetref)
-			ref_release(buf->proginfo_inetref);
-		buf->proginfo_inetref = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena, &buf->proginfo_inetref,
+				      cmyth_msg_string(msg));
 	}
 
 	if (buf->proginfo_version >= 12) {
@@ -2235,43 +2211,24 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		 * Get lastmodified (string)
 		 */
 		if (buf->proginfo_version >= 14) {
-			consumed =
-				cmyth_rcv_datetime(conn, err,
-						   &(buf->proginfo_lastmodified),
-						   count);
+			err = cmyth_msg_datetime(msg, lastmodified);
 		}
 		else {
-			consumed =
-				cmyth_rcv_timestamp(conn, err,
-						    &(buf->proginfo_lastmodified),
-						    count);
-		}	
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_timestamp lastmodified";
+			err = cmyth_msg_timestamp(msg, lastmodified);
+		}
+		if (err < 0) {
+			failed = "cmyth_msg_timestamp lastmodified";
 			goto fail;
 		}
 	}
 
 	if (buf->proginfo_version >= 12) {
-		char stars[16];
-
 		/*
 		 * Get stars (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err, tmp_str,
-					    sizeof(tmp_str) - 1, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string stars";
-			goto fail;
-		}
-		if (buf->proginfo_stars)
-			ref_release(buf->proginfo_stars);
-		snprintf(stars, sizeof(stars), "%3.1f", atof(tmp_str) * 4.0);
-		buf->proginfo_stars = ref_strdup(stars);
+		snprintf(stars, sizeof(stars), "%3.1f",
+			 atof(cmyth_msg_string(msg)) * 4.0);
+		proginfo_arena_string(&arena, &buf->proginfo_stars, stars);
 	}
 
 	if (buf->proginfo_version >= 12) {
@@ -2279,79 +2236,44 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		 * Get original_air_date (string)
 		 */
 		if ((buf->proginfo_version >= 14) & (buf->proginfo_version <=32)) {
-			consumed =
-				cmyth_rcv_datetime(conn, err,
-						   &(buf->proginfo_originalairdate),
-						   count);
+			err = cmyth_msg_datetime(msg, originalairdate);
 		}
 		else {
-			consumed =
-				cmyth_rcv_timestamp(conn, err,
-						    &(buf->proginfo_originalairdate),
-						    count);
-		}	
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string originalairdate";
+			err = cmyth_msg_timestamp(msg, originalairdate);
+		}
+		if (err < 0) {
+			failed = "cmyth_msg_timestamp originalairdate";
 			goto fail;
 		}
 	}
 
 	if (buf->proginfo_version >= 15 && buf->proginfo_version < 57) {
-		consumed = cmyth_rcv_ulong(conn, err,
-					   &buf->proginfo_hasairdate, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong hasairdate";
+		if ((err=cmyth_msg_ulong(msg, &buf->proginfo_hasairdate)) < 0) {
+			failed = "cmyth_msg_ulong hasairdate";
 			goto fail;
 		}
 	}
-	
+
 	if (buf->proginfo_version >= 18) {
 		/*
 		 * Get playgroup (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err, tmp_str,
-					    sizeof(tmp_str) - 1, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string playgroup";
-			goto fail;
-		}
-		if (buf->proginfo_playgroup)
-			ref_release(buf->proginfo_playgroup);
-		buf->proginfo_playgroup = ref_strdup(tmp_str);
+		proginfo_arena_intern(&arena, &buf->proginfo_playgroup,
+				      cmyth_msg_string(msg));
 	}
 	if (buf->proginfo_version >= 25) {
 		/*
 		 * Get proginfo_recpriority_2 (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err,
-					    tmp_str, sizeof(tmp_str) - 1,
-					    count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string recpriority_2";
-			goto fail;
-		}
-		if (buf->proginfo_recpriority_2)
-			ref_release(buf->proginfo_recpriority_2);
-		buf->proginfo_recpriority_2 = ref_strdup(tmp_str);
+		proginfo_arena_string(&arena, &buf->proginfo_recpriority_2,
+				      cmyth_msg_string(msg));
 	}
 	if (buf->proginfo_version >= 31) {
 		/*
 		 * Get proginfo_parentid (long)
 		 */
-		consumed = cmyth_rcv_long(conn, err,
-					&buf->proginfo_parentid, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_long parentid";
+		if ((err=cmyth_msg_long(msg, &buf->proginfo_parentid)) < 0) {
+			failed = "cmyth_msg_long parentid";
 			goto fail;
 		}
 	}
@@ -2359,47 +2281,29 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		/*
 		 * Get storagegroup (string)
 		 */
-		consumed = cmyth_rcv_string(conn, err, tmp_str,
-					    sizeof(tmp_str) - 1, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_string storagegroup";
-			goto fail;
-		}
-		if (buf->proginfo_storagegroup)
-			ref_release(buf->proginfo_storagegroup);
-		buf->proginfo_storagegroup = ref_strdup(tmp_str);
+		proginfo_arena_intern(&arena, &buf->proginfo_storagegroup,
+				      cmyth_msg_string(msg));
 	}
 	if (buf->proginfo_version >= 35) {
 		/*
 		 * Get audioproperties,videoproperties,subtitletype (int)
 		 */
-		consumed = cmyth_rcv_ulong(conn, err,
-				&buf->proginfo_audioproperties, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong audio";
+		if ((err=cmyth_msg_ulong(msg,
+					 &buf->proginfo_audioproperties)) < 0) {
+			failed = "cmyth_msg_ulong audio";
 			goto fail;
 		}
-		consumed = cmyth_rcv_ulong(conn, err,
-				&buf->proginfo_videoproperties, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong video";
+		if ((err=cmyth_msg_ulong(msg,
+					 &buf->proginfo_videoproperties)) < 0) {
+			failed = "cmyth_msg_ulong video";
 			goto fail;
 		}
-		consumed = cmyth_rcv_ulong(conn, err,
-				&buf->proginfo_subtitletype, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong subtitletype";
+		if ((err=cmyth_msg_ulong(msg,
+					 &buf->proginfo_subtitletype)) < 0) {
+			failed = "cmyth_msg_ulong subtitletype";
 			goto fail;
 		}
-	}	
+	}
 
 	/*
 	 * Get Year
@@ -2410,49 +2314,102 @@ cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
 		 * recordings list on the last program.  In this case, just
 		 * assume the rest of the program list is fine.
 		 */
-		if (count == 0) {
+		if (cmyth_msg_remaining(msg) == 0) {
 			buf->proginfo_year = 0;
 		} else {
-			consumed = cmyth_rcv_ushort(conn, err,
-						    &buf->proginfo_year, count);
-			count -= consumed;
-			total += consumed;
-			if (*err) {
-				failed = "cmyth_rcv_ushort proginfo_year";
+			if ((err=cmyth_msg_ushort(msg,
+						  &buf->proginfo_year)) < 0) {
+				failed = "cmyth_msg_ushort proginfo_year";
 				goto fail;
 			}
 		}
 	}
 
 	if (buf->proginfo_version >= 76) {
-		consumed = cmyth_rcv_ulong(conn, err,
-				&buf->proginfo_partnumber, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong partnumber";
+		if ((err=cmyth_msg_ulong(msg, &buf->proginfo_partnumber)) < 0) {
+			failed = "cmyth_msg_ulong partnumber";
 			goto fail;
 		}
-
-		consumed = cmyth_rcv_ulong(conn, err,
-				&buf->proginfo_parttotal, count);
-		count -= consumed;
-		total += consumed;
-		if (*err) {
-			failed = "cmyth_rcv_ulong parttotal";
+		if ((err=cmyth_msg_ulong(msg, &buf->proginfo_parttotal)) < 0) {
+			failed = "cmyth_msg_ulong parttotal";
 			goto fail;
 		}
 	}
 
 	cmyth_dbg(CMYTH_DBG_INFO, "%s: got recording info\n", __FUNCTION__);
 
-	cmyth_proginfo_parse_url(buf);
-	return total;
+	cmyth_proginfo_parse_url(&arena, buf, url, hostname);
+
+	if ((err=proginfo_arena_commit(&arena)) < 0) {
+		failed = "proginfo_arena_commit";
+		goto fail;
+	}
+	return 0;
 
     fail:
-	cmyth_dbg(CMYTH_DBG_ERROR, "%s: %s() failed (%d) (count = %d)\n",
-		  __FUNCTION__, failed, *err, count);
-	return total;
+	cmyth_dbg(CMYTH_DBG_ERROR, "%s: %s() failed (%d) (remaining = %d)\n",
+		  __FUNCTION__, failed, err, cmyth_msg_remaining(msg));
+	return err;
+}
+
+/*
+ * cmyth_rcv_proginfo(cmyth_conn_t conn, cmyth_proginfo_t buf, int count)
+ * 
+ * Scope: PRIVATE (mapped to __cmyth_rcv_proginfo)
+ *
+ * Description
+ *
+ * Receive a program information structure from a list of tokens in a
+ * MythTV Protocol message.  The program information must be the last
+ * thing in the message: all 'count' remaining bytes are read from the
+ * socket specified by 'conn' in one go and decoded with
+ * cmyth_msg_proginfo().  Any tokens following the program information
+ * are discarded.  The proginfo structure specified in 'buf' will be
+ * filled out.  If an error is encountered and 'err' is not NULL, an
+ * indication of the nature of the error will be recorded by placing
+ * an error code in the location pointed to by 'err'.  If all goes
+ * well, 'err' wil be set to 0.
+ *
+ * Return Value:
+ *
+ * A value >=0 indicating the number of bytes consumed.
+ *
+ * Error Codes:
+ *
+ * In addition to system call error codes, the following errors may be
+ * placed in 'err':
+ *
+ * ERANGE       The token received did not parse into a program
+ *              information structure
+ *
+ * EINVAL       The token received is not numeric or is signed
+ */
+int
+cmyth_rcv_proginfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
+		   int count)
+{
+	cmyth_msg_t msg;
+	int tmp;
+
+	if (!err) {
+		err = &tmp;
+	}
+	if (count <= 0) {
+		*err = EINVAL;
+		return 0;
+	}
+
+	if ((msg=cmyth_rcv_msg(conn, err, count)) == NULL) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: cmyth_rcv_msg() failed (%d)\n",
+			  __FUNCTION__, *err);
+		return 0;
+	}
+
+	*err = -cmyth_msg_proginfo(msg, buf);
+
+	ref_release(msg);
+
+	return count;
 }
 
 /*
@@ -2732,10 +2689,9 @@ cmyth_rcv_chaninfo(cmyth_conn_t conn, int *err, cmyth_proginfo_t buf,
  * Description
  *
  * Receive a program list from a list of tokens in a MythTV Protocol
- * message.  Tokens in MythTV Protocol messages are separated by the
- * string: []:[] or terminated by running out of message.  Up to
- * 'count' Bytes will be consumed from the socket specified by 'conn'
- * (stopping when a separator is seen or 'count' is exhausted).  The
+ * message.  The whole remaining message of 'count' bytes is read
+ * from the socket specified by 'conn' in one go and the program
+ * entries are decoded from it without further socket traffic.  The
  * program list structure specified in 'buf' will be filled out.  If
  * an error is encountered and 'err' is not NULL, an indication of the
  * nature of the error will be recorded by placing an error code in
@@ -2758,10 +2714,10 @@ cmyth_rcv_proglist(cmyth_conn_t conn, int *err, cmyth_proglist_t buf,
 		   int count)
 {
 	int tmp_err;
-	int consumed = 0;
 	int r;
 	int c;
 	cmyth_proginfo_t pi;
+	cmyth_msg_t msg;
 	int i;
 
 	cmyth_dbg(CMYTH_DBG_DEBUG, "%s\n", __FUNCTION__);
@@ -2778,46 +2734,51 @@ cmyth_rcv_proglist(cmyth_conn_t conn, int *err, cmyth_proglist_t buf,
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL buffer\n", __FUNCTION__);
 		return 0;
 	}
-	r = cmyth_rcv_long(conn, err, &buf->proglist_count, count);
-	consumed += r;
-	if (*err) {
+	if ((msg=cmyth_rcv_msg(conn, err, count)) == NULL) {
 		cmyth_dbg(CMYTH_DBG_ERROR,
-			  "%s: cmyth_rcv_long() failed (%d)\n",
+			  "%s: cmyth_rcv_msg() failed (%d)\n",
 			  __FUNCTION__, *err);
-		return consumed;
+		return 0;
+	}
+	if ((r=cmyth_msg_long(msg, &buf->proglist_count)) < 0) {
+		cmyth_dbg(CMYTH_DBG_ERROR,
+			  "%s: cmyth_msg_long() failed (%d)\n",
+			  __FUNCTION__, r);
+		*err = -r;
+		goto out;
 	}
-	count -= r;
 	c = buf->proglist_count;
 	buf->proglist_list = malloc(c * sizeof(cmyth_proginfo_t));
 	if (!buf->proglist_list) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: malloc() failed for list\n",
 			  __FUNCTION__);
 		*err = ENOMEM;
-		return consumed;
+		goto out;
 	}
 	memset(buf->proglist_list, 0, c * sizeof(cmyth_proginfo_t));
 	for (i = 0; i < c; ++i) {
-		pi = cmyth_proginfo_create();
+		pi = cmyth_proginfo_alloc();
 		if (!pi) {
 			cmyth_dbg(CMYTH_DBG_ERROR,
-				  "%s: cmyth_proginfo_create() failed\n",
+				  "%s: cmyth_proginfo_alloc() failed\n",
 				  __FUNCTION__);
 			*err = ENOMEM;
 			break;
 		}
-		r = cmyth_rcv_proginfo(conn, err, pi, count);
-		consumed += r;
-		count -= r;
-		if (*err) {
+		if ((r=cmyth_msg_proginfo(msg, pi)) < 0) {
 			ref_release(pi);
 			cmyth_dbg(CMYTH_DBG_ERROR,
-				  "%s: cmyth_rcv_proginfo() failed (%d)\n",
-				  __FUNCTION__, *err);
+				  "%s: cmyth_msg_proginfo() failed (%d)\n",
+				  __FUNCTION__, r);
+			*err = -r;
 			break;
 		}
 		buf->proglist_list[i] = pi;
 	}
-	return consumed;
+
+    out:
+	ref_release(msg);
+	return count;
 }
 
 /*
@@ -2990,8 +2951,6 @@ cmyth_rcv_data(cmyth_conn_t conn, int *err, unsigned char *buf, int count)
 	int total = 0;
 	unsigned char *p;
 	int tmp_err;
-	struct timeval tv;
-	fd_set fds;
 
 	if (!err) {
 		err = &tmp_err;
@@ -3009,16 +2968,15 @@ cmyth_rcv_data(cmyth_conn_t conn, int *err, unsigned char *buf, int count)
 	}
 	p = buf;
 	while (count > 0) {
-		tv.tv_sec = 10;
-		tv.tv_usec = 0;
-		FD_ZERO(&fds);
-		FD_SET(conn->conn_fd, &fds);
-		if ((r=select((int)conn->conn_fd+1, &fds, NULL, NULL,
-			      &tv)) == 0) {
-			conn->conn_hang = 1;
-			continue;
-		} else if (r > 0) {
-			conn->conn_hang = 0;
+		if ((r = cmyth_conn_wait(conn, CMYTH_IO_READ)) < 0) {
+			if (total == 0) {
+				cmyth_dbg(CMYTH_DBG_ERROR,
+					  "%s: wait failed (%d)\n",
+					  __FUNCTION__, r);
+				*err = r;
+				return 0;
+			}
+			break;
 		}
 		r = recv(conn->conn_fd, p, count, 0);
 		if (r < 0) {
@@ -65,27 +65,29 @@ cmyth_timestamp_create(void)
 }
 
 /*
- * cmyth_timestamp_from_string(char *str)
+ * cmyth_timestamp_set_string(cmyth_timestamp_t ret, char *str)
  * 
- * Scope: PUBLIC
+ * Scope: PRIVATE (mapped to __cmyth_timestamp_set_string)
  *
  * Description
  *
- * Create and fill out a timestamp structure using the string 'str'.
- * The string must be a timestamp of the forn:
+ * Fill out the existing timestamp structure 'ret' using the string
+ * 'str'.  The string must be a timestamp of the forn:
  *
  *    yyyy-mm-ddThh:mm:ss
  *
+ * or a date of the form yyyy-mm-dd.  The contents of 'str' are
+ * modified in the process.
+ *
  * Return Value:
  *
- * Success: A timestamp structure (this is a pointer type)
+ * Success: 0
  *
- * Failure: NULL
+ * Failure: -EINVAL
  */
-cmyth_timestamp_t
-cmyth_timestamp_from_string(char *str)
+int
+cmyth_timestamp_set_string(cmyth_timestamp_t ret, char *str)
 {
-	cmyth_timestamp_t ret;
 	unsigned int i;
 	int datetime = 1;
 	char *yyyy = &str[0];
@@ -97,14 +99,7 @@ cmyth_timestamp_from_string(char *str)
 	
 	if (!str) {
 		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL string\n", __FUNCTION__);
-		return NULL;
-	}
-
-	ret = cmyth_timestamp_create();
-	if (!ret) {
-		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL timestamp\n",
-			  __FUNCTION__);
-		return NULL;
+		return -EINVAL;
 	}
 	if (strlen(str) != CMYTH_TIMESTAMP_LEN) {
 		datetime = 0;
@@ -162,7 +157,7 @@ cmyth_timestamp_from_string(char *str)
 	}
 
 	if (datetime == 0)
-		return ret;
+		return 0;
 
 	ret->timestamp_hour = atoi(hh);
 	if (ret->timestamp_hour > 23) {
@@ -182,13 +177,56 @@ cmyth_timestamp_from_string(char *str)
 			  __FUNCTION__, str);
 		goto err;
 	}
-	return ret;
+	return 0;
 
     err:
-	ref_release(ret);
-	return NULL;
+	return -EINVAL;
 }
 
+/*
+ * cmyth_timestamp_from_string(char *str)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Create and fill out a timestamp structure using the string 'str'.
+ * The string must be a timestamp of the forn:
+ *
+ *    yyyy-mm-ddThh:mm:ss
+ *
+ * Return Value:
+ *
+ * Success: A timestamp structure (this is a pointer type)
+ *
+ * Failure: NULL
+ */
+cmyth_timestamp_t
+cmyth_timestamp_from_string(char *str)
+{
+	cmyth_timestamp_t ret;
+
+	if (!str) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL string\n", __FUNCTION__);
+		return NULL;
+	}
+
+	ret = cmyth_timestamp_create();
+	if (!ret) {
+		cmyth_dbg(CMYTH_DBG_ERROR, "%s: NULL timestamp\n",
+			  __FUNCTION__);
+		return NULL;
+	}
+
+	if (cmyth_timestamp_set_string(ret, str) < 0) {
+		ref_release(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+
 cmyth_timestamp_t
 cmyth_timestamp_from_tm(struct tm * tm_datetime)
 {
@@ -233,6 +271,31 @@ cmyth_timestamp_from_unixtime(time_t l)
 	return cmyth_timestamp_from_tm(&tm_datetime);
 }
 
+/*
+ * cmyth_timestamp_set_unixtime(cmyth_timestamp_t ts, time_t l)
+ * 
+ * Scope: PRIVATE (mapped to __cmyth_timestamp_set_unixtime)
+ *
+ * Description
+ *
+ * Fill out the existing timestamp structure 'ts' using the time_t 'l'.
+ *
+ * Return Value: NONE
+ */
+void
+cmyth_timestamp_set_unixtime(cmyth_timestamp_t ts, time_t l)
+{
+	struct tm tm_datetime;
+	localtime_r(&l,&tm_datetime);
+	ts->timestamp_year = tm_datetime.tm_year + 1900;
+	ts->timestamp_month = tm_datetime.tm_mon + 1;
+	ts->timestamp_day = tm_datetime.tm_mday;
+	ts->timestamp_hour = tm_datetime.tm_hour;
+	ts->timestamp_minute = tm_datetime.tm_min;
+	ts->timestamp_second = tm_datetime.tm_sec;
+	ts->timestamp_isdst = tm_datetime.tm_isdst;
+}
+
 
 /*
  * cmyth_timestamp_to_longlong( cmyth_timestamp_t ts)
@@ -477,6 +540,76 @@ cmyth_timestamp_compare(cmyth_timestamp_t ts1, cmyth_timestamp_t ts2)
 	return 0;
 }
 
+/*
+ * cmyth_timeslot_parse(char *data, long *chanid, char *recstart, int len,
+ *                      time_t *start, char **rest)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Split the "chanid starttime" at the start of the event data 'data',
+ * as sent with RECORDING_LIST_CHANGE and UPDATE_FILE_SIZE events.  The
+ * start time is copied as sent into 'recstart', which holds 'len'
+ * bytes, and converted into seconds since the Epoch in 'start'.  Newer
+ * backends send the time in UTC, marked with a Z.  If 'rest' is not
+ * NULL, it is left pointing after the start time.
+ *
+ * Return Value:
+ *
+ * Success: 0
+ *
+ * Failure: -(ERRNO)
+ */
+int
+cmyth_timeslot_parse(char *data, long *chanid, char *recstart, int len,
+		     time_t *start, char **rest)
+{
+	struct tm tm;
+	char *p, *end;
+	int n;
+
+	if (!data || !chanid || !recstart || !start) {
+		return -EINVAL;
+	}
+
+	*chanid = strtol(data, &p, 10);
+	if ((p == data) || (*p != ' ')) {
+		return -EINVAL;
+	}
+	while (*p == ' ') {
+		p++;
+	}
+	end = p + strcspn(p, " ");
+	n = end - p;
+	if ((n == 0) || (n >= len)) {
+		return -EINVAL;
+	}
+	memcpy(recstart, p, n);
+	recstart[n] = '\0';
+
+	memset(&tm, 0, sizeof(tm));
+	if (sscanf(recstart, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon,
+		   &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+		return -EINVAL;
+	}
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+
+	if (recstart[n-1] == 'Z') {
+		*start = timegm(&tm);
+	} else {
+		tm.tm_isdst = -1;
+		*start = mktime(&tm);
+	}
+
+	if (rest) {
+		*rest = end;
+	}
+
+	return 0;
+}
+
 int
 cmyth_timestamp_diff(cmyth_timestamp_t ts1, cmyth_timestamp_t ts2)
 {
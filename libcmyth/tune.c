@@ -0,0 +1,297 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * tune.c - Block size controller for data connections.  The best size for
+ *          a REQUEST_BLOCK depends on the link: a fast network needs big
+ *          blocks to keep the backend busy between round trips, while a
+ *          slow one needs small blocks so that each request comes back
+ *          quickly.  Much like TCP window autotuning, each data
+ *          connection measures the throughput and the time from request
+ *          to reply, and adjusts its block size to suit.
+ *
+ *          Requests are counted in windows of at least TUNE_WINDOW
+ *          requests and TUNE_WINDOW_MS milliseconds.  After each
+ *          window the block is doubled, as long as the previous doubling
+ *          made the transfer at least 10% faster and requests are not
+ *          coming back too slowly.  A doubling that does not pay off is
+ *          undone, and that size is not tried again for TUNE_PROBE
+ *          windows.  If the smoothed latency goes over TUNE_LATENCY_MAX
+ *          the block is halved.  The receive buffer of the socket is
+ *          grown along with the block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <cmyth_local.h>
+
+#define TUNE_BLOCK_MIN		(16 * 1024)
+#define TUNE_BLOCK_START	(128 * 1024)
+#define TUNE_BLOCK_MAX		(4 * 1024 * 1024)
+#define TUNE_RCVBUF_MAX		(8 * 1024 * 1024)
+#define TUNE_WINDOW		4
+#define TUNE_WINDOW_MS		20
+#define TUNE_PROBE		64	/* windows */
+#define TUNE_LATENCY_MAX	250	/* milliseconds */
+#define TUNE_IDLE		1000	/* milliseconds */
+
+/*
+ * Make the receive buffer big enough to hold a block with room to spare,
+ * since the size the system reports includes its bookkeeping (Linux
+ * doubles the size asked for).  It is never shrunk, and the system may
+ * not grant all of it, so the size actually in use is read back.  Called
+ * with tune_mutex held.
+ */
+static void
+cmyth_tune_rcvbuf(cmyth_conn_t conn)
+{
+	struct cmyth_tune *t = &conn->conn_tune;
+	int want, got;
+	socklen_t size;
+
+	want = (t->tune_block * 4 > TUNE_RCVBUF_MAX) ?
+		TUNE_RCVBUF_MAX : (int)(t->tune_block * 4);
+	if ((conn->conn_fd < 0) || (want <= conn->conn_tcp_rcvbuf)) {
+		return;
+	}
+
+	if (setsockopt(conn->conn_fd, SOL_SOCKET, SO_RCVBUF, (void*)&want,
+		       sizeof(want)) < 0) {
+		cmyth_dbg(CMYTH_DBG_DEBUG, "%s: setsockopt(%d) failed (%d)\n",
+			  __FUNCTION__, want, errno);
+		return;
+	}
+	size = sizeof(got);
+	if (getsockopt(conn->conn_fd, SOL_SOCKET, SO_RCVBUF, (void*)&got,
+		       &size) == 0) {
+		conn->conn_tcp_rcvbuf = got;
+	}
+}
+
+/*
+ * End of a window: decide on the block size for the next one.  Called
+ * with tune_mutex held.
+ */
+static void
+cmyth_tune_adapt(cmyth_conn_t conn, long long now)
+{
+	struct cmyth_tune *t = &conn->conn_tune;
+	unsigned long old = t->tune_block;
+	long long rate;
+
+	rate = t->tune_bytes * 1000 / (now - t->tune_start);
+
+	if ((t->tune_latency > TUNE_LATENCY_MAX) &&
+	    (t->tune_block > TUNE_BLOCK_MIN)) {
+		t->tune_block /= 2;
+		t->tune_ceiling = old;
+		t->tune_probe = TUNE_PROBE;
+		t->tune_grew = 0;
+	} else if (t->tune_grew &&
+		   (rate < t->tune_rate + t->tune_rate / 10)) {
+		t->tune_block /= 2;
+		t->tune_ceiling = old;
+		t->tune_probe = TUNE_PROBE;
+		t->tune_grew = 0;
+	} else if (!t->tune_limited && (t->tune_block < TUNE_BLOCK_MAX) &&
+		   (t->tune_latency * 2 <= TUNE_LATENCY_MAX) &&
+		   ((t->tune_ceiling == 0) ||
+		    (t->tune_block * 2 < t->tune_ceiling) ||
+		    (t->tune_probe == 0))) {
+		t->tune_block *= 2;
+		if (t->tune_block >= t->tune_ceiling) {
+			t->tune_ceiling = 0;
+		}
+		t->tune_grew = 1;
+		cmyth_tune_rcvbuf(conn);
+	} else {
+		t->tune_grew = 0;
+	}
+
+	if (t->tune_probe > 0) {
+		t->tune_probe--;
+	}
+	t->tune_rate = rate;
+	if (t->tune_block != old) {
+		cmyth_dbg(CMYTH_DBG_DEBUG,
+			  "%s: %lld bytes/s, %d ms, block %lu -> %lu\n",
+			  __FUNCTION__, rate, t->tune_latency, old,
+			  t->tune_block);
+	}
+}
+
+/*
+ * cmyth_tune_init(cmyth_conn_t conn)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_tune_init)
+ *
+ * Description
+ *
+ * Set up the block size controller of the connection 'conn'.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_tune_init(cmyth_conn_t conn)
+{
+	struct cmyth_tune *t = &conn->conn_tune;
+
+	memset(t, 0, sizeof(*t));
+	pthread_mutex_init(&t->tune_mutex, NULL);
+	t->tune_block = TUNE_BLOCK_START;
+}
+
+/*
+ * cmyth_tune_block(cmyth_conn_t conn, unsigned long len, int streamed)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_tune_block)
+ *
+ * Description
+ *
+ * Choose the size of the next block to request on the data connection
+ * 'conn', which is at most 'len' bytes.  If the caller waits for the
+ * reply before reading the data ('streamed' is 0), the block must fit in
+ * the receive buffer, or the backend stalls writing the data and never
+ * sends the reply.  Blocks up to the starting size are left alone, as
+ * they always have been.
+ *
+ * Return Value:
+ *
+ * The number of bytes to request
+ */
+unsigned long
+cmyth_tune_block(cmyth_conn_t conn, unsigned long len, int streamed)
+{
+	struct cmyth_tune *t = &conn->conn_tune;
+	unsigned long ret, room;
+	long long now = cmyth_io_now();
+
+	pthread_mutex_lock(&t->tune_mutex);
+
+	if ((t->tune_count == 0) || (now - t->tune_last > TUNE_IDLE)) {
+		t->tune_count = 0;
+		t->tune_bytes = 0;
+		t->tune_start = now;
+		t->tune_limited = 0;
+	}
+
+	ret = t->tune_block;
+	if (len < ret) {
+		ret = len;
+		t->tune_limited = 1;
+	}
+	room = conn->conn_tcp_rcvbuf / 4;
+	if (!streamed && (ret > TUNE_BLOCK_START) && (ret > room)) {
+		ret = (room > TUNE_BLOCK_START) ? room : TUNE_BLOCK_START;
+		t->tune_limited = 1;
+	}
+
+	pthread_mutex_unlock(&t->tune_mutex);
+
+	return ret;
+}
+
+/*
+ * cmyth_tune_sample(cmyth_conn_t conn, unsigned long asked, long got,
+ *                   long long sent)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_tune_sample)
+ *
+ * Description
+ *
+ * Tell the controller of the data connection 'conn' that a request for
+ * 'asked' bytes, sent at cmyth_io_now() time 'sent', was answered with
+ * 'got' bytes.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_tune_sample(cmyth_conn_t conn, unsigned long asked, long got,
+		  long long sent)
+{
+	struct cmyth_tune *t = &conn->conn_tune;
+	long long now = cmyth_io_now();
+	int ms = (int)(now - sent);
+
+	pthread_mutex_lock(&t->tune_mutex);
+
+	if (t->tune_latency == 0) {
+		t->tune_latency = ms;
+	} else {
+		t->tune_latency = (t->tune_latency * 7 + ms) / 8;
+	}
+	if ((got < 0) || ((unsigned long)got < asked)) {
+		/* the end of the file, which says nothing about the link */
+		t->tune_limited = 1;
+	}
+	if (got > 0) {
+		t->tune_bytes += got;
+	}
+	t->tune_last = now;
+
+	if ((++t->tune_count >= TUNE_WINDOW) &&
+	    (now - t->tune_start >= TUNE_WINDOW_MS)) {
+		cmyth_tune_adapt(conn, now);
+		t->tune_count = 0;
+	}
+
+	pthread_mutex_unlock(&t->tune_mutex);
+}
+
+/*
+ * cmyth_tune_get_stats(cmyth_conn_t conn, unsigned long *block,
+ *                      int *rcvbuf, unsigned long long *rate,
+ *                      int *latency)
+ *
+ * Scope: PRIVATE (mapped to __cmyth_tune_get_stats)
+ *
+ * Description
+ *
+ * Report the state of the controller of the data connection 'conn': the
+ * current block size, the receive buffer size, the throughput of the
+ * last window in bytes per second and the smoothed latency of a request
+ * in milliseconds.  Any of the pointers may be NULL.
+ *
+ * Return Value:
+ *
+ * None.
+ */
+void
+cmyth_tune_get_stats(cmyth_conn_t conn, unsigned long *block, int *rcvbuf,
+		     unsigned long long *rate, int *latency)
+{
+	struct cmyth_tune *t = &conn->conn_tune;
+
+	pthread_mutex_lock(&t->tune_mutex);
+	if (block)
+		*block = t->tune_block;
+	if (rcvbuf)
+		*rcvbuf = conn->conn_tcp_rcvbuf;
+	if (rate)
+		*rate = t->tune_rate;
+	if (latency)
+		*latency = t->tune_latency;
+	pthread_mutex_unlock(&t->tune_mutex);
+}
@@ -49,6 +49,7 @@
 #include <refmem_local.h>
 
 #include <string.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -88,6 +89,13 @@ static mvp_atomic_t total_bytecount=0;
  *   of any complex structures contained in the reference counted block.  If
  *   it is NULL, no function is called.
  *
+ * - The size class pool the block was taken from (see pool.c), or 0 if it
+ *   was allocated with malloc().
+ *
+ * - For a sub-block placed inside another allocation by ref_sub_alloc(),
+ *   a pointer to the refcounter of the enclosing block.  All holds and
+ *   releases of the sub-block are applied to that block instead.
+ *
  * NOTE: Make sure this has a word aligned length, as it will be placed
  *       before each allocation and will affect the alignment of pointers.
  */
@@ -100,8 +108,10 @@ typedef struct refcounter {
 	int line;
 #endif /* DEBUG */
 	mvp_atomic_t refcount;
+	unsigned int pool;
 	size_t length;
 	ref_destroy_t destroy;
+	struct refcounter *parent;
 } refcounter_t;
 
 #ifdef DEBUG
@@ -112,6 +122,7 @@ typedef struct {
 
 #define REF_REFCNT(p) ((refcounter_t *)(((unsigned char *)(p)) - sizeof(refcounter_t)))
 #define REF_DATA(r) (((unsigned char *)(r)) + sizeof(refcounter_t))
+#define REF_SUB_ALIGN(n) (((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
 
 #if defined(DEBUG)
 #define REF_ALLOC_BINS	101
@@ -138,9 +149,17 @@ guard_check(guard_t *guard)
 
 int ref_get_refcount(char *loc)
 {
+	unsigned int slab_bytes, in_use;
+
 	refmem_dbg(REF_DBG_COUNTERS,
 		   "%40.40s Refs: %7d   Bytes: %8d\n",
 		   loc,total_refcount,total_bytecount);
+	ref_get_pool_usage(&slab_bytes, &in_use, NULL, NULL);
+	if (slab_bytes) {
+		refmem_dbg(REF_DBG_COUNTERS,
+			   "%40.40s Pool: %7u   Slabs: %8u\n",
+			   loc, in_use, slab_bytes);
+	}
 	return(total_refcount);
 }
 
@@ -265,7 +284,9 @@ ref_alloc_show(void)
  *
  * Description
  *
- * Allocate a reference counted block of data.
+ * Allocate a reference counted block of data.  Small blocks are taken
+ * from the size class pool when it has been enabled with
+ * ref_pool_enable().
  *
  * Return Value:
  *
@@ -279,19 +300,28 @@ void *
 __ref_alloc(size_t len, const char *file, const char *func, int line)
 {
 #ifdef DEBUG
-	void *block = malloc(sizeof(refcounter_t) + len + sizeof(guard_t));
+	size_t size = sizeof(refcounter_t) + len + sizeof(guard_t);
 	guard_t *guard;
 #else
-	void *block = malloc(sizeof(refcounter_t) + len);
+	size_t size = sizeof(refcounter_t) + len;
 #endif /* DEBUG */
-	void *ret = REF_DATA(block);
-	refcounter_t *ref = (refcounter_t *)block;
+	unsigned int pool;
+	void *block = ref_pool_alloc(size, &pool);
+	void *ret;
+	refcounter_t *ref;
+
+	if (!block) {
+		block = malloc(size);
+	}
+	ret = REF_DATA(block);
+	ref = (refcounter_t *)block;
 
 	refmem_dbg(REF_DBG_DEBUG, "%s(%d, ret = %p, ref = %p) {\n",
 		   __FUNCTION__, len, ret, ref);
 	if (block) {
 		memset(block, 0, sizeof(refcounter_t) + len);
 		mvp_atomic_set(&ref->refcount, 1);
+		ref->pool = pool;
 		mvp_atomic_inc(&total_refcount);
 		total_bytecount += sizeof(refcounter_t) + len;
 
@@ -316,6 +346,79 @@ __ref_alloc(size_t len, const char *file, const char *func, int line)
 	return NULL;
 }
 
+/*
+ * ref_sub_size(size_t len)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Compute the number of bytes a sub-block of 'len' bytes occupies
+ * inside its parent block, including its header and any padding
+ * needed to keep the next sub-block aligned.
+ *
+ * Return Value: The number of bytes to reserve in the parent block
+ */
+size_t
+ref_sub_size(size_t len)
+{
+	return REF_SUB_ALIGN(sizeof(refcounter_t) + len);
+}
+
+/*
+ * ref_sub_alloc(void *parent, size_t offset, size_t len)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Place a sub-block of 'len' bytes at 'offset' within the reference
+ * counted block 'parent' (as returned by ref_alloc()).  The caller is
+ * responsible for sizing 'parent' using ref_sub_size() and for not
+ * overlapping sub-blocks.  The sub-block behaves like any other
+ * reference counted pointer, except that ref_hold() and ref_release()
+ * act on the reference count of 'parent'.  This allows many small
+ * objects which share a lifetime to be carved out of a single
+ * allocation.  Sub-blocks cannot be reallocated and cannot have their
+ * own destroy function.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL pointer to the zeroed sub-block, holding one
+ *          reference on 'parent'.
+ *
+ * Failure: A NULL pointer.
+ */
+void *
+ref_sub_alloc(void *parent, size_t offset, size_t len)
+{
+	refcounter_t *pref = REF_REFCNT(parent);
+	refcounter_t *ref;
+
+	if (!parent) {
+		return NULL;
+	}
+#ifdef DEBUG
+	assert(pref->magic == ALLOC_MAGIC);
+	assert(offset + ref_sub_size(len) <= pref->length);
+#endif /* DEBUG */
+	if (pref->parent) {
+		pref = pref->parent;
+	}
+
+	ref = (refcounter_t *)((unsigned char *)parent + offset);
+	memset(ref, 0, sizeof(refcounter_t) + len);
+#ifdef DEBUG
+	ref->magic = ALLOC_MAGIC;
+#endif /* DEBUG */
+	ref->length = len;
+	ref->parent = pref;
+
+	ref_hold(REF_DATA(pref));
+
+	return REF_DATA(ref);
+}
+
 /*
  * ref_realloc(void *p, size_t len)
  * 
@@ -503,6 +606,10 @@ ref_hold(void *p)
 
 	refmem_dbg(REF_DBG_DEBUG, "%s(%p) {\n", __FUNCTION__, p);
 	if (p) {
+		if (ref->parent) {
+			ref = ref->parent;
+			block = ref;
+		}
 #ifdef DEBUG
 		assert(ref->magic == ALLOC_MAGIC);
 		guard = (guard_t*)((uintptr_t)block +
@@ -516,6 +623,66 @@ ref_hold(void *p)
         return p;
 }
 
+#if !defined(__GNUC__)
+/*
+ * Without a compare and swap, ref_hold_live() and the decrement in
+ * ref_release() are serialized with this lock, so that a block can not
+ * be revived once its count has reached zero.
+ */
+static pthread_mutex_t live_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*
+ * ref_hold_live(void *p)
+ * 
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Place a hold on the reference counted block 'p', unless its last
+ * reference has already been released and it is about to be
+ * destroyed.  This is for lookup tables and callbacks which keep
+ * pointers to blocks without holding them, and which are cleared from
+ * the blocks' destroy functions.  It must not be used on sub-blocks.
+ *
+ * Return Value:
+ *
+ * Success: 'p', with a new reference held.
+ *
+ * Failure: NULL, if 'p' is being destroyed.
+ */
+void *
+ref_hold_live(void *p)
+{
+	refcounter_t *ref = REF_REFCNT(p);
+	mvp_atomic_t count;
+
+#ifdef DEBUG
+	assert(ref->magic == ALLOC_MAGIC);
+	assert(ref->parent == NULL);
+#endif /* DEBUG */
+#if defined(__GNUC__)
+	do {
+		count = ref->refcount;
+		if (count == 0) {
+			return NULL;
+		}
+	} while (!__sync_bool_compare_and_swap(&ref->refcount,
+					       count, count + 1));
+#else
+	pthread_mutex_lock(&live_mutex);
+	count = ref->refcount;
+	if (count == 0) {
+		pthread_mutex_unlock(&live_mutex);
+		return NULL;
+	}
+	mvp_atomic_inc(&ref->refcount);
+	pthread_mutex_unlock(&live_mutex);
+#endif
+	mvp_atomic_inc(&total_refcount);
+	return p;
+}
+
 /*
  * ref_release(void *p)
  * 
@@ -541,9 +708,19 @@ ref_release(void *p)
 	guard_t *guard;
 #endif /* DEBUG */
 	int refcount;
+	int last;
 
 	refmem_dbg(REF_DBG_DEBUG, "%s(%p) {\n", __FUNCTION__, p);
 	if (p) {
+		if (ref->parent) {
+			/*
+			 * This is a sub-block, release the block that
+			 * contains it.
+			 */
+			ref = ref->parent;
+			block = ref;
+			p = REF_DATA(ref);
+		}
 		refmem_dbg(REF_DBG_DEBUG,
 			   "%s:%d %s(%p,ref = %p,refcount = %p,length = %d)\n",
 			   __FILE__, __LINE__, __FUNCTION__,
@@ -560,7 +737,14 @@ ref_release(void *p)
 
 		refcount = ((int)ref->refcount) - 1;
 
-		if (mvp_atomic_dec_and_test(&ref->refcount)) {
+#if defined(__GNUC__)
+		last = mvp_atomic_dec_and_test(&ref->refcount);
+#else
+		pthread_mutex_lock(&live_mutex);
+		last = mvp_atomic_dec_and_test(&ref->refcount);
+		pthread_mutex_unlock(&live_mutex);
+#endif
+		if (last) {
 			/*
 			 * Last reference, destroy the structure (if
 			 * there is a destroy function) and free the
@@ -580,7 +764,7 @@ ref_release(void *p)
 #endif /* DEBUG */
 			/* Remove its bytes */
 			total_bytecount -= ( sizeof(refcounter_t) + ref->length);
-			free(block);
+			ref_pool_free(block, ref->pool);
 		}
 		if (refcount < 0)
 			fprintf(stderr, "*** %s(): %p refcount %d ***\n",
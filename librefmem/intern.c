@@ -0,0 +1,175 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * intern.c -  Interned reference counted strings.  ref_strintern() hands
+ *             out one shared reference counted copy of each distinct
+ *             string that is currently in use, which saves a lot of
+ *             memory for values that repeat across many structures.
+ *
+ *             The table is a hash table with a lock for each group of
+ *             buckets, so lookups of unrelated strings rarely contend.
+ *             The table does not hold references to the strings it
+ *             contains.  Each interned string has a destroy function
+ *             which unlinks it from the table when its last reference
+ *             is released, and lookups skip strings which are on their
+ *             way out.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <refmem/refmem.h>
+#include <refmem_local.h>
+
+#define INTERN_BUCKETS	1024
+#define INTERN_LOCKS	32
+
+#define INTERN_ALIGN(n) (((n) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+/*
+ * The table entry for an interned string is stored in the same block as
+ * the string, just past its terminating NUL.
+ */
+struct intern_entry {
+	struct intern_entry *next;
+	char *str;
+	unsigned int hash;
+};
+
+static struct intern_entry *intern_table[INTERN_BUCKETS];
+static pthread_mutex_t intern_lock[INTERN_LOCKS];
+static pthread_once_t intern_once = PTHREAD_ONCE_INIT;
+
+static void
+intern_init(void)
+{
+	int i;
+
+	for (i = 0; i < INTERN_LOCKS; i++) {
+		pthread_mutex_init(&intern_lock[i], NULL);
+	}
+}
+
+static inline unsigned int
+intern_hash(const char *str, size_t *len)
+{
+	unsigned int hash = 2166136261u;
+	const unsigned char *p = (const unsigned char *)str;
+
+	while (*p) {
+		hash = (hash ^ *p++) * 16777619u;
+	}
+	*len = (const char *)p - str;
+
+	return hash;
+}
+
+static inline struct intern_entry *
+intern_entry(char *str, size_t len)
+{
+	return (struct intern_entry *)(str + INTERN_ALIGN(len + 1));
+}
+
+static void
+intern_destroy(void *p)
+{
+	char *str = p;
+	struct intern_entry **pp;
+	unsigned int hash;
+	size_t len;
+	pthread_mutex_t *lock;
+
+	hash = intern_hash(str, &len);
+	lock = &intern_lock[hash % INTERN_LOCKS];
+
+	pthread_mutex_lock(lock);
+	for (pp = &intern_table[hash % INTERN_BUCKETS]; *pp;
+	     pp = &(*pp)->next) {
+		if ((*pp)->str == str) {
+			*pp = (*pp)->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(lock);
+}
+
+/*
+ * ref_strintern(const char *str)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Return a reference counted copy of 'str' which is shared with every
+ * other caller interning the same string while it is held.  Two
+ * strings returned by ref_strintern() are equal exactly when the
+ * pointers are equal.  Interned strings must never be modified.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL pointer to a reference counted string which can
+ *          be released using ref_release().
+ *
+ * Failure: A NULL pointer.
+ */
+char *
+ref_strintern(const char *str)
+{
+	struct intern_entry *e;
+	unsigned int hash;
+	size_t len;
+	pthread_mutex_t *lock;
+	char *ret = NULL;
+
+	if (!str) {
+		return NULL;
+	}
+
+	pthread_once(&intern_once, intern_init);
+
+	hash = intern_hash(str, &len);
+	lock = &intern_lock[hash % INTERN_LOCKS];
+
+	pthread_mutex_lock(lock);
+	for (e = intern_table[hash % INTERN_BUCKETS]; e; e = e->next) {
+		if ((e->hash == hash) && (strcmp(e->str, str) == 0) &&
+		    ((ret = ref_hold_live(e->str)) != NULL)) {
+			break;
+		}
+	}
+	if (ret == NULL) {
+		ret = ref_alloc(INTERN_ALIGN(len + 1) + sizeof(*e));
+		if (ret) {
+			memcpy(ret, str, len + 1);
+			ref_set_destroy(ret, intern_destroy);
+			e = intern_entry(ret, len);
+			e->str = ret;
+			e->hash = hash;
+			e->next = intern_table[hash % INTERN_BUCKETS];
+			intern_table[hash % INTERN_BUCKETS] = e;
+		}
+	}
+	pthread_mutex_unlock(lock);
+
+	refmem_dbg(REF_DBG_DEBUG, "%s(%s) = %p\n", __FUNCTION__, str, ret);
+
+	return ret;
+}
@@ -0,0 +1,386 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * pool.c -    Size class pool used by ref_alloc() for small blocks.  Each
+ *             size class is carved out of 64k slabs obtained with
+ *             malloc().  Freed blocks go onto a small per-thread cache
+ *             first, and overflow onto a lock-free global free list for
+ *             their class.  The global lists are only ever pushed onto
+ *             or emptied as a whole, which keeps them safe from the ABA
+ *             problem without needing a double width compare and swap.
+ *
+ *             Slabs are never returned to the system.  The pool is
+ *             aimed at long running programs which repeatedly allocate
+ *             and release the same kinds of objects, so memory is
+ *             recycled rather than fragmented.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <refmem/refmem.h>
+#include <refmem/atomic.h>
+#include <refmem_local.h>
+
+#if defined(__GNUC__) && !defined(_WIN32)
+#define REF_POOL
+#include <pthread.h>
+#endif
+
+#define POOL_CLASSES	24
+#define POOL_MAX_SIZE	4096
+#define POOL_SLAB_SIZE	(64 * 1024)
+#define POOL_CACHE_MAX	256
+#define POOL_STATS_MAX	1024
+
+static volatile int pool_enabled;
+
+static mvp_atomic_t pool_slab_bytes;
+static mvp_atomic_t pool_hits;
+static mvp_atomic_t pool_frees;
+static mvp_atomic_t pool_misses;
+
+#if defined(REF_POOL)
+static const size_t pool_class_size[POOL_CLASSES] = {
+	32, 64, 96, 128, 160, 192, 224, 256,
+	320, 384, 448, 512, 640, 768, 896, 1024,
+	1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096
+};
+
+struct pool_free {
+	struct pool_free *next;
+};
+
+/*
+ * Allocations and frees are counted per thread and only added to the
+ * global statistics in batches, to keep shared cache lines out of the
+ * fast path.
+ */
+struct pool_cache {
+	struct pool_free *head[POOL_CLASSES];
+	int count[POOL_CLASSES];
+	unsigned int hits;
+	unsigned int frees;
+};
+
+static struct pool_free *volatile pool_list[POOL_CLASSES];
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static __thread struct pool_cache pool_cache;
+static __thread int pool_cache_init;
+
+static inline void
+pool_stats_flush(struct pool_cache *cache)
+{
+	__sync_fetch_and_add(&pool_hits, cache->hits);
+	__sync_fetch_and_add(&pool_frees, cache->frees);
+	cache->hits = 0;
+	cache->frees = 0;
+}
+
+/*
+ * Classes are 32 bytes apart up to 256 bytes, and then there are four
+ * classes for each power of two, so no more than a fifth of a block is
+ * wasted.
+ */
+static inline int
+pool_class(size_t size)
+{
+	int shift;
+
+	if (size <= 256) {
+		return (size - 1) >> 5;
+	}
+	if (size > POOL_MAX_SIZE) {
+		return -1;
+	}
+	shift = (sizeof(unsigned int) * 8 - 1) - __builtin_clz(size - 1);
+	return 8 + ((shift - 8) * 4) + (((size - 1) >> (shift - 2)) & 3);
+}
+
+/*
+ * Push the chain of free blocks from 'head' to 'tail' onto the global
+ * free list of class 'c'.
+ */
+static inline void
+pool_push(int c, struct pool_free *head, struct pool_free *tail)
+{
+	struct pool_free *old;
+
+	do {
+		old = pool_list[c];
+		tail->next = old;
+	} while (!__sync_bool_compare_and_swap(&pool_list[c], old, head));
+}
+
+/*
+ * Hand everything in a thread's cache back to the global free lists.
+ * This is called when a thread exits.
+ */
+static void
+pool_cache_flush(void *arg)
+{
+	struct pool_cache *cache = arg;
+	struct pool_free *tail;
+	int c;
+
+	for (c = 0; c < POOL_CLASSES; c++) {
+		if (!cache->head[c]) {
+			continue;
+		}
+		tail = cache->head[c];
+		while (tail->next) {
+			tail = tail->next;
+		}
+		pool_push(c, cache->head[c], tail);
+		cache->head[c] = NULL;
+		cache->count[c] = 0;
+	}
+	pool_stats_flush(cache);
+	pool_cache_init = 0;
+}
+
+static void
+pool_key_create(void)
+{
+	pthread_key_create(&pool_key, pool_cache_flush);
+}
+
+static inline struct pool_cache *
+pool_get_cache(void)
+{
+	if (!pool_cache_init) {
+		pthread_once(&pool_once, pool_key_create);
+		pthread_setspecific(pool_key, &pool_cache);
+		pool_cache_init = 1;
+	}
+	return &pool_cache;
+}
+
+/*
+ * Refill an empty cache for class 'c', either by taking the whole
+ * global free list or by carving up a new slab, and return one block.
+ */
+static void *
+pool_refill(struct pool_cache *cache, int c)
+{
+	struct pool_free *list, *p;
+	size_t size = pool_class_size[c];
+	unsigned char *slab;
+	int i, n;
+
+	list = __sync_lock_test_and_set(&pool_list[c], NULL);
+	if (list) {
+		n = 0;
+		for (p = list->next; p; p = p->next) {
+			n++;
+		}
+		cache->head[c] = list->next;
+		cache->count[c] = n;
+		return list;
+	}
+
+	slab = malloc(POOL_SLAB_SIZE);
+	if (!slab) {
+		return NULL;
+	}
+	__sync_fetch_and_add(&pool_slab_bytes, POOL_SLAB_SIZE);
+
+	n = POOL_SLAB_SIZE / size;
+	for (i = n - 1; i > 0; i--) {
+		p = (struct pool_free *)(slab + (i * size));
+		p->next = cache->head[c];
+		cache->head[c] = p;
+	}
+	cache->count[c] += n - 1;
+
+	return slab;
+}
+#endif /* REF_POOL */
+
+/*
+ * ref_pool_alloc(size_t size, unsigned int *pool)
+ *
+ * Scope: PRIVATE (mapped to __ref_pool_alloc)
+ *
+ * Description
+ *
+ * Allocate a block of at least 'size' bytes from the size class pool.
+ * The pool class of the block is stored in 'pool', and must be handed
+ * back to ref_pool_free() along with the block.
+ *
+ * Return Value:
+ *
+ * Success: A non-NULL pointer to a block of memory
+ *
+ * Failure: A NULL pointer, if the pool is disabled, the block is too
+ *          large for the pool, or memory could not be obtained.  The
+ *          caller should use malloc() instead.
+ */
+void *
+ref_pool_alloc(size_t size, unsigned int *pool)
+{
+#if defined(REF_POOL)
+	struct pool_cache *cache;
+	struct pool_free *p;
+	int c;
+
+	*pool = 0;
+	if (!pool_enabled) {
+		return NULL;
+	}
+	if ((c = pool_class(size)) < 0) {
+		mvp_atomic_inc(&pool_misses);
+		return NULL;
+	}
+
+	cache = pool_get_cache();
+	if ((p = cache->head[c]) != NULL) {
+		cache->head[c] = p->next;
+		cache->count[c]--;
+	} else if ((p = pool_refill(cache, c)) == NULL) {
+		mvp_atomic_inc(&pool_misses);
+		return NULL;
+	}
+
+	if (++cache->hits >= POOL_STATS_MAX) {
+		pool_stats_flush(cache);
+	}
+	*pool = c + 1;
+
+	return p;
+#else
+	*pool = 0;
+	return NULL;
+#endif /* REF_POOL */
+}
+
+/*
+ * ref_pool_free(void *block, unsigned int pool)
+ *
+ * Scope: PRIVATE (mapped to __ref_pool_free)
+ *
+ * Description
+ *
+ * Release a block obtained from ref_pool_alloc() with pool class
+ * 'pool'.  A 'pool' of 0 means the block came from malloc(), and it is
+ * simply freed.
+ *
+ * Return Value: NONE
+ */
+void
+ref_pool_free(void *block, unsigned int pool)
+{
+#if defined(REF_POOL)
+	struct pool_cache *cache;
+	struct pool_free *p = block, *tail;
+	int c = pool - 1;
+	int i;
+
+	if (pool == 0) {
+		free(block);
+		return;
+	}
+
+	cache = pool_get_cache();
+	p->next = cache->head[c];
+	cache->head[c] = p;
+
+	if (++cache->count[c] > POOL_CACHE_MAX) {
+		/*
+		 * Give half of the cache to other threads.
+		 */
+		tail = p;
+		for (i = 1; i < POOL_CACHE_MAX / 2; i++) {
+			tail = tail->next;
+		}
+		cache->head[c] = tail->next;
+		cache->count[c] -= POOL_CACHE_MAX / 2;
+		pool_push(c, p, tail);
+	}
+
+	if (++cache->frees >= POOL_STATS_MAX) {
+		pool_stats_flush(cache);
+	}
+#else
+	free(block);
+#endif /* REF_POOL */
+}
+
+/*
+ * ref_pool_enable(int enable)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Turn the size class pool used by ref_alloc() on or off.  The pool
+ * is off by default.  This only affects new allocations, blocks can
+ * always be released no matter where they came from.
+ *
+ * Return Value: NONE
+ */
+void
+ref_pool_enable(int enable)
+{
+	pool_enabled = enable;
+}
+
+/*
+ * ref_get_pool_usage(unsigned int *slab_bytes, unsigned int *in_use,
+ *                    unsigned int *hits, unsigned int *misses)
+ *
+ * Scope: PUBLIC
+ *
+ * Description
+ *
+ * Retrieve the size class pool statistics: the number of bytes
+ * obtained from the system for slabs, the number of pool blocks
+ * currently in use, the number of allocations served by the pool, and
+ * the number of allocations that fell back to malloc() while the pool
+ * was enabled.  Any of the pointers may be NULL.  Threads report their
+ * activity in batches, so the numbers may lag slightly behind.
+ *
+ * Return Value: NONE
+ */
+void
+ref_get_pool_usage(unsigned int *slab_bytes, unsigned int *in_use,
+		   unsigned int *hits, unsigned int *misses)
+{
+	unsigned int h, f;
+
+	/*
+	 * A block may be freed by a thread which flushes its counts before
+	 * the thread which allocated it does, so frees can run ahead of
+	 * hits for a while.  The difference is taken as signed, since the
+	 * counters themselves may wrap.
+	 */
+	f = pool_frees;
+	h = pool_hits;
+
+	if (slab_bytes)
+		*slab_bytes = pool_slab_bytes;
+	if (in_use)
+		*in_use = ((int)(h - f) > 0) ? h - f : 0;
+	if (hits)
+		*hits = h;
+	if (misses)
+		*misses = pool_misses;
+}
@@ -22,4 +22,13 @@
 
 void refmem_dbg(int level, char *fmt, ...);
 
+/*
+ * From pool.c
+ */
+#define ref_pool_alloc __ref_pool_alloc
+extern void *ref_pool_alloc(size_t size, unsigned int *pool);
+
+#define ref_pool_free __ref_pool_free
+extern void ref_pool_free(void *block, unsigned int pool);
+
 #endif /* __REFMEM_LOCAL_H */
@@ -0,0 +1,173 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * proglist_bench.c - Measure the cost of decoding a large program list.
+ *
+ *                    A synthetic protocol 77 program list is written to
+ *                    a socket pair and decoded with cmyth_rcv_proglist().
+ *                    The number of malloc() calls and the wall time of
+ *                    the decode, and the wall time of releasing the
+ *                    list, are reported.  malloc() is counted with the
+ *                    linker's --wrap option, so this needs GNU ld:
+ *
+ *                    gcc -Iinclude -Ilibcmyth -o proglist_bench \
+ *                        scripts/proglist_bench.c libcmyth/libcmyth.a \
+ *                        librefmem/librefmem.a -lpthread \
+ *                        -Wl,--wrap=malloc
+ *
+ *                    ./proglist_bench [programs]
+ *
+ *                    To compare two versions of the library, build it
+ *                    against each of them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <cmyth_local.h>
+
+static long mallocs;
+
+void *__real_malloc(size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&mallocs, 1);
+	return __real_malloc(size);
+}
+
+struct message {
+	int fd;
+	char *buf;
+	int len;
+};
+
+static double
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * Build a program list of 'count' programs, each with the 44 fields of
+ * protocol 77.
+ */
+static int
+make_proglist(char *buf, int count)
+{
+	int i, len;
+
+	len = sprintf(buf, "%d", count);
+	for (i = 0; i < count; i++) {
+		len += sprintf(buf + len,
+			"[]:[]Some Title %d[]:[]Episode Subtitle"
+			"[]:[]A fairly long description of the program "
+			"that goes on for a while, number %d."
+			"[]:[]3[]:[]%d[]:[][]:[]Drama[]:[]1%03d[]:[]%d"
+			"[]:[]KXYZ[]:[]icon.png"
+			"[]:[]myth://backend:6543/1%03d_2014010%d.mpg"
+			"[]:[]%d[]:[]1389000000[]:[]1389003600[]:[]0"
+			"[]:[]backend[]:[]1[]:[]1[]:[]1[]:[]0[]:[]-3"
+			"[]:[]12[]:[]1[]:[]15[]:[]6[]:[]1389000000"
+			"[]:[]1389003600[]:[]0[]:[]Default[]:[][]:[]EP0001"
+			"[]:[]EP000100%d[]:[][]:[]1389003700[]:[]0.75"
+			"[]:[]2013-05-06[]:[]Default[]:[]0[]:[]0"
+			"[]:[]Default[]:[]1[]:[]2[]:[]0[]:[]2013[]:[]0"
+			"[]:[]0",
+			i, i, i % 20, i % 1000, i % 100, i % 1000, i % 9,
+			1000000 + i, i);
+	}
+
+	return len;
+}
+
+static void *
+writer(void *arg)
+{
+	struct message *m = (struct message*)arg;
+	int off = 0, r;
+
+	while (off < m->len) {
+		if ((r = write(m->fd, m->buf + off, m->len - off)) <= 0) {
+			break;
+		}
+		off += r;
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	int count = (argc > 1) ? atoi(argv[1]) : 20000;
+	struct message m;
+	struct cmyth_conn *conn;
+	cmyth_proglist_t pl;
+	pthread_t thread;
+	double t0, t1, t2;
+	long m0, m1;
+	int sv[2], err = 0, n;
+
+	m.buf = malloc((size_t)count * 700 + 100);
+	m.len = make_proglist(m.buf, count);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	m.fd = sv[1];
+	pthread_create(&thread, NULL, writer, &m);
+
+	conn = calloc(1, sizeof(*conn));
+	conn->conn_fd = sv[0];
+	conn->conn_buflen = 4096;
+	conn->conn_buf = malloc(conn->conn_buflen);
+	conn->conn_version = 77;
+	conn->conn_timeout = 10000;
+
+	pl = cmyth_proglist_create();
+
+	m0 = mallocs;
+	t0 = now_ms();
+	cmyth_rcv_proglist(conn, &err, pl, m.len);
+	t1 = now_ms();
+	m1 = mallocs;
+	n = cmyth_proglist_get_count(pl);
+	ref_release(pl);
+	t2 = now_ms();
+
+	pthread_join(thread, NULL);
+
+	printf("programs decoded   %d (err %d)\n", n, err);
+	printf("mallocs in decode  %ld (%.1f per program)\n",
+	       m1 - m0, (double)(m1 - m0) / count);
+	printf("decode wall time   %.1f ms\n", t1 - t0);
+	printf("release wall time  %.1f ms\n", t2 - t1);
+
+	return (n == count) ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/*
+ *  Copyright (C) 2014, mvpmc.org
+ *  http://www.mvpmc.org/
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * rcv_string_fuzz.c - Differential test of cmyth_rcv_string() against the
+ *                     original byte at a time implementation, which is
+ *                     kept here as the reference.
+ *
+ *                     Random messages made mostly of separator characters
+ *                     are written to two socket pairs, and read back
+ *                     token by token, through both implementations, with
+ *                     the same random output buffer sizes.  Connection
+ *                     buffers are kept small so that tokens and
+ *                     separators are split across refills.  The bytes
+ *                     consumed, the error, the output buffer and the
+ *                     connection buffer state must all be the same.
+ *
+ *                     Build it after the libraries have been built:
+ *
+ *                     gcc -Iinclude -Ilibcmyth -o rcv_string_fuzz \
+ *                         scripts/rcv_string_fuzz.c libcmyth/libcmyth.a \
+ *                         librefmem/librefmem.a -lpthread
+ *
+ *                     and run it with an optional number of rounds and
+ *                     random seed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <cmyth_local.h>
+
+#define MSG_MAX		4096
+#define OUT_MAX		64
+
+/*
+ * The refill of libcmyth/socket.c, without the wait for data, which is
+ * always there already.
+ */
+static int
+ref_refill(cmyth_conn_t conn, int len)
+{
+	int r, total = 0;
+	unsigned char *p = conn->conn_buf;
+
+	if (len > conn->conn_buflen) {
+		len = conn->conn_buflen;
+	}
+	while (len > 0) {
+		r = recv(conn->conn_fd, p, len, 0);
+		if (r <= 0) {
+			if (total == 0) {
+				return -EIO;
+			}
+			break;
+		}
+		total += r;
+		len -= r;
+		p += r;
+	}
+	conn->conn_pos = 0;
+	conn->conn_len = total;
+	return 0;
+}
+
+/*
+ * The original cmyth_rcv_string(), with the argument checks left out.
+ */
+static int
+ref_rcv_string(cmyth_conn_t conn, int *err, char *buf, int buflen, int count)
+{
+	static char separator[] = "[]:[]";
+	int consumed = 0;
+	int placed = 0;
+	char *state = separator;
+	char *sep_start = NULL;
+
+	*err = 0;
+	while (1) {
+		if (consumed >= count) {
+			conn->conn_pos = conn->conn_len = 0;
+			if (buflen > placed) {
+				buf[placed] = '\0';
+			}
+			break;
+		}
+		if (conn->conn_pos >= conn->conn_len) {
+			*err = ref_refill(conn, count - consumed);
+			if (*err < 0) {
+				*err = -1 * (*err);
+				break;
+			}
+		}
+		if (conn->conn_buf[conn->conn_pos] == (unsigned char)*state) {
+			if ((state == separator) && (placed < buflen)) {
+				sep_start = &buf[placed];
+			}
+			++state;
+		} else {
+			sep_start = NULL;
+			state = separator;
+		}
+		if (placed < buflen) {
+			buf[placed++] = conn->conn_buf[conn->conn_pos];
+		}
+		++conn->conn_pos;
+		++consumed;
+		if (*state == '\0') {
+			if (sep_start) {
+				*sep_start = '\0';
+			} else if (buflen > placed) {
+				buf[placed] = '\0';
+			}
+			break;
+		}
+	}
+	return consumed;
+}
+
+static cmyth_conn_t
+make_conn(int fd, int buflen)
+{
+	cmyth_conn_t conn;
+
+	conn = ref_alloc(sizeof(*conn));
+	memset(conn, 0, sizeof(*conn));
+	conn->conn_fd = fd;
+	conn->conn_buflen = buflen;
+	conn->conn_buf = malloc(buflen);
+	conn->conn_timeout = 1000;
+	pthread_mutex_init(&conn->conn_mutex, NULL);
+	return conn;
+}
+
+static void
+free_conn(cmyth_conn_t conn)
+{
+	close(conn->conn_fd);
+	free(conn->conn_buf);
+	conn->conn_buf = NULL;
+	conn->conn_fd = -1;
+	ref_release(conn);
+}
+
+/*
+ * Fill 'msg' with 'len' bytes, mostly taken from separators and pieces
+ * of them.
+ */
+static void
+make_message(char *msg, int len)
+{
+	static const char *pieces[] = {
+		"[]:[]", "[", "]", ":", "[]", "[]:", "[]:[", "]:[]", "[[]:[]",
+		"[]:[]:[]", "x", "abc", "[]::[]",
+	};
+	int i = 0, n;
+	const char *p;
+
+	while (i < len) {
+		if (random() % 4 == 0) {
+			msg[i++] = (char)(random() % 256);
+			continue;
+		}
+		p = pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+		n = strlen(p);
+		if (n > len - i) {
+			n = len - i;
+		}
+		memcpy(msg + i, p, n);
+		i += n;
+	}
+}
+
+static int
+round_trip(int round)
+{
+	static char msg[MSG_MAX];
+	char out_new[OUT_MAX + 8], out_ref[OUT_MAX + 8];
+	cmyth_conn_t c_new, c_ref;
+	int p_new[2], p_ref[2];
+	int len, buflen, left, outlen;
+	int r_new, r_ref, e_new, e_ref;
+	int ret = 0;
+
+	len = random() % MSG_MAX;
+	buflen = 1 + random() % 32;
+	make_message(msg, len);
+
+	if ((socketpair(AF_UNIX, SOCK_STREAM, 0, p_new) < 0) ||
+	    (socketpair(AF_UNIX, SOCK_STREAM, 0, p_ref) < 0)) {
+		perror("socketpair");
+		exit(2);
+	}
+	if ((write(p_new[1], msg, len) != len) ||
+	    (write(p_ref[1], msg, len) != len)) {
+		perror("write");
+		exit(2);
+	}
+	close(p_new[1]);
+	close(p_ref[1]);
+	c_new = make_conn(p_new[0], buflen);
+	c_ref = make_conn(p_ref[0], buflen);
+
+	for (left = len; left > 0; left -= r_new) {
+		outlen = random() % OUT_MAX;
+		memset(out_new, 0x55, sizeof(out_new));
+		memset(out_ref, 0x55, sizeof(out_ref));
+		r_new = cmyth_rcv_string(c_new, &e_new, out_new, outlen, left);
+		r_ref = ref_rcv_string(c_ref, &e_ref, out_ref, outlen, left);
+		if ((r_new != r_ref) || (e_new != e_ref) ||
+		    (memcmp(out_new, out_ref, sizeof(out_new)) != 0) ||
+		    (c_new->conn_pos != c_ref->conn_pos) ||
+		    (c_new->conn_len != c_ref->conn_len)) {
+			printf("round %d: mismatch at offset %d (buflen %d, "
+			       "outlen %d): consumed %d/%d err %d/%d\n",
+			       round, len - left, buflen, outlen,
+			       r_new, r_ref, e_new, e_ref);
+			ret = 1;
+			break;
+		}
+		if (r_new == 0) {
+			break;
+		}
+	}
+
+	free_conn(c_new);
+	free_conn(c_ref);
+
+	return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+	int rounds = (argc > 1) ? atoi(argv[1]) : 10000;
+	unsigned int seed = (argc > 2) ? atoi(argv[2]) : getpid();
+	int i, failed = 0;
+
+	srandom(seed);
+	for (i = 0; i < rounds; i++) {
+		failed += round_trip(i);
+	}
+	printf("%d rounds, seed %u, %d failed\n", rounds, seed, failed);
+
+	return failed ? 1 : 0;
+}
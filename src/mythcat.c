@@ -61,52 +61,6 @@ is_alive(char *host)
 	return 1;
 }
 
-static int
-fill_buffer(cmyth_file_t file, char *buf, size_t size)
-{
-	int tot, len, n = 0;
-
-	tot = 0;
-	len = cmyth_file_request_block(file, size);
-	while (tot < len) {
-		n = cmyth_file_get_block(file, buf+tot, len-tot);
-		if (n > 0) {
-			tot += n;
-		}
-		if (n < 0) {
-			return -1;
-		}
-	}
-
-	if (len < 0) {
-		return -1;
-	}
-
-	return tot;
-}
-
-static int
-write_buffer(int fd, char *buf, int len)
-{
-	int tot = 0, n;
-
-	while (tot < len) {
-		n = write(fd, buf+tot, len-tot);
-		if (n > 0) {
-			tot += n;
-		}
-		if (n <= 0) {
-			return -1;
-		}
-	}
-
-	if (len < 0) {
-		return -1;
-	}
-
-	return 0;
-}
-
 static int
 dump_prog(cmyth_proginfo_t prog, int thumbnail)
 {
@@ -156,27 +110,9 @@ dump_prog(cmyth_proginfo_t prog, int thumbnail)
 
 	fd = fileno(stdout);
 
-	cur = 0;
-	while (cur < len) {
-		char buf[MAX_BSIZE];
-		int n;
-
-		if (cmyth_file_seek(f, cur, SEEK_SET) != cur) {
-			break;
-		}
-
-		n = fill_buffer(f, buf, sizeof(buf));
-
-		if (n <= 0) {
-			break;
-		}
+	fflush(stdout);
 
-		if (write_buffer(fd, buf, n) != 0) {
-			break;
-		}
-
-		cur += n;
-	}
+	cur = cmyth_file_copy_to_fd(f, fd, 0, thumbnail ? -1 : len);
 
 	ref_release(f);
 
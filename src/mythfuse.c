@@ -40,20 +40,66 @@
 #define MAX_BSIZE	(128*1024)
 #define MIN_BSIZE	(1024*2)
 
-struct prog_map {
+#define CONTROL_POOL_SIZE	4
+
+/*
+ * After SEQ_READS reads in a row that each start where the last one
+ * ended, the file is being streamed, so read-ahead is turned on for it
+ * with PREFETCH_DEPTH blocks in flight.  A read anywhere else turns it
+ * off again.
+ */
+#define SEQ_READS		2
+#define PREFETCH_DEPTH		4
+
+#define INDEX_HASH_SIZE		1024
+
+/*
+ * Recordings with the same title and subtitle share a group, which hands
+ * out the suffixes that tell their names apart in the all directory.
+ */
+struct prog_group {
+	char *title;
+	char *subtitle;
+	unsigned int suffix;	/* next suffix to hand out */
+	int count;
+	struct prog_group *next;
+};
+
+struct prog_entry {
 	cmyth_proginfo_t prog;
-	unsigned int suffix;
+	char *pathname;		/* the name in files is pathname+1 */
+	char *link;		/* the name in all */
+	long chanid;
+	time_t start;
+	struct prog_group *group;
+	struct prog_entry *file_next;
+	struct prog_entry *link_next;
+};
+
+/*
+ * The recordings of a backend.  Entries are kept in the order of the
+ * recording list for readdir, and hashed by both of their names for
+ * lookups.  It is built once from the recording list and then kept up
+ * to date from RECORDING_LIST_CHANGE ADD and DELETE events.  Protected
+ * by the global mutex.
+ */
+struct prog_index {
+	struct prog_entry **entries;
+	int count;
+	int max;
+	struct prog_entry *files[INDEX_HASH_SIZE];
+	struct prog_entry *links[INDEX_HASH_SIZE];
+	struct prog_group *groups[INDEX_HASH_SIZE];
 };
 
 struct myth_conn {
 	char *host;
-	cmyth_conn_t control;
-	cmyth_conn_t event;
-	cmyth_proglist_t list;
-	pthread_t thread;
+	cmyth_conn_pool_t pool;
+	cmyth_event_sub_t event;
+	struct prog_index *index;
+	unsigned long gen;	/* bumped when index changes hands */
+	int fetching;		/* index is being built */
 	int used;
-	struct prog_map *progs;
-	int nprogs;
 };
 
 struct path_info {
@@ -62,13 +108,23 @@ struct path_info {
 	char *file;
 };
 
+/*
+ * An open file.  buf holds the n bytes of the file from start that were
+ * read last, so that reads which arrive a little out of order do not
+ * cost a seek.  offset is the position of the backend.  Everything but
+ * used is protected by mutex, so that reads of different files run in
+ * parallel.
+ */
 struct file_info {
+	pthread_mutex_t mutex;
 	cmyth_file_t file;
 	off_t offset;
 	struct path_info *info;
 	char *buf;
 	size_t n;
 	off_t start;
+	int seq;		/* sequential reads in a row */
+	int prefetch;		/* read-ahead is on */
 	int used;
 };
 
@@ -91,6 +147,7 @@ static int tcp_program = 128*1024;
 static int port = 6543;
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t index_cond = PTHREAD_COND_INITIALIZER;
 
 static int rd_files(struct path_info*, void*, fuse_fill_dir_t, off_t,
 		    struct fuse_file_info*);
@@ -138,108 +195,455 @@ free_info(struct path_info *info)
 	free(info->file);
 }
 
+static unsigned int
+hash_string(const char *s, unsigned int h)
+{
+	while (*s) {
+		h = (h * 31) + (unsigned char)*s++;
+	}
+
+	return h;
+}
+
+static void
+index_destroy(struct prog_index *idx)
+{
+	struct prog_group *g, *next;
+	int i;
+
+	if (idx == NULL) {
+		return;
+	}
+
+	for (i=0; i<idx->count; i++) {
+		ref_release(idx->entries[i]->prog);
+		ref_release(idx->entries[i]->pathname);
+		ref_release(idx->entries[i]->link);
+		free(idx->entries[i]);
+	}
+	for (i=0; i<INDEX_HASH_SIZE; i++) {
+		for (g=idx->groups[i]; g; g=next) {
+			next = g->next;
+			ref_release(g->title);
+			ref_release(g->subtitle);
+			free(g);
+		}
+	}
+	free(idx->entries);
+	free(idx);
+}
+
+static struct prog_entry*
+index_file(struct prog_index *idx, const char *file)
+{
+	struct prog_entry *e;
+
+	e = idx->files[hash_string(file, 0) % INDEX_HASH_SIZE];
+	while (e && (strcmp(e->pathname+1, file) != 0)) {
+		e = e->file_next;
+	}
+
+	return e;
+}
+
+static struct prog_entry*
+index_link(struct prog_index *idx, const char *link)
+{
+	struct prog_entry *e;
+
+	e = idx->links[hash_string(link, 0) % INDEX_HASH_SIZE];
+	while (e && (strcmp(e->link, link) != 0)) {
+		e = e->link_next;
+	}
+
+	return e;
+}
+
+static struct prog_group*
+index_group(struct prog_index *idx, char *title, char *subtitle)
+{
+	struct prog_group *g;
+	unsigned int h;
+
+	h = hash_string(subtitle, hash_string(title, 0)) % INDEX_HASH_SIZE;
+
+	for (g=idx->groups[h]; g; g=g->next) {
+		if ((strcmp(g->title, title) == 0) &&
+		    (strcmp(g->subtitle, subtitle) == 0)) {
+			return g;
+		}
+	}
+
+	if ((g=calloc(1, sizeof(*g))) == NULL) {
+		return NULL;
+	}
+	g->title = ref_hold(title);
+	g->subtitle = ref_hold(subtitle);
+	g->next = idx->groups[h];
+	idx->groups[h] = g;
+
+	return g;
+}
+
+/*
+ * Add a recording to the index, unless it is already there.  Its link
+ * gets the next suffix of its group, so the names of the recordings
+ * already listed never change.
+ */
+static int
+index_add(struct prog_index *idx, cmyth_proginfo_t prog)
+{
+	struct prog_entry *e = NULL, **entries;
+	struct prog_group *g;
+	cmyth_timestamp_t ts;
+	char *title, *subtitle, *pn;
+	unsigned int h;
+	int ret = -1;
+
+	title = cmyth_proginfo_title(prog);
+	subtitle = cmyth_proginfo_subtitle(prog);
+	pn = cmyth_proginfo_pathname(prog);
+
+	if ((title == NULL) || (subtitle == NULL) || (pn == NULL)) {
+		goto out;
+	}
+
+	if (index_file(idx, pn+1)) {
+		ret = 0;
+		goto out;
+	}
+
+	if (idx->count == idx->max) {
+		int max = (idx->max == 0) ? 64 : idx->max * 2;
+
+		entries = realloc(idx->entries, max * sizeof(*entries));
+		if (entries == NULL) {
+			goto out;
+		}
+		idx->entries = entries;
+		idx->max = max;
+	}
+
+	if ((g=index_group(idx, title, subtitle)) == NULL) {
+		goto out;
+	}
+	if ((e=calloc(1, sizeof(*e))) == NULL) {
+		goto out;
+	}
+
+	if (g->suffix == 0) {
+		e->link = ref_sprintf("%s - %s.nuv", title, subtitle);
+	} else {
+		e->link = ref_sprintf("%s - %s (%d).nuv", title, subtitle,
+				      g->suffix);
+	}
+	if (e->link == NULL) {
+		free(e);
+		goto out;
+	}
+	g->suffix++;
+	g->count++;
+
+	e->prog = ref_hold(prog);
+	e->pathname = ref_hold(pn);
+	e->group = g;
+	e->chanid = cmyth_proginfo_chan_id(prog);
+	if ((ts=cmyth_proginfo_rec_start(prog)) != NULL) {
+		e->start = cmyth_timestamp_to_unixtime(ts);
+		ref_release(ts);
+	}
+
+	h = hash_string(pn+1, 0) % INDEX_HASH_SIZE;
+	e->file_next = idx->files[h];
+	idx->files[h] = e;
+
+	h = hash_string(e->link, 0) % INDEX_HASH_SIZE;
+	e->link_next = idx->links[h];
+	idx->links[h] = e;
+
+	idx->entries[idx->count++] = e;
+
+	ret = 0;
+
+out:
+	ref_release(title);
+	ref_release(subtitle);
+	ref_release(pn);
+
+	return ret;
+}
+
+/*
+ * Remove the recording made on 'chanid' at 'start' from the index.
+ */
 static void
-parse_progs(struct myth_conn *c)
+index_remove(struct prog_index *idx, long chanid, time_t start)
+{
+	struct prog_entry *e = NULL, **p;
+	struct prog_group *g, **gp;
+	unsigned int h;
+	int i;
+
+	for (i=0; i<idx->count; i++) {
+		if ((idx->entries[i]->chanid == chanid) &&
+		    (idx->entries[i]->start == start)) {
+			e = idx->entries[i];
+			break;
+		}
+	}
+	if (e == NULL) {
+		return;
+	}
+
+	memmove(idx->entries+i, idx->entries+i+1,
+		(idx->count - i - 1) * sizeof(*idx->entries));
+	idx->count--;
+
+	h = hash_string(e->pathname+1, 0) % INDEX_HASH_SIZE;
+	for (p=&idx->files[h]; *p!=e; p=&(*p)->file_next)
+		;
+	*p = e->file_next;
+
+	h = hash_string(e->link, 0) % INDEX_HASH_SIZE;
+	for (p=&idx->links[h]; *p!=e; p=&(*p)->link_next)
+		;
+	*p = e->link_next;
+
+	g = e->group;
+	if (--g->count == 0) {
+		h = hash_string(g->subtitle, hash_string(g->title, 0)) %
+			INDEX_HASH_SIZE;
+		for (gp=&idx->groups[h]; *gp!=g; gp=&(*gp)->next)
+			;
+		*gp = g->next;
+		ref_release(g->title);
+		ref_release(g->subtitle);
+		free(g);
+	}
+
+	ref_release(e->prog);
+	ref_release(e->pathname);
+	ref_release(e->link);
+	free(e);
+}
+
+static struct prog_index*
+index_build(cmyth_proglist_t list)
 {
-	int i, j, count;
-	struct prog_map *progs;
+	struct prog_index *idx;
+	cmyth_proginfo_t prog;
+	int i, count;
+
+	if (list == NULL) {
+		return NULL;
+	}
 
-	count = cmyth_proglist_get_count(c->list);
+	if ((idx=calloc(1, sizeof(*idx))) == NULL) {
+		return NULL;
+	}
 
-	progs = ref_alloc(sizeof(*progs)*count);
+	count = cmyth_proglist_get_count(list);
 
 	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
-		char *title, *subtitle;
-		prog = cmyth_proglist_get_item(c->list, i);
-		title = cmyth_proginfo_title(prog);
-		subtitle = cmyth_proginfo_subtitle(prog);
-		progs[i].prog = ref_hold(prog);
-		progs[i].suffix = 0;
-		for (j=0; j<i; j++) {
-			char *t, *s;
-			t = cmyth_proginfo_title(progs[j].prog);
-			s = cmyth_proginfo_subtitle(progs[j].prog);
-			if ((strcmp(title, t) == 0) &&
-			    (strcmp(subtitle, s) == 0)) {
-				progs[i].suffix++;
-			}
-			ref_release(t);
-			ref_release(s);
+		prog = cmyth_proglist_get_item(list, i);
+		if (index_add(idx, prog) < 0) {
+			debug("%s(): failed to add recording %d\n",
+			      __FUNCTION__, i);
 		}
-		ref_release(title);
-		ref_release(subtitle);
 		ref_release(prog);
 	}
 
-	for (i=0; i<c->nprogs; i++) {
-		ref_release(c->progs[i].prog);
-	}
-	ref_release(c->progs);
-	c->progs = progs;
+	return idx;
 }
 
-static void*
-event_loop(void *arg)
+static cmyth_proglist_t
+get_recorded(struct myth_conn *c)
 {
-	intptr_t i = (intptr_t)arg;
-	char buf[128];
-	cmyth_event_t next;
-	int done = 0;
-	cmyth_conn_t event;
 	cmyth_conn_t control;
 	cmyth_proglist_t list;
 
-	debug("%s(): event loop started\n", __FUNCTION__);
+	if ((control=cmyth_conn_pool_get(c->pool)) == NULL) {
+		return NULL;
+	}
 
-	pthread_mutex_lock(&mutex);
+	list = cmyth_proglist_get_all_recorded(control);
+
+	cmyth_conn_pool_put(c->pool, control);
+
+	return list;
+}
+
+/*
+ * Get the index of a backend, fetching the recording list the first time
+ * it is needed.  Called with the global mutex held, which is dropped
+ * while the index is built so that other backends and open files are
+ * not held up by the fetch.  Other threads wanting the index meanwhile
+ * wait for it rather than fetching it too.
+ */
+static struct prog_index*
+get_index(struct myth_conn *c)
+{
+	cmyth_proglist_t list;
+	struct prog_index *idx;
+	unsigned long gen;
 
-	pthread_detach(pthread_self());
+	while (c->index == NULL) {
+		if (c->fetching) {
+			pthread_cond_wait(&index_cond, &mutex);
+			continue;
+		}
 
-	if (!conn[i].used) {
+		c->fetching = 1;
+		gen = c->gen;
 		pthread_mutex_unlock(&mutex);
-		return NULL;
+
+		list = get_recorded(c);
+		idx = index_build(list);
+		ref_release(list);
+
+		pthread_mutex_lock(&mutex);
+		c->fetching = 0;
+		pthread_cond_broadcast(&index_cond);
+
+		if (idx == NULL) {
+			break;
+		}
+
+		/*
+		 * If the index was replaced or dropped during the fetch,
+		 * the list fetched may be out of date.
+		 */
+		if ((c->index != NULL) || (c->gen != gen)) {
+			index_destroy(idx);
+			continue;
+		}
+
+		c->index = idx;
 	}
 
-	event = conn[i].event;
-	control = conn[i].control;
-	list = conn[i].list;
+	return c->index;
+}
+
+/*
+ * Fetch the whole recording list again, without holding the global
+ * mutex while waiting for the backend.
+ */
+static void
+refresh_index(struct myth_conn *c)
+{
+	cmyth_proglist_t list;
+	struct prog_index *idx, *old;
+
+	list = get_recorded(c);
+	idx = index_build(list);
+	ref_release(list);
 
+	pthread_mutex_lock(&mutex);
+	old = c->index;
+	c->index = idx;
+	c->gen++;
 	pthread_mutex_unlock(&mutex);
 
-	while (!done) {
-		next = cmyth_event_get(event, buf, 128);
+	index_destroy(old);
+}
 
-		pthread_mutex_lock(&mutex);
+/*
+ * Apply a RECORDING_LIST_CHANGE ADD or DELETE event to the index.  A new
+ * recording is fetched on its own, rather than with the whole list.
+ */
+static int
+update_index(struct myth_conn *c, cmyth_event_t next, char *data)
+{
+	cmyth_conn_t control;
+	cmyth_proginfo_t prog = NULL;
+	char recstart[64];
+	long chanid;
+	time_t start;
+	int ret = 0;
 
-		switch (next) {
-		case CMYTH_EVENT_CLOSE:
-			ref_release(control);
-			ref_release(list);
-			ref_release(event);
-			done = 1;
-			break;
-		case CMYTH_EVENT_RECORDING_LIST_CHANGE:
-			ref_release(list);
-			list = cmyth_proglist_get_all_recorded(control);
-			conn[i].list = list;
-			parse_progs(conn+i);
-			break;
-		default:
-			break;
+	if (cmyth_timeslot_parse(data, &chanid, recstart, sizeof(recstart),
+				 &start, NULL) < 0) {
+		debug("%s(): bad event data '%s'\n", __FUNCTION__, data);
+		return -1;
+	}
+
+	if (next == CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD) {
+		if ((control=cmyth_conn_pool_get(c->pool)) == NULL) {
+			return -1;
 		}
+		prog = cmyth_proginfo_get_from_timeslot(control, chanid,
+							recstart);
+		cmyth_conn_pool_put(c->pool, control);
+		if (prog == NULL) {
+			return -1;
+		}
+	}
 
-		pthread_mutex_unlock(&mutex);
+	pthread_mutex_lock(&mutex);
+	if (c->index) {
+		if (prog) {
+			ret = index_add(c->index, prog);
+		} else {
+			index_remove(c->index, chanid, start);
+		}
+	} else {
+		c->gen++;
 	}
+	pthread_mutex_unlock(&mutex);
 
-	return NULL;
+	ref_release(prog);
+
+	return ret;
+}
+
+/*
+ * Called by the event dispatcher of libcmyth, which is shared with
+ * anything else in the process that wants the events of the backend.
+ * When the event connection is lost, events may have been missed, so
+ * the index is dropped and built again when it is next needed.
+ */
+static void
+event_callback(cmyth_event_sub_t sub, cmyth_eventinfo_t ev, void *arg)
+{
+	intptr_t i = (intptr_t)arg;
+	cmyth_event_t next = cmyth_eventinfo_type(ev);
+	struct prog_index *old;
+	char *data;
+
+	switch (next) {
+	case CMYTH_EVENT_CLOSE:
+	case CMYTH_EVENT_ERROR:
+		pthread_mutex_lock(&mutex);
+		old = conn[i].index;
+		conn[i].index = NULL;
+		conn[i].gen++;
+		pthread_mutex_unlock(&mutex);
+		index_destroy(old);
+		break;
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE:
+		refresh_index(conn+i);
+		break;
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD:
+	case CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE:
+		data = cmyth_eventinfo_data(ev);
+		if ((data == NULL) || (update_index(conn+i, next, data) < 0)) {
+			refresh_index(conn+i);
+		}
+		ref_release(data);
+		break;
+	default:
+		break;
+	}
 }
 
 static int
 lookup_server(char *host)
 {
 	intptr_t i, j = -1;
-	cmyth_conn_t control, event;
+	cmyth_conn_pool_t pool;
+	cmyth_conn_t control;
+	cmyth_event_sub_t event;
+	unsigned long mask;
 
 	debug("%s(): host '%s'\n", __FUNCTION__, host);
 
@@ -261,25 +665,36 @@ lookup_server(char *host)
 	}
 
 	if (i == MAX_CONN) {
-		if ((control=cmyth_conn_connect_ctrl(host, port, 16*1024,
-						     tcp_control)) == NULL) {
+		if ((pool=cmyth_conn_pool_create(host, port, 16*1024,
+						 tcp_control,
+						 CONTROL_POOL_SIZE)) == NULL) {
+			debug("%s(): error at %d\n", __FUNCTION__, __LINE__);
+			conn[j].used = 0;
+			return -1;
+		}
+		if ((control=cmyth_conn_pool_get(pool)) == NULL) {
 			debug("%s(): error at %d\n", __FUNCTION__, __LINE__);
+			ref_release(pool);
 			conn[j].used = 0;
 			return -1;
 		}
-		if ((event=cmyth_conn_connect_event(host, port, 16*1024,
-						    tcp_control)) == NULL) {
+		cmyth_conn_pool_put(pool, control);
+		mask = CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE) |
+			CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_ADD) |
+			CMYTH_EVENT_MASK(CMYTH_EVENT_RECORDING_LIST_CHANGE_DELETE);
+		if ((event=cmyth_event_subscribe(host, port, mask,
+						 event_callback,
+						 (void*)j)) == NULL) {
 			debug("%s(): error at %d\n", __FUNCTION__, __LINE__);
+			ref_release(pool);
 			conn[j].used = 0;
 			return -1;
 		}
 
 		conn[j].host = strdup(host);
-		conn[j].control = control;
+		conn[j].pool = pool;
 		conn[j].event = event;
-		conn[j].list = NULL;
-
-		pthread_create(&conn[j].thread, NULL, event_loop, (void*)j);
+		conn[j].index = NULL;
 
 		i = j;
 	}
@@ -367,11 +782,9 @@ static void myth_destroy(void *arg)
 	int i;
 
 	for (i=0; i<MAX_CONN; i++) {
-		if (conn[i].list) {
-			ref_release(conn[i].list);
-		}
-		if (conn[i].control) {
-			ref_release(conn[i].control);
+		index_destroy(conn[i].index);
+		if (conn[i].pool) {
+			ref_release(conn[i].pool);
 		}
 	}
 #endif
@@ -401,10 +814,15 @@ do_open(cmyth_proginfo_t prog, struct fuse_file_info *fi, int i)
 	ref_release(host);
 	ref_release(c);
 
+	pthread_mutex_lock(&files[i].mutex);
 	files[i].file = f;
 	files[i].buf = malloc(MAX_BSIZE);
+	files[i].offset = 0;
 	files[i].start = 0;
 	files[i].n = 0;
+	files[i].seq = 0;
+	files[i].prefetch = 0;
+	pthread_mutex_unlock(&files[i].mutex);
 
 	fi->fh = i;
 
@@ -414,10 +832,9 @@ do_open(cmyth_proginfo_t prog, struct fuse_file_info *fi, int i)
 static int o_files(int f, struct path_info *info, struct fuse_file_info *fi)
 {
 	int i;
-	cmyth_conn_t control;
-	cmyth_proglist_t list;
-	int count;
-	int ret = -ENOENT;
+	struct prog_index *idx;
+	struct prog_entry *e;
+	cmyth_proginfo_t prog = NULL;
 
 	pthread_mutex_lock(&mutex);
 
@@ -426,50 +843,22 @@ static int o_files(int f, struct path_info *info, struct fuse_file_info *fi)
 		return -ENOENT;
 	}
 
-	control = ref_hold(conn[i].control);
-
-	if (conn[i].list == NULL) {
-		list = cmyth_proglist_get_all_recorded(control);
-		conn[i].list = list;
-		parse_progs(conn+i);
-	} else {
-		list = conn[i].list;
+	if (((idx=get_index(conn+i)) != NULL) &&
+	    ((e=index_file(idx, info->file)) != NULL)) {
+		prog = ref_hold(e->prog);
 	}
 
-	list = ref_hold(list);
-
 	pthread_mutex_unlock(&mutex);
 
-	count = cmyth_proglist_get_count(list);
-
-	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
-		char *pn;
-
-		prog = cmyth_proglist_get_item(list, i);
-		pn = cmyth_proginfo_pathname(prog);
-
-		if (strcmp(pn+1, info->file) == 0) {
-			if (do_open(prog, fi, f) < 0) {
-				ref_release(pn);
-				ref_release(prog);
-				goto out;
-			}
-			ref_release(pn);
-			ref_release(prog);
-			ret = 0;
-			goto out;
-		}
-
-		ref_release(pn);
-		ref_release(prog);
+	if (prog == NULL) {
+		return -ENOENT;
 	}
 
-out:
-	ref_release(control);
-	ref_release(list);
+	i = do_open(prog, fi, f);
 
-	return ret;
+	ref_release(prog);
+
+	return (i < 0) ? -ENOENT : 0;
 }
 
 static int readme_open(const char *path, struct fuse_file_info *fi)
@@ -540,12 +929,19 @@ static int myth_release(const char *path, struct fuse_file_info *fi)
 	debug("%s(): path '%s'\n", __FUNCTION__, path);
 
 	if ((int)fi->fh != -1) {
+		pthread_mutex_lock(&files[i].mutex);
 		f = files[i].file;
+		files[i].file = NULL;
+		free(files[i].buf);
+		files[i].buf = NULL;
+		files[i].n = 0;
+		pthread_mutex_unlock(&files[i].mutex);
+
 		ref_release(f);
-		if (files[i].buf) {
-			free(files[i].buf);
-		}
-		memset(files+i, 0, sizeof(struct file_info));
+
+		pthread_mutex_lock(&mutex);
+		files[i].used = 0;
+		pthread_mutex_unlock(&mutex);
 		fi->fh = -1;
 	}
 
@@ -557,9 +953,7 @@ rd_files(struct path_info *info, void *buf, fuse_fill_dir_t filler,
 	 off_t offset, struct fuse_file_info *fi)
 {
 	int i;
-	cmyth_conn_t control;
-	cmyth_proglist_t list;
-	int count;
+	struct prog_index *idx;
 
 	pthread_mutex_lock(&mutex);
 
@@ -568,43 +962,16 @@ rd_files(struct path_info *info, void *buf, fuse_fill_dir_t filler,
 		return 0;
 	}
 
-	control = ref_hold(conn[i].control);
-
-	if (conn[i].list == NULL) {
-		list = cmyth_proglist_get_all_recorded(control);
-		conn[i].list = list;
-		parse_progs(conn+i);
-	} else {
-		list = conn[i].list;
+	if ((idx=get_index(conn+i)) != NULL) {
+		for (i=0; i<idx->count; i++) {
+			debug("%s(): file '%s'\n", __FUNCTION__,
+			      idx->entries[i]->pathname+1);
+			filler(buf, idx->entries[i]->pathname+1, NULL, 0);
+		}
 	}
 
-	list = ref_hold(list);
-
 	pthread_mutex_unlock(&mutex);
 
-	count = cmyth_proglist_get_count(list);
-
-	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
-		long long len;
-		char *fn, *pn;
-
-		prog = cmyth_proglist_get_item(list, i);
-		pn = cmyth_proginfo_pathname(prog);
-		len = cmyth_proginfo_length(prog);
-
-		fn = pn+1;
-
-		debug("%s(): file '%s' len %lld\n", __FUNCTION__, fn, len);
-		filler(buf, fn, NULL, 0);
-
-		ref_release(prog);
-		ref_release(pn);
-	}
-
-	ref_release(control);
-	ref_release(list);
-
 	return 0;
 }
 
@@ -613,10 +980,7 @@ rd_all(struct path_info *info, void *buf, fuse_fill_dir_t filler,
        off_t offset, struct fuse_file_info *fi)
 {
 	int i;
-	cmyth_conn_t control;
-	cmyth_proglist_t list;
-	int count;
-	struct myth_conn *mc;
+	struct prog_index *idx;
 
 	pthread_mutex_lock(&mutex);
 
@@ -625,61 +989,15 @@ rd_all(struct path_info *info, void *buf, fuse_fill_dir_t filler,
 		return 0;
 	}
 
-	control = ref_hold(conn[i].control);
-
-	if (conn[i].list == NULL) {
-		list = cmyth_proglist_get_all_recorded(control);
-		conn[i].list = list;
-		parse_progs(conn+i);
-	} else {
-		list = conn[i].list;
-	}
-
-	mc = conn+i;
-
-	list = ref_hold(list);
-
-	pthread_mutex_unlock(&mutex);
-
-	count = cmyth_proglist_get_count(list);
-
-	char *name[count];
-
-	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
-		long long len;
-		char *fn, *pn, *t, *s;
-
-		prog = cmyth_proglist_get_item(list, i);
-		pn = cmyth_proginfo_pathname(prog);
-		t = cmyth_proginfo_title(prog);
-		s = cmyth_proginfo_subtitle(prog);
-		len = cmyth_proginfo_length(prog);
-
-		if (mc->progs[i].suffix == 0) {
-			name[i] = ref_sprintf("%s - %s.nuv", t, s);
-		} else {
-			name[i] = ref_sprintf("%s - %s (%d).nuv", t, s,
-					      mc->progs[i].suffix);
+	if ((idx=get_index(conn+i)) != NULL) {
+		for (i=0; i<idx->count; i++) {
+			debug("%s(): file '%s'\n", __FUNCTION__,
+			      idx->entries[i]->link);
+			filler(buf, idx->entries[i]->link, NULL, 0);
 		}
-
-		fn = pn+1;
-
-		debug("%s(): file '%s' len %lld\n", __FUNCTION__, fn, len);
-		filler(buf, name[i], NULL, 0);
-
-		ref_release(prog);
-		ref_release(pn);
-		ref_release(t);
-		ref_release(s);
-	}
-
-	for (i=0; i<count; i++) {
-		ref_release(name[i]);
 	}
 
-	ref_release(control);
-	ref_release(list);
+	pthread_mutex_unlock(&mutex);
 
 	return 0;
 }
@@ -740,9 +1058,8 @@ finish:
 
 static int ga_files(struct path_info *info, struct stat *stbuf)
 {
-	cmyth_conn_t control;
-	cmyth_proglist_t list;
-	int count;
+	struct prog_index *idx;
+	struct prog_entry *e = NULL;
 	int i;
 
 	pthread_mutex_lock(&mutex);
@@ -752,76 +1069,47 @@ static int ga_files(struct path_info *info, struct stat *stbuf)
 		return -ENOENT;
 	}
 
-	control = ref_hold(conn[i].control);
-
-	if (conn[i].list == NULL) {
-		list = cmyth_proglist_get_all_recorded(control);
-		conn[i].list = list;
-		parse_progs(conn+i);
-	} else {
-		list = conn[i].list;
-	}
-
-	list = ref_hold(list);
-
-	pthread_mutex_unlock(&mutex);
-
 	stbuf->st_mode = S_IFREG | 0444;
 	stbuf->st_nlink = 1;
 
-	count = cmyth_proglist_get_count(list);
-
 	debug("%s(): file '%s'\n", __FUNCTION__, info->file);
 
-	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
+	if ((idx=get_index(conn+i)) != NULL) {
+		e = index_file(idx, info->file);
+	}
+
+	if (e) {
+		cmyth_timestamp_t ts;
+		time_t t;
 		long long len;
-		char *pn;
 
-		prog = cmyth_proglist_get_item(list, i);
-		pn = cmyth_proginfo_pathname(prog);
-
-		if (strcmp(pn+1, info->file) == 0) {
-			cmyth_timestamp_t ts;
-			time_t t;
-			len = cmyth_proginfo_length(prog);
-			debug("%s(): file '%s' len %lld\n",
-			      __FUNCTION__, pn+1, len);
-			stbuf->st_size = len;
-			stbuf->st_blksize = MAX_BSIZE;
-			stbuf->st_blocks = len / MAX_BSIZE;
-			if ((len * MAX_BSIZE) != stbuf->st_blocks) {
-				stbuf->st_blocks++;
-			}
-			ts = cmyth_proginfo_rec_end(prog);
-			t = cmyth_timestamp_to_unixtime(ts);
-			stbuf->st_atime = t;
-			stbuf->st_mtime = t;
-			stbuf->st_ctime = t;
-			ref_release(prog);
-			ref_release(pn);
-			ref_release(ts);
-			ref_release(control);
-			ref_release(list);
-			return 0;
+		len = cmyth_proginfo_length(e->prog);
+		debug("%s(): file '%s' len %lld\n",
+		      __FUNCTION__, info->file, len);
+		stbuf->st_size = len;
+		stbuf->st_blksize = MAX_BSIZE;
+		stbuf->st_blocks = len / MAX_BSIZE;
+		if ((len * MAX_BSIZE) != stbuf->st_blocks) {
+			stbuf->st_blocks++;
 		}
-		ref_release(prog);
-		ref_release(pn);
+		ts = cmyth_proginfo_rec_end(e->prog);
+		t = cmyth_timestamp_to_unixtime(ts);
+		stbuf->st_atime = t;
+		stbuf->st_mtime = t;
+		stbuf->st_ctime = t;
+		ref_release(ts);
 	}
 
-	ref_release(control);
-	ref_release(list);
+	pthread_mutex_unlock(&mutex);
 
-	return -ENOENT;
+	return e ? 0 : -ENOENT;
 }
 
 static int ga_all(struct path_info *info, struct stat *stbuf)
 {
-	cmyth_conn_t control;
-	cmyth_proglist_t list;
-	int count;
+	struct prog_index *idx;
+	struct prog_entry *e = NULL;
 	int i;
-	struct myth_conn *mc;
 
 	pthread_mutex_lock(&mutex);
 
@@ -830,79 +1118,33 @@ static int ga_all(struct path_info *info, struct stat *stbuf)
 		return -ENOENT;
 	}
 
-	control = ref_hold(conn[i].control);
-
-	if (conn[i].list == NULL) {
-		list = cmyth_proglist_get_all_recorded(control);
-		conn[i].list = list;
-		parse_progs(conn+i);
-	} else {
-		list = conn[i].list;
-	}
-
-	mc = conn+i;
-
-	list = ref_hold(list);
-
-	pthread_mutex_unlock(&mutex);
-
 	stbuf->st_mode = S_IFLNK | 0444;
 	stbuf->st_nlink = 1;
 
-	count = cmyth_proglist_get_count(list);
-
 	debug("%s(): file '%s'\n", __FUNCTION__, info->file);
 
-	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
-		long long len;
-		char *title, *s;
-		char tmp[512];
-
-		prog = cmyth_proglist_get_item(list, i);
-		title = cmyth_proginfo_title(prog);
-		s = cmyth_proginfo_subtitle(prog);
+	if ((idx=get_index(conn+i)) != NULL) {
+		e = index_link(idx, info->file);
+	}
 
-		if (mc->progs[i].suffix > 0) {
-			snprintf(tmp, sizeof(tmp), "%s - %s (%d).nuv",
-				 title, s, mc->progs[i].suffix);
-		} else {
-			snprintf(tmp, sizeof(tmp), "%s - %s.nuv", title, s);
-		}
+	if (e) {
+		cmyth_timestamp_t ts;
+		time_t t;
 
-		if (strcmp(tmp, info->file) == 0) {
-			cmyth_timestamp_t ts;
-			time_t t;
-			char *pn;
-
-			len = cmyth_proginfo_length(prog);
-			pn = cmyth_proginfo_pathname(prog);
-			debug("%s(): file '%s' len %lld\n",
-			      __FUNCTION__, tmp, len);
-			stbuf->st_size = strlen(pn);
-			ts = cmyth_proginfo_rec_end(prog);
-			t = cmyth_timestamp_to_unixtime(ts);
-			stbuf->st_atime = t;
-			stbuf->st_mtime = t;
-			stbuf->st_ctime = t;
-			ref_release(pn);
-			ref_release(prog);
-			ref_release(ts);
-			ref_release(title);
-			ref_release(s);
-			ref_release(control);
-			ref_release(list);
-			return 0;
-		}
-		ref_release(prog);
-		ref_release(title);
-		ref_release(s);
+		debug("%s(): file '%s' len %lld\n", __FUNCTION__,
+		      info->file, cmyth_proginfo_length(e->prog));
+		stbuf->st_size = strlen(e->pathname);
+		ts = cmyth_proginfo_rec_end(e->prog);
+		t = cmyth_timestamp_to_unixtime(ts);
+		stbuf->st_atime = t;
+		stbuf->st_mtime = t;
+		stbuf->st_ctime = t;
+		ref_release(ts);
 	}
 
-	ref_release(control);
-	ref_release(list);
+	pthread_mutex_unlock(&mutex);
 
-	return -ENOENT;
+	return e ? 0 : -ENOENT;
 }
 
 static int readme_getattr(const char *path, struct stat *stbuf)
@@ -990,31 +1232,71 @@ do_seek(int i, off_t offset, int whence)
 	return pos;
 }
 
+/*
+ * Get the backend to 'offset', and decide whether the file is being
+ * streamed.  Called with the file mutex held.
+ */
 static int
-fill_buffer(int i, char *buf, size_t size)
+prepare_read(int i, off_t offset)
 {
-	int tot, len, n = 0;
+	struct file_info *f = files+i;
 
-	tot = 0;
-	len = cmyth_file_request_block(files[i].file, size);
-	while (tot < len) {
-		n = cmyth_file_get_block(files[i].file, buf+tot, len-tot);
-		if (n > 0) {
-			tot += n;
+	if (offset == f->offset) {
+		f->seq++;
+	} else {
+		f->seq = 0;
+	}
+
+	if ((f->seq >= SEQ_READS) && !f->prefetch) {
+		debug("%s(): file %d is sequential, prefetching\n",
+		      __FUNCTION__, i);
+		if (cmyth_file_set_readahead(f->file, PREFETCH_DEPTH,
+					     MAX_BSIZE) == 0) {
+			f->prefetch = 1;
 		}
-		if (n <= 0) {
+	} else if ((f->seq == 0) && f->prefetch) {
+		debug("%s(): file %d is random, not prefetching\n",
+		      __FUNCTION__, i);
+		cmyth_file_set_readahead(f->file, 0, 0);
+		f->prefetch = 0;
+	}
+
+	if (offset != f->offset) {
+		if (do_seek(i, offset, SEEK_SET) < 0) {
 			return -1;
 		}
+		f->offset = offset;
 	}
 
-	debug("%s(): tot %d len %d n %d size %lld\n", __FUNCTION__,
-	      tot, len, n, (long long)size);
+	return 0;
+}
+
+/*
+ * Read the next block of the file into the file buffer.  With read-ahead
+ * on this comes out of the data already prefetched.  Called with the file
+ * mutex held.
+ */
+static int
+fill_buffer(int i)
+{
+	struct file_info *f = files+i;
+	int len;
+
+	len = cmyth_file_read(f->file, f->buf, MAX_BSIZE);
+
+	debug("%s(): len %d at %lld\n", __FUNCTION__, len,
+	      (long long)f->offset);
 
 	if (len < 0) {
+		f->n = 0;
 		return -1;
 	}
 
-	return tot;
+	f->start = f->offset;
+	f->n = len;
+	f->offset += len;
+
+	return len;
 }
 
 static int readme_read(const char *path, char *buf, size_t size, off_t offset,
@@ -1043,57 +1325,68 @@ static int readme_read(const char *path, char *buf, size_t size, off_t offset,
 static int myth_read(const char *path, char *buf, size_t size, off_t offset,
 		     struct fuse_file_info *fi)
 {
+	struct file_info *f;
 	int tot, len = 0;
-
-	pthread_mutex_lock(&mutex);
+	off_t skip;
 
 	debug("%s(): path '%s' size %lld\n", __FUNCTION__, path,
 	      (long long)size);
 
 	if (strcmp(path, README_PATH) == 0) {
-		pthread_mutex_unlock(&mutex);
 		return readme_read(path, buf, size, offset, fi);
 	}
 
 	if ((int)fi->fh == -1) {
-		pthread_mutex_unlock(&mutex);
 		return -ENOENT;
 	}
 
-	if (files[fi->fh].offset != offset) {
-		if (do_seek(fi->fh, offset, SEEK_SET) < 0) {
-			goto fail;
-		}
+	f = files+fi->fh;
+
+	pthread_mutex_lock(&f->mutex);
+
+	if (f->file == NULL) {
+		pthread_mutex_unlock(&f->mutex);
+		return -ENOENT;
 	}
 
 	tot = 0;
 	while (size > 0) {
-		len = (size > MAX_BSIZE) ? MAX_BSIZE : size;
-		if ((len=fill_buffer(fi->fh, buf+tot, len)) <= 0)
-			break;
+		if ((offset < f->start) || (offset >= f->start + (off_t)f->n)) {
+			if (prepare_read(fi->fh, offset) < 0) {
+				len = -1;
+				break;
+			}
+			if ((len=fill_buffer(fi->fh)) <= 0)
+				break;
+		}
+		skip = offset - f->start;
+		len = f->n - skip;
+		if ((size_t)len > size)
+			len = size;
+		memcpy(buf+tot, f->buf+skip, len);
 		size -= len;
 		tot += len;
+		offset += len;
 	}
 
-	files[fi->fh].offset = offset + tot;
-
 	debug("%s(): read %d bytes at %lld (len %d)\n", __FUNCTION__,
-	      tot, (long long)offset, len);
+	      tot, (long long)offset - tot, len);
 
 	if (len < 0) {
 		goto fail;
 	}
 
-	pthread_mutex_unlock(&mutex);
+	pthread_mutex_unlock(&f->mutex);
 
 	return tot;
 
 fail:
 	debug("%s(): shutting down file connection!\n", __FUNCTION__);
 
-	ref_release(files[fi->fh].file);
-	memset(files+fi->fh, 0, sizeof(files[0]));
-	pthread_mutex_unlock(&mutex);
+	ref_release(f->file);
+	f->file = NULL;
+	f->n = 0;
+	pthread_mutex_unlock(&f->mutex);
 
 	return -ENOENT;
 }
@@ -1101,12 +1394,11 @@ fail:
 static int myth_readlink(const char *path, char *buf, size_t size)
 {
 	struct path_info info;
+	struct prog_index *idx;
+	struct prog_entry *e = NULL;
+	char tmp[512];
 	int n;
 	int i;
-	cmyth_conn_t control;
-	cmyth_proglist_t list;
-	int count;
-	struct myth_conn *mc;
 
 	debug("%s(): path '%s' size %lld\n", __FUNCTION__, path,
 	      (long long)size);
@@ -1129,76 +1421,30 @@ static int myth_readlink(const char *path, char *buf, size_t size)
 		return -ENOENT;
 	}
 
-	control = ref_hold(conn[i].control);
-
-	if (conn[i].list == NULL) {
-		list = cmyth_proglist_get_all_recorded(control);
-		conn[i].list = list;
-		parse_progs(conn+i);
-	} else {
-		list = conn[i].list;
+	if ((idx=get_index(conn+i)) != NULL) {
+		e = index_link(idx, info.file);
 	}
 
-	mc = conn+i;
-
-	list = ref_hold(list);
+	if (e) {
+		snprintf(tmp, sizeof(tmp), "../files%s", e->pathname);
+	}
 
 	pthread_mutex_unlock(&mutex);
 
-	count = cmyth_proglist_get_count(list);
-
-	for (i=0; i<count; i++) {
-		cmyth_proginfo_t prog;
-		char tmp[512];
-		char *t, *s, *pn;
-
-		prog = cmyth_proglist_get_item(list, i);
-		t = cmyth_proginfo_title(prog);
-		s = cmyth_proginfo_subtitle(prog);
-		pn = cmyth_proginfo_pathname(prog);
-
-		if (mc->progs[i].suffix == 0) {
-			snprintf(tmp, sizeof(tmp), "%s - %s.nuv", t, s);
-		} else {
-			snprintf(tmp, sizeof(tmp), "%s - %s (%d).nuv", t, s,
-				 mc->progs[i].suffix);
-		}
-
-		if (strcmp(tmp, info.file) == 0) {
-			snprintf(tmp, sizeof(tmp), "../files%s", pn);
-
-			memset(buf, 0, size);
-
-			n = (strlen(tmp) > size) ? size : strlen(tmp);
-			strncpy(buf, tmp, n);
-
-			debug("%s(): link '%s' %d bytes\n", __FUNCTION__,
-			      tmp, n);
-
-			ref_release(t);
-			ref_release(s);
-			ref_release(pn);
-			ref_release(prog);
-			ref_release(control);
-			ref_release(list);
-
-			free_info(&info);
-
-			return 0;
-		}
+	free_info(&info);
 
-		ref_release(t);
-		ref_release(s);
-		ref_release(pn);
-		ref_release(prog);
+	if (e == NULL) {
+		return -ENOENT;
 	}
 
-	ref_release(control);
-	ref_release(list);
+	memset(buf, 0, size);
 
-	free_info(&info);
+	n = (strlen(tmp) > size) ? size : strlen(tmp);
+	strncpy(buf, tmp, n);
 
-	return -ENOENT;
+	debug("%s(): link '%s' %d bytes\n", __FUNCTION__, tmp, n);
+
+	return 0;
 }
  
 static struct fuse_operations myth_oper = {
@@ -1245,6 +1491,10 @@ main(int argc, char **argv)
 	fuse[0] = argv[0];
 	fuse[1] = argv[optind];
 
+	for (c=0; c<MAX_FILES; c++) {
+		pthread_mutex_init(&files[c].mutex, NULL);
+	}
+
 	fuse_main(2, fuse, &myth_oper, NULL);
 
 	return 0;
@@ -36,6 +36,7 @@ static struct option opts[] = {
 	{ "scheduled", no_argument, 0, 's' },
 	{ "upcoming", no_argument, 0, 'u' },
 	{ "verbose", no_argument, 0, 'v' },
+	{ "version-cache", required_argument, 0, 'c' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -49,6 +50,8 @@ print_help(char *prog)
 	printf("       --scheduled  -s    list scheduled recordings\n");
 	printf("       --upcoming   -u    list upcoming recordings\n");
 	printf("       --verbose    -v    verbose output\n");
+	printf("       --version-cache -c <file>\n");
+	printf("                          remember protocol versions in file\n");
 }
 
 static int
@@ -315,7 +318,7 @@ main(int argc, char **argv)
 	int opt_e = 0, opt_r = 0, opt_s = 0, opt_u = 0;
 	char *server;
 
-	while ((c=getopt_long(argc, argv, "hersuv", opts, &opt_index)) != -1) {
+	while ((c=getopt_long(argc, argv, "c:hersuv", opts, &opt_index)) != -1) {
 		switch (c) {
 		case 'h':
 			print_help(argv[0]);
@@ -336,6 +339,12 @@ main(int argc, char **argv)
 		case 'v':
 			verbose++;
 			break;
+		case 'c':
+			if (cmyth_version_cache_open(optarg) < 0) {
+				fprintf(stderr, "cannot open version cache %s\n",
+					optarg);
+			}
+			break;
 		default:
 			print_help(argv[0]);
 			exit(1);
@@ -365,6 +374,8 @@ main(int argc, char **argv)
 		int version, count;
 		cmyth_proglist_t list;
 		long long total, used;
+		unsigned long hits;
+		unsigned long long msecs;
 
 		printf("libcmyth version %s\n", cmyth_version());
 		printf("librefmem version %s\n", ref_version());
@@ -373,6 +384,11 @@ main(int argc, char **argv)
 
 		printf("\tprotocol version: %d\n", version);
 
+		cmyth_conn_get_connect_stats(NULL, &hits, NULL, &msecs);
+
+		printf("\tconnect time: %llu ms%s\n", msecs,
+		       hits ? " (cached version)" : "");
+
 		list = cmyth_proglist_get_all_recorded(control);
 		count = cmyth_proglist_get_count(list);
 